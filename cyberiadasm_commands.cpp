@@ -0,0 +1,372 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ * 
+ * The State Machine Model Undo Commands implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+#include <QCoreApplication>
+#include <QAtomicInt>
+#include <algorithm>
+
+#include "cyberiadasm_commands.h"
+#include "myassert.h"
+
+static bool samePoint(const Cyberiada::Point& a, const Cyberiada::Point& b)
+{
+	return a.valid == b.valid && (!a.valid || (a.x == b.x && a.y == b.y));
+}
+
+static bool sameRect(const Cyberiada::Rect& a, const Cyberiada::Rect& b)
+{
+	return a.valid == b.valid && (!a.valid || (a.x == b.x && a.y == b.y &&
+											   a.width == b.width && a.height == b.height));
+}
+
+static bool sameGeometry(const CyberiadaSMModel::TransitionGeometry& a,
+						 const CyberiadaSMModel::TransitionGeometry& b)
+{
+	if (!samePoint(a.sourcePoint, b.sourcePoint) ||
+		!samePoint(a.targetPoint, b.targetPoint) ||
+		a.polyline.size() != b.polyline.size()) {
+		return false;
+	}
+	for (Cyberiada::Polyline::const_iterator i = a.polyline.begin(), j = b.polyline.begin(); i != a.polyline.end(); i++, j++) {
+		if (!samePoint(*i, *j)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* -----------------------------------------------------------------------------
+ * Text Command
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMTextCommand::CyberiadaSMTextCommand(CyberiadaSMModel* _model,
+											   const QList<Cyberiada::Element*>& elements,
+											   CyberiadaSMModel::TextField _field,
+											   const QString& text,
+											   int _session,
+											   QUndoCommand* parent):
+	QUndoCommand(parent), model(_model), field(_field), session(_session)
+{
+	MY_ASSERT(model);
+	foreach(Cyberiada::Element* element, elements) {
+		MY_ASSERT(element);
+		QString old_text = model->elementText(element, field);
+		if (old_text != text) {
+			TextChange change;
+			change.id = element->get_id();
+			change.oldText = old_text;
+			change.newText = text;
+			changes.append(change);
+		}
+	}
+	setText(QCoreApplication::translate("CyberiadaSMTextCommand", "Edit text"));
+}
+
+int CyberiadaSMTextCommand::newSession()
+{
+	static QAtomicInt lastSession;
+	return lastSession.fetchAndAddRelaxed(1) + 1;
+}
+
+bool CyberiadaSMTextCommand::mergeWith(const QUndoCommand* other)
+{
+	if (other->id() != id()) {
+		return false;
+	}
+	const CyberiadaSMTextCommand* command = static_cast<const CyberiadaSMTextCommand*>(other);
+	// two renames of the same element stay two undo steps
+	if (session == 0 || command->session != session) {
+		return false;
+	}
+	if (command->field != field || command->changes.size() != changes.size()) {
+		return false;
+	}
+	for (int i = 0; i < changes.size(); i++) {
+		if (changes[i].id != command->changes[i].id) {
+			return false;
+		}
+	}
+	// the edits of one session of the same field of the same elements collapse into a single step
+	for (int i = 0; i < changes.size(); i++) {
+		changes[i].newText = command->changes[i].newText;
+	}
+	return true;
+}
+
+void CyberiadaSMTextCommand::undo()
+{
+	apply(false);
+}
+
+void CyberiadaSMTextCommand::redo()
+{
+	apply(true);
+}
+
+void CyberiadaSMTextCommand::apply(bool forward)
+{
+	model->beginUpdate();
+	for (QVector<TextChange>::const_iterator i = changes.begin(); i != changes.end(); i++) {
+		Cyberiada::Element* element = model->idToElement(QString(i->id.c_str()));
+		MY_ASSERT(element);
+		model->updateElementText(element, field, forward ? i->newText : i->oldText);
+	}
+	model->endUpdate();
+}
+
+/* -----------------------------------------------------------------------------
+ * Move Command
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMMoveCommand::CyberiadaSMMoveCommand(CyberiadaSMModel* _model,
+											   const QList<Cyberiada::Element*>& elements,
+											   const QPointF& _delta,
+											   int _gesture,
+											   QUndoCommand* parent):
+	QUndoCommand(parent), model(_model), delta(_delta), gesture(_gesture)
+{
+	MY_ASSERT(model);
+	foreach(Cyberiada::Element* element, elements) {
+		MY_ASSERT(element);
+		ids.append(element->get_id());
+	}
+	std::sort(ids.begin(), ids.end());
+	QList<Cyberiada::Element*> anchored = model->anchoredTransitions(elements);
+	foreach(Cyberiada::Element* element, anchored) {
+		anchoredIds.append(element->get_id());
+	}
+	setText(QCoreApplication::translate("CyberiadaSMMoveCommand", "Move"));
+}
+
+int CyberiadaSMMoveCommand::newGesture()
+{
+	static QAtomicInt lastGesture;
+	return lastGesture.fetchAndAddRelaxed(1) + 1;
+}
+
+bool CyberiadaSMMoveCommand::mergeWith(const QUndoCommand* other)
+{
+	if (other->id() != id()) {
+		return false;
+	}
+	const CyberiadaSMMoveCommand* command = static_cast<const CyberiadaSMMoveCommand*>(other);
+	// two drags of the same selection stay two undo steps
+	if (gesture == 0 || command->gesture != gesture) {
+		return false;
+	}
+	if (command->ids != ids || command->anchoredIds != anchoredIds) {
+		return false;
+	}
+	delta += command->delta;
+	return true;
+}
+
+void CyberiadaSMMoveCommand::undo()
+{
+	apply(-delta);
+}
+
+void CyberiadaSMMoveCommand::redo()
+{
+	apply(delta);
+}
+
+void CyberiadaSMMoveCommand::apply(const QPointF& d)
+{
+	model->beginUpdate();
+	for (QVector<Cyberiada::ID>::const_iterator i = ids.begin(); i != ids.end(); i++) {
+		Cyberiada::Element* element = model->idToElement(QString(i->c_str()));
+		MY_ASSERT(element);
+		model->translateElement(element, d);
+	}
+	for (QVector<Cyberiada::ID>::const_iterator i = anchoredIds.begin(); i != anchoredIds.end(); i++) {
+		Cyberiada::Element* element = model->idToElement(QString(i->c_str()));
+		MY_ASSERT(element);
+		model->translateElement(element, -d);
+	}
+	model->endUpdate();
+}
+
+/* -----------------------------------------------------------------------------
+ * Insert Command
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMInsertCommand::CyberiadaSMInsertCommand(CyberiadaSMModel* _model,
+												   Cyberiada::ElementType _type,
+												   Cyberiada::ElementCollection* parent,
+												   const QString& _text,
+												   const Cyberiada::Rect& _rect,
+												   QUndoCommand* parent_command):
+	QUndoCommand(parent_command), model(_model), type(_type), text(_text), rect(_rect)
+{
+	MY_ASSERT(model);
+	MY_ASSERT(parent);
+	MY_ASSERT(type == Cyberiada::elementSimpleState || type == Cyberiada::elementComment);
+	parentId = parent->get_id();
+	if (type == Cyberiada::elementComment) {
+		setText(QCoreApplication::translate("CyberiadaSMInsertCommand", "Add comment"));
+	} else {
+		setText(QCoreApplication::translate("CyberiadaSMInsertCommand", "Add state"));
+	}
+}
+
+CyberiadaSMInsertCommand::CyberiadaSMInsertCommand(CyberiadaSMModel* _model,
+												   Cyberiada::Element* source,
+												   Cyberiada::Element* target,
+												   QUndoCommand* parent_command):
+	QUndoCommand(parent_command), model(_model), type(Cyberiada::elementTransition)
+{
+	MY_ASSERT(model);
+	MY_ASSERT(source);
+	MY_ASSERT(target);
+	MY_ASSERT(model->rootDocument());
+	Cyberiada::StateMachine* sm = model->rootDocument()->get_parent_sm(source);
+	MY_ASSERT(sm);
+	parentId = sm->get_id();
+	sourceId = source->get_id();
+	targetId = target->get_id();
+	setText(QCoreApplication::translate("CyberiadaSMInsertCommand", "Add transition"));
+}
+
+void CyberiadaSMInsertCommand::undo()
+{
+	Cyberiada::Element* element = model->idToElement(QString(elementID.c_str()));
+	MY_ASSERT(element);
+	model->removeElement(element);
+}
+
+void CyberiadaSMInsertCommand::redo()
+{
+	Cyberiada::Element* parent = model->idToElement(QString(parentId.c_str()));
+	MY_ASSERT(parent);
+	Cyberiada::Element* element = NULL;
+	switch (type) {
+	case Cyberiada::elementSimpleState:
+		element = model->insertState(static_cast<Cyberiada::ElementCollection*>(parent), elementID, text, rect);
+		break;
+	case Cyberiada::elementComment:
+		element = model->insertComment(static_cast<Cyberiada::ElementCollection*>(parent), elementID, text, rect);
+		break;
+	case Cyberiada::elementTransition: {
+		Cyberiada::Element* source = model->idToElement(QString(sourceId.c_str()));
+		Cyberiada::Element* target = model->idToElement(QString(targetId.c_str()));
+		element = model->insertTransition(static_cast<Cyberiada::StateMachine*>(parent), elementID, source, target);
+		break;
+	}
+	default:
+		MY_ASSERT(false);
+	}
+	MY_ASSERT(element);
+	elementID = element->get_id();
+}
+
+/* -----------------------------------------------------------------------------
+ * Geometry Command
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMGeometryCommand::CyberiadaSMGeometryCommand(CyberiadaSMModel* _model,
+													   const QMap<Cyberiada::ID, Cyberiada::Rect>& geometry,
+													   QUndoCommand* parent):
+	QUndoCommand(parent), model(_model)
+{
+	MY_ASSERT(model);
+	for (QMap<Cyberiada::ID, Cyberiada::Rect>::const_iterator i = geometry.begin(); i != geometry.end(); i++) {
+		Cyberiada::Element* element = model->idToElement(QString(i.key().c_str()));
+		if (!element) continue;
+		GeometryChange change;
+		change.id = i.key();
+		change.oldRect = model->elementGeometry(element);
+		change.newRect = i.value();
+		if (!sameRect(change.oldRect, change.newRect)) {
+			changes.append(change);
+		}
+	}
+	setText(QCoreApplication::translate("CyberiadaSMGeometryCommand", "Place elements"));
+}
+
+void CyberiadaSMGeometryCommand::undo()
+{
+	apply(false);
+}
+
+void CyberiadaSMGeometryCommand::redo()
+{
+	apply(true);
+}
+
+void CyberiadaSMGeometryCommand::apply(bool forward)
+{
+	model->beginUpdate();
+	for (QVector<GeometryChange>::const_iterator i = changes.begin(); i != changes.end(); i++) {
+		Cyberiada::Element* element = model->idToElement(QString(i->id.c_str()));
+		MY_ASSERT(element);
+		model->updateElementGeometry(element, forward ? i->newRect : i->oldRect);
+	}
+	model->endUpdate();
+}
+
+/* -----------------------------------------------------------------------------
+ * Route Command
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMRouteCommand::CyberiadaSMRouteCommand(CyberiadaSMModel* _model,
+												 const QMap<Cyberiada::ID, CyberiadaSMModel::TransitionGeometry>& geometry,
+												 QUndoCommand* parent):
+	QUndoCommand(parent), model(_model)
+{
+	MY_ASSERT(model);
+	for (QMap<Cyberiada::ID, CyberiadaSMModel::TransitionGeometry>::const_iterator i = geometry.begin();
+		 i != geometry.end(); i++) {
+		Cyberiada::Element* element = model->idToElement(QString(i.key().c_str()));
+		if (!element) continue;
+		RouteChange change;
+		change.id = i.key();
+		change.oldGeometry = model->transitionGeometry(element);
+		change.newGeometry = i.value();
+		if (!sameGeometry(change.oldGeometry, change.newGeometry)) {
+			changes.append(change);
+		}
+	}
+	setText(QCoreApplication::translate("CyberiadaSMRouteCommand", "Route transitions"));
+}
+
+void CyberiadaSMRouteCommand::undo()
+{
+	apply(false);
+}
+
+void CyberiadaSMRouteCommand::redo()
+{
+	apply(true);
+}
+
+void CyberiadaSMRouteCommand::apply(bool forward)
+{
+	model->beginUpdate();
+	for (QVector<RouteChange>::const_iterator i = changes.begin(); i != changes.end(); i++) {
+		Cyberiada::Element* element = model->idToElement(QString(i->id.c_str()));
+		MY_ASSERT(element);
+		model->updateTransitionGeometry(element, forward ? i->newGeometry : i->oldGeometry);
+	}
+	model->endUpdate();
+}
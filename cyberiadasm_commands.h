@@ -0,0 +1,203 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ * 
+ * The State Machine Model Undo Commands
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+#ifndef CYBERIADA_SM_COMMANDS_HEADER
+#define CYBERIADA_SM_COMMANDS_HEADER
+
+#include <QUndoCommand>
+#include <QPointF>
+#include <QVector>
+
+#include "cyberiadasm_model.h"
+
+/* -----------------------------------------------------------------------------
+ * The commands refer to the elements by their IDs and keep only the changed
+ * values, never copies of the document, so the memory used by the undo stack
+ * depends on the size of the edits, not on the size of the document.
+ * ----------------------------------------------------------------------------- */
+
+enum CyberiadaSMCommandID {
+	commandText = 1,
+	commandMove
+};
+
+/* -----------------------------------------------------------------------------
+ * Text Command
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMTextCommand: public QUndoCommand {
+public:
+	// the edits of the same session are merged, the session 0 is never merged
+	CyberiadaSMTextCommand(CyberiadaSMModel* model,
+						   const QList<Cyberiada::Element*>& elements,
+						   CyberiadaSMModel::TextField field,
+						   const QString& text,
+						   int session = 0,
+						   QUndoCommand* parent = NULL);
+
+	static int                  newSession();
+
+	bool                        isEmpty() const { return changes.isEmpty(); }
+
+	virtual int                 id() const { return commandText; }
+	virtual bool                mergeWith(const QUndoCommand* other);
+	virtual void                undo();
+	virtual void                redo();
+
+private:
+	struct TextChange {
+		Cyberiada::ID           id;
+		QString                 oldText;
+		QString                 newText;
+	};
+
+	void                        apply(bool forward);
+
+	CyberiadaSMModel*           model;
+	CyberiadaSMModel::TextField field;
+	QVector<TextChange>         changes;
+	int                         session;
+};
+
+/* -----------------------------------------------------------------------------
+ * Move Command
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMMoveCommand: public QUndoCommand {
+public:
+	// the moves of the same gesture are merged, the gesture 0 is never merged
+	CyberiadaSMMoveCommand(CyberiadaSMModel* model,
+						   const QList<Cyberiada::Element*>& elements,
+						   const QPointF& delta,
+						   int gesture = 0,
+						   QUndoCommand* parent = NULL);
+
+	static int                  newGesture();
+
+	virtual int                 id() const { return commandMove; }
+	virtual bool                mergeWith(const QUndoCommand* other);
+	virtual void                undo();
+	virtual void                redo();
+
+private:
+	void                        apply(const QPointF& d);
+
+	CyberiadaSMModel*           model;
+	QVector<Cyberiada::ID>      ids;
+	QVector<Cyberiada::ID>      anchoredIds;
+	QPointF                     delta;
+	int                         gesture;
+};
+
+/* -----------------------------------------------------------------------------
+ * Insert Command
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMInsertCommand: public QUndoCommand {
+public:
+	// state or comment
+	CyberiadaSMInsertCommand(CyberiadaSMModel* model,
+							 Cyberiada::ElementType type,
+							 Cyberiada::ElementCollection* parent,
+							 const QString& text,
+							 const Cyberiada::Rect& rect,
+							 QUndoCommand* parent_command = NULL);
+	// transition
+	CyberiadaSMInsertCommand(CyberiadaSMModel* model,
+							 Cyberiada::Element* source,
+							 Cyberiada::Element* target,
+							 QUndoCommand* parent_command = NULL);
+
+	const Cyberiada::ID&        elementId() const { return elementID; }
+
+	virtual void                undo();
+	virtual void                redo();
+
+private:
+	CyberiadaSMModel*           model;
+	Cyberiada::ElementType      type;
+	Cyberiada::ID               parentId;
+	Cyberiada::ID               sourceId;
+	Cyberiada::ID               targetId;
+	QString                     text;
+	Cyberiada::Rect             rect;
+	Cyberiada::ID               elementID;
+};
+
+/* -----------------------------------------------------------------------------
+ * Geometry Command
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMGeometryCommand: public QUndoCommand {
+public:
+	CyberiadaSMGeometryCommand(CyberiadaSMModel* model,
+							   const QMap<Cyberiada::ID, Cyberiada::Rect>& geometry,
+							   QUndoCommand* parent = NULL);
+
+	bool                        isEmpty() const { return changes.isEmpty(); }
+
+	virtual void                undo();
+	virtual void                redo();
+
+private:
+	struct GeometryChange {
+		Cyberiada::ID           id;
+		Cyberiada::Rect         oldRect;
+		Cyberiada::Rect         newRect;
+	};
+
+	void                        apply(bool forward);
+
+	CyberiadaSMModel*           model;
+	QVector<GeometryChange>     changes;
+};
+
+/* -----------------------------------------------------------------------------
+ * Route Command
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMRouteCommand: public QUndoCommand {
+public:
+	CyberiadaSMRouteCommand(CyberiadaSMModel* model,
+							const QMap<Cyberiada::ID, CyberiadaSMModel::TransitionGeometry>& geometry,
+							QUndoCommand* parent = NULL);
+
+	bool                        isEmpty() const { return changes.isEmpty(); }
+
+	virtual void                undo();
+	virtual void                redo();
+
+private:
+	struct RouteChange {
+		Cyberiada::ID                        id;
+		CyberiadaSMModel::TransitionGeometry oldGeometry;
+		CyberiadaSMModel::TransitionGeometry newGeometry;
+	};
+
+	void                        apply(bool forward);
+
+	CyberiadaSMModel*           model;
+	QVector<RouteChange>        changes;
+};
+
+#endif
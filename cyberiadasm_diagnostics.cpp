@@ -0,0 +1,247 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Diagram Diagnostics implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <QElapsedTimer>
+
+#include "cyberiadasm_diagnostics.h"
+#include "cyberiadasm_spatial_index.h"
+#include "cyberiadasm_geometry.h"
+#include "cyberiadasm_model.h"
+#include "myassert.h"
+
+// the states touching each other along the border are not reported
+static const qreal OVERLAP_TOLERANCE = 1;
+// the shapes of the height in [2^(k-1), 2^k) share the active group k
+static const int   HEIGHT_GROUPS = 64;
+
+static int heightGroup(qreal height)
+{
+	if (height <= 1) {
+		return 0;
+	}
+	int exponent = 0;
+	std::frexp(height, &exponent);
+	return qMin(exponent, HEIGHT_GROUPS - 1);
+}
+
+CyberiadaSMDiagnostics::CyberiadaSMDiagnostics(CyberiadaSMModel* _model, const Cyberiada::StateMachine* _sm):
+	model(_model), sm(_sm), elapsedTime(0)
+{
+	MY_ASSERT(model);
+	MY_ASSERT(sm);
+}
+
+void CyberiadaSMDiagnostics::addShapes(const Cyberiada::ElementCollection* collection)
+{
+	if (!collection->has_children()) {
+		return;
+	}
+	const CyberiadaSMSpatialIndex* index = model->spatialIndex(sm);
+	const Cyberiada::ElementList& children = collection->get_children();
+	for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+		const Cyberiada::Element* e = *i;
+		Shape shape;
+		shape.element = e;
+		shape.source = shape.target = NULL;
+		shape.segment = false;
+		switch (e->get_type()) {
+		case Cyberiada::elementSimpleState:
+		case Cyberiada::elementCompositeState:
+		case Cyberiada::elementInitial:
+		case Cyberiada::elementFinal:
+		case Cyberiada::elementTerminate:
+		case Cyberiada::elementChoice:
+			shape.box = CyberiadaSMGeometry::sceneRect(e);
+			if (!shape.box.isNull()) {
+				shapes.append(shape);
+			}
+			break;
+		case Cyberiada::elementTransition: {
+			const Cyberiada::Transition* t = static_cast<const Cyberiada::Transition*>(e);
+			shape.segment = true;
+			shape.source = index->findElement(t->source_element_id());
+			shape.target = index->findElement(t->target_element_id());
+			QVector<QPointF> path = index->transitionPath(t);
+			for (int k = 1; k < path.size(); k++) {
+				shape.line = QLineF(path[k - 1], path[k]);
+				shape.box = QRectF(QPointF(qMin(path[k - 1].x(), path[k].x()), qMin(path[k - 1].y(), path[k].y())),
+								   QPointF(qMax(path[k - 1].x(), path[k].x()), qMax(path[k - 1].y(), path[k].y())));
+				shapes.append(shape);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		if (e->get_type() == Cyberiada::elementCompositeState) {
+			addShapes(static_cast<const Cyberiada::ElementCollection*>(e));
+		}
+	}
+}
+
+QList<CyberiadaSMDiagnostic> CyberiadaSMDiagnostics::run()
+{
+	QElapsedTimer timer;
+	timer.start();
+	QList<CyberiadaSMDiagnostic> result;
+	shapes.clear();
+	reported.clear();
+	addShapes(sm);
+
+	const int n = shapes.size();
+	QVector<int> order(n);
+	QVector<int> group(n);
+	QVector<qreal> group_height(HEIGHT_GROUPS, -1);
+	for (int i = 0; i < n; i++) {
+		order[i] = i;
+		group[i] = heightGroup(shapes[i].box.height());
+		group_height[group[i]] = qMax(group_height[group[i]], shapes[i].box.height());
+	}
+	QVector<int> groups;
+	for (int g = 0; g < HEIGHT_GROUPS; g++) {
+		if (group_height[g] >= 0) groups.append(g);
+	}
+	std::sort(order.begin(), order.end(), [this](int a, int b) {
+		return shapes[a].box.left() < shapes[b].box.left();
+	});
+
+	// the active shapes are ordered by the right side to leave the sweep
+	// and by the top side in their height group to find the vertical overlaps
+	typedef std::multimap<qreal, int> ActiveMap;
+	ActiveMap by_right;
+	QVector<ActiveMap> by_top(HEIGHT_GROUPS);
+	QVector<ActiveMap::iterator> top_position(n);
+	foreach(int i, order) {
+		const QRectF& box = shapes[i].box;
+		while (!by_right.empty() && by_right.begin()->first < box.left()) {
+			int leaving = by_right.begin()->second;
+			by_top[group[leaving]].erase(top_position[leaving]);
+			by_right.erase(by_right.begin());
+		}
+		foreach(int g, groups) {
+			// the shapes of the group starting above the box by more than its tallest shape cannot reach it
+			ActiveMap& active = by_top[g];
+			ActiveMap::iterator first = active.lower_bound(box.top() - group_height[g]);
+			ActiveMap::iterator last = active.upper_bound(box.bottom());
+			for (ActiveMap::iterator j = first; j != last; j++) {
+				const Shape& other = shapes[j->second];
+				if (other.box.bottom() >= box.top()) {
+					check(shapes[i], other, result);
+				}
+			}
+		}
+		by_right.insert(std::make_pair(box.right(), i));
+		top_position[i] = by_top[group[i]].insert(std::make_pair(box.top(), i));
+	}
+	elapsedTime = timer.elapsed();
+	return result;
+}
+
+bool CyberiadaSMDiagnostics::isAncestor(const Cyberiada::Element* ancestor, const Cyberiada::Element* element)
+{
+	for (const Cyberiada::Element* e = element; e; e = e->get_parent()) {
+		if (e == ancestor) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CyberiadaSMDiagnostics::clipLine(const QLineF& line, const QRectF& rect, QPointF* middle)
+{
+	// Liang-Barsky clipping against the rectangle interior
+	qreal t0 = 0, t1 = 1;
+	qreal dx = line.dx(), dy = line.dy();
+	qreal p[4] = { -dx, dx, -dy, dy };
+	qreal q[4] = { line.x1() - rect.left(), rect.right() - line.x1(),
+				   line.y1() - rect.top(), rect.bottom() - line.y1() };
+	for (int k = 0; k < 4; k++) {
+		if (p[k] == 0) {
+			if (q[k] <= 0) return false;
+			continue;
+		}
+		qreal t = q[k] / p[k];
+		if (p[k] < 0) {
+			t0 = qMax(t0, t);
+		} else {
+			t1 = qMin(t1, t);
+		}
+		if (t0 >= t1) return false;
+	}
+	*middle = line.pointAt((t0 + t1) / 2);
+	return true;
+}
+
+void CyberiadaSMDiagnostics::check(const Shape& a, const Shape& b, QList<CyberiadaSMDiagnostic>& result)
+{
+	if (a.element == b.element) {
+		return;
+	}
+	const Cyberiada::Element* first = a.element < b.element ? a.element : b.element;
+	const Cyberiada::Element* second = a.element < b.element ? b.element : a.element;
+	QPair<const Cyberiada::Element*, const Cyberiada::Element*> key(first, second);
+	if (reported.contains(key)) {
+		return;
+	}
+
+	CyberiadaSMDiagnostic d;
+	if (!a.segment && !b.segment) {
+		// only the siblings can overlap, the nested states lie inside their parents
+		if (a.element->get_parent() != b.element->get_parent()) return;
+		QRectF common = a.box.intersected(b.box);
+		if (common.width() <= OVERLAP_TOLERANCE || common.height() <= OVERLAP_TOLERANCE) return;
+		d.kind = CyberiadaSMDiagnostic::statesOverlap;
+		d.position = common.center();
+	} else if (a.segment && b.segment) {
+		if (a.source == b.source || a.source == b.target || a.target == b.source || a.target == b.target) return;
+		QPointF point;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+		if (a.line.intersects(b.line, &point) != QLineF::BoundedIntersection) return;
+#else
+		if (a.line.intersect(b.line, &point) != QLineF::BoundedIntersection) return;
+#endif
+		d.kind = CyberiadaSMDiagnostic::transitionsCross;
+		d.position = point;
+	} else {
+		const Shape& segment = a.segment ? a : b;
+		const Shape& state = a.segment ? b : a;
+		Cyberiada::ElementType type = state.element->get_type();
+		if (type != Cyberiada::elementSimpleState && type != Cyberiada::elementCompositeState) return;
+		// the transition enters its own ends and their ancestors
+		if (isAncestor(state.element, segment.source) || isAncestor(state.element, segment.target)) return;
+		QRectF inner = state.box.adjusted(OVERLAP_TOLERANCE, OVERLAP_TOLERANCE, -OVERLAP_TOLERANCE, -OVERLAP_TOLERANCE);
+		if (!clipLine(segment.line, inner, &d.position)) return;
+		d.kind = CyberiadaSMDiagnostic::transitionCrossesState;
+		// the transition goes first
+		first = segment.element;
+		second = state.element;
+	}
+	reported.insert(key);
+	d.first = first->get_id();
+	d.second = second->get_id();
+	result.append(d);
+}
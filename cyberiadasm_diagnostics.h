@@ -0,0 +1,90 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Diagram Diagnostics
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_DIAGNOSTICS_HEADER
+#define CYBERIADA_SM_DIAGNOSTICS_HEADER
+
+#include <QList>
+#include <QVector>
+#include <QRectF>
+#include <QLineF>
+#include <QSet>
+#include <QPair>
+#include <cyberiada/cyberiadamlpp.h>
+
+class CyberiadaSMModel;
+
+struct CyberiadaSMDiagnostic {
+	enum Kind {
+		statesOverlap,
+		transitionCrossesState,
+		transitionsCross
+	};
+	Kind                                kind;
+	Cyberiada::ID                       first;
+	Cyberiada::ID                       second;
+	QPointF                             position;   // in the scene coordinates
+};
+
+/* -----------------------------------------------------------------------------
+ * The layout defects of a state machine: the overlapping sibling states, the
+ * transitions cutting through states and the crossing transitions. A single
+ * sweep over the state rectangles and the transition segments sorted by the
+ * left side finds all candidate pairs. The active shapes are grouped by the
+ * power of two of their height, and a box looks into every group only as far
+ * up as the tallest shape of that group reaches, so a few tall composite
+ * states do not widen the search for the small shapes and the sweep stays
+ * near O(n log n + k).
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMDiagnostics {
+public:
+	CyberiadaSMDiagnostics(CyberiadaSMModel* model, const Cyberiada::StateMachine* sm);
+
+	QList<CyberiadaSMDiagnostic>        run();
+	qint64                              elapsed() const { return elapsedTime; }
+
+private:
+	struct Shape {
+		const Cyberiada::Element*       element;
+		const Cyberiada::Element*       source;     // the transition ends
+		const Cyberiada::Element*       target;
+		bool                            segment;
+		QRectF                          box;
+		QLineF                          line;
+	};
+
+	void                                addShapes(const Cyberiada::ElementCollection* collection);
+	void                                check(const Shape& a, const Shape& b, QList<CyberiadaSMDiagnostic>& result);
+	static bool                         isAncestor(const Cyberiada::Element* ancestor, const Cyberiada::Element* element);
+	static bool                         clipLine(const QLineF& line, const QRectF& rect, QPointF* middle);
+
+	CyberiadaSMModel*                   model;
+	const Cyberiada::StateMachine*      sm;
+	QVector<Shape>                      shapes;
+	QSet<QPair<const Cyberiada::Element*, const Cyberiada::Element*> > reported;
+	qint64                              elapsedTime;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include <QPainter>
+#include <QGraphicsSceneMouseEvent>
+#include <QtMath>
+
+#include "cyberiadasm_editor_bundle_item.h"
+#include "cyberiadasm_profiler.h"
+#include "cyberiadasm_editor_transition_item.h"
+#include "cyberiadasm_editor_scene.h"
+#include "myassert.h"
+
+// the distance between the neighbour curves of the fan and the widest fan
+static const qreal BUNDLE_SPACING = 8;
+static const qreal BUNDLE_MAX_WIDTH = 60;
+static const qreal BUNDLE_BADGE_SIZE = 18;
+static const qreal BUNDLE_ARROW_SIZE = 10;
+
+/* -----------------------------------------------------------------------------
+ * Transition Bundle Item
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMEditorBundleItem::CyberiadaSMEditorBundleItem():
+    m_source(NULL), m_target(NULL), m_expanded(false)
+{
+}
+
+void CyberiadaSMEditorBundleItem::setTransitions(QGraphicsItem* source, QGraphicsItem* target,
+                                                 const QList<CyberiadaSMEditorTransitionItem*>& transitions)
+{
+    MY_ASSERT(source);
+    MY_ASSERT(target);
+    m_source = source;
+    m_target = target;
+    m_transitions = transitions;
+    for (int i = 0; i < m_transitions.size(); i++) {
+        m_transitions[i]->setBundleOffset(offset(i, m_transitions.size()));
+    }
+    setExpanded(m_expanded);
+    updatePath();
+}
+
+qreal CyberiadaSMEditorBundleItem::offset(int index, int count)
+{
+    if (count < 2) {
+        return 0;
+    }
+    qreal spacing = qMin(BUNDLE_SPACING, BUNDLE_MAX_WIDTH / (count - 1));
+    return (index - (count - 1) / 2.0) * spacing;
+}
+
+void CyberiadaSMEditorBundleItem::setExpanded(bool expanded)
+{
+    m_expanded = expanded;
+    setVisible(!expanded);
+    foreach(CyberiadaSMEditorTransitionItem* transition, m_transitions) {
+        bool was_visible = transition->isVisible();
+        transition->setVisible(expanded);
+        if (expanded && !was_visible) {
+            // the hidden transitions do not follow their ends
+            transition->updatePath();
+        }
+    }
+}
+
+void CyberiadaSMEditorBundleItem::updatePath()
+{
+    prepareGeometryChange();
+    m_path = QPainterPath();
+    m_shape = QPainterPath();
+    m_arrow.clear();
+    m_badge = QRectF();
+    if (!m_source || !m_target || m_transitions.isEmpty()) {
+        return;
+    }
+
+    // the line between the centers clipped by the borders of the ends
+    QRectF s = m_source->sceneBoundingRect();
+    QRectF t = m_target->sceneBoundingRect();
+    QLineF center_line(s.center(), t.center());
+    QPointF start = s.center(), end = t.center();
+    QLineF edges[4];
+    edges[0] = QLineF(s.topLeft(), s.topRight());
+    edges[1] = QLineF(s.topRight(), s.bottomRight());
+    edges[2] = QLineF(s.bottomRight(), s.bottomLeft());
+    edges[3] = QLineF(s.bottomLeft(), s.topLeft());
+    for (int i = 0; i < 4; i++) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        if (center_line.intersects(edges[i], &start) == QLineF::BoundedIntersection) break;
+#else
+        if (center_line.intersect(edges[i], &start) == QLineF::BoundedIntersection) break;
+#endif
+        start = s.center();
+    }
+    edges[0] = QLineF(t.topLeft(), t.topRight());
+    edges[1] = QLineF(t.topRight(), t.bottomRight());
+    edges[2] = QLineF(t.bottomRight(), t.bottomLeft());
+    edges[3] = QLineF(t.bottomLeft(), t.topLeft());
+    for (int i = 0; i < 4; i++) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        if (center_line.intersects(edges[i], &end) == QLineF::BoundedIntersection) break;
+#else
+        if (center_line.intersect(edges[i], &end) == QLineF::BoundedIntersection) break;
+#endif
+        end = t.center();
+    }
+
+    QLineF line(start, end);
+    if (line.length() == 0) {
+        return;
+    }
+    QLineF normal = line.normalVector().unitVector();
+    QPointF n(normal.dx(), normal.dy());
+    QPointF middle = (start + end) / 2;
+    int count = m_transitions.size();
+    for (int i = 0; i < count; i++) {
+        // the control point is twice as far as the top of the curve
+        m_path.moveTo(start);
+        m_path.quadTo(middle + n * offset(i, count) * 2, end);
+    }
+
+    QPainterPath spine;
+    spine.moveTo(start);
+    spine.lineTo(end);
+    QPainterPathStroker stroker;
+    stroker.setWidth(qMin(BUNDLE_SPACING * count, BUNDLE_MAX_WIDTH) + 10);
+    m_shape = stroker.createStroke(spine);
+
+    double angle = std::atan2(-line.dy(), line.dx());
+    m_arrow << end
+            << end + QPointF(-BUNDLE_ARROW_SIZE * std::cos(angle - M_PI / 6),
+                             BUNDLE_ARROW_SIZE * std::sin(angle - M_PI / 6))
+            << end + QPointF(-BUNDLE_ARROW_SIZE * std::cos(angle + M_PI / 6),
+                             BUNDLE_ARROW_SIZE * std::sin(angle + M_PI / 6));
+    m_badge = QRectF(middle - QPointF(BUNDLE_BADGE_SIZE / 2, BUNDLE_BADGE_SIZE / 2),
+                     QSizeF(BUNDLE_BADGE_SIZE, BUNDLE_BADGE_SIZE));
+    m_shape.addEllipse(m_badge);
+    update();
+}
+
+QRectF CyberiadaSMEditorBundleItem::boundingRect() const
+{
+    SM_PROFILE_COUNT(boundingRectCall);
+    return m_shape.boundingRect().united(m_arrow.boundingRect()).adjusted(-2, -2, 2, 2);
+}
+
+QPainterPath CyberiadaSMEditorBundleItem::shape() const
+{
+    SM_PROFILE_COUNT(shapeCall);
+    return m_shape;
+}
+
+void CyberiadaSMEditorBundleItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
+{
+    SM_PROFILE_COUNT(paintTransition);
+    QPen pen(Qt::black, 1);
+    pen.setCosmetic(true);
+    painter->setPen(pen);
+    painter->setBrush(Qt::NoBrush);
+    painter->drawPath(m_path);
+
+    painter->setBrush(Qt::black);
+    painter->drawPolygon(m_arrow);
+
+    // the number of the bundled transitions
+    painter->setBrush(Qt::white);
+    painter->drawEllipse(m_badge);
+    painter->drawText(m_badge, Qt::AlignCenter, QString::number(m_transitions.size()));
+}
+
+void CyberiadaSMEditorBundleItem::mousePressEvent(QGraphicsSceneMouseEvent* event)
+{
+    // the press is taken to receive the double click
+    if (event->button() == Qt::LeftButton) {
+        event->accept();
+        return;
+    }
+    QGraphicsItem::mousePressEvent(event);
+}
+
+void CyberiadaSMEditorBundleItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent* event)
+{
+    if (event->button() == Qt::LeftButton) {
+        static_cast<CyberiadaSMEditorScene*>(scene())->expandBundle(this);
+        event->accept();
+        return;
+    }
+    QGraphicsItem::mouseDoubleClickEvent(event);
+}
@@ -0,0 +1,65 @@
+#ifndef CYBERIADASM_EDITOR_BUNDLE_ITEM_H
+#define CYBERIADASM_EDITOR_BUNDLE_ITEM_H
+
+#include <QGraphicsItem>
+#include <QPainterPath>
+#include <QList>
+
+#include "cyberiadasm_editor_items.h"
+
+class CyberiadaSMEditorTransitionItem;
+
+/* -----------------------------------------------------------------------------
+ * Transition Bundle Item
+ *
+ * The transitions between the same pair of items are drawn by a single item
+ * as a fan of curves around the line between the ends; the fan is built once
+ * per move of the ends and drawn as one path. The expanded bundle hides itself
+ * and shows its transitions with the same offsets, so every one of them can
+ * be selected.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMEditorBundleItem: public QGraphicsItem {
+public:
+    enum { Type = CyberiadaSMEditorAbstractItem::TransitionItem + 1 };
+
+    CyberiadaSMEditorBundleItem();
+
+    virtual int type() const { return Type; }
+
+    void setTransitions(QGraphicsItem* source, QGraphicsItem* target,
+                        const QList<CyberiadaSMEditorTransitionItem*>& transitions);
+    const QList<CyberiadaSMEditorTransitionItem*>& transitions() const { return m_transitions; }
+    void removeTransition(CyberiadaSMEditorTransitionItem* transition) { m_transitions.removeAll(transition); }
+    QGraphicsItem* sourceItem() const { return m_source; }
+    QGraphicsItem* targetItem() const { return m_target; }
+
+    bool isExpanded() const { return m_expanded; }
+    void setExpanded(bool expanded);
+
+    // the distance of the transition from the line between the ends
+    static qreal offset(int index, int count);
+
+    void updatePath();
+
+    QRectF boundingRect() const override;
+    QPainterPath shape() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+protected:
+    void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
+    void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
+
+private:
+    QGraphicsItem* m_source;
+    QGraphicsItem* m_target;
+    QList<CyberiadaSMEditorTransitionItem*> m_transitions;
+    bool m_expanded;
+
+    QPainterPath m_path;
+    QPainterPath m_shape;
+    QPolygonF m_arrow;
+    QRectF m_badge;
+};
+
+#endif // CYBERIADASM_EDITOR_BUNDLE_ITEM_H
@@ -3,6 +3,8 @@
 #include <QColor>
 
 #include "cyberiadasm_editor_choice_item.h"
+#include "cyberiadasm_profiler.h"
+#include "cyberiadasm_painter.h"
 #include "myassert.h"
 
 /* -----------------------------------------------------------------------------
@@ -14,19 +16,30 @@ CyberiadaSMEditorChoiceItem::CyberiadaSMEditorChoiceItem(CyberiadaSMModel* model
                                                          QGraphicsItem* parent):
     CyberiadaSMEditorAbstractItem(model, element, parent)
 {
+    Cyberiada::Rect r = element->get_bound_rect(*(model->rootDocument()));
+    setPos(r.x, r.y);
+
+    setFlags(ItemIsSelectable | ItemSendsGeometryChanges);
 }
 
-void CyberiadaSMEditorChoiceItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
+QRectF CyberiadaSMEditorChoiceItem::boundingRect() const
 {
-    painter->setPen(QPen(Qt::black, 1, Qt::SolidLine));
+    SM_PROFILE_COUNT(boundingRectCall);
+    return QRectF(- VERTEX_POINT_RADIUS,
+                  - VERTEX_POINT_RADIUS,
+                  VERTEX_POINT_RADIUS * 2,
+                  VERTEX_POINT_RADIUS * 2);
+}
 
-    QRectF r = boundingRect();
-    const QPointF points[] = {
-        QPointF(r.left() + r.width() / 2.0, r.top()),
-        QPointF(r.right(), r.top() + r.height() / 2.0),
-        QPointF(r.left() + r.width() / 2.0, r.bottom()),
-        QPointF(r.left(), r.top() + r.height() / 2.0)
-    };
+void CyberiadaSMEditorChoiceItem::syncFromModel()
+{
+    Cyberiada::Rect r = element->get_bound_rect(*(model->rootDocument()));
+    setPos(r.x, r.y);
+    update();
+}
 
-    painter->drawConvexPolygon(points, 4);
+void CyberiadaSMEditorChoiceItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
+{
+    SM_PROFILE_COUNT(paintVertex);
+    CyberiadaSMPainter::paintChoice(painter, boundingRect(), isSelected());
 }
@@ -15,7 +15,12 @@ public:
 
     virtual int type() const { return ChoiceItem; }
 
+    QRectF boundingRect() const override;
+    void syncFromModel() override;
     virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+
+protected:
+    bool isMovable() const override { return true; }
 };
 
 
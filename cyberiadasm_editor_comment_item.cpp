@@ -2,6 +2,8 @@
 #include <QPainter>
 #include <QColor>
 #include "cyberiadasm_editor_comment_item.h"
+#include "cyberiadasm_profiler.h"
+#include "cyberiadasm_painter.h"
 #include "myassert.h"
 
 /* -----------------------------------------------------------------------------
@@ -19,9 +21,12 @@ CyberiadaSMEditorCommentItem::CyberiadaSMEditorCommentItem(QObject *parent_objec
 {
     m_comment = static_cast<const Cyberiada::Comment*>(element);
 
+    Cyberiada::Rect r = m_comment->get_geometry_rect();
+    setPos(r.x, r.y);
+    setFlags(ItemIsSelectable | ItemSendsGeometryChanges);
+
     text = new EditableTextItem(m_comment->get_body().c_str(), this);
 
-    m_commentBrush = QBrush(QColor(0xff, 0xcc, 0));
 }
 
 
@@ -31,6 +36,7 @@ CyberiadaSMEditorCommentItem::~CyberiadaSMEditorCommentItem() {
 
 QRectF CyberiadaSMEditorCommentItem::boundingRect() const
 {
+    SM_PROFILE_COUNT(boundingRectCall);
     Cyberiada::Rect r = m_comment->get_geometry_rect();
     return QRectF(- r.width / 2,
                   - r.height / 2,
@@ -38,39 +44,37 @@ QRectF CyberiadaSMEditorCommentItem::boundingRect() const
                   r.height);
 }
 
-void CyberiadaSMEditorCommentItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
+void CyberiadaSMEditorCommentItem::syncFromModel()
 {
+    Cyberiada::Rect r = m_comment->get_geometry_rect();
+    prepareGeometryChange();
+    setPos(r.x, r.y);
+    text->setPlainText(m_comment->get_body().c_str());
     setPositionText();
+    update();
+}
 
-    painter->setPen(QPen(Qt::black, 1, Qt::SolidLine));
-    painter->setBrush(m_commentBrush);
-
-    QRectF r = boundingRect();
-
-    const QPointF points[] = {
-        QPointF(r.left(), r.top()),
-        QPointF(r.right() - COMMENT_ANGLE_CORNER, r.top()),
-        QPointF(r.right(), r.top() + COMMENT_ANGLE_CORNER),
-        QPointF(r.right(), r.bottom()),
-        QPointF(r.left(), r.bottom())
-    };
-
-    painter->drawConvexPolygon(points, 5);
+void CyberiadaSMEditorCommentItem::rebind(Cyberiada::Element* _element)
+{
+    m_comment = static_cast<const Cyberiada::Comment*>(_element);
+    CyberiadaSMEditorAbstractItem::rebind(_element);
+}
 
-    Cyberiada::ElementType type = element->get_type();
-    if (type == Cyberiada::elementFormalComment) {
-        painter->setBrush(QBrush(Qt::black));
-    } else {
-        painter->setBrush(m_commentBrush);
+void CyberiadaSMEditorCommentItem::textEdited(QGraphicsItem* textItem, const QString& newText)
+{
+    if (textItem == text) {
+        model->editElementsText(QList<Cyberiada::Element*>() << element, CyberiadaSMModel::textBody, newText,
+                                text->session());
     }
+}
 
-    const QPointF triangle[] = {
-        QPointF(r.right() - COMMENT_ANGLE_CORNER, r.top()),
-        QPointF(r.right(), r.top() + COMMENT_ANGLE_CORNER),
-        QPointF(r.right()- COMMENT_ANGLE_CORNER, r.top() + COMMENT_ANGLE_CORNER)
-    };
+void CyberiadaSMEditorCommentItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
+{
+    SM_PROFILE_COUNT(paintText);
+    setPositionText();
 
-    painter->drawConvexPolygon(points, 3);
+    CyberiadaSMPainter::paintComment(painter, boundingRect(),
+                                     element->get_type() == Cyberiada::elementFormalComment, isSelected());
 }
 
 void CyberiadaSMEditorCommentItem::setPositionText()
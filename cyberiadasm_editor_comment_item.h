@@ -28,12 +28,17 @@ public:
 
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
     QRectF boundingRect() const override;
+    void syncFromModel() override;
+    void textEdited(QGraphicsItem* textItem, const QString& text) override;
+    void rebind(Cyberiada::Element* element) override;
 
     void setPositionText();
 
+protected:
+    bool isMovable() const override { return true; }
+
 private:
     EditableTextItem* text;
-    QBrush m_commentBrush;
 
     const Cyberiada::Comment* m_comment;
     QMap<Cyberiada::ID, QGraphicsItem*>* m_elementItem;
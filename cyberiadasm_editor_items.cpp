@@ -24,7 +24,9 @@
 #include <QDebug>
 #include <QPainter>
 #include <QColor>
+#include <QGraphicsSceneMouseEvent>
 #include "cyberiadasm_editor_items.h"
+#include "cyberiadasm_editor_scene.h"
 #include "myassert.h"
 
 
@@ -37,7 +39,8 @@ CyberiadaSMEditorAbstractItem::CyberiadaSMEditorAbstractItem(CyberiadaSMModel* _
                                                              QGraphicsItem* parent):
     QGraphicsItem(parent),
     model(_model),
-    element(_element)
+    element(_element),
+    dragged(false)
 {
 }
 
@@ -50,3 +53,84 @@ QVariant CyberiadaSMEditorAbstractItem::data(int key) const
 	}
 }
 
+
+void CyberiadaSMEditorAbstractItem::syncFromModel()
+{
+	update();
+}
+
+void CyberiadaSMEditorAbstractItem::textEdited(QGraphicsItem*, const QString&)
+{
+}
+
+void CyberiadaSMEditorAbstractItem::textEditFinished(QGraphicsItem*)
+{
+}
+
+void CyberiadaSMEditorAbstractItem::rebind(Cyberiada::Element* _element)
+{
+	MY_ASSERT(_element);
+	MY_ASSERT(!scene());
+	prepareGeometryChange();
+	element = _element;
+	dragged = false;
+	setSelected(false);
+	syncFromModel();
+}
+
+QVariant CyberiadaSMEditorAbstractItem::itemChange(GraphicsItemChange change, const QVariant& value)
+{
+	if (change == ItemPositionHasChanged) {
+		invalidateTransitions();
+		CyberiadaSMEditorScene* s = dynamic_cast<CyberiadaSMEditorScene*>(scene());
+		if (s) {
+			s->noteItemChanged(this);
+		}
+	}
+	return QGraphicsItem::itemChange(change, value);
+}
+
+void CyberiadaSMEditorAbstractItem::mousePressEvent(QGraphicsSceneMouseEvent* event)
+{
+	QGraphicsItem::mousePressEvent(event);
+	if ((event->button() & Qt::LeftButton) && isMovable()) {
+		CyberiadaSMEditorScene* s = dynamic_cast<CyberiadaSMEditorScene*>(scene());
+		if (s) {
+			dragged = true;
+			// the selection is already updated by the default handler
+			s->beginDrag(event->scenePos());
+		}
+	}
+}
+
+void CyberiadaSMEditorAbstractItem::mouseMoveEvent(QGraphicsSceneMouseEvent* event)
+{
+	if (dragged) {
+		CyberiadaSMEditorScene* s = dynamic_cast<CyberiadaSMEditorScene*>(scene());
+		if (s) {
+			s->dragTo(event->scenePos());
+		}
+		return;
+	}
+	QGraphicsItem::mouseMoveEvent(event);
+}
+
+void CyberiadaSMEditorAbstractItem::mouseReleaseEvent(QGraphicsSceneMouseEvent* event)
+{
+	if ((event->button() & Qt::LeftButton) && dragged) {
+		dragged = false;
+		CyberiadaSMEditorScene* s = dynamic_cast<CyberiadaSMEditorScene*>(scene());
+		if (s) {
+			s->endDrag();
+		}
+	}
+	QGraphicsItem::mouseReleaseEvent(event);
+}
+
+void CyberiadaSMEditorAbstractItem::invalidateTransitions()
+{
+	CyberiadaSMEditorScene* s = dynamic_cast<CyberiadaSMEditorScene*>(scene());
+	if (s) {
+		s->invalidateTransitions(this);
+	}
+}
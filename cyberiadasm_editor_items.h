@@ -59,13 +59,38 @@ public:
     // virtual QRectF boundingRect() const;
 	virtual QVariant data(int key) const;
 
+	Cyberiada::Element* getElement() const { return element; }
+	virtual void syncFromModel();
+	virtual void textEdited(QGraphicsItem* textItem, const QString& text);
+	// the text item used for the editing is not needed any more
+	virtual void textEditFinished(QGraphicsItem* textItem);
+	// attach the detached item to another element of the same type (item pooling)
+	virtual void rebind(Cyberiada::Element* element);
+
+	static bool isEditorItem(const QGraphicsItem* item) {
+		return item && item->type() >= SMItem && item->type() <= TransitionItem;
+	}
+
 	static QRectF toQtRect(const Cyberiada::Rect& r) {
 		return QRectF(r.x, r.y, r.width, r.height);
 	}
 	
 protected:
+	virtual QVariant itemChange(GraphicsItemChange change, const QVariant& value);
+	void invalidateTransitions();
+
+	// the movable items are dragged by the scene and commit their geometry on release
+	virtual bool isMovable() const { return false; }
+	bool isDragged() const { return dragged; }
+	virtual void mousePressEvent(QGraphicsSceneMouseEvent* event);
+	virtual void mouseMoveEvent(QGraphicsSceneMouseEvent* event);
+	virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent* event);
+
 	CyberiadaSMModel* model;
 	Cyberiada::Element* element;
+
+private:
+	bool dragged;
 };
 
 // /* -----------------------------------------------------------------------------
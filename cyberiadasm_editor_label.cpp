@@ -0,0 +1,151 @@
+#include <QPainter>
+#include <QTextOption>
+#include <QTransform>
+
+#include "cyberiadasm_editor_label.h"
+#include "cyberiadasm_profiler.h"
+#include "editable_text_item.h"
+#include "myassert.h"
+
+// the same margin around the text as the QTextDocument of the editor has
+static const qreal LABEL_MARGIN = 4;
+
+/* -----------------------------------------------------------------------------
+ * Label
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMEditorLabel::CyberiadaSMEditorLabel():
+    m_role(CyberiadaSMTypography::roleTrigger), m_maxWidth(-1), m_centered(false),
+    m_staticFontKey(-1), m_wrapped(false), m_dirty(true), m_metricsKey(-1), m_editor(nullptr)
+{
+    m_staticText.setTextFormat(Qt::PlainText);
+}
+
+CyberiadaSMEditorLabel::~CyberiadaSMEditorLabel()
+{
+    // the editor is deleted by its parent item
+}
+
+void CyberiadaSMEditorLabel::setText(const QString& text)
+{
+    if (m_text == text) {
+        return;
+    }
+    m_text = text;
+    m_dirty = true;
+}
+
+void CyberiadaSMEditorLabel::setRole(CyberiadaSMTypography::Role role)
+{
+    if (m_role == role) {
+        return;
+    }
+    m_role = role;
+    m_dirty = true;
+}
+
+void CyberiadaSMEditorLabel::setMaximumWidth(qreal width)
+{
+    if (m_maxWidth == width) {
+        return;
+    }
+    m_maxWidth = width;
+    m_dirty = true;
+}
+
+void CyberiadaSMEditorLabel::setCentered(bool centered)
+{
+    if (m_centered == centered) {
+        return;
+    }
+    m_centered = centered;
+    m_dirty = true;
+}
+
+void CyberiadaSMEditorLabel::prepare() const
+{
+    CyberiadaSMTypography* typography = CyberiadaSMTypography::instance();
+    if (!m_dirty && m_metricsKey == typography->metricsKey()) {
+        return;
+    }
+    m_dirty = false;
+    m_metricsKey = typography->metricsKey();
+    m_staticFontKey = -1;
+    m_wrapped = false;
+    if (m_text.isEmpty()) {
+        // the empty label keeps the height of a line like the text item does
+        m_size = QSizeF(2 * LABEL_MARGIN, typography->metrics(m_role).height() + 2 * LABEL_MARGIN);
+        return;
+    }
+    QSizeF text_size = typography->textSize(m_role, m_text);
+    qreal max_text_width = m_maxWidth - 2 * LABEL_MARGIN;
+    if (m_maxWidth > 0 && text_size.width() > max_text_width) {
+        // only the wrapped text needs the layout to be measured
+        m_wrapped = true;
+        prepareStaticText(typography->font(m_role));
+        text_size = QSizeF(max_text_width, m_staticText.size().height());
+    }
+    m_size = text_size + QSizeF(2 * LABEL_MARGIN, 2 * LABEL_MARGIN);
+}
+
+void CyberiadaSMEditorLabel::prepareStaticText(const QFont& font) const
+{
+    CyberiadaSMTypography* typography = CyberiadaSMTypography::instance();
+    if (m_staticFontKey == typography->fontKey()) {
+        return;
+    }
+    m_staticText.setText(m_text);
+    m_staticText.setTextOption(QTextOption(m_centered ? Qt::AlignHCenter : Qt::AlignLeft));
+    m_staticText.setTextWidth(m_wrapped ? m_maxWidth - 2 * LABEL_MARGIN : -1);
+    m_staticText.prepare(QTransform(), font);
+    m_staticFontKey = typography->fontKey();
+}
+
+QSizeF CyberiadaSMEditorLabel::size() const
+{
+    prepare();
+    return m_size;
+}
+
+void CyberiadaSMEditorLabel::paint(QPainter* painter) const
+{
+    SM_PROFILE_COUNT(paintText);
+    if (m_text.isEmpty() || m_editor) {
+        return;
+    }
+    prepare();
+    // the font of the zoom bucket is shared by all labels of the role
+    QFont font = CyberiadaSMTypography::instance()->font(m_role);
+    prepareStaticText(font);
+    painter->setFont(font);
+    painter->drawStaticText(m_pos + QPointF(LABEL_MARGIN, LABEL_MARGIN), m_staticText);
+}
+
+EditableTextItem* CyberiadaSMEditorLabel::beginEdit(QGraphicsItem* owner)
+{
+    MY_ASSERT(owner);
+    if (m_editor) {
+        return m_editor;
+    }
+    m_editor = new EditableTextItem(m_text, owner, m_centered);
+    prepare();
+    m_editor->setFont(CyberiadaSMTypography::instance()->font(m_role));
+    if (m_wrapped) {
+        m_editor->setTextWidth(m_maxWidth);
+    }
+    m_editor->setPos(m_pos);
+    m_editor->startEditing();
+    owner->update(rect());
+    return m_editor;
+}
+
+void CyberiadaSMEditorLabel::endEdit()
+{
+    if (!m_editor) {
+        return;
+    }
+    // the editor is still in its focus-out handler here
+    m_editor->hide();
+    m_editor->deleteLater();
+    m_editor = nullptr;
+}
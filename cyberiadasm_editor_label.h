@@ -0,0 +1,73 @@
+#ifndef CYBERIADASM_EDITOR_LABEL_H
+#define CYBERIADASM_EDITOR_LABEL_H
+
+#include <QStaticText>
+#include <QRectF>
+#include <QString>
+#include <QSizeF>
+
+#include "cyberiadasm_typography.h"
+
+class QPainter;
+class QGraphicsItem;
+class EditableTextItem;
+
+/* -----------------------------------------------------------------------------
+ * Label
+ *
+ * The text of an item painted by the item itself from a cached QStaticText:
+ * no text document exists. The size of the text comes from the shared
+ * measurements of the typography, so the text is laid out only when it is
+ * wrapped or painted, and again only when the text, the width or the font
+ * changes. The real text item is created only for the editing and is
+ * positioned exactly over the label.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMEditorLabel {
+public:
+    CyberiadaSMEditorLabel();
+    ~CyberiadaSMEditorLabel();
+
+    const QString& text() const { return m_text; }
+    void setText(const QString& text);
+    void setRole(CyberiadaSMTypography::Role role);
+    CyberiadaSMTypography::Role role() const { return m_role; }
+    // the longer text is wrapped at the width; a negative width disables wrapping
+    void setMaximumWidth(qreal width);
+    void setCentered(bool centered);
+
+    QPointF pos() const { return m_pos; }
+    void setPos(const QPointF& pos) { m_pos = pos; }
+    QSizeF size() const;
+    QRectF rect() const { return QRectF(m_pos, size()); }
+    bool isEmpty() const { return m_text.isEmpty(); }
+
+    void paint(QPainter* painter) const;
+
+    // the editing session: the editor is a child of the owner over the label
+    EditableTextItem* beginEdit(QGraphicsItem* owner);
+    void endEdit();
+    EditableTextItem* editor() const { return m_editor; }
+    bool isEditing() const { return m_editor != nullptr; }
+
+private:
+    void prepare() const;
+    void prepareStaticText(const QFont& font) const;
+
+    QString m_text;
+    CyberiadaSMTypography::Role m_role;
+    qreal m_maxWidth;
+    bool m_centered;
+    QPointF m_pos;
+
+    mutable QStaticText m_staticText;
+    mutable int m_staticFontKey;
+    mutable QSizeF m_size;
+    mutable bool m_wrapped;
+    mutable bool m_dirty;
+    mutable int m_metricsKey;
+
+    EditableTextItem* m_editor;
+};
+
+#endif // CYBERIADASM_EDITOR_LABEL_H
@@ -28,15 +28,22 @@
 #include <QPainter>
 #include <QGraphicsView>
 #include <QGraphicsScene>
+#include <QElapsedTimer>
+#include <QUndoStack>
+#include <algorithm>
 
 #include "cyberiadasm_editor_scene.h"
 #include "cyberiadasm_editor_items.h"
 #include "cyberiadasm_editor_sm_item.h"
 #include "cyberiadasm_editor_state_item.h"
 #include "cyberiadasm_editor_vertex_item.h"
+#include "cyberiadasm_editor_choice_item.h"
 #include "cyberiadasm_editor_transition_item.h"
 #include "cyberiadasm_editor_comment_item.h"
-#include "smeditor_window.h"
+#include "cyberiadasm_editor_view.h"
+#include "cyberiadasm_commands.h"
+#include "cyberiadasm_typography.h"
+#include "cyberiadasm_trace.h"
 #include "myassert.h"
 
 static double DEFAULT_SCENE_X = -700;
@@ -44,6 +51,32 @@ static double DEFAULT_SCENE_Y = -700;
 static double DEFAULT_SCENE_WIDTH = 3000;
 static double DEFAULT_SCENE_HEIGHT = 3000;
 static double DEFAULT_SCENE_DELTA = 0.2;
+static int    TRANSITIONS_UPDATE_INTERVAL = 16; // ms, once per frame at 60 fps
+static double TOOL_MIN_SIZE = 10;
+static double DEFAULT_STATE_WIDTH = 160;
+static double DEFAULT_STATE_HEIGHT = 100;
+static double DEFAULT_COMMENT_WIDTH = 120;
+static double DEFAULT_COMMENT_HEIGHT = 60;
+static int    LEVEL_OF_DETAIL_INTERVAL = 100; // ms
+// the composite state shows its children when its smaller side takes at least
+// so many pixels on the screen; the lower collapse limit prevents flickering
+static double EXPAND_MIN_PIXELS = 120;
+static double COLLAPSE_MIN_PIXELS = 80;
+// the margins around the viewport (in the viewport sizes) to expand / collapse the states
+static double EXPAND_VIEWPORT_MARGIN = 0.5;
+static double COLLAPSE_VIEWPORT_MARGIN = 1.0;
+// the machines of this size are always shown in the virtualized mode
+static int    VIRTUAL_SCENE_MIN_ELEMENTS = 20000;
+// the margin around the viewport (in the viewport sizes) where the items are kept
+static double VIRTUAL_SCENE_MARGIN = 0.5;
+// the maximum number of the detached items of each type kept for the reuse
+static int    ITEM_POOL_LIMIT = 512;
+// the time (ms) given to the label placement in one pass; the rest waits for the next pass
+static int    LABEL_PLACEMENT_BUDGET = 4;
+// the transitions between the same pair of items are bundled starting from this number
+static int    BUNDLE_MIN_TRANSITIONS = 3;
+// the item is cached after so many painted frames without changes
+static int    DEFAULT_CACHE_STABLE_FRAMES = 30;
 
 CyberiadaSMEditorScene::CyberiadaSMEditorScene(CyberiadaSMModel* _model, QObject *_parent):
     QGraphicsScene(_parent), model(_model), currentSM(NULL)
@@ -55,16 +88,94 @@ CyberiadaSMEditorScene::CyberiadaSMEditorScene(CyberiadaSMModel* _model, QObject
 
 	setBackgroundBrush(Qt::white);
     connect(this, &QGraphicsScene::selectionChanged, this, &CyberiadaSMEditorScene::onSelectionChanged);
+
+    dragGesture = 0;
+    transitionsTimer = new QTimer(this);
+    transitionsTimer->setSingleShot(true);
+    transitionsTimer->setInterval(TRANSITIONS_UPDATE_INTERVAL);
+    connect(transitionsTimer, &QTimer::timeout, this, &CyberiadaSMEditorScene::slotUpdateTransitions);
+
+    connect(model, &QAbstractItemModel::rowsInserted, this, &CyberiadaSMEditorScene::slotRowsInserted);
+    connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, &CyberiadaSMEditorScene::slotRowsAboutToBeRemoved);
+
+    geometryService = new CyberiadaSMGeometryService(this);
+    connect(geometryService, &CyberiadaSMGeometryService::finished, this, &CyberiadaSMEditorScene::slotGeometryReady);
+
+    router = new CyberiadaSMRouter(this);
+    routingSerial = 0;
+    autoRouting = false;
+    connect(router, &CyberiadaSMRouter::routed, this, &CyberiadaSMEditorScene::slotTransitionsRouted);
+
+    levelOfDetailTimer = new QTimer(this);
+    levelOfDetailTimer->setSingleShot(true);
+    levelOfDetailTimer->setInterval(LEVEL_OF_DETAIL_INTERVAL);
+    connect(levelOfDetailTimer, &QTimer::timeout, this, &CyberiadaSMEditorScene::updateLevelOfDetail);
+    labelsTimer = new QTimer(this);
+    labelsTimer->setSingleShot(true);
+    labelsTimer->setInterval(0);
+    connect(labelsTimer, &QTimer::timeout, this, &CyberiadaSMEditorScene::slotPlaceLabels);
+    connect(CyberiadaSMTypography::instance(), &CyberiadaSMTypography::metricsChanged,
+            this, &CyberiadaSMEditorScene::slotMetricsChanged);
+    cachingEnabled = true;
+    cacheStableFrames = DEFAULT_CACHE_STABLE_FRAMES;
+    frameNumber = 0;
+    resetCacheStatistics();
+    buildingItems = false;
+    storeDirty = false;
+    virtualized = false;
+    virtualActive = false;
+
+    currentTool = toolSelect;
+    toolActive = false;
+    QPen toolPen(Qt::darkGray, 0, Qt::DashLine);
+    toolRect = new QGraphicsRectItem();
+    toolRect->setPen(toolPen);
+    toolRect->setZValue(1000);
+    toolLine = new QGraphicsLineItem();
+    toolLine->setPen(toolPen);
+    toolLine->setZValue(1000);
+
     reset();
 }
 
 CyberiadaSMEditorScene::~CyberiadaSMEditorScene()
 {
+    cancelTool();
+    delete toolRect;
+    delete toolLine;
+    clearItemPool();
 }
 
 void CyberiadaSMEditorScene::reset()
 {
+	geometryService->cancel();
+	cancelTool();
+	dragItems.clear();
+	transitionIndex.clear();
+	transitionOwners.clear();
+	dirtyTransitions.clear();
+	hiddenEnds.clear();
+	transitionHidden.clear();
+	staleTransitions.clear();
+	elementIds.clear();
+	dirtyLabels.clear();
+	labelsTimer->stop();
+	labelPlacer.clear();
+	bundles.clear();
+	transitionBundle.clear();
+	transitionBundleKey.clear();
+	dirtyBundles.clear();
+	cacheCandidates.clear();
+	cachedItems.clear();
+	levelOfDetailTimer->stop();
+	userExpansion.clear();
+	store.clear();
+	wanted.clear();
 	clear();
+	clearItemPool();
+	elementItem.clear();
+	currentSM = NULL;
+	emit overviewChanged(QRectF());
 	setSceneRect(DEFAULT_SCENE_X,
 				 DEFAULT_SCENE_Y,
 				 DEFAULT_SCENE_WIDTH,
@@ -72,60 +183,257 @@ void CyberiadaSMEditorScene::reset()
 	update();
 }
 
-void CyberiadaSMEditorScene::onSelectionChanged() {
-    QGraphicsItem* item = selectedItems().first();
-    Cyberiada::ID item_id = elementItem.key(item);
-    Cyberiada::Element* element = model->idToElement(QString::fromStdString(item_id));
-    const QModelIndex index = model->elementToIndex(element);
-
-    CyberiadaSMEditorWindow* p = dynamic_cast<CyberiadaSMEditorWindow*>(parent());
-    p->SMView->setCurrentIndex(index);
-
+void CyberiadaSMEditorScene::onSelectionChanged()
+{
+    SM_TRACE_SPAN("scene selection sync");
+    QModelIndexList indexes;
+    QList<QGraphicsItem*> items = selectedItems();
+    foreach(QGraphicsItem* item, items) {
+        if (!CyberiadaSMEditorAbstractItem::isEditorItem(item)) continue;
+        Cyberiada::Element* element = static_cast<CyberiadaSMEditorAbstractItem*>(item)->getElement();
+        MY_ASSERT(element);
+        indexes.append(model->elementToIndex(element));
+    }
+    emit elementsSelected(indexes);
 }
 
 void CyberiadaSMEditorScene::slotElementSelected(const QModelIndex& index)
 {
     if (index.isValid() && index != model->rootIndex() && index != model->documentIndex()) {
         Cyberiada::Element* element = model->indexToElement(index);
-        const Cyberiada::ID element_id = element->get_id().c_str();
         MY_ASSERT(element);
+        showStateMachine(model->rootDocument()->get_parent_sm(element));
+    }
+}
 
-        blockSignals(true);
-        clearSelection();
-        blockSignals(false);
+void CyberiadaSMEditorScene::slotElementsSelected(const QModelIndexList& indexes)
+{
+    SM_TRACE_SPAN("tree selection sync");
+    QSet<QGraphicsItem*> items;
+    foreach(QModelIndex index, indexes) {
+        if (!index.isValid() || index == model->rootIndex() || index == model->documentIndex()) continue;
+        Cyberiada::Element* element = model->indexToElement(index);
+        MY_ASSERT(element);
+        if (items.isEmpty()) {
+            showStateMachine(model->rootDocument()->get_parent_sm(element));
+        }
+        revealElement(element);
+        QGraphicsItem* item = elementItem.value(element->get_id());
+        if (item) {
+            if (item->type() == CyberiadaSMEditorAbstractItem::TransitionItem) {
+                CyberiadaSMEditorBundleItem* bundle =
+                    transitionBundle.value(static_cast<CyberiadaSMEditorTransitionItem*>(item));
+                if (bundle) {
+                    expandBundle(bundle);
+                }
+            }
+            items.insert(item);
+        }
+    }
 
-        QGraphicsItem* item = elementItem.value(element_id);
+    QSet<QGraphicsItem*> selected;
+    foreach(QGraphicsItem* item, selectedItems()) {
+        if (CyberiadaSMEditorAbstractItem::isEditorItem(item)) {
+            selected.insert(item);
+        }
+    }
+    if (items == selected) {
+        return;
+    }
+
+    blockSignals(true);
+    clearSelection();
+    foreach(QGraphicsItem* item, items) {
+        item->setSelected(true);
+    }
+    blockSignals(false);
+}
+
+void CyberiadaSMEditorScene::focusElements(const QModelIndexList& indexes, const QPointF& scenePos)
+{
+    if (indexes.isEmpty()) {
+        return;
+    }
+    Cyberiada::Element* element = model->indexToElement(indexes.first());
+    MY_ASSERT(element);
+    showStateMachine(model->rootDocument()->get_parent_sm(element));
+    if (!views().isEmpty()) {
+        views().first()->centerOn(scenePos);
+        // the items around the new viewport are needed right now to be selected
+        updateLevelOfDetail();
+    }
+    slotElementsSelected(indexes);
+    onSelectionChanged();
+}
+
+void CyberiadaSMEditorScene::slotElementsChanged(const QList<Cyberiada::Element*>& elements)
+{
+    if (!storeDirty && store.size() > 0) {
+        // the overview is dirty where the elements and their neighbours were and are now
+        QRectF dirty = storeArea(elements);
+        if (store.update(elements)) {
+            emit overviewChanged(dirty | storeArea(elements));
+        } else {
+            storeDirty = true;
+            emit overviewChanged(QRectF());
+        }
+    }
+    foreach(Cyberiada::Element* element, elements) {
+        QGraphicsItem* item = elementItem.value(element->get_id());
         if (item) {
-            blockSignals(true);
-            item->setSelected(true);
-            blockSignals(false);
-        }
-
-        Cyberiada::StateMachine* sm = model->rootDocument()->get_parent_sm(element);
-        if (sm != currentSM) {
-            currentSM = sm;
-            /*Cyberiada::Rect bound = currentSM->get_bound_rect();
-            clear();
-            if (bound.valid) {
-                setSceneRect(-(bound.width / 2.0) * (1.0 + DEFAULT_SCENE_DELTA),
-                             -(bound.height / 2.0) * (1.0 + DEFAULT_SCENE_DELTA),
-                             bound.width * (1.0 + 2.0 * DEFAULT_SCENE_DELTA),
-                             bound.height * (1.0 + 2.0 * DEFAULT_SCENE_DELTA));
-                QRectF r = sceneRect();
-                qDebug() << "Scene (" << r.left() << ", " << r.top() << ", " << r.right() << ", " << r.bottom() << ")";
-            } else {
-                //reconstructGeometry();
-            }*/
+            static_cast<CyberiadaSMEditorAbstractItem*>(item)->syncFromModel();
+            noteItemChanged(item);
+            if (item->type() == CyberiadaSMEditorAbstractItem::TransitionItem) {
+                dirtyTransitions.insert(static_cast<CyberiadaSMEditorTransitionItem*>(item));
+                scheduleTransitionsUpdate();
+            }
+        }
+    }
+}
+
+void CyberiadaSMEditorScene::showStateMachine(Cyberiada::StateMachine* sm)
+{
+    if (sm == currentSM) {
+        return;
+    }
+    currentSM = sm;
+
+    geometryService->cancel();
+    cancelTool();
+    dragItems.clear();
+    transitionIndex.clear();
+    transitionOwners.clear();
+    dirtyTransitions.clear();
+    hiddenEnds.clear();
+    transitionHidden.clear();
+    staleTransitions.clear();
+    elementIds.clear();
+    dirtyLabels.clear();
+    labelsTimer->stop();
+    labelPlacer.clear();
+    bundles.clear();
+    transitionBundle.clear();
+    transitionBundleKey.clear();
+    dirtyBundles.clear();
+    cacheCandidates.clear();
+    cachedItems.clear();
+    levelOfDetailTimer->stop();
+    routingSerial++;
+    router->clearCache();
+    blockSignals(true);
+    clear();
+    elementItem.clear();
+    blockSignals(false);
+    store.clear();
+    emit overviewChanged(QRectF());
+    wanted.clear();
+    virtualActive = false;
+
+    if (!currentSM) {
+        return;
+    }
+    if (CyberiadaSMLayout::needsLayout(currentSM)) {
+        // the items are built when the geometry comes back from the worker thread
+        geometryService->request(currentSM);
+        update();
+        return;
+    }
+    buildItems();
+}
+
+void CyberiadaSMEditorScene::slotGeometryReady(int, CyberiadaSMLayoutResult layout)
+{
+    // the service drops the results of the outdated requests
+    if (!currentSM || layout->stateMachineId() != currentSM->get_id() || !elementItem.isEmpty()) {
+        return;
+    }
+    // only the elements without geometry and their transitions are written
+    layout->apply(model);
+    emit layoutFinished(layout->elementsCount(), layout->elapsed());
+    buildItems();
+}
+
+QRectF CyberiadaSMEditorScene::machineRect() const
+{
+    if (!currentSM) {
+        return QRectF();
+    }
+    return virtualActive ? store.boundingRect() : itemsBoundingRect();
+}
+
+const CyberiadaSMGeometryStore& CyberiadaSMEditorScene::geometryStore()
+{
+    if (storeDirty && currentSM) {
+        store.build(currentSM);
+        storeDirty = false;
+    }
+    return store;
+}
 
-            addItemsRecursively(NULL, currentSM);
-            views().first()->fitInView(itemsBoundingRect(), Qt::KeepAspectRatio);
-            update();
+QRectF CyberiadaSMEditorScene::storeArea(const QList<Cyberiada::Element*>& elements) const
+{
+    QRectF area;
+    foreach(Cyberiada::Element* element, elements) {
+        int index = store.indexOf(element->get_id());
+        if (index >= 0 && store.isValid(index)) {
+            area |= store.rect(index);
         }
-	}
+    }
+    if (area.isNull()) {
+        return area;
+    }
+    // the attached transitions cross the rects of their ends
+    QRectF result = area;
+    foreach(int index, store.query(area)) {
+        if (store.isValid(index)) {
+            result |= store.rect(index);
+        }
+    }
+    return result;
+}
+
+QRectF CyberiadaSMEditorScene::selectionRect() const
+{
+    QRectF rect;
+    foreach(QGraphicsItem* item, selectedItems()) {
+        rect |= item->sceneBoundingRect();
+    }
+    return rect;
+}
+
+void CyberiadaSMEditorScene::buildItems()
+{
+    MY_ASSERT(currentSM);
+    store.build(currentSM);
+    storeDirty = false;
+    elementIds.clear();
+    addElementIds(currentSM);
+    emit overviewChanged(QRectF());
+    virtualActive = virtualized || store.size() >= VIRTUAL_SCENE_MIN_ELEMENTS;
+    if (virtualActive) {
+        // the view is fitted to the stored geometry, so the first pass builds the visible items only
+        if (!views().isEmpty()) {
+            views().first()->fitInView(store.boundingRect(), Qt::KeepAspectRatio);
+        }
+        updateWantedElements();
+    } else {
+        // the composite states are collapsed until the view is fitted to the machine
+        buildingItems = true;
+    }
+    addItemsRecursively(NULL, currentSM);
+    buildingItems = false;
+    rebuildTransitionIndex();
+    if (!virtualActive && !views().isEmpty()) {
+        views().first()->fitInView(itemsBoundingRect(), Qt::KeepAspectRatio);
+    }
+    updateLevelOfDetail();
+    slotUpdateTransitions();
+    update();
 }
 
 void CyberiadaSMEditorScene::addItemsRecursively(QGraphicsItem* parent, Cyberiada::ElementCollection* collection)
 {
+    SM_TRACE_SPAN("addItemsRecursively");
 	Cyberiada::ElementType parent_type = collection->get_type();
     QGraphicsItem* new_parent = parent;
 
@@ -133,72 +441,1341 @@ void CyberiadaSMEditorScene::addItemsRecursively(QGraphicsItem* parent, Cyberiad
         new_parent = new CyberiadaSMEditorSMItem(model, collection, parent);
         elementItem.insert(collection->get_id(), new_parent);
         addItem(new_parent);
-        new_parent->setSelected(true);
+        noteItemChanged(new_parent);
     }
 
-    qDebug() << "PARRENT: " << collection->get_id().c_str();
     if (collection->has_children()) {
 		const Cyberiada::ElementList& children = collection->get_children();
 		for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
-			Cyberiada::Element* child = *i;
-            Cyberiada::ElementType type = child->get_type();
-
-			switch(type) {
-            case Cyberiada::elementCompositeState: {
-                CyberiadaSMEditorStateItem* state = new CyberiadaSMEditorStateItem(this, model, child, new_parent);
-                elementItem.insert(child->get_id(), state);
-                qDebug() << "add item" << child->get_id().c_str() << "type" << type << "parent" << elementItem.key(new_parent).c_str();
-                addItemsRecursively(state, static_cast<Cyberiada::ElementCollection*>(child));
-                addItem(state);
-                break;
+            if (virtualActive && !isWanted(*i)) continue;
+            addElementItem(new_parent, *i);
+		}
+    }
+}
+
+QGraphicsItem* CyberiadaSMEditorScene::addElementItem(QGraphicsItem* parent, Cyberiada::Element* element)
+{
+    QGraphicsItem* item = NULL;
+    Cyberiada::ElementType type = element->get_type();
+
+    switch(type) {
+    case Cyberiada::elementCompositeState:
+    case Cyberiada::elementSimpleState:
+        item = takePooledItem(CyberiadaSMEditorAbstractItem::StateItem, element, parent);
+        if (!item) {
+            item = new CyberiadaSMEditorStateItem(this, model, element, parent);
+        }
+        break;
+    case Cyberiada::elementInitial:
+    case Cyberiada::elementFinal:
+    case Cyberiada::elementTerminate:
+        item = takePooledItem(CyberiadaSMEditorAbstractItem::VertexItem, element, parent);
+        if (!item) {
+            item = new CyberiadaSMEditorVertexItem(model, element, parent);
+        }
+        break;
+    case Cyberiada::elementChoice:
+        item = takePooledItem(CyberiadaSMEditorAbstractItem::ChoiceItem, element, parent);
+        if (!item) {
+            item = new CyberiadaSMEditorChoiceItem(model, element, parent);
+        }
+        break;
+    case Cyberiada::elementComment:
+    case Cyberiada::elementFormalComment:
+        item = takePooledItem(CyberiadaSMEditorAbstractItem::CommentItem, element, parent);
+        if (!item) {
+            item = new CyberiadaSMEditorCommentItem(this, model, element, parent, &elementItem);
+        }
+        break;
+    case Cyberiada::elementTransition:
+        item = takePooledItem(CyberiadaSMEditorAbstractItem::TransitionItem, element, NULL);
+        if (!item) {
+            item = new CyberiadaSMEditorTransitionItem(this, model, element, NULL, &elementItem, &elementIds);
+        }
+        break;
+    default:
+        MY_ASSERT(false);
+    }
+
+    if (!item) {
+        return NULL;
+    }
+    elementItem.insert(element->get_id(), item);
+    noteItemChanged(item);
+    if (type == Cyberiada::elementTransition) {
+        staleTransitions.insert(static_cast<CyberiadaSMEditorTransitionItem*>(item));
+    } else {
+        // the transitions drawn to an ancestor of the element now end at its item
+        foreach(CyberiadaSMEditorTransitionItem* transition, hiddenEnds.values(element->get_id())) {
+            staleTransitions.insert(transition);
+        }
+    }
+    // the child items join the scene together with their parent
+    if (!item->parentItem()) {
+        addItem(item);
+    }
+
+    if (type == Cyberiada::elementCompositeState) {
+        CyberiadaSMEditorStateItem* state = static_cast<CyberiadaSMEditorStateItem*>(item);
+        if (shouldExpand(state, false)) {
+            addItemsRecursively(item, static_cast<Cyberiada::ElementCollection*>(element));
+        } else {
+            state->setExpanded(false);
+        }
+    }
+    return item;
+}
+
+void CyberiadaSMEditorScene::removeElementItem(Cyberiada::Element* element)
+{
+    QGraphicsItem* item = elementItem.value(element->get_id());
+    if (!item) {
+        return;
+    }
+
+    QList<QGraphicsItem*> removed;
+    QSet<QGraphicsItem*> removed_set;
+    QList<Cyberiada::Element*> elements;
+    elements.append(element);
+    while (!elements.isEmpty()) {
+        Cyberiada::Element* e = elements.takeLast();
+        QGraphicsItem* i = elementItem.take(e->get_id());
+        if (i) {
+            removed.append(i);
+            removed_set.insert(i);
+        }
+        Cyberiada::ElementType type = e->get_type();
+        if (type == Cyberiada::elementCompositeState || type == Cyberiada::elementSM) {
+            Cyberiada::ElementCollection* collection = static_cast<Cyberiada::ElementCollection*>(e);
+            if (collection->has_children()) {
+                const Cyberiada::ElementList& children = collection->get_children();
+                for (Cyberiada::ElementList::const_iterator c = children.begin(); c != children.end(); c++) {
+                    elements.append(*c);
+                }
             }
-            case Cyberiada::elementSimpleState: {
-                CyberiadaSMEditorStateItem* state = new CyberiadaSMEditorStateItem(this, model, child, new_parent);
-                elementItem.insert(child->get_id(), state);
-                addItem(state);
-                qDebug() << "add item" << child->get_id().c_str() << "type" << type << "parent" << elementItem.key(new_parent).c_str();
-				break;
+        }
+    }
+
+    foreach(QGraphicsItem* i, removed) {
+        if (i->type() == CyberiadaSMEditorAbstractItem::TransitionItem) {
+            CyberiadaSMEditorTransitionItem* transition = static_cast<CyberiadaSMEditorTransitionItem*>(i);
+            unindexTransition(transition);
+            CyberiadaSMEditorBundleItem* bundle = transitionBundle.take(transition);
+            if (bundle) {
+                bundle->removeTransition(transition);
+            }
+        } else {
+            // the transitions of the removed vertex lose their end and are drawn to an ancestor
+            foreach(CyberiadaSMEditorTransitionItem* transition, transitionIndex.take(i)) {
+                dirtyTransitions.insert(transition);
+                staleTransitions.insert(transition);
             }
-            case Cyberiada::elementInitial: {
-                CyberiadaSMEditorVertexItem* initial = new CyberiadaSMEditorVertexItem(model, child, new_parent);
-                elementItem.insert(child->get_id(), initial);
-                addItem(initial);
-                qDebug() << "add item" << child->get_id().c_str() << "type" << type << "parent" << elementItem.key(new_parent).c_str();
+        }
+        dragItems.remove(i);
+        forgetCachedItem(i);
+    }
+    // the bundles of the removed ends go at once, the rest is regrouped later
+    for (QMap<BundleKey, CyberiadaSMEditorBundleItem*>::iterator b = bundles.begin();
+         b != bundles.end();) {
+        CyberiadaSMEditorBundleItem* bundle = b.value();
+        if (removed_set.contains(bundle->sourceItem()) || removed_set.contains(bundle->targetItem())) {
+            foreach(CyberiadaSMEditorTransitionItem* transition, bundle->transitions()) {
+                transitionBundle.remove(transition);
+            }
+            removeItem(bundle);
+            delete bundle;
+            b = bundles.erase(b);
+        } else {
+            b++;
+        }
+    }
+    if (virtualActive) {
+        // every item goes to the pool on its own, so the nested ones are detached first
+        foreach(QGraphicsItem* i, removed) {
+            i->setParentItem(NULL);
+            if (i->scene() == this) {
+                removeItem(i);
+            }
+            recycleItem(i);
+        }
+    } else {
+        // the nested items are deleted by their parents; the transitions are top-level items
+        foreach(QGraphicsItem* i, removed) {
+            if (i == item || !i->parentItem()) {
+                removeItem(i);
+                delete i;
+            }
+        }
+    }
+    scheduleTransitionsUpdate();
+}
+
+void CyberiadaSMEditorScene::slotRowsInserted(const QModelIndex& parent, int first, int last)
+{
+    if (!currentSM) {
+        return;
+    }
+    storeDirty = true;
+    emit overviewChanged(QRectF());
+    Cyberiada::Element* parent_element = model->indexToElement(parent);
+    if (!parent_element || parent_element->is_root()) {
+        return;
+    }
+    for (int row = first; row <= last; row++) {
+        addElementIds(model->indexToElement(model->index(row, 0, parent)));
+    }
+    QGraphicsItem* parent_item = elementItem.value(parent_element->get_id());
+    if (!parent_item) {
+        // the element does not belong to the state machine on the scene
+        return;
+    }
+    if (parent_item->type() == CyberiadaSMEditorAbstractItem::StateItem &&
+        !static_cast<CyberiadaSMEditorStateItem*>(parent_item)->isExpanded()) {
+        // the new children appear when the composite state is expanded
+        return;
+    }
+    for (int row = first; row <= last; row++) {
+        Cyberiada::Element* element = model->indexToElement(model->index(row, 0, parent));
+        MY_ASSERT(element);
+        addElementItem(parent_item, element);
+    }
+    updateTransitionIndex();
+    scheduleTransitionsUpdate();
+}
+
+void CyberiadaSMEditorScene::slotRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last)
+{
+    if (!currentSM) {
+        return;
+    }
+    storeDirty = true;
+    emit overviewChanged(QRectF());
+    for (int row = first; row <= last; row++) {
+        Cyberiada::Element* element = model->indexToElement(model->index(row, 0, parent));
+        if (!element) continue;
+        if (element == currentSM) {
+            showStateMachine(NULL);
+            return;
+        }
+        removeElementItem(element);
+        removeElementIds(element);
+    }
+}
+
+void CyberiadaSMEditorScene::beginDrag(const QPointF& scenePos)
+{
+    dragItems.clear();
+    dragStart = scenePos;
+    dragGesture = CyberiadaSMMoveCommand::newGesture();
+
+    QList<QGraphicsItem*> items = selectedItems();
+    foreach(QGraphicsItem* item, items) {
+        int type = item->type();
+        if (type != CyberiadaSMEditorAbstractItem::StateItem &&
+            type != CyberiadaSMEditorAbstractItem::CommentItem &&
+            type != CyberiadaSMEditorAbstractItem::VertexItem &&
+            type != CyberiadaSMEditorAbstractItem::ChoiceItem) {
+            continue;
+        }
+        // the children follow their selected ancestor
+        bool ancestor_selected = false;
+        for (QGraphicsItem* p = item->parentItem(); p; p = p->parentItem()) {
+            if (p->isSelected()) {
+                ancestor_selected = true;
                 break;
             }
-            case Cyberiada::elementFinal: {
-                CyberiadaSMEditorVertexItem* final = new CyberiadaSMEditorVertexItem(model, child, new_parent);
-                elementItem.insert(child->get_id(), final);
-                addItem(final);
-                qDebug() << "add item" << child->get_id().c_str() << "type" << type << "parent" << elementItem.key(new_parent).c_str();
+        }
+        if (!ancestor_selected) {
+            dragItems.insert(item, item->pos());
+            noteItemChanged(item);
+        }
+    }
+}
+
+void CyberiadaSMEditorScene::dragTo(const QPointF& scenePos)
+{
+    if (dragItems.isEmpty()) {
+        return;
+    }
+    QPointF delta = scenePos - dragStart;
+    for (QMap<QGraphicsItem*, QPointF>::const_iterator i = dragItems.begin(); i != dragItems.end(); i++) {
+        i.key()->setPos(i.value() + delta);
+    }
+}
+
+void CyberiadaSMEditorScene::endDrag()
+{
+    if (dragItems.isEmpty()) {
+        return;
+    }
+    QList<Cyberiada::Element*> elements;
+    QPointF delta = dragItems.begin().key()->pos() - dragItems.begin().value();
+    for (QMap<QGraphicsItem*, QPointF>::const_iterator i = dragItems.begin(); i != dragItems.end(); i++) {
+        elements.append(static_cast<CyberiadaSMEditorAbstractItem*>(i.key())->getElement());
+    }
+    dragItems.clear();
+
+    transitionsTimer->stop();
+    slotUpdateTransitions();
+
+    // the geometry of the moved elements and their transitions is committed as a single command
+    if (autoRouting) {
+        // the new routes are undone together with the move
+        model->undoStack()->beginMacro(tr("Move"));
+        model->moveElements(elements, delta, dragGesture);
+        routeTransitionsNow();
+        model->undoStack()->endMacro();
+    } else {
+        model->moveElements(elements, delta, dragGesture);
+    }
+}
+
+void CyberiadaSMEditorScene::invalidateTransitions(QGraphicsItem* item)
+{
+    QHash<QGraphicsItem*, QList<CyberiadaSMEditorTransitionItem*> >::const_iterator i = transitionIndex.find(item);
+    if (i == transitionIndex.end() || i.value().isEmpty()) {
+        return;
+    }
+    foreach(CyberiadaSMEditorTransitionItem* transition, i.value()) {
+        dirtyTransitions.insert(transition);
+    }
+    scheduleTransitionsUpdate();
+}
+
+void CyberiadaSMEditorScene::scheduleTransitionsUpdate()
+{
+    if (!transitionsTimer->isActive()) {
+        transitionsTimer->start();
+    }
+}
+
+void CyberiadaSMEditorScene::slotUpdateTransitions()
+{
+    updateTransitionIndex();
+    if (!dirtyBundles.empty()) {
+        rebuildBundles();
+    }
+    QSet<CyberiadaSMEditorTransitionItem*> transitions;
+    transitions.swap(dirtyTransitions);
+    QSet<CyberiadaSMEditorBundleItem*> dirty_bundles;
+    foreach(CyberiadaSMEditorTransitionItem* transition, transitions) {
+        // the collapsed bundle draws its transitions with a single path
+        CyberiadaSMEditorBundleItem* bundle = transitionBundle.value(transition);
+        if (bundle && !bundle->isExpanded()) {
+            dirty_bundles.insert(bundle);
+            continue;
+        }
+        transition->updatePath();
+    }
+    foreach(CyberiadaSMEditorBundleItem* bundle, dirty_bundles) {
+        bundle->updatePath();
+    }
+}
+
+void CyberiadaSMEditorScene::rebuildBundles()
+{
+    // only the pairs of ends that gained or lost a transition are regrouped
+    std::set<BundleKey> keys;
+    keys.swap(dirtyBundles);
+    for (std::set<BundleKey>::const_iterator k = keys.begin(); k != keys.end(); k++) {
+        rebuildBundle(*k);
+    }
+}
+
+void CyberiadaSMEditorScene::rebuildBundle(const BundleKey& key)
+{
+    // the transitions between the pair are found in the index of the source
+    QGraphicsItem* source = elementItem.value(key.first);
+    QGraphicsItem* target = elementItem.value(key.second);
+    QList<CyberiadaSMEditorTransitionItem*> group;
+    if (source && target) {
+        foreach(CyberiadaSMEditorTransitionItem* transition, transitionIndex.value(source)) {
+            if (transition->sourceItem() == source && transition->targetItem() == target) {
+                group.append(transition);
+            }
+        }
+        std::sort(group.begin(), group.end(),
+                  [](CyberiadaSMEditorTransitionItem* a, CyberiadaSMEditorTransitionItem* b) {
+                      return a->getElement()->get_id() < b->getElement()->get_id();
+                  });
+    }
+
+    QList<CyberiadaSMEditorTransitionItem*> single;
+    CyberiadaSMEditorBundleItem* bundle = bundles.take(key);
+    if (bundle) {
+        // the transitions reconnected elsewhere leave the bundle unless another one took them
+        foreach(CyberiadaSMEditorTransitionItem* transition, bundle->transitions()) {
+            if (transitionBundle.value(transition) != bundle) continue;
+            transitionBundle.remove(transition);
+            if (!group.contains(transition)) {
+                single.append(transition);
+            }
+        }
+    }
+    if (source == target || group.size() < BUNDLE_MIN_TRANSITIONS) {
+        single.append(group);
+        if (bundle) {
+            removeItem(bundle);
+            delete bundle;
+        }
+    } else {
+        // the existing bundle keeps its expansion
+        if (!bundle) {
+            bundle = new CyberiadaSMEditorBundleItem();
+            addItem(bundle);
+        }
+        bundle->setTransitions(source, target, group);
+        bundles.insert(key, bundle);
+        foreach(CyberiadaSMEditorTransitionItem* transition, group) {
+            transitionBundle.insert(transition, bundle);
+            if (!bundle->isExpanded()) {
+                dirtyLabels.remove(transition);
+                labelPlacer.remove(transition);
+            }
+        }
+    }
+
+    foreach(CyberiadaSMEditorTransitionItem* transition, single) {
+        bool hidden = !transition->isVisible();
+        transition->setVisible(true);
+        if (transition->bundleOffset() != 0) {
+            transition->setBundleOffset(0);
+        } else if (hidden) {
+            transition->updatePath();
+        }
+    }
+}
+
+void CyberiadaSMEditorScene::expandBundle(CyberiadaSMEditorBundleItem* bundle)
+{
+    MY_ASSERT(bundle);
+    if (!bundle->isExpanded()) {
+        bundle->setExpanded(true);
+    }
+}
+
+void CyberiadaSMEditorScene::collapseBundles()
+{
+    foreach(CyberiadaSMEditorBundleItem* bundle, bundles) {
+        if (!bundle->isExpanded()) continue;
+        foreach(CyberiadaSMEditorTransitionItem* transition, bundle->transitions()) {
+            transition->setSelected(false);
+            dirtyLabels.remove(transition);
+            labelPlacer.remove(transition);
+        }
+        bundle->setExpanded(false);
+        bundle->updatePath();
+    }
+}
+
+void CyberiadaSMEditorScene::setCachePolicy(bool enabled, int stableFrames)
+{
+    MY_ASSERT(stableFrames > 0);
+    cacheStableFrames = stableFrames;
+    setCachingEnabled(enabled);
+}
+
+void CyberiadaSMEditorScene::setCachingEnabled(bool on)
+{
+    if (cachingEnabled == on) {
+        return;
+    }
+    cachingEnabled = on;
+    if (!on) {
+        uncacheItems();
+    }
+}
+
+void CyberiadaSMEditorScene::noteItemChanged(QGraphicsItem* item)
+{
+    int type = item->type();
+    if (type != CyberiadaSMEditorAbstractItem::SMItem &&
+        type != CyberiadaSMEditorAbstractItem::StateItem &&
+        type != CyberiadaSMEditorAbstractItem::CommentItem) {
+        return;
+    }
+    // the changing item would render its cache on every frame
+    if (cachedItems.remove(item)) {
+        item->setCacheMode(QGraphicsItem::NoCache);
+        cacheDemotions++;
+    }
+    cacheCandidates.insert(item, frameNumber);
+}
+
+void CyberiadaSMEditorScene::forgetCachedItem(QGraphicsItem* item)
+{
+    cacheCandidates.remove(item);
+    if (cachedItems.remove(item)) {
+        item->setCacheMode(QGraphicsItem::NoCache);
+    }
+}
+
+void CyberiadaSMEditorScene::uncacheItems()
+{
+    foreach(QGraphicsItem* item, cachedItems) {
+        item->setCacheMode(QGraphicsItem::NoCache);
+        cacheCandidates.insert(item, frameNumber);
+        cacheDemotions++;
+    }
+    cachedItems.clear();
+}
+
+void CyberiadaSMEditorScene::slotZoomChanged()
+{
+    // the device cache is rendered again on every scale, so it waits for the zoom to settle
+    uncacheItems();
+    for (QHash<QGraphicsItem*, qint64>::iterator i = cacheCandidates.begin(); i != cacheCandidates.end(); i++) {
+        i.value() = frameNumber;
+    }
+}
+
+void CyberiadaSMEditorScene::slotFramePainted(qint64 nsecs)
+{
+    frameNumber++;
+    if (cachedItems.isEmpty()) {
+        uncachedFramesTime += nsecs;
+        uncachedFrames++;
+    } else {
+        cachedFramesTime += nsecs;
+        cachedFrames++;
+    }
+    if (!cachingEnabled || isDragging()) {
+        return;
+    }
+    // the device cache would be rendered again at every step of the zoom animation
+    foreach(QGraphicsView* view, views()) {
+        CyberiadaSMGraphicsView* sm_view = qobject_cast<CyberiadaSMGraphicsView*>(view);
+        if (sm_view && sm_view->isZooming()) {
+            return;
+        }
+    }
+    for (QHash<QGraphicsItem*, qint64>::iterator i = cacheCandidates.begin(); i != cacheCandidates.end();) {
+        if (frameNumber - i.value() < cacheStableFrames) {
+            i++;
+            continue;
+        }
+        i.key()->setCacheMode(QGraphicsItem::DeviceCoordinateCache);
+        cachedItems.insert(i.key());
+        cachePromotions++;
+        i = cacheCandidates.erase(i);
+    }
+}
+
+CyberiadaSMEditorScene::CacheStatistics CyberiadaSMEditorScene::cacheStatistics() const
+{
+    CacheStatistics stats;
+    stats.cachedItems = cachedItems.size();
+    stats.uncachedItems = cacheCandidates.size();
+    stats.promotions = cachePromotions;
+    stats.demotions = cacheDemotions;
+    stats.cachedFrameMs = cachedFrames > 0 ? cachedFramesTime / 1e6 / cachedFrames : 0;
+    stats.uncachedFrameMs = uncachedFrames > 0 ? uncachedFramesTime / 1e6 / uncachedFrames : 0;
+    return stats;
+}
+
+void CyberiadaSMEditorScene::resetCacheStatistics()
+{
+    cachePromotions = 0;
+    cacheDemotions = 0;
+    cachedFramesTime = 0;
+    cachedFrames = 0;
+    uncachedFramesTime = 0;
+    uncachedFrames = 0;
+}
+
+void CyberiadaSMEditorScene::slotMetricsChanged()
+{
+    // the texts are measured again and the items lay them out anew
+    for (QMap<Cyberiada::ID, QGraphicsItem*>::const_iterator i = elementItem.begin(); i != elementItem.end(); i++) {
+        static_cast<CyberiadaSMEditorAbstractItem*>(i.value())->syncFromModel();
+    }
+}
+
+void CyberiadaSMEditorScene::scheduleLabelPlacement(CyberiadaSMEditorTransitionItem* transition)
+{
+    dirtyLabels.insert(transition);
+    if (!labelsTimer->isActive()) {
+        labelsTimer->start();
+    }
+}
+
+void CyberiadaSMEditorScene::slotPlaceLabels()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // the larger labels are harder to fit, so they choose first
+    QList<CyberiadaSMEditorTransitionItem*> labels = dirtyLabels.values();
+    dirtyLabels.clear();
+    std::sort(labels.begin(), labels.end(),
+              [](CyberiadaSMEditorTransitionItem* a, CyberiadaSMEditorTransitionItem* b) {
+                  QSizeF sa = a->labelSize(), sb = b->labelSize();
+                  return sa.width() * sa.height() > sb.width() * sb.height();
+              });
+
+    for (int i = 0; i < labels.size(); i++) {
+        if (timer.elapsed() >= LABEL_PLACEMENT_BUDGET) {
+            for (int j = i; j < labels.size(); j++) {
+                dirtyLabels.insert(labels[j]);
+            }
+            labelsTimer->start();
+            break;
+        }
+        CyberiadaSMEditorTransitionItem* transition = labels[i];
+        QSizeF size = transition->labelSize();
+        if (size.isEmpty() || !transition->isVisible()) {
+            labelPlacer.remove(transition);
+            continue;
+        }
+        QVector<QPointF> candidates = transition->labelCandidates();
+        QRectF area;
+        foreach(const QPointF& c, candidates) {
+            area |= QRectF(c, size);
+        }
+
+        // the obstacles come from the scene index; the common ancestors of
+        // the transition ends contain the label anyway
+        QGraphicsItem* source = transition->sourceItem();
+        QGraphicsItem* target = transition->targetItem();
+        QVector<QRectF> obstacles;
+        QVector<QLineF> lines;
+        foreach(QGraphicsItem* item, items(area, Qt::IntersectsItemBoundingRect)) {
+            switch (item->type()) {
+            case CyberiadaSMEditorAbstractItem::StateItem:
+            case CyberiadaSMEditorAbstractItem::CompositeStateItem:
+            case CyberiadaSMEditorAbstractItem::CommentItem:
+            case CyberiadaSMEditorAbstractItem::VertexItem:
+            case CyberiadaSMEditorAbstractItem::ChoiceItem:
+                if ((item == source || item->isAncestorOf(source)) &&
+                    (item == target || item->isAncestorOf(target))) {
+                    continue;
+                }
+                obstacles.append(item->sceneBoundingRect());
+                break;
+            case CyberiadaSMEditorAbstractItem::TransitionItem: {
+                if (item == transition) continue;
+                // the curves and the subpath breaks are flattened into the polylines
+                QPainterPath path = static_cast<CyberiadaSMEditorTransitionItem*>(item)->path();
+                foreach(const QPolygonF& polyline, path.toSubpathPolygons(item->sceneTransform())) {
+                    for (int k = 1; k < polyline.size(); k++) {
+                        lines.append(QLineF(polyline[k - 1], polyline[k]));
+                    }
+                }
                 break;
             }
-			case Cyberiada::elementTerminate:
-                // new CyberiadaSMEditorVertexItem(model, child, new_parent);
-				break;
-			case Cyberiada::elementChoice:
-                // new CyberiadaSMEditorChoiceItem(model, child, new_parent);
-				break;
-			case Cyberiada::elementComment:
-            case Cyberiada::elementFormalComment: {
-                // CyberiadaSMEditorCommentItem* formalComment = new CyberiadaSMEditorCommentItem(this, model, child, new_parent, &elementItem);
-                // elementItem.insert(child->get_id(), formalComment);
-                // addItem(formalComment);
-                // qDebug() << "add item" << child->get_id().c_str() << "type" << type << "parent" << elementItem.key(new_parent).c_str();
+            default:
                 break;
             }
-            case Cyberiada::elementTransition: {
-                CyberiadaSMEditorTransitionItem* transition = new CyberiadaSMEditorTransitionItem(this, model, child, NULL, &elementItem);
-                elementItem.insert(child->get_id(), transition);
-                addItem(transition);
-                qDebug() << "add item" << child->get_id().c_str() << "type" << type << "parent" << elementItem.key(new_parent).c_str();
+        }
+        transition->setLabelCandidate(labelPlacer.place(transition, candidates, size, obstacles, lines));
+    }
+}
+
+void CyberiadaSMEditorScene::indexTransition(CyberiadaSMEditorTransitionItem* transition)
+{
+    // register the transition at both ends and at all their ancestors, so moving
+    // a composite state reaches the transitions of its nested elements
+    // the ends without items are remembered, their items move the transition
+    QSet<QGraphicsItem*> owners;
+    QList<Cyberiada::ID> hidden;
+    const Cyberiada::Transition* t = static_cast<const Cyberiada::Transition*>(transition->getElement());
+    QGraphicsItem* ends[2] = {
+        CyberiadaSMEditorTransitionItem::visibleItem(t->source_element_id(), elementItem, elementIds, &hidden),
+        CyberiadaSMEditorTransitionItem::visibleItem(t->target_element_id(), elementItem, elementIds, &hidden)
+    };
+    for (int i = 0; i < 2; i++) {
+        for (QGraphicsItem* item = ends[i]; item; item = item->parentItem()) {
+            owners.insert(item);
+        }
+    }
+    foreach(QGraphicsItem* item, owners) {
+        transitionIndex[item].append(transition);
+    }
+    transitionOwners.insert(transition, owners.values());
+    foreach(const Cyberiada::ID& id, hidden) {
+        hiddenEnds.insert(id, transition);
+    }
+    transitionHidden.insert(transition, hidden);
+    dirtyTransitions.insert(transition);
+    if (ends[0] && ends[1]) {
+        BundleKey key(static_cast<CyberiadaSMEditorAbstractItem*>(ends[0])->getElement()->get_id(),
+                      static_cast<CyberiadaSMEditorAbstractItem*>(ends[1])->getElement()->get_id());
+        transitionBundleKey.insert(transition, key);
+        dirtyBundles.insert(key);
+    }
+}
+
+void CyberiadaSMEditorScene::unindexTransition(CyberiadaSMEditorTransitionItem* transition)
+{
+    // only the lists of the ends and their ancestors known at the indexing hold the transition
+    foreach(QGraphicsItem* item, transitionOwners.take(transition)) {
+        QHash<QGraphicsItem*, QList<CyberiadaSMEditorTransitionItem*> >::iterator i = transitionIndex.find(item);
+        if (i == transitionIndex.end()) continue;
+        i.value().removeOne(transition);
+        if (i.value().isEmpty()) {
+            transitionIndex.erase(i);
+        }
+    }
+    foreach(const Cyberiada::ID& id, transitionHidden.take(transition)) {
+        hiddenEnds.remove(id, transition);
+    }
+    staleTransitions.remove(transition);
+    dirtyTransitions.remove(transition);
+    dirtyLabels.remove(transition);
+    labelPlacer.remove(transition);
+    // the bundle of the former ends is regrouped without the transition
+    QHash<CyberiadaSMEditorTransitionItem*, BundleKey>::iterator key = transitionBundleKey.find(transition);
+    if (key != transitionBundleKey.end()) {
+        dirtyBundles.insert(key.value());
+        transitionBundleKey.erase(key);
+    }
+}
+
+void CyberiadaSMEditorScene::rebuildTransitionIndex()
+{
+    transitionIndex.clear();
+    transitionOwners.clear();
+    dirtyTransitions.clear();
+    hiddenEnds.clear();
+    transitionHidden.clear();
+    staleTransitions.clear();
+    foreach(const BundleKey& key, transitionBundleKey) {
+        dirtyBundles.insert(key);
+    }
+    transitionBundleKey.clear();
+    for (QMap<Cyberiada::ID, QGraphicsItem*>::const_iterator i = elementItem.begin(); i != elementItem.end(); i++) {
+        if (i.value()->type() == CyberiadaSMEditorAbstractItem::TransitionItem) {
+            indexTransition(static_cast<CyberiadaSMEditorTransitionItem*>(i.value()));
+        }
+    }
+}
+
+void CyberiadaSMEditorScene::updateTransitionIndex()
+{
+    // only the transitions whose ends got or lost their items are indexed again
+    QSet<CyberiadaSMEditorTransitionItem*> stale;
+    stale.swap(staleTransitions);
+    foreach(CyberiadaSMEditorTransitionItem* transition, stale) {
+        unindexTransition(transition);
+        indexTransition(transition);
+    }
+}
+
+void CyberiadaSMEditorScene::addElementIds(const Cyberiada::Element* element)
+{
+    elementIds.insert(element->get_id(), element);
+    Cyberiada::ElementType type = element->get_type();
+    if (type == Cyberiada::elementCompositeState || type == Cyberiada::elementSM) {
+        const Cyberiada::ElementCollection* collection = static_cast<const Cyberiada::ElementCollection*>(element);
+        if (collection->has_children()) {
+            const Cyberiada::ElementList& children = collection->get_children();
+            for (Cyberiada::ElementList::const_iterator c = children.begin(); c != children.end(); c++) {
+                addElementIds(*c);
+            }
+        }
+    }
+}
+
+void CyberiadaSMEditorScene::removeElementIds(const Cyberiada::Element* element)
+{
+    elementIds.remove(element->get_id());
+    Cyberiada::ElementType type = element->get_type();
+    if (type == Cyberiada::elementCompositeState || type == Cyberiada::elementSM) {
+        const Cyberiada::ElementCollection* collection = static_cast<const Cyberiada::ElementCollection*>(element);
+        if (collection->has_children()) {
+            const Cyberiada::ElementList& children = collection->get_children();
+            for (Cyberiada::ElementList::const_iterator c = children.begin(); c != children.end(); c++) {
+                removeElementIds(*c);
+            }
+        }
+    }
+}
+
+void CyberiadaSMEditorScene::scheduleLevelOfDetail()
+{
+    if (currentSM && !levelOfDetailTimer->isActive()) {
+        levelOfDetailTimer->start();
+    }
+}
+
+bool CyberiadaSMEditorScene::shouldExpand(CyberiadaSMEditorStateItem* item, bool expanded) const
+{
+    QMap<Cyberiada::ID, bool>::const_iterator user = userExpansion.find(item->getElement()->get_id());
+    if (user != userExpansion.end()) {
+        return user.value();
+    }
+    if (views().isEmpty()) {
+        // nothing to save without a view
+        return true;
+    }
+    if (buildingItems) {
+        return false;
+    }
+    QGraphicsView* view = views().first();
+    QRectF visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+    QRectF r = item->sceneBoundingRect();
+    qreal pixels = qMin(r.width(), r.height()) * view->transform().m11();
+    qreal margin = expanded ? COLLAPSE_VIEWPORT_MARGIN : EXPAND_VIEWPORT_MARGIN;
+    visible.adjust(-visible.width() * margin, -visible.height() * margin,
+                   visible.width() * margin, visible.height() * margin);
+    return pixels >= (expanded ? COLLAPSE_MIN_PIXELS : EXPAND_MIN_PIXELS) && visible.intersects(r);
+}
+
+void CyberiadaSMEditorScene::expandComposite(CyberiadaSMEditorStateItem* item)
+{
+    if (item->isExpanded()) {
+        return;
+    }
+    item->setExpanded(true);
+    addItemsRecursively(item, static_cast<Cyberiada::ElementCollection*>(item->getElement()));
+}
+
+void CyberiadaSMEditorScene::collapseComposite(CyberiadaSMEditorStateItem* item)
+{
+    if (!item->isExpanded()) {
+        return;
+    }
+    Cyberiada::ElementCollection* collection = static_cast<Cyberiada::ElementCollection*>(item->getElement());
+    if (collection->has_children()) {
+        const Cyberiada::ElementList& children = collection->get_children();
+        for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+            removeElementItem(*i);
+        }
+    }
+    item->setExpanded(false);
+}
+
+void CyberiadaSMEditorScene::toggleComposite(CyberiadaSMEditorStateItem* item)
+{
+    bool expand = !item->isExpanded();
+    userExpansion.insert(item->getElement()->get_id(), expand);
+    if (expand) {
+        expandComposite(item);
+    } else {
+        collapseComposite(item);
+    }
+    updateTransitionIndex();
+    scheduleTransitionsUpdate();
+}
+
+void CyberiadaSMEditorScene::revealElement(Cyberiada::Element* element)
+{
+    // expand the collapsed ancestors starting from the outermost one
+    QList<Cyberiada::Element*> ancestors;
+    for (Cyberiada::Element* e = element->get_parent(); e && e->get_type() == Cyberiada::elementCompositeState;
+         e = e->get_parent()) {
+        ancestors.prepend(e);
+    }
+    bool changed = false;
+    foreach(Cyberiada::Element* e, ancestors) {
+        QGraphicsItem* item = elementItem.value(e->get_id());
+        if (!item) {
+            break;
+        }
+        CyberiadaSMEditorStateItem* state = static_cast<CyberiadaSMEditorStateItem*>(item);
+        if (!state->isExpanded()) {
+            expandComposite(state);
+            changed = true;
+        }
+    }
+    if (changed) {
+        updateTransitionIndex();
+        scheduleTransitionsUpdate();
+    }
+}
+
+void CyberiadaSMEditorScene::updateLevelOfDetail()
+{
+    if (!currentSM || isDragging() || toolActive || mouseGrabberItem()) {
+        return;
+    }
+    bool changed = false;
+    if (virtualActive) {
+        changed = updateVirtualization();
+    }
+
+    QList<Cyberiada::ID> composites;
+    for (QMap<Cyberiada::ID, QGraphicsItem*>::const_iterator i = elementItem.begin(); i != elementItem.end(); i++) {
+        if (i.value()->type() == CyberiadaSMEditorAbstractItem::StateItem &&
+            static_cast<CyberiadaSMEditorStateItem*>(i.value())->isComposite()) {
+            composites.append(i.key());
+        }
+    }
+
+    QList<QGraphicsItem*> selected = selectedItems();
+    foreach(const Cyberiada::ID& id, composites) {
+        // the item might be removed together with a collapsed ancestor
+        QGraphicsItem* item = elementItem.value(id);
+        if (!item) continue;
+        CyberiadaSMEditorStateItem* state = static_cast<CyberiadaSMEditorStateItem*>(item);
+        bool expanded = state->isExpanded();
+        if (shouldExpand(state, expanded) == expanded) continue;
+        if (expanded) {
+            // keep the selected items alive
+            bool has_selected = false;
+            foreach(QGraphicsItem* s, selected) {
+                if (state->isAncestorOf(s)) {
+                    has_selected = true;
+                    break;
+                }
+            }
+            if (has_selected) continue;
+            collapseComposite(state);
+        } else {
+            // the new nested composites are checked on creation
+            expandComposite(state);
+        }
+        changed = true;
+    }
+    if (changed) {
+        updateTransitionIndex();
+        scheduleTransitionsUpdate();
+    }
+}
+
+void CyberiadaSMEditorScene::setVirtualized(bool on)
+{
+    if (virtualized == on) {
+        return;
+    }
+    virtualized = on;
+    // rebuild the items of the current machine in the new mode
+    Cyberiada::StateMachine* sm = currentSM;
+    showStateMachine(NULL);
+    showStateMachine(sm);
+}
+
+void CyberiadaSMEditorScene::markWanted(int index)
+{
+    // the nested items need their parents
+    while (index >= 0 && !wanted[index]) {
+        wanted[index] = true;
+        index = store.parent(index);
+    }
+}
+
+bool CyberiadaSMEditorScene::isWanted(const Cyberiada::Element* element) const
+{
+    // the elements missing in the store are newer than the store itself
+    int index = store.indexOf(element->get_id());
+    return index < 0 || index >= wanted.size() || wanted[index];
+}
+
+void CyberiadaSMEditorScene::updateWantedElements()
+{
+    wanted.fill(views().isEmpty(), store.size());
+    if (views().isEmpty()) {
+        return;
+    }
+    QGraphicsView* view = views().first();
+    QRectF region = view->mapToScene(view->viewport()->rect()).boundingRect();
+    region.adjust(-region.width() * VIRTUAL_SCENE_MARGIN, -region.height() * VIRTUAL_SCENE_MARGIN,
+                  region.width() * VIRTUAL_SCENE_MARGIN, region.height() * VIRTUAL_SCENE_MARGIN);
+    QVector<int> found = store.query(region);
+    // the selection survives the scrolling
+    foreach(QGraphicsItem* item, selectedItems()) {
+        if (!CyberiadaSMEditorAbstractItem::isEditorItem(item)) continue;
+        int index = store.indexOf(static_cast<CyberiadaSMEditorAbstractItem*>(item)->getElement()->get_id());
+        if (index >= 0) {
+            found.append(index);
+        }
+    }
+    foreach(int index, found) {
+        markWanted(index);
+        // the transitions are drawn between the items of their ends
+        markWanted(store.source(index));
+        markWanted(store.target(index));
+    }
+}
+
+bool CyberiadaSMEditorScene::updateVirtualization()
+{
+    SM_TRACE_SPAN("updateVirtualization");
+    if (storeDirty) {
+        store.build(currentSM);
+        storeDirty = false;
+    }
+    updateWantedElements();
+
+    // the items that left the region go to the pool together with their nested items
+    QList<Cyberiada::Element*> released;
+    for (QMap<Cyberiada::ID, QGraphicsItem*>::const_iterator i = elementItem.begin(); i != elementItem.end(); i++) {
+        if (i.value()->type() == CyberiadaSMEditorAbstractItem::SMItem) continue;
+        int index = store.indexOf(i.key());
+        if (index >= 0 && !wanted[index]) {
+            released.append(static_cast<CyberiadaSMEditorAbstractItem*>(i.value())->getElement());
+        }
+    }
+    foreach(Cyberiada::Element* element, released) {
+        // does nothing if the element has gone with its parent
+        removeElementItem(element);
+    }
+
+    // the parents precede their children in the store
+    int added = 0;
+    for (int index = 1; index < store.size(); index++) {
+        if (!wanted[index]) continue;
+        Cyberiada::Element* element = store.element(index);
+        if (elementItem.contains(element->get_id())) continue;
+        QGraphicsItem* parent = elementItem.value(store.element(store.parent(index))->get_id());
+        if (!parent) continue;
+        if (parent->type() == CyberiadaSMEditorAbstractItem::StateItem &&
+            !static_cast<CyberiadaSMEditorStateItem*>(parent)->isExpanded()) {
+            continue;
+        }
+        if (addElementItem(parent, element)) {
+            added++;
+        }
+    }
+    if (!released.isEmpty() || added > 0) {
+        return true;
+    }
+    return false;
+}
+
+CyberiadaSMEditorAbstractItem* CyberiadaSMEditorScene::takePooledItem(int type, Cyberiada::Element* element,
+                                                                      QGraphicsItem* parent)
+{
+    QHash<int, QList<CyberiadaSMEditorAbstractItem*> >::iterator pool = itemPool.find(type);
+    if (pool == itemPool.end() || pool.value().isEmpty()) {
+        return NULL;
+    }
+    CyberiadaSMEditorAbstractItem* item = pool.value().takeLast();
+    item->rebind(element);
+    item->setParentItem(parent);
+    return item;
+}
+
+void CyberiadaSMEditorScene::recycleItem(QGraphicsItem* item)
+{
+    MY_ASSERT(!item->scene());
+    QList<CyberiadaSMEditorAbstractItem*>& pool = itemPool[item->type()];
+    if (item->type() == CyberiadaSMEditorAbstractItem::SMItem || pool.size() >= ITEM_POOL_LIMIT) {
+        delete item;
+        return;
+    }
+    pool.append(static_cast<CyberiadaSMEditorAbstractItem*>(item));
+}
+
+void CyberiadaSMEditorScene::clearItemPool()
+{
+    for (QHash<int, QList<CyberiadaSMEditorAbstractItem*> >::iterator i = itemPool.begin(); i != itemPool.end(); i++) {
+        qDeleteAll(i.value());
+    }
+    itemPool.clear();
+}
+
+void CyberiadaSMEditorScene::setTool(Tool tool)
+{
+    if (tool == currentTool) {
+        return;
+    }
+    cancelTool();
+    currentTool = tool;
+    emit toolChanged(int(currentTool));
+}
+
+void CyberiadaSMEditorScene::cancelTool()
+{
+    if (toolRect->scene() == this) {
+        removeItem(toolRect);
+    }
+    if (toolLine->scene() == this) {
+        removeItem(toolLine);
+    }
+    toolActive = false;
+}
+
+QPointF CyberiadaSMEditorScene::snapToGrid(const QPointF& scenePos) const
+{
+    if (!gridSnap || gridSize <= 0) {
+        return scenePos;
+    }
+    return QPointF(qRound(scenePos.x() / gridSize) * gridSize,
+                   qRound(scenePos.y() / gridSize) * gridSize);
+}
+
+CyberiadaSMEditorAbstractItem* CyberiadaSMEditorScene::vertexItemAt(const QPointF& scenePos) const
+{
+    // the topmost state or pseudostate under the point
+    QList<QGraphicsItem*> found = items(scenePos);
+    foreach(QGraphicsItem* item, found) {
+        int type = item->type();
+        if (type == CyberiadaSMEditorAbstractItem::StateItem ||
+            type == CyberiadaSMEditorAbstractItem::VertexItem ||
+            type == CyberiadaSMEditorAbstractItem::ChoiceItem) {
+            return static_cast<CyberiadaSMEditorAbstractItem*>(item);
+        }
+    }
+    return NULL;
+}
+
+Cyberiada::ElementCollection* CyberiadaSMEditorScene::collectionAt(const QPointF& scenePos,
+                                                                   QGraphicsItem** collectionItem) const
+{
+    // the innermost composite state under the point or the state machine itself
+    QList<QGraphicsItem*> found = items(scenePos);
+    foreach(QGraphicsItem* item, found) {
+        if (item->type() != CyberiadaSMEditorAbstractItem::StateItem) continue;
+        Cyberiada::Element* element = static_cast<CyberiadaSMEditorAbstractItem*>(item)->getElement();
+        if (element->get_type() == Cyberiada::elementCompositeState) {
+            *collectionItem = item;
+            return static_cast<Cyberiada::ElementCollection*>(element);
+        }
+    }
+    *collectionItem = elementItem.value(currentSM->get_id());
+    return currentSM;
+}
+
+void CyberiadaSMEditorScene::mousePressEvent(QGraphicsSceneMouseEvent* event)
+{
+    if (currentTool == toolSelect && currentSM && event->button() == Qt::LeftButton &&
+        (event->modifiers() & Qt::ShiftModifier)) {
+        // the rubber band selection runs over the geometry store, not over the items
+        cancelTool();
+        toolStart = event->scenePos();
+        toolRect->setRect(QRectF(toolStart, toolStart));
+        addItem(toolRect);
+        toolActive = true;
+        event->accept();
+        return;
+    }
+    if (currentTool == toolSelect || !currentSM || event->button() != Qt::LeftButton) {
+        QGraphicsScene::mousePressEvent(event);
+        return;
+    }
+    cancelTool();
+    toolStart = event->scenePos();
+    if (currentTool == toolTransition) {
+        if (!vertexItemAt(toolStart)) {
+            event->accept();
+            return;
+        }
+        toolLine->setLine(QLineF(toolStart, toolStart));
+        addItem(toolLine);
+    } else {
+        toolStart = snapToGrid(toolStart);
+        toolRect->setRect(QRectF(toolStart, toolStart));
+        addItem(toolRect);
+    }
+    toolActive = true;
+    event->accept();
+}
+
+void CyberiadaSMEditorScene::mouseMoveEvent(QGraphicsSceneMouseEvent* event)
+{
+    if (!toolActive) {
+        QGraphicsScene::mouseMoveEvent(event);
+        return;
+    }
+    // only the geometry of the preview item changes during the gesture
+    if (currentTool == toolTransition) {
+        toolLine->setLine(QLineF(toolStart, event->scenePos()));
+    } else if (currentTool == toolSelect) {
+        toolRect->setRect(QRectF(toolStart, event->scenePos()).normalized());
+    } else {
+        toolRect->setRect(QRectF(toolStart, snapToGrid(event->scenePos())).normalized());
+    }
+    event->accept();
+}
+
+void CyberiadaSMEditorScene::mouseReleaseEvent(QGraphicsSceneMouseEvent* event)
+{
+    if (currentTool == toolSelect && toolActive && event->button() == Qt::LeftButton) {
+        cancelTool();
+        selectRect(QRectF(toolStart, event->scenePos()).normalized());
+        event->accept();
+        return;
+    }
+    if (currentTool == toolSelect || event->button() != Qt::LeftButton) {
+        QGraphicsScene::mouseReleaseEvent(event);
+        return;
+    }
+    if (toolActive) {
+        finishTool(event->scenePos());
+    }
+    event->accept();
+}
+
+void CyberiadaSMEditorScene::selectRect(const QRectF& rect)
+{
+    if (storeDirty) {
+        store.build(currentSM);
+        storeDirty = false;
+    }
+    QModelIndexList indexes;
+    QVector<int> found = store.contained(rect);
+    foreach(int index, found) {
+        // the elements hidden inside the collapsed states stay unselected
+        bool hidden = false;
+        for (int p = store.parent(index); p > 0; p = store.parent(p)) {
+            QGraphicsItem* item = elementItem.value(store.element(p)->get_id());
+            if (item && !static_cast<CyberiadaSMEditorStateItem*>(item)->isExpanded()) {
+                hidden = true;
                 break;
             }
-			default:
-				MY_ASSERT(false);
-			}
-		}
+        }
+        if (!hidden) {
+            indexes.append(model->elementToIndex(store.element(index)));
+        }
+    }
+    slotElementsSelected(indexes);
+    onSelectionChanged();
+}
+
+void CyberiadaSMEditorScene::finishTool(const QPointF& scenePos)
+{
+    cancelTool();
+    MY_ASSERT(currentSM);
+
+    Cyberiada::Element* element = NULL;
+    if (currentTool == toolTransition) {
+        CyberiadaSMEditorAbstractItem* source = vertexItemAt(toolStart);
+        CyberiadaSMEditorAbstractItem* target = vertexItemAt(scenePos);
+        if (source && target &&
+            source->getElement()->get_type() != Cyberiada::elementFinal &&
+            target->getElement()->get_type() != Cyberiada::elementInitial) {
+            if (autoRouting) {
+                // the new transition is undone together with its route
+                model->undoStack()->beginMacro(tr("Add transition"));
+                element = model->createTransition(source->getElement(), target->getElement());
+                if (element) {
+                    routeTransitionsNow();
+                }
+                model->undoStack()->endMacro();
+            } else {
+                element = model->createTransition(source->getElement(), target->getElement());
+            }
+        }
+    } else {
+        QRectF r = QRectF(toolStart, snapToGrid(scenePos)).normalized();
+        if (r.width() < TOOL_MIN_SIZE || r.height() < TOOL_MIN_SIZE) {
+            // a click places the element of the default size
+            if (currentTool == toolState) {
+                r = QRectF(toolStart, QSizeF(DEFAULT_STATE_WIDTH, DEFAULT_STATE_HEIGHT));
+            } else {
+                r = QRectF(toolStart, QSizeF(DEFAULT_COMMENT_WIDTH, DEFAULT_COMMENT_HEIGHT));
+            }
+        }
+        QGraphicsItem* parent_item = NULL;
+        Cyberiada::ElementCollection* parent = collectionAt(toolStart, &parent_item);
+        MY_ASSERT(parent_item);
+        if (parent_item->type() == CyberiadaSMEditorAbstractItem::StateItem &&
+            !static_cast<CyberiadaSMEditorStateItem*>(parent_item)->isExpanded()) {
+            // the new element must be visible inside its parent
+            CyberiadaSMEditorStateItem* state = static_cast<CyberiadaSMEditorStateItem*>(parent_item);
+            userExpansion.insert(parent->get_id(), true);
+            expandComposite(state);
+            updateTransitionIndex();
+        }
+        // the model keeps the center of the element in the parent coordinates
+        QPointF center = parent_item->mapFromScene(r.center());
+        Cyberiada::Rect rect(center.x(), center.y(), r.width(), r.height());
+        if (currentTool == toolState) {
+            element = model->createState(parent, rect);
+        } else {
+            element = model->createComment(parent, rect);
+        }
+    }
+
+    if (element) {
+        QGraphicsItem* item = elementItem.value(element->get_id());
+        if (item) {
+            clearSelection();
+            item->setSelected(true);
+        }
+    }
+    setTool(toolSelect);
+}
+
+void CyberiadaSMEditorScene::setAutoRouting(bool on)
+{
+    autoRouting = on;
+    if (autoRouting) {
+        routeTransitions();
+    }
+}
+
+void CyberiadaSMEditorScene::routeTransitions()
+{
+    if (!currentSM) {
+        return;
+    }
+    router->route(routingSnapshot());
+}
+
+void CyberiadaSMEditorScene::routeTransitionsNow()
+{
+    if (!currentSM) {
+        return;
+    }
+    applyRoutes(router->routeNow(routingSnapshot()));
+}
+
+CyberiadaSMRoutingSnapshot CyberiadaSMEditorScene::routingSnapshot()
+{
+    CyberiadaSMRoutingSnapshot snapshot;
+    snapshot.serial = ++routingSerial;
+    for (QMap<Cyberiada::ID, QGraphicsItem*>::const_iterator i = elementItem.begin(); i != elementItem.end(); i++) {
+        QGraphicsItem* item = i.value();
+        int type = item->type();
+        if (type == CyberiadaSMEditorAbstractItem::TransitionItem) {
+            CyberiadaSMEditorTransitionItem* transition = static_cast<CyberiadaSMEditorTransitionItem*>(item);
+            if (!transition->source() || !transition->target() || transition->source() == transition->target()) {
+                continue;
+            }
+            CyberiadaSMRouteRequest request;
+            request.id = i.key();
+            request.source = transition->source()->sceneBoundingRect();
+            request.target = transition->target()->sceneBoundingRect();
+            snapshot.transitions.append(request);
+        } else if (type != CyberiadaSMEditorAbstractItem::SMItem) {
+            CyberiadaSMRouteObstacle obstacle;
+            obstacle.id = i.key();
+            obstacle.rect = item->sceneBoundingRect();
+            snapshot.obstacles.append(obstacle);
+        }
+    }
+    return snapshot;
+}
+
+void CyberiadaSMEditorScene::slotTransitionsRouted(const CyberiadaSMRoutingResult& result)
+{
+    // the result of an older request or of another state machine
+    if (result.serial != routingSerial || !currentSM) {
+        return;
+    }
+    applyRoutes(result);
+}
+
+void CyberiadaSMEditorScene::applyRoutes(const CyberiadaSMRoutingResult& result)
+{
+    QMap<Cyberiada::ID, CyberiadaSMModel::TransitionGeometry> geometry;
+    foreach(const CyberiadaSMRoute& route, result.routes) {
+        QGraphicsItem* item = elementItem.value(route.id);
+        if (!item || item->type() != CyberiadaSMEditorAbstractItem::TransitionItem || route.points.size() < 2) {
+            continue;
+        }
+        CyberiadaSMEditorTransitionItem* transition = static_cast<CyberiadaSMEditorTransitionItem*>(item);
+        if (!transition->source() || !transition->target()) {
+            continue;
+        }
+        QRectF source = transition->source()->sceneBoundingRect();
+        QRectF target = transition->target()->sceneBoundingRect();
+        if (source != route.source || target != route.target) {
+            continue;
+        }
+        // the model keeps the ports relative to the centers and the polyline relative to the source
+        QPointF sc = source.center(), tc = target.center();
+        CyberiadaSMModel::TransitionGeometry g;
+        g.sourcePoint = Cyberiada::Point(route.points.first().x() - sc.x(), route.points.first().y() - sc.y());
+        g.targetPoint = Cyberiada::Point(route.points.last().x() - tc.x(), route.points.last().y() - tc.y());
+        for (int k = 1; k < route.points.size() - 1; k++) {
+            g.polyline.push_back(Cyberiada::Point(route.points[k].x() - sc.x(), route.points[k].y() - sc.y()));
+        }
+        geometry.insert(route.id, g);
     }
+    model->routeTransitions(geometry);
 }
 
 void CyberiadaSMEditorScene::setGridSize(int newSize)
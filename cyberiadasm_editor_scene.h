@@ -29,16 +29,28 @@
 
 #include <QGraphicsScene>
 #include <QGraphicsRectItem>
+#include <QGraphicsLineItem>
+#include <QGraphicsSceneMouseEvent>
 #include <QSet>
+#include <QHash>
 #include <QMenu>
 #include <QByteArrayList>
 #include <QList>
 #include <QGraphicsItem>
+#include <QTimer>
 #include <QDebug>
+#include <set>
 
 #include "cyberiadasm_model.h"
 #include "cyberiadasm_editor_items.h"
 #include "cyberiadasm_editor_state_item.h"
+#include "cyberiadasm_router.h"
+#include "cyberiadasm_geometry_service.h"
+#include "cyberiadasm_geometry_store.h"
+#include "cyberiadasm_label_placer.h"
+#include "cyberiadasm_editor_bundle_item.h"
+
+class CyberiadaSMEditorTransitionItem;
 
 class CyberiadaSMEditorScene: public QGraphicsScene {
 Q_OBJECT
@@ -48,7 +60,17 @@ public:
     virtual ~CyberiadaSMEditorScene();
 
 	void reset();
-	
+
+	enum Tool {
+		toolSelect = 0,
+		toolState,
+		toolTransition,
+		toolComment
+	};
+
+    void  setTool(Tool tool);
+    Tool  getTool() const { return currentTool; }
+
     void  setGridSize(int newSize);
     int   getGridSize() const { return gridSize; }
 
@@ -58,18 +80,144 @@ public:
     void  setGridPen(const QPen& gridPen);
     const QPen& getGridPen() const { return gridPen; }
 
+    // drag session
+    void  beginDrag(const QPointF& scenePos);
+    void  dragTo(const QPointF& scenePos);
+    void  endDrag();
+    bool  isDragging() const { return !dragItems.isEmpty(); }
+
+    // orthogonal routing
+    bool  isAutoRouting() const { return autoRouting; }
+
+    // transitions adjacency
+    void  invalidateTransitions(QGraphicsItem* item);
+    const QList<CyberiadaSMEditorTransitionItem*> incidentTransitions(QGraphicsItem* item) const {
+        return transitionIndex.value(item);
+    }
+
+    // lazy composite states: the explicit choice of the user overrides the zoom-based policy
+    void  toggleComposite(CyberiadaSMEditorStateItem* item);
+
+    // the label of the transition is placed again on the next pass of the event loop
+    void  scheduleLabelPlacement(CyberiadaSMEditorTransitionItem* transition);
+
+    // the transitions between the same pair of items are drawn as a bundle
+    void  expandBundle(CyberiadaSMEditorBundleItem* bundle);
+
+    // adaptive item caching: the frames that did not change for a number of
+    // painted frames are cached in the device coordinates
+    struct CacheStatistics {
+        int    cachedItems;
+        int    uncachedItems;
+        int    promotions;
+        int    demotions;
+        qreal  cachedFrameMs;     // the average frame with cached items
+        qreal  uncachedFrameMs;   // the average frame without them
+    };
+    void  setCachePolicy(bool enabled, int stableFrames);
+    bool  isCachingEnabled() const { return cachingEnabled; }
+    CacheStatistics cacheStatistics() const;
+    void  resetCacheStatistics();
+    void  noteItemChanged(QGraphicsItem* item);
+
+    // virtualized scene: only the items near the viewport exist
+    bool  isVirtualized() const { return virtualized; }
+
+    // the diagram shown and the navigation to a given place of it
+    Cyberiada::StateMachine* stateMachine() const { return currentSM; }
+    // the rect of the whole machine, including the elements that have no items now
+    QRectF machineRect() const;
+    QRectF selectionRect() const;
+    // the geometry of the whole machine for the overview
+    const CyberiadaSMGeometryStore& geometryStore();
+    void  focusElements(const QModelIndexList& indexes, const QPointF& scenePos);
+
 public slots:
 	void  slotElementSelected(const QModelIndex& index);
+	void  slotElementsSelected(const QModelIndexList& indexes);
+	void  slotElementsChanged(const QList<Cyberiada::Element*>& elements);
 	
     void  enableGrid(bool on = true);
     void  enableGridSnap(bool on = true);
     void  onSelectionChanged();
+    void  routeTransitions();
+    // routes at once, so the new routes join the command being recorded
+    void  routeTransitionsNow();
+    CyberiadaSMRoutingSnapshot routingSnapshot();
+    void  applyRoutes(const CyberiadaSMRoutingResult& result);
+    void  setAutoRouting(bool on);
+    void  scheduleLevelOfDetail();
+    void  setVirtualized(bool on);
+    void  collapseBundles();
+    void  setCachingEnabled(bool on);
+    void  slotFramePainted(qint64 nsecs);
+    void  slotZoomChanged();
+
+signals:
+	void  elementsSelected(const QModelIndexList& indexes);
+	void  toolChanged(int tool);
+	void  layoutFinished(int elements, qint64 msecs);
+	// the geometry changed in the scene rect; the null rect means the whole machine
+	void  overviewChanged(const QRectF& rect);
+
+private slots:
+    void  slotUpdateTransitions();
+    void  slotRowsInserted(const QModelIndex& parent, int first, int last);
+    void  slotRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+    void  slotTransitionsRouted(const CyberiadaSMRoutingResult& result);
+    void  slotGeometryReady(int generation, CyberiadaSMLayoutResult layout);
+    void  updateLevelOfDetail();
+    void  slotPlaceLabels();
+    void  slotMetricsChanged();
 
 protected:
     void  drawBackground(QPainter *painter, const QRectF &);
+    void  mousePressEvent(QGraphicsSceneMouseEvent* event);
+    void  mouseMoveEvent(QGraphicsSceneMouseEvent* event);
+    void  mouseReleaseEvent(QGraphicsSceneMouseEvent* event);
 	
 private:
+    void  showStateMachine(Cyberiada::StateMachine* sm);
+    void  buildItems();
     void  addItemsRecursively(QGraphicsItem* parent, Cyberiada::ElementCollection* element);
+    QGraphicsItem* addElementItem(QGraphicsItem* parent, Cyberiada::Element* element);
+    void  removeElementItem(Cyberiada::Element* element);
+    void  indexTransition(CyberiadaSMEditorTransitionItem* transition);
+    void  unindexTransition(CyberiadaSMEditorTransitionItem* transition);
+    void  rebuildTransitionIndex();
+    void  updateTransitionIndex();
+    void  addElementIds(const Cyberiada::Element* element);
+    void  removeElementIds(const Cyberiada::Element* element);
+    void  scheduleTransitionsUpdate();
+    typedef QPair<Cyberiada::ID, Cyberiada::ID> BundleKey;
+    void  rebuildBundles();
+    void  rebuildBundle(const BundleKey& key);
+    void  forgetCachedItem(QGraphicsItem* item);
+    QRectF storeArea(const QList<Cyberiada::Element*>& elements) const;
+    void  uncacheItems();
+
+    // lazy composite states
+    bool  shouldExpand(CyberiadaSMEditorStateItem* item, bool expanded) const;
+    void  expandComposite(CyberiadaSMEditorStateItem* item);
+    void  collapseComposite(CyberiadaSMEditorStateItem* item);
+    void  revealElement(Cyberiada::Element* element);
+
+    // virtualized scene
+    bool  updateVirtualization();
+    void  updateWantedElements();
+    void  markWanted(int index);
+    bool  isWanted(const Cyberiada::Element* element) const;
+    CyberiadaSMEditorAbstractItem* takePooledItem(int type, Cyberiada::Element* element, QGraphicsItem* parent);
+    void  recycleItem(QGraphicsItem* item);
+    void  clearItemPool();
+
+    // creation tools
+    void  cancelTool();
+    void  finishTool(const QPointF& scenePos);
+    void  selectRect(const QRectF& rect);
+    QPointF snapToGrid(const QPointF& scenePos) const;
+    CyberiadaSMEditorAbstractItem* vertexItemAt(const QPointF& scenePos) const;
+    Cyberiada::ElementCollection* collectionAt(const QPointF& scenePos, QGraphicsItem** collectionItem) const;
 
     CyberiadaSMModel*              model;
 	Cyberiada::StateMachine*       currentSM;
@@ -80,6 +228,74 @@ private:
     bool                           gridSnap;
     QPen                           gridPen;
 
+    QMap<QGraphicsItem*, QPointF>  dragItems;
+    QPointF                        dragStart;
+    int                            dragGesture;
+    QTimer*                        transitionsTimer;
+
+    // vertex/state item -> transitions attached to it or to any of its descendants
+    QHash<QGraphicsItem*, QList<CyberiadaSMEditorTransitionItem*> > transitionIndex;
+    // transition -> the keys it is registered under in transitionIndex
+    QHash<CyberiadaSMEditorTransitionItem*, QList<QGraphicsItem*> > transitionOwners;
+    QSet<CyberiadaSMEditorTransitionItem*> dirtyTransitions;
+    // element id -> the transitions drawn to an ancestor because the element has no item
+    QMultiMap<Cyberiada::ID, CyberiadaSMEditorTransitionItem*> hiddenEnds;
+    // transition -> the keys it is registered under in hiddenEnds
+    QHash<CyberiadaSMEditorTransitionItem*, QList<Cyberiada::ID> > transitionHidden;
+    // the transitions whose ends got or lost their items since the last indexing
+    QSet<CyberiadaSMEditorTransitionItem*> staleTransitions;
+    // the elements of the machine by id, the transition ends are resolved without the document search
+    QMap<Cyberiada::ID, const Cyberiada::Element*> elementIds;
+
+    // the preview items are created once and only added to the scene during the gesture
+    Tool                           currentTool;
+    bool                           toolActive;
+    QPointF                        toolStart;
+    QGraphicsRectItem*             toolRect;
+    QGraphicsLineItem*             toolLine;
+
+    CyberiadaSMGeometryService*    geometryService;
+    CyberiadaSMRouter*             router;
+    int                            routingSerial;
+    bool                           autoRouting;
+
+    // the children of a collapsed composite state are not materialized
+    QMap<Cyberiada::ID, bool>      userExpansion;
+    QTimer*                        levelOfDetailTimer;
+    bool                           buildingItems;
+
+    // the geometry of all elements; the items exist only for the wanted entries
+    CyberiadaSMGeometryStore       store;
+    bool                           storeDirty;
+    bool                           virtualized;
+    bool                           virtualActive;
+    QVector<bool>                  wanted;
+    QHash<int, QList<CyberiadaSMEditorAbstractItem*> > itemPool;
+
+    // transition labels
+    CyberiadaSMLabelPlacer         labelPlacer;
+    QSet<CyberiadaSMEditorTransitionItem*> dirtyLabels;
+    QTimer*                        labelsTimer;
+
+    // the bundles by the ids of the end elements
+    QMap<BundleKey, CyberiadaSMEditorBundleItem*> bundles;
+    QHash<CyberiadaSMEditorTransitionItem*, CyberiadaSMEditorBundleItem*> transitionBundle;
+    QHash<CyberiadaSMEditorTransitionItem*, BundleKey> transitionBundleKey; // the ends at the indexing
+    std::set<BundleKey>            dirtyBundles;                            // the end pairs to regroup
+
+    // adaptive item caching
+    bool                           cachingEnabled;
+    int                            cacheStableFrames;
+    qint64                         frameNumber;
+    QHash<QGraphicsItem*, qint64>  cacheCandidates; // the uncached item -> the frame of its last change
+    QSet<QGraphicsItem*>           cachedItems;
+    int                            cachePromotions;
+    int                            cacheDemotions;
+    qint64                         cachedFramesTime;
+    int                            cachedFrames;
+    qint64                         uncachedFramesTime;
+    int                            uncachedFrames;
+
 };
 
 #endif
@@ -2,6 +2,7 @@
 #include <QPainter>
 #include <QColor>
 #include "cyberiadasm_editor_sm_item.h"
+#include "cyberiadasm_profiler.h"
 #include "myassert.h"
 
 /* -----------------------------------------------------------------------------
@@ -20,6 +21,7 @@ CyberiadaSMEditorSMItem::CyberiadaSMEditorSMItem(CyberiadaSMModel* model,
 
 QRectF CyberiadaSMEditorSMItem::boundingRect() const
 {
+    SM_PROFILE_COUNT(boundingRectCall);
     MY_ASSERT(model);
     MY_ASSERT(model->rootDocument());
     QRectF rect = toQtRect(element->get_bound_rect(*(model->rootDocument())));
@@ -29,6 +31,7 @@ QRectF CyberiadaSMEditorSMItem::boundingRect() const
 
 void CyberiadaSMEditorSMItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
 {
+    SM_PROFILE_COUNT(paintSM);
     QColor color(Qt::black);
     if (isSelected()) {
         color.setRgb(255, 0, 0);
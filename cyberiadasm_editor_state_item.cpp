@@ -1,4 +1,6 @@
 #include "cyberiadasm_editor_state_item.h"
+#include "cyberiadasm_profiler.h"
+#include "cyberiadasm_painter.h"
 
 #include <QPainter>
 #include <QDebug>
@@ -7,6 +9,8 @@
 #include <QGraphicsSceneMouseEvent>
 #include <QGraphicsRectItem>
 #include <math.h>
+#include "cyberiadasm_editor_scene.h"
+#include "myassert.h"
 // #include "grabber.h"
 
 
@@ -23,6 +27,7 @@ CyberiadaSMEditorStateItem::CyberiadaSMEditorStateItem(QObject *parent_object,
     CyberiadaSMEditorAbstractItem(model, element, parent),
     QObject(parent_object)
 {
+    m_expanded = true;
     setAcceptHoverEvents(true);
     setFlags(ItemIsSelectable | ItemSendsGeometryChanges);
 
@@ -42,23 +47,41 @@ CyberiadaSMEditorStateItem::CyberiadaSMEditorStateItem(QObject *parent_object,
     //     // setPos(parent->boundingRect().x() + width()/2, parent->boundingRect().y() + height()/2);
     // }
 
-    title = new EditableTextItem(m_state->get_name().c_str(), this, true);
-    title->setFont(QFont("Monospace"));
+    title.setCentered(true);
+    title.setRole(CyberiadaSMTypography::roleTitle);
+    title.setText(m_state->get_name().c_str());
+    entry.setRole(CyberiadaSMTypography::roleAction);
+    exit.setRole(CyberiadaSMTypography::roleAction);
 
+    updateActionLabels();
+
+    setPositionText();
+}
+
+void CyberiadaSMEditorStateItem::updateActionLabels()
+{
     m_actions = m_state->get_actions();
-    std::list<Cyberiada::Action> actions = m_state->get_actions();
-    for (std::list<Cyberiada::Action>::const_iterator i = actions.begin(); i != actions.end(); i++) {
+    QString entry_text, exit_text;
+    for (std::list<Cyberiada::Action>::const_iterator i = m_actions.begin(); i != m_actions.end(); i++) {
         Cyberiada::ActionType type = i->get_type();
         if (type == Cyberiada::actionEntry) {
-            entry = new EditableTextItem(QString("entry() / ") + QString(i->get_behavior().c_str()), this);
-            entry->setFont(QFont("Monospace"));
+            entry_text = QString("entry() / ") + QString(i->get_behavior().c_str());
         } else if (type == Cyberiada::actionExit) {
-            exit = new EditableTextItem(QString("exit() / ") + QString(i->get_behavior().c_str()), this);
-            exit->setFont(QFont("Monospace"));
+            exit_text = QString("exit() / ") + QString(i->get_behavior().c_str());
         }
     }
+    entry.setText(entry_text);
+    exit.setText(exit_text);
+}
 
-    setPositionText();
+void CyberiadaSMEditorStateItem::rebind(Cyberiada::Element* _element)
+{
+    m_state = static_cast<const Cyberiada::State*>(_element);
+    m_expanded = true;
+    title.endEdit();
+    entry.endEdit();
+    exit.endEdit();
+    CyberiadaSMEditorAbstractItem::rebind(_element);
 }
 
 CyberiadaSMEditorStateItem::~CyberiadaSMEditorStateItem()
@@ -107,6 +130,7 @@ void CyberiadaSMEditorStateItem::setRect(const QRectF &rect)
     }
 */
     m_rect = rect;
+    invalidateTransitions();
 }
 
 QRectF CyberiadaSMEditorStateItem::rect() const {
@@ -141,18 +165,86 @@ qreal CyberiadaSMEditorStateItem::height() const
 
 QRectF CyberiadaSMEditorStateItem::boundingRect() const
 {
+    SM_PROFILE_COUNT(boundingRectCall);
     return rect();
 }
 
+void CyberiadaSMEditorStateItem::syncFromModel()
+{
+    prepareGeometryChange();
+    setPos(QPointF(x(), y()));
+    title.setText(m_state->get_name().c_str());
+    updateActionLabels();
+    setPositionText();
+    invalidateTransitions();
+    update();
+}
+
+bool CyberiadaSMEditorStateItem::isComposite() const
+{
+    return element->get_type() == Cyberiada::elementCompositeState;
+}
+
+void CyberiadaSMEditorStateItem::setExpanded(bool expanded)
+{
+    if (m_expanded == expanded)
+        return;
+    m_expanded = expanded;
+    update(toggleRect());
+}
+
+QRectF CyberiadaSMEditorStateItem::toggleRect() const
+{
+    QRectF r = rect();
+    return QRectF(r.left() + 6, r.top() + 6, 10, 10);
+}
+
+void CyberiadaSMEditorStateItem::textEdited(QGraphicsItem* textItem, const QString& text)
+{
+    if (textItem == title.editor()) {
+        model->editElementsText(QList<Cyberiada::Element*>() << element, CyberiadaSMModel::textName, text,
+                                title.editor()->session());
+    }
+}
+
+void CyberiadaSMEditorStateItem::textEditFinished(QGraphicsItem* textItem)
+{
+    CyberiadaSMEditorLabel* labels[] = { &title, &entry, &exit };
+    for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+        if (labels[i]->editor() == textItem) {
+            labels[i]->endEdit();
+            update(labels[i]->rect());
+        }
+    }
+}
+
+void CyberiadaSMEditorStateItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event)
+{
+    if (event->button() & Qt::LeftButton) {
+        CyberiadaSMEditorLabel* labels[] = { &title, &entry, &exit };
+        for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+            if ((i == 0 || !labels[i]->isEmpty()) && labels[i]->rect().contains(event->pos())) {
+                labels[i]->beginEdit(this);
+                event->accept();
+                return;
+            }
+        }
+    }
+    QGraphicsItem::mouseDoubleClickEvent(event);
+}
 
 void CyberiadaSMEditorStateItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
 {
+    if ((event->button() & Qt::LeftButton) && isComposite() && toggleRect().contains(event->pos())) {
+        event->accept();
+        static_cast<CyberiadaSMEditorScene*>(scene())->toggleComposite(this);
+        return;
+    }
+    CyberiadaSMEditorAbstractItem::mousePressEvent(event);
     if (event->button() & Qt::LeftButton) {
-        m_leftMouseButtonPressed = true;
         setPreviousPosition(event->scenePos());
         emit clicked(this);
     }
-    QGraphicsItem::mousePressEvent(event);
 }
 
 void CyberiadaSMEditorStateItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
@@ -190,23 +282,21 @@ void CyberiadaSMEditorStateItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
         break;
     default:
     */
-    if (m_leftMouseButtonPressed) {
+    if (isDragged()) {
         setCursor(Qt::ClosedHandCursor);
-        setFlag(ItemIsMovable);
     }
     // break;
     // }
 
-    QGraphicsItem::mouseMoveEvent(event);
+    CyberiadaSMEditorAbstractItem::mouseMoveEvent(event);
 }
 
 void CyberiadaSMEditorStateItem::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 {
-    if (event->button() & Qt::LeftButton) {
-        m_leftMouseButtonPressed = false;
-        setFlag(ItemIsMovable, false);
+    if ((event->button() & Qt::LeftButton) && isDragged()) {
+        setCursor(Qt::OpenHandCursor);
     }
-    QGraphicsItem::mouseReleaseEvent(event);
+    CyberiadaSMEditorAbstractItem::mouseReleaseEvent(event);
 }
 
 
@@ -366,13 +456,18 @@ void CyberiadaSMEditorStateItem::resizeTop(const QPointF &pt)
 void CyberiadaSMEditorStateItem::setPositionText()
 {
     QRectF oldRect = rect();
-    QRectF titleRect = title->boundingRect();
-    title->setPos(oldRect.x() + (oldRect.width() - titleRect.width()) / 2 , oldRect.y());
-    if (entry != nullptr) {
-        entry->setPos(oldRect.x() + 15, oldRect.y() + titleRect.height());
-    }
-    if (exit != nullptr) {
-        exit->setPos(oldRect.x() + 15, oldRect.bottom() - exit->boundingRect().height());
+    title.setMaximumWidth(oldRect.width() - 30);
+    entry.setMaximumWidth(oldRect.width() - 30);
+    exit.setMaximumWidth(oldRect.width() - 30);
+    QSizeF titleSize = title.size();
+    title.setPos(QPointF(oldRect.x() + (oldRect.width() - titleSize.width()) / 2 , oldRect.y()));
+    entry.setPos(QPointF(oldRect.x() + 15, oldRect.y() + titleSize.height()));
+    exit.setPos(QPointF(oldRect.x() + 15, oldRect.bottom() - exit.size().height()));
+    CyberiadaSMEditorLabel* labels[] = { &title, &entry, &exit };
+    for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+        if (labels[i]->isEditing()) {
+            labels[i]->editor()->setPos(labels[i]->pos());
+        }
     }
 
     // setPositionGrabbers();
@@ -412,25 +507,28 @@ void CyberiadaSMEditorStateItem::hideGrabbers()
 */
 
 void CyberiadaSMEditorStateItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget){
+    SM_PROFILE_COUNT(paintState);
     Q_UNUSED(option)
     Q_UNUSED(widget)
 
-    setPositionText();
-    QRectF oldRect = rect();
-    qreal titleHeight = title->boundingRect().height();
-    setRect(QRectF(oldRect.x(), oldRect.y(), oldRect.width(), titleHeight));
+    // the labels are positioned on the model changes, not on every paint
+    qreal titleHeight = title.size().height();
 
-    QColor color(Qt::black);
-    if (isSelected()) {
-        color.setRgb(255, 0, 0);
+    CyberiadaSMPainter::paintState(painter, rect(), titleHeight, isSelected());
+
+    if (isComposite()) {
+        QRectF box = toggleRect();
+        painter->drawRect(box);
+        painter->drawLine(QPointF(box.left() + 2, box.center().y()), QPointF(box.right() - 2, box.center().y()));
+        if (!m_expanded) {
+            painter->drawLine(QPointF(box.center().x(), box.top() + 2), QPointF(box.center().x(), box.bottom() - 2));
+        }
     }
-    painter->setPen(QPen(color, 1, Qt::SolidLine));
 
-    QPainterPath path;
-    QRectF tmpRect = rect();
-    path.addRoundedRect(tmpRect, 10, 10);
-    painter->drawLine(QPointF(tmpRect.x(), tmpRect.y() + titleHeight), QPointF(tmpRect.right(), tmpRect.y() + titleHeight));
-    painter->drawPath(path);
+    painter->setPen(CyberiadaSMPainter::textPen());
+    title.paint(painter);
+    entry.paint(painter);
+    exit.paint(painter);
 
     painter->setBrush(Qt::red);
     painter->drawEllipse(QPointF(0, 0), 2, 2); // Центр системы координат
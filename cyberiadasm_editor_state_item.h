@@ -8,6 +8,7 @@
 
 #include "editable_text_item.h"
 #include "cyberiadasm_editor_items.h"
+#include "cyberiadasm_editor_label.h"
 
 
 
@@ -65,9 +66,19 @@ public:
     qreal height() const;
 
     QRectF boundingRect() const override;
+    void syncFromModel() override;
+    void textEdited(QGraphicsItem* textItem, const QString& text) override;
+    void textEditFinished(QGraphicsItem* textItem) override;
+    void rebind(Cyberiada::Element* element) override;
 
     void setPositionText();
 
+    // a collapsed composite state has no child items on the scene
+    bool isComposite() const;
+    bool isExpanded() const { return m_expanded; }
+    void setExpanded(bool expanded);
+    QRectF toggleRect() const;
+
 signals:
     void rectChanged(CyberiadaSMEditorStateItem *rect);
     void previousPositionChanged();
@@ -75,23 +86,28 @@ signals:
     void signalMove(QGraphicsItem *item, qreal dx, qreal dy);
 
 protected:
+    bool isMovable() const override { return true; }
     void mouseMoveEvent(QGraphicsSceneMouseEvent *event) override;
     void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
     void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) override;
+    void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
     void hoverEnterEvent(QGraphicsSceneHoverEvent *event) override;
     void hoverLeaveEvent(QGraphicsSceneHoverEvent *event) override;
     void hoverMoveEvent(QGraphicsSceneHoverEvent *event) override;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
 
 private:
+    void updateActionLabels();
+
     // unsigned int m_cornerFlags;
     QPointF m_previousPosition;
-    bool m_leftMouseButtonPressed;
+    bool m_expanded;
     // Grabber *cornerGrabber[8];
 
-    EditableTextItem *title;
-    EditableTextItem* entry = nullptr;
-    EditableTextItem* exit = nullptr;
+    // the texts are painted by the state, the editors exist only while editing
+    CyberiadaSMEditorLabel title;
+    CyberiadaSMEditorLabel entry;
+    CyberiadaSMEditorLabel exit;
 
     QRectF m_rect;
     const Cyberiada::State* m_state;
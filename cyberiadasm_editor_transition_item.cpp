@@ -5,24 +5,32 @@
 #include <QtMath>
 
 #include "cyberiadasm_editor_transition_item.h"
+#include "cyberiadasm_profiler.h"
+#include "cyberiadasm_painter.h"
+#include "cyberiadasm_editor_scene.h"
+
+// the gap between the transition line and its label
+static const qreal LABEL_GAP = 4;
 
 
 CyberiadaSMEditorTransitionItem::CyberiadaSMEditorTransitionItem(QObject *parent_object,
                                                                  CyberiadaSMModel *model,
                                                                  Cyberiada::Element *element,
                                                                  QGraphicsItem *parent,
-                                                                 QMap<Cyberiada::ID, QGraphicsItem*>* elementItem) :
+                                                                 QMap<Cyberiada::ID, QGraphicsItem*>* elementItem,
+                                                                 const QMap<Cyberiada::ID, const Cyberiada::Element*>* elementIds) :
     CyberiadaSMEditorAbstractItem(model, element, parent),
     QObject(parent_object),
-    m_elementItem(elementItem)
+    m_elementItem(elementItem),
+    m_elementIds(elementIds)
 {
     m_mouseTraking = false;
 
     m_transition = static_cast<const Cyberiada::Transition*>(element);
 
-    m_actionItem = new QGraphicsTextItem(text(), this);
-    m_actionItem->setTextInteractionFlags(Qt::TextEditorInteraction);
-    updateTextPosition();
+    m_label.setCentered(true);
+    m_label.setRole(CyberiadaSMTypography::roleTrigger);
+    m_label.setText(text());
 
     // setAcceptHoverEvents(true);
     setFlags(ItemIsSelectable);
@@ -30,37 +38,83 @@ CyberiadaSMEditorTransitionItem::CyberiadaSMEditorTransitionItem(QObject *parent
 
 CyberiadaSMEditorTransitionItem::~CyberiadaSMEditorTransitionItem()
 {
-    if(m_actionItem) { delete m_actionItem; }
 }
 
 QRectF CyberiadaSMEditorTransitionItem::boundingRect() const
 {
-    return path().boundingRect().adjusted(-10, -10, 10, 10); // Увеличиваем область для стрелки
+    SM_PROFILE_COUNT(boundingRectCall);
+    QRectF rect = m_path.boundingRect().adjusted(-10, -10, 10, 10); // Увеличиваем область для стрелки
+    if (!m_label.isEmpty()) {
+        rect |= m_label.rect();
+    }
+    return rect;
 }
 
 void CyberiadaSMEditorTransitionItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
-{   QColor color(Qt::black);
-    if (isSelected()) {
-        color.setRgb(255, 0, 0);
-    }
-    QPen pen(color, 1);
-    pen.setCosmetic(true);
-    painter->setPen(pen);
-    painter->setBrush(Qt::NoBrush);
-
-    painter->drawPath(path());
-
-    update();
-    drawArrow(painter);
+{
+    SM_PROFILE_COUNT(paintTransition);
+    QPointF p1, p2;
+    arrowLine(p1, p2);
+    CyberiadaSMPainter::paintTransition(painter, path(), p1, p2, isSelected());
 
-    updateTextPosition();
+    painter->setPen(CyberiadaSMPainter::textPen());
+    m_label.paint(painter);
 }
 
 QPainterPath CyberiadaSMEditorTransitionItem::shape() const
 {
+    SM_PROFILE_COUNT(shapeCall);
     QPainterPathStroker stroker;
     stroker.setWidth(10);
-    return stroker.createStroke(m_path);
+    QPainterPath shape = stroker.createStroke(m_path);
+    if (!m_label.isEmpty()) {
+        // the label is clicked to be edited
+        shape.addRect(m_label.rect());
+    }
+    return shape;
+}
+
+void CyberiadaSMEditorTransitionItem::syncFromModel()
+{
+    // the label is a part of the bounding rect
+    prepareGeometryChange();
+    m_label.setText(text());
+    updatePath();
+}
+
+void CyberiadaSMEditorTransitionItem::rebind(Cyberiada::Element* _element)
+{
+    m_transition = static_cast<const Cyberiada::Transition*>(_element);
+    m_labelCandidate = 0;
+    m_bundleOffset = 0;
+    m_label.endEdit();
+    CyberiadaSMEditorAbstractItem::rebind(_element);
+}
+
+void CyberiadaSMEditorTransitionItem::textEdited(QGraphicsItem* textItem, const QString& text)
+{
+    if (textItem == m_label.editor()) {
+        model->editElementsText(QList<Cyberiada::Element*>() << element, CyberiadaSMModel::textTrigger, text,
+                                m_label.editor()->session());
+    }
+}
+
+void CyberiadaSMEditorTransitionItem::textEditFinished(QGraphicsItem* textItem)
+{
+    if (textItem == m_label.editor()) {
+        m_label.endEdit();
+        update();
+    }
+}
+
+void CyberiadaSMEditorTransitionItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event)
+{
+    if ((event->button() & Qt::LeftButton) && !m_label.isEmpty() && m_label.rect().contains(event->pos())) {
+        m_label.beginEdit(this);
+        event->accept();
+        return;
+    }
+    QGraphicsItem::mouseDoubleClickEvent(event);
 }
 
 CyberiadaSMEditorAbstractItem *CyberiadaSMEditorTransitionItem::source() const
@@ -99,7 +153,6 @@ QPointF CyberiadaSMEditorTransitionItem::sourcePoint() const
 
 QPointF CyberiadaSMEditorTransitionItem::sourceCenter() const
 {
-    Cyberiada::ElementType sourceElementType = model->idToElement(QString::fromStdString(m_transition->source_element_id()))->get_type();
     // if (sourceElementType == Cyberiada::elementCompositeState ||
     //     sourceElementType == Cyberiada::elementSimpleState)
     // {
@@ -110,7 +163,11 @@ QPointF CyberiadaSMEditorTransitionItem::sourceCenter() const
     // {
     //     return static_cast<CyberiadaSMEditorVertexItem*>(m_elementItem->value(m_transition->source_element_id()))->sceneBoundingRect().center();
     // }
-    return (m_elementItem->value(m_transition->source_element_id()))->sceneBoundingRect().center();
+    QGraphicsItem* item = m_elementItem->value(m_transition->source_element_id());
+    if (!item) {
+        return QPointF();
+    }
+    return item->sceneBoundingRect().center();
 }
 
 CyberiadaSMEditorAbstractItem *CyberiadaSMEditorTransitionItem::target() const
@@ -158,15 +215,91 @@ QPointF CyberiadaSMEditorTransitionItem::targetCenter() const
     //     targetElementType == Cyberiada::elementFinal){
     //     return static_cast<CyberiadaSMEditorVertexItem*>(m_elementItem->value(m_transition->source_element_id()))->sceneBoundingRect().center();
     // }
-    return (m_elementItem->value(m_transition->target_element_id()))->sceneBoundingRect().center();
+    QGraphicsItem* item = m_elementItem->value(m_transition->target_element_id());
+    if (!item) {
+        return QPointF();
+    }
+    return item->sceneBoundingRect().center();
+}
+
+QGraphicsItem *CyberiadaSMEditorTransitionItem::visibleItem(const Cyberiada::ID& id,
+                                                            const QMap<Cyberiada::ID, QGraphicsItem*>& items,
+                                                            const QMap<Cyberiada::ID, const Cyberiada::Element*>& ids,
+                                                            QList<Cyberiada::ID>* hidden)
+{
+    // the end itself has an item in most cases
+    QGraphicsItem* item = items.value(id);
+    if (item) {
+        return item;
+    }
+    if (hidden) {
+        hidden->append(id);
+    }
+    const Cyberiada::Element* e = ids.value(id);
+    for (e = e ? e->get_parent() : NULL; e && e->get_type() != Cyberiada::elementSM; e = e->get_parent()) {
+        item = items.value(e->get_id());
+        if (item) {
+            return item;
+        }
+        if (hidden) {
+            hidden->append(e->get_id());
+        }
+    }
+    return NULL;
+}
+
+QGraphicsItem *CyberiadaSMEditorTransitionItem::sourceItem() const
+{
+    return visibleItem(m_transition->source_element_id(), *m_elementItem, *m_elementIds);
+}
+
+QGraphicsItem *CyberiadaSMEditorTransitionItem::targetItem() const
+{
+    return visibleItem(m_transition->target_element_id(), *m_elementItem, *m_elementIds);
 }
 
 QPainterPath CyberiadaSMEditorTransitionItem::path() const
+{
+    return m_path;
+}
+
+void CyberiadaSMEditorTransitionItem::updatePath()
+{
+    prepareGeometryChange();
+    m_path = buildPath();
+    updateTextPosition();
+    update();
+}
+
+QPainterPath CyberiadaSMEditorTransitionItem::buildPath() const
 {
     QPainterPath path = QPainterPath();
+    QGraphicsItem* s = sourceItem();
+    QGraphicsItem* t = targetItem();
+    if (!s || !t) {
+        return path;
+    }
+    if (s != source() || t != target()) {
+        // an end is hidden inside a collapsed state: the stored points are
+        // relative to the hidden element, so connect the visible centers
+        if (s != t) {
+            path.moveTo(s->sceneBoundingRect().center());
+            path.lineTo(t->sceneBoundingRect().center());
+        }
+        return path;
+    }
 
     path.moveTo(sourcePoint() + sourceCenter());
 
+    if (m_bundleOffset != 0 && !m_transition->has_polyline()) {
+        QPointF start = sourcePoint() + sourceCenter();
+        QPointF end = targetPoint() + targetCenter();
+        QLineF normal = QLineF(start, end).normalVector().unitVector();
+        // the control point is twice as far as the top of the curve
+        path.quadTo((start + end) / 2 + QPointF(normal.dx(), normal.dy()) * m_bundleOffset * 2, end);
+        return path;
+    }
+
     if(m_transition->has_polyline()) {
         for (const auto& point : m_transition->get_geometry_polyline()) {
             path.lineTo(QPointF(point.x, point.y) + sourceCenter());
@@ -219,48 +352,23 @@ QPainterPath CyberiadaSMEditorTransitionItem::path() const
 //     prepareGeometryChange();
 // }
 
-void CyberiadaSMEditorTransitionItem::drawArrow(QPainter* painter)
+void CyberiadaSMEditorTransitionItem::arrowLine(QPointF& p1, QPointF& p2) const
 {
-    QColor color(Qt::black);
-    if (isSelected()) {
-        color.setRgb(255, 0, 0);
-    }
-    QPen pen(color, 1);
-    painter->setPen(pen);
-
-    QPointF p1 = sourcePoint() + sourceCenter(); // Предпоследняя точка
+    p1 = sourcePoint() + sourceCenter(); // Предпоследняя точка
     if(m_transition->has_polyline()) {
         Cyberiada::Polyline polyline = m_transition->get_geometry_polyline();
         Cyberiada::Point lastPolylinePoint = *(std::next(polyline.begin(), polyline.size() - 1));
         p1 = QPointF(lastPolylinePoint.x, lastPolylinePoint.y) + sourceCenter();
+    } else if (m_bundleOffset != 0 && m_path.elementCount() > 0) {
+        // the bent transition ends along the tangent of the curve
+        p1 = m_path.pointAtPercent(0.9);
     }
 
-    QPointF p2;
     if (m_mouseTraking) {
         p2 = targetPoint(); // TODO ПОМЕНЯТЬ НА КУРСОР МЫШИ
     } else {
         p2 = targetPoint() + targetCenter(); // Последняя точка
     }
-
-    // Вычисляем направление
-    QLineF line(p1, p2);
-    double angle = std::atan2(-line.dy(), line.dx());
-
-    // Размер стрелки
-    qreal arrowSize = 10.0;
-
-    // Вычисляем точки треугольника
-    QPointF arrowP1 = p2 + QPointF(-arrowSize * std::cos(angle - M_PI / 6),
-                                   arrowSize * std::sin(angle - M_PI / 6));
-    QPointF arrowP2 = p2 + QPointF(-arrowSize * std::cos(angle + M_PI / 6),
-                                   arrowSize * std::sin(angle + M_PI / 6));
-
-    // Рисуем треугольник
-    QPolygonF arrowHead;
-    arrowHead << p2 << arrowP1 << arrowP2;
-
-    painter->setBrush(QBrush(color));
-    painter->drawPolygon(arrowHead);
 }
 
 // QVector<QPointF> CyberiadaSMEditorTransitionItem::points() const
@@ -308,19 +416,81 @@ QString CyberiadaSMEditorTransitionItem::text() const
 // }
 
 void CyberiadaSMEditorTransitionItem::updateTextPosition() {
-    if (!m_actionItem) return;
+    // the label follows the transition at the chosen place until the scene finds a better one
+    QVector<QPointF> candidates = labelCandidates();
+    prepareGeometryChange();
+    m_label.setPos(candidates.value(m_labelCandidate, candidates.first()));
+    if (m_label.isEditing()) {
+        m_label.editor()->setPos(m_label.pos());
+    }
+
+    CyberiadaSMEditorScene* s = dynamic_cast<CyberiadaSMEditorScene*>(scene());
+    if (s) {
+        s->scheduleLabelPlacement(this);
+    }
+}
+
+QVector<QPointF> CyberiadaSMEditorTransitionItem::labelCandidates() const
+{
+    QVector<QPointF> candidates;
 
-    // Установить позицию текста
     QPointF lastPoint = sourcePoint();
     if(m_transition->has_polyline()) {
         Cyberiada::Polyline polyline = m_transition->get_geometry_polyline();
         Cyberiada::Point lastPolylinePoint = *(std::next(polyline.begin(), polyline.size() - 1));
         lastPoint = QPointF(lastPolylinePoint.x, lastPolylinePoint.y);
     }
-    QPointF textPos = (lastPoint + (targetPoint() + targetCenter() - sourceCenter())) / 2 + sourceCenter();
+    candidates.append((lastPoint + (targetPoint() + targetCenter() - sourceCenter())) / 2 + sourceCenter());
 
-    m_actionItem->setPos(textPos);
-    update();
+    if (m_path.elementCount() < 2 || m_path.length() == 0) {
+        return candidates;
+    }
+    // both sides of the line at several places along it, the middle first
+    static const qreal fractions[] = { 0.5, 0.35, 0.65, 0.2, 0.8 };
+    QSizeF size = labelSize();
+    for (size_t i = 0; i < sizeof(fractions) / sizeof(fractions[0]); i++) {
+        QPointF point = m_path.pointAtPercent(fractions[i]);
+        QLineF normal = QLineF::fromPolar(1, m_path.angleAtPercent(fractions[i]) + 90);
+        for (int side = 1; side >= -1; side -= 2) {
+            QPointF n(side * normal.dx(), side * normal.dy());
+            qreal extent = qAbs(n.x()) * size.width() / 2 + qAbs(n.y()) * size.height() / 2 + LABEL_GAP;
+            candidates.append(point + n * extent - QPointF(size.width() / 2, size.height() / 2));
+        }
+    }
+    return candidates;
+}
+
+QSizeF CyberiadaSMEditorTransitionItem::labelSize() const
+{
+    if (m_label.isEmpty()) {
+        return QSizeF();
+    }
+    return m_label.size();
+}
+
+void CyberiadaSMEditorTransitionItem::setBundleOffset(qreal offset)
+{
+    if (m_bundleOffset == offset) {
+        return;
+    }
+    m_bundleOffset = offset;
+    if (isVisible()) {
+        updatePath();
+    }
+}
+
+void CyberiadaSMEditorTransitionItem::setLabelCandidate(int index)
+{
+    QVector<QPointF> candidates = labelCandidates();
+    if (index < 0 || index >= candidates.size()) {
+        index = 0;
+    }
+    m_labelCandidate = index;
+    prepareGeometryChange();
+    m_label.setPos(candidates[index]);
+    if (m_label.isEditing()) {
+        m_label.editor()->setPos(m_label.pos());
+    }
 }
 
 // QPointF CyberiadaSMEditorTransitionItem::findIntersectionWithRect(const State *state)
@@ -11,6 +11,8 @@
 #include <QString>
 
 #include "cyberiadasm_editor_items.h"
+#include "editable_text_item.h"
+#include "cyberiadasm_editor_label.h"
 #include "dotsignal.h"
 
 
@@ -28,7 +30,8 @@ public:
                         CyberiadaSMModel *model,
                         Cyberiada::Element *element,
                         QGraphicsItem *parent,
-                        QMap<Cyberiada::ID, QGraphicsItem*> *elementItem);
+                        QMap<Cyberiada::ID, QGraphicsItem*> *elementItem,
+                        const QMap<Cyberiada::ID, const Cyberiada::Element*> *elementIds);
     ~CyberiadaSMEditorTransitionItem();
 
 
@@ -46,15 +49,31 @@ public:
     // void setTargetPoint(const QPointF& point);
     QPointF targetCenter() const;
 
+    // the items the transition is drawn between: the ends hidden inside
+    // collapsed composite states are replaced by their nearest visible ancestors
+    QGraphicsItem *sourceItem() const;
+    QGraphicsItem *targetItem() const;
+    // the item of the element or of its nearest ancestor that has one; the ids
+    // passed without an item are appended to the hidden list
+    static QGraphicsItem *visibleItem(const Cyberiada::ID& id,
+                                      const QMap<Cyberiada::ID, QGraphicsItem*>& items,
+                                      const QMap<Cyberiada::ID, const Cyberiada::Element*>& ids,
+                                      QList<Cyberiada::ID>* hidden = NULL);
+
     QRectF boundingRect() const override;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr);
     QPainterPath shape() const override; // для обнаружения столкновений
+    void syncFromModel() override;
+    void textEdited(QGraphicsItem* textItem, const QString& text) override;
+    void textEditFinished(QGraphicsItem* textItem) override;
+    void rebind(Cyberiada::Element* element) override;
 
     QPainterPath path() const;
     // void setPath(const QPainterPath &path);
     void updatePath();
 
-    void drawArrow(QPainter* painter);
+    // the last segment the arrow points along
+    void arrowLine(QPointF& p1, QPointF& p2) const;
 
     QVector<QPointF> points() const;
     // void setPoints(const QVector<QPointF>& points);
@@ -64,8 +83,21 @@ public:
     void setTextPosition(const QPointF& pos);
     void updateTextPosition();
 
+    // the label positions (top-left corners) the scene chooses from, the
+    // first one is the default at the middle of the last segment
+    QVector<QPointF> labelCandidates() const;
+    QSizeF labelSize() const;
+    void setLabelCandidate(int index);
+
+    // the straight transitions of a bundle are bent apart by the offset
+    void setBundleOffset(qreal offset);
+    qreal bundleOffset() const { return m_bundleOffset; }
+
     // QPointF findIntersectionWithRect(const State* state);
 
+protected:
+    void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
+
 signals:
     void pathChanged();
     //    void rectChanged();
@@ -90,17 +122,22 @@ private slots:
     // void hoverEnterEvent(QGraphicsSceneHoverEvent *event) override;
 
 private:
+    QPainterPath buildPath() const;
     // void updateCoordinates(State *state, State::CornerFlags side, QPointF *point, QPointF* previousCenterPos);
 
     const Cyberiada::Transition* m_transition;
 
     QMap<Cyberiada::ID, QGraphicsItem*> *m_elementItem;
+    const QMap<Cyberiada::ID, const Cyberiada::Element*> *m_elementIds;
 
     QPointF m_previousSourceCenterPos;
     QPointF m_previousTargetCenterPos;
 
-    QGraphicsTextItem *m_actionItem = nullptr;
+    // the trigger painted by the transition, the editor exists only while editing
+    CyberiadaSMEditorLabel m_label;
     QPointF m_textPosition;
+    int m_labelCandidate = 0;
+    qreal m_bundleOffset = 0;
 
     QPointF m_previousPosition;
     QPainterPath m_path;
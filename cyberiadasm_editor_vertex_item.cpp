@@ -1,4 +1,6 @@
 #include "cyberiadasm_editor_vertex_item.h"
+#include "cyberiadasm_profiler.h"
+#include "cyberiadasm_painter.h"
 
 #include <QDebug>
 #include <QPainter>
@@ -18,10 +20,17 @@ CyberiadaSMEditorVertexItem::CyberiadaSMEditorVertexItem(CyberiadaSMModel* model
     Cyberiada::Rect r = element->get_bound_rect(*(model->rootDocument()));
     setPos(r.x, r.y);
 
-    setFlags(ItemIsSelectable);
+    setFlags(ItemIsSelectable | ItemSendsGeometryChanges);
     setAcceptHoverEvents(true);
 }
 
+void CyberiadaSMEditorVertexItem::syncFromModel()
+{
+    Cyberiada::Rect r = element->get_bound_rect(*(model->rootDocument()));
+    setPos(r.x, r.y);
+    update();
+}
+
 void CyberiadaSMEditorVertexItem::hoverEnterEvent(QGraphicsSceneHoverEvent *event)
 {
     setCursor(Qt::ArrowCursor);
@@ -30,6 +39,7 @@ void CyberiadaSMEditorVertexItem::hoverEnterEvent(QGraphicsSceneHoverEvent *even
 
 QRectF CyberiadaSMEditorVertexItem::boundingRect() const
 {
+    SM_PROFILE_COUNT(boundingRectCall);
     return fullCircle();
 }
 
@@ -43,38 +53,12 @@ QRectF CyberiadaSMEditorVertexItem::fullCircle() const
                   VERTEX_POINT_RADIUS * 2);
 }
 
-QRectF CyberiadaSMEditorVertexItem::partialCircle() const
-{
-    MY_ASSERT(model);
-    MY_ASSERT(model->rootDocument());
-    Cyberiada::Rect r = element->get_bound_rect(*(model->rootDocument()));
-    return QRectF(r.x - (VERTEX_POINT_RADIUS * 2.0 / 3.0),
-                  r.y - (VERTEX_POINT_RADIUS * 2.0 / 3.0),
-                  VERTEX_POINT_RADIUS * 4.0 / 3.0,
-                  VERTEX_POINT_RADIUS * 4.0 / 3.0);
-}
-
 void CyberiadaSMEditorVertexItem::paint(QPainter* painter, const QStyleOptionGraphicsItem*, QWidget*)
 {
-    QColor color(Qt::black);
-    if (isSelected()) {
-        color.setRgb(255, 0, 0);
-    }
-    painter->setPen(QPen(color, 1, Qt::SolidLine));
+    SM_PROFILE_COUNT(paintVertex);
     Cyberiada::ElementType type = element->get_type();
-    if (type == Cyberiada::elementInitial) {
-        painter->setBrush(QBrush(color));
-        painter->drawEllipse(fullCircle());
-    } else if (type == Cyberiada::elementFinal) {
-        painter->setBrush(painter->background());
-        painter->drawEllipse(fullCircle());
-        painter->setBrush(QBrush(color));
-        painter->drawEllipse(partialCircle());
-    } else {
-        MY_ASSERT(type == Cyberiada::elementTerminate);
-        painter->setPen(QPen(color, 2, Qt::SolidLine));
-        QRectF r = fullCircle();
-        painter->drawLine(r.left(), r.top(), r.right(), r.bottom());
-    }
+    MY_ASSERT(type == Cyberiada::elementInitial || type == Cyberiada::elementFinal ||
+              type == Cyberiada::elementTerminate);
+    CyberiadaSMPainter::paintVertex(painter, type, fullCircle(), isSelected());
 }
 
@@ -16,13 +16,14 @@ public:
     virtual int type() const { return VertexItem; }
 
     QRectF boundingRect() const override;
+    void syncFromModel() override;
 protected:
+    bool isMovable() const override { return true; }
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
     void hoverEnterEvent(QGraphicsSceneHoverEvent *event) override;
 
 private:
     QRectF fullCircle() const;
-    QRectF partialCircle() const;
 };
 
 
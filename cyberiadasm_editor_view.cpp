@@ -25,37 +25,365 @@
  * ----------------------------------------------------------------------------- */
 
 #include "cyberiadasm_editor_view.h"
+#include "cyberiadasm_typography.h"
+#include "cyberiadasm_trace.h"
+#include <QPainter>
+#include <QGraphicsScene>
+#include <QtMath>
 
+// the update mode is chosen again after so many painted frames
+static const int   UPDATE_WINDOW_FRAMES = 30;
+// the non-minimal modes sample the dirty regions again after so many windows
+static const int   UPDATE_SAMPLE_WINDOWS = 4;
+// the weight of the new frame in the moving averages
+static const qreal UPDATE_AVERAGE_WEIGHT = 0.1;
+// the dirty region is scattered if it covers less than this part of its bounding rect
+static const qreal UPDATE_SCATTERED_COVERAGE = 0.5;
+// the bounding rect covering this part of the viewport is painted entirely
+static const qreal UPDATE_FULL_COVERAGE = 0.7;
+// too many dirty rects cost more than painting their bounding rect
+static const qreal UPDATE_MAX_REGION_RECTS = 24;
+// the mode is kept unless the measured frame of the new one is cheaper by this factor
+static const qreal UPDATE_SWITCH_GAIN = 0.8;
+static const int   OVERLAY_MARGIN = 8;
+static const int   OVERLAY_WIDTH = 330;
+static const int   OVERLAY_LINES = 4;
+static const qreal ZOOM_STEP = 1.1;        // the scale factor of one wheel notch
+static const qreal ZOOM_MIN = 0.01;
+static const qreal ZOOM_MAX = 20;
+static const int   ZOOM_FRAME_MSECS = 16;
+static const qreal ZOOM_SMOOTHING = 0.35;  // the part of the way to the target made per frame
+static const qreal ZOOM_EPSILON = 0.01;    // the log scale distance considered reached
+static const int   ZOOM_FIT_MARGIN = 20;
 
 CyberiadaSMGraphicsView::CyberiadaSMGraphicsView(QWidget *parent):
-	QGraphicsView(parent)
+	QGraphicsView(parent), adaptiveUpdates(true), frames(0), windowFrames(0), windows(0), modeSwitches(0),
+	regionRects(0), regionCoverage(1), boundsCoverage(0), regionSampled(false),
+	profilingOverlay(false), overlayRefresh(false), overlayFrameNsecs(0), overlayVisibleItems(0),
+	zoomAnimating(false), zoomTarget(1), zoomAnchored(false), zoomCentered(false)
 {
+	for (int i = 0; i < 3; i++) {
+		frameNsecs[i] = 0;
+	}
+	for (int i = 0; i < CyberiadaSMProfiler::countersNumber; i++) {
+		overlayCounters[i] = 0;
+	}
     setAttribute(Qt::WA_TranslucentBackground, false);
-	setViewportUpdateMode(BoundingRectViewportUpdate);
+	// the dirty regions are sampled first
+	setViewportUpdateMode(MinimalViewportUpdate);
 
 	setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
 	setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
 
     setRenderHint(QPainter::Antialiasing);
-	setOptimizationFlags(DontSavePainterState);
-    setOptimizationFlags(DontAdjustForAntialiasing);
+	setOptimizationFlags(DontSavePainterState | DontAdjustForAntialiasing);
 
 	setFocus();
 
     setTransformationAnchor(AnchorUnderMouse);
     setDragMode(ScrollHandDrag);
+
+	CyberiadaSMTypography::instance()->setResolution(logicalDpiY());
+
+	zoomTimer = new QTimer(this);
+	zoomTimer->setInterval(ZOOM_FRAME_MSECS);
+	connect(zoomTimer, SIGNAL(timeout()), this, SLOT(slotZoomStep()));
+}
+
+void CyberiadaSMGraphicsView::paintEvent(QPaintEvent *event)
+{
+	// the texts are painted with the fonts of the current zoom, the animation keeps the old ones
+	if (!zoomAnimating) {
+		CyberiadaSMTypography::instance()->setZoom(transform().m11());
+	}
+	QElapsedTimer timer;
+	timer.start();
+	{
+		SM_TRACE_SPAN("scene paint");
+		QGraphicsView::paintEvent(event);
+	}
+	qint64 nsecs = timer.nsecsElapsed();
+
+	if (overlayRefresh) {
+		overlayRefresh = false;
+		return;
+	}
+	if (profilingOverlay) {
+		overlayFrameNsecs = nsecs;
+		CyberiadaSMProfiler::takeFrame(overlayCounters);
+		overlayVisibleItems = scene() ? scene()->items(mapToScene(viewport()->rect())).size() : 0;
+		// the overlay shows the frame that has just been painted
+		overlayRefresh = true;
+		viewport()->update(overlayRect());
+	}
+
+	frames++;
+	int mode = modeIndex(viewportUpdateMode());
+	if (mode >= 0) {
+		frameNsecs[mode] = frameNsecs[mode] == 0 ? nsecs :
+			frameNsecs[mode] + (nsecs - frameNsecs[mode]) * UPDATE_AVERAGE_WEIGHT;
+	}
+	if (viewportUpdateMode() == MinimalViewportUpdate) {
+		sampleRegion(event->region());
+	}
+	if (adaptiveUpdates && ++windowFrames >= UPDATE_WINDOW_FRAMES) {
+		chooseUpdateMode();
+	}
+	emit framePainted(nsecs);
+}
+
+int CyberiadaSMGraphicsView::modeIndex(ViewportUpdateMode mode)
+{
+	switch (mode) {
+	case MinimalViewportUpdate:      return 0;
+	case BoundingRectViewportUpdate: return 1;
+	case FullViewportUpdate:         return 2;
+	default:                         return -1;
+	}
+}
+
+void CyberiadaSMGraphicsView::sampleRegion(const QRegion& region)
+{
+	QRect bounds = region.boundingRect();
+	qreal viewport_area = qreal(viewport()->width()) * viewport()->height();
+	if (bounds.isEmpty() || viewport_area <= 0) {
+		return;
+	}
+	qreal area = 0;
+	int rects = 0;
+	for (QRegion::const_iterator r = region.begin(); r != region.end(); r++) {
+		area += qreal(r->width()) * r->height();
+		rects++;
+	}
+	qreal bounds_area = qreal(bounds.width()) * bounds.height();
+	if (!regionSampled) {
+		regionRects = rects;
+		regionCoverage = area / bounds_area;
+		boundsCoverage = bounds_area / viewport_area;
+		regionSampled = true;
+		return;
+	}
+	regionRects += (rects - regionRects) * UPDATE_AVERAGE_WEIGHT;
+	regionCoverage += (area / bounds_area - regionCoverage) * UPDATE_AVERAGE_WEIGHT;
+	boundsCoverage += (bounds_area / viewport_area - boundsCoverage) * UPDATE_AVERAGE_WEIGHT;
+}
+
+void CyberiadaSMGraphicsView::chooseUpdateMode()
+{
+	windowFrames = 0;
+	windows++;
+	ViewportUpdateMode current = viewportUpdateMode();
+	if (!regionSampled) {
+		return;
+	}
+	if (current != MinimalViewportUpdate && windows % UPDATE_SAMPLE_WINDOWS == 0) {
+		// the other modes hide the shape of the dirty regions, they are sampled for one window
+		setViewportUpdateMode(MinimalViewportUpdate);
+		return;
+	}
+	ViewportUpdateMode next;
+	if (boundsCoverage >= UPDATE_FULL_COVERAGE) {
+		next = FullViewportUpdate;
+	} else if (regionCoverage < UPDATE_SCATTERED_COVERAGE && regionRects <= UPDATE_MAX_REGION_RECTS) {
+		next = MinimalViewportUpdate;
+	} else {
+		next = BoundingRectViewportUpdate;
+	}
+	if (next == current) {
+		return;
+	}
+	qreal current_cost = frameNsecs[modeIndex(current)];
+	qreal next_cost = frameNsecs[modeIndex(next)];
+	if (current_cost > 0 && next_cost > 0 && next_cost > current_cost * UPDATE_SWITCH_GAIN) {
+		// the measurements do not confirm the expected gain
+		return;
+	}
+	setViewportUpdateMode(next);
+	modeSwitches++;
+}
+
+void CyberiadaSMGraphicsView::setAdaptiveUpdates(bool on)
+{
+	adaptiveUpdates = on;
+	windowFrames = 0;
+	if (!on) {
+		setViewportUpdateMode(BoundingRectViewportUpdate);
+	}
+}
+
+CyberiadaSMGraphicsView::UpdateStatistics CyberiadaSMGraphicsView::updateStatistics() const
+{
+	UpdateStatistics stats;
+	stats.mode = viewportUpdateMode();
+	stats.adaptive = adaptiveUpdates;
+	stats.frames = frames;
+	stats.switches = modeSwitches;
+	for (int i = 0; i < 3; i++) {
+		stats.frameMs[i] = frameNsecs[i] / 1e6;
+	}
+	stats.regionRects = regionRects;
+	stats.regionCoverage = regionCoverage;
+	stats.boundsCoverage = boundsCoverage;
+	return stats;
+}
+
+void CyberiadaSMGraphicsView::setProfilingOverlay(bool on)
+{
+	profilingOverlay = on;
+	overlayRefresh = false;
+	CyberiadaSMProfiler::takeFrame(overlayCounters);
+	viewport()->update();
+}
+
+QRect CyberiadaSMGraphicsView::overlayRect() const
+{
+	return QRect(OVERLAY_MARGIN, OVERLAY_MARGIN, OVERLAY_WIDTH,
+				 fontMetrics().lineSpacing() * OVERLAY_LINES + 2 * OVERLAY_MARGIN);
+}
+
+void CyberiadaSMGraphicsView::drawForeground(QPainter *painter, const QRectF &rect)
+{
+	QGraphicsView::drawForeground(painter, rect);
+	if (!profilingOverlay) {
+		return;
+	}
+	QStringList lines;
+	lines.append(tr("Frame: %1 ms, visible items: %2")
+				 .arg(overlayFrameNsecs / 1e6, 0, 'f', 2).arg(overlayVisibleItems));
+	if (CyberiadaSMProfiler::isEnabled()) {
+		lines.append(tr("Paints: %1 states, %2 transitions, %3 vertices")
+					 .arg(overlayCounters[CyberiadaSMProfiler::paintState])
+					 .arg(overlayCounters[CyberiadaSMProfiler::paintTransition])
+					 .arg(overlayCounters[CyberiadaSMProfiler::paintVertex]));
+		lines.append(tr("Paints: %1 SM, %2 texts")
+					 .arg(overlayCounters[CyberiadaSMProfiler::paintSM])
+					 .arg(overlayCounters[CyberiadaSMProfiler::paintText]));
+		lines.append(tr("Calls: %1 boundingRect(), %2 shape()")
+					 .arg(overlayCounters[CyberiadaSMProfiler::boundingRectCall])
+					 .arg(overlayCounters[CyberiadaSMProfiler::shapeCall]));
+	} else {
+		lines.append(tr("The counters are disabled in this build"));
+	}
+
+	QRect r = overlayRect();
+	painter->save();
+	painter->resetTransform();
+	painter->setPen(Qt::NoPen);
+	painter->setBrush(QColor(255, 255, 224, 220));
+	painter->drawRect(r);
+	painter->setPen(Qt::black);
+	painter->setFont(font());
+	painter->drawText(r.adjusted(OVERLAY_MARGIN, OVERLAY_MARGIN, -OVERLAY_MARGIN, -OVERLAY_MARGIN),
+					  Qt::AlignLeft | Qt::AlignTop, lines.join("\n"));
+	painter->restore();
 }
 
 void CyberiadaSMGraphicsView::wheelEvent(QWheelEvent *event) {
     if (event->modifiers() & Qt::ControlModifier){
-        double scaleFactor = 1.1;
-        if (event->angleDelta().y() > 0) {
-            scale(scaleFactor, scaleFactor);
-        } else {
-            scale(1.0 / scaleFactor, 1.0 / scaleFactor);
+        // the trackpads send the fractions of the notch
+        if (!zoomAnimating) {
+            zoomTarget = transform().m11();
         }
+        zoomTarget *= qPow(ZOOM_STEP, event->angleDelta().y() / 120.0);
+        zoomTarget = qBound(ZOOM_MIN, zoomTarget, ZOOM_MAX);
+        zoomAnchored = true;
+        zoomCentered = false;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        zoomAnchorView = event->position().toPoint();
+#else
+        zoomAnchorView = event->pos();
+#endif
+        zoomAnchorScene = mapToScene(zoomAnchorView);
+        startZoom();
+        event->accept();
     }
     else {
         QGraphicsView::wheelEvent(event);
     }
 }
+
+void CyberiadaSMGraphicsView::zoomToRect(const QRectF& rect)
+{
+    if (rect.isEmpty()) {
+        return;
+    }
+    QRect area = viewport()->rect().adjusted(ZOOM_FIT_MARGIN, ZOOM_FIT_MARGIN, -ZOOM_FIT_MARGIN, -ZOOM_FIT_MARGIN);
+    if (area.isEmpty()) {
+        return;
+    }
+    zoomTarget = qBound(ZOOM_MIN, qMin(area.width() / rect.width(), area.height() / rect.height()), ZOOM_MAX);
+    zoomAnchored = false;
+    zoomCentered = true;
+    zoomCenterTarget = rect.center();
+    startZoom();
+}
+
+void CyberiadaSMGraphicsView::startZoom()
+{
+    if (zoomAnimating) {
+        // the new target is picked up by the next frame
+        return;
+    }
+    zoomAnimating = true;
+    setRenderHint(QPainter::Antialiasing, false);
+    emit zoomChanged();
+    zoomTimer->start();
+}
+
+void CyberiadaSMGraphicsView::slotZoomStep()
+{
+    qreal current = transform().m11();
+    qreal distance = qLn(zoomTarget / current);
+    bool reached = qAbs(distance) < ZOOM_EPSILON;
+    qreal factor = reached ? zoomTarget / current : qExp(distance * ZOOM_SMOOTHING);
+
+    ViewportAnchor anchor = transformationAnchor();
+    setTransformationAnchor(NoAnchor);
+    scale(factor, factor);
+    setTransformationAnchor(anchor);
+
+    QPointF center = mapToScene(viewport()->rect().center());
+    if (zoomAnchored) {
+        centerOn(center - (mapToScene(zoomAnchorView) - zoomAnchorScene));
+    } else if (zoomCentered) {
+        QPointF offset = zoomCenterTarget - center;
+        // the center is reached together with the scale
+        if (!reached || QLineF(QPointF(), offset * transform().m11()).length() >= 1) {
+            reached = false;
+            centerOn(center + offset * ZOOM_SMOOTHING);
+        } else {
+            centerOn(zoomCenterTarget);
+        }
+    }
+    if (reached) {
+        finishZoom();
+    }
+}
+
+void CyberiadaSMGraphicsView::finishZoom()
+{
+    zoomTimer->stop();
+    zoomAnimating = false;
+    setRenderHint(QPainter::Antialiasing, true);
+    emit zoomChanged();
+    emit viewportChanged();
+    // the sharp frame with the fonts of the final zoom
+    viewport()->update();
+}
+
+void CyberiadaSMGraphicsView::scrollContentsBy(int dx, int dy)
+{
+    QGraphicsView::scrollContentsBy(dx, dy);
+    // the level of detail waits for the end of the zoom animation
+    if (!zoomAnimating) {
+        emit viewportChanged();
+    }
+}
+
+void CyberiadaSMGraphicsView::resizeEvent(QResizeEvent *event)
+{
+    // the window might be moved to another screen
+    CyberiadaSMTypography::instance()->setResolution(logicalDpiY());
+    QGraphicsView::resizeEvent(event);
+    emit viewportChanged();
+}
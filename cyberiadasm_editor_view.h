@@ -29,6 +29,25 @@
 
 #include <QGraphicsView>
 #include <QPaintEvent>
+#include <QResizeEvent>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "cyberiadasm_typography.h"
+#include "cyberiadasm_profiler.h"
+
+/* -----------------------------------------------------------------------------
+ * The view chooses the viewport update mode by itself. The dirty regions are
+ * sampled in the minimal mode: the scattered small regions stay minimal, the
+ * compact ones go to the bounding rect and the regions covering most of the
+ * viewport go to the full update. The measured frame time of every mode keeps
+ * the view in the current mode unless the new one is expected to be cheaper.
+ *
+ * The zoom is animated: the wheel steps of one frame are summed into the
+ * target scale, and every frame moves the transform part of the way to it.
+ * The animated frames are painted without antialiasing and keep the text
+ * layouts; the final frame is painted sharp and updates the level of detail.
+ * ----------------------------------------------------------------------------- */
 
 class CyberiadaSMGraphicsView: public QGraphicsView {
 Q_OBJECT
@@ -36,15 +55,79 @@ Q_OBJECT
 public:
 	CyberiadaSMGraphicsView(QWidget *parent = NULL);
 
-	void paintEvent(QPaintEvent * event) {
-		QPaintEvent* newEvent = new QPaintEvent(event->region().boundingRect());
-		QGraphicsView::paintEvent(newEvent);
-		delete newEvent;
-	}
+	struct UpdateStatistics {
+		ViewportUpdateMode mode;
+		bool               adaptive;
+		qint64             frames;
+		int                switches;
+		qreal              frameMs[3];      // the average frame of the minimal, bounding rect and full modes
+		qreal              regionRects;     // the average number of the dirty rects (minimal mode)
+		qreal              regionCoverage;  // the dirty area / the area of its bounding rect
+		qreal              boundsCoverage;  // the bounding rect area / the viewport area
+	};
+
+	void             setAdaptiveUpdates(bool on);
+	bool             isAdaptiveUpdates() const { return adaptiveUpdates; }
+	UpdateStatistics updateStatistics() const;
+	bool             isProfilingOverlay() const { return profilingOverlay; }
+	bool             isZooming() const { return zoomAnimating; }
+	// the smooth zoom to fit the scene rect in the viewport
+	void             zoomToRect(const QRectF& rect);
+
+public slots:
+	// the overlay shows the time and the counters of the last frame
+	void             setProfilingOverlay(bool on);
+
+signals:
+	void viewportChanged();
+	void zoomChanged();
+	void framePainted(qint64 nsecs);
 
 protected:
+    void paintEvent(QPaintEvent *event) override;
     void wheelEvent(QWheelEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void drawForeground(QPainter *painter, const QRectF &rect) override;
+
+private:
+	static int       modeIndex(ViewportUpdateMode mode);
+	void             sampleRegion(const QRegion& region);
+	void             chooseUpdateMode();
+	QRect            overlayRect() const;
+	void             startZoom();
+	void             finishZoom();
+
+private slots:
+	void             slotZoomStep();
+
+private:
+
+	bool             adaptiveUpdates;
+	qint64           frames;
+	int              windowFrames;     // the frames painted since the last decision
+	int              windows;
+	int              modeSwitches;
+	qreal            frameNsecs[3];    // the moving averages per mode, 0 - not measured yet
+	qreal            regionRects;
+	qreal            regionCoverage;
+	qreal            boundsCoverage;
+	bool             regionSampled;
+
+	bool             profilingOverlay;
+	bool             overlayRefresh;   // the next paint repaints the overlay only
+	qint64           overlayFrameNsecs;
+	int              overlayVisibleItems;
+	quint32          overlayCounters[CyberiadaSMProfiler::countersNumber];
 
+	QTimer*          zoomTimer;
+	bool             zoomAnimating;
+	qreal            zoomTarget;
+	bool             zoomAnchored;     // the wheel zoom keeps the scene point under the mouse
+	QPoint           zoomAnchorView;
+	QPointF          zoomAnchorScene;
+	bool             zoomCentered;     // the zoom to a rect moves the center to the rect
+	QPointF          zoomCenterTarget;
 };
 
 #endif
@@ -0,0 +1,396 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Diagram Export implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPainter>
+#include <QPainterPath>
+#include <QPdfWriter>
+#include <QSvgGenerator>
+#include <QtConcurrent>
+#include <QtMath>
+
+#include "cyberiadasm_export.h"
+#include "cyberiadasm_model.h"
+#include "cyberiadasm_spatial_index.h"
+#include "cyberiadasm_geometry.h"
+#include "cyberiadasm_painter.h"
+#include "cyberiadasm_png_stream.h"
+#include "cyberiadasm_editor_items.h"
+#include "cyberiadasm_trace.h"
+#include "myassert.h"
+
+// the same as the margin of the item labels
+static const qreal TEXT_MARGIN = 4;
+// the texts may stick out of the element rects, the neighbour elements are painted too
+static const qreal TEXT_OVERFLOW = 100;
+// the compression is the only serial stage of the PNG export, so the speed matters more
+static const int   PNG_COMPRESSION = 3;
+
+namespace {
+	typedef QPair<int, const Cyberiada::Element*> OrderedElement;
+
+	bool lessOrdered(const OrderedElement& a, const OrderedElement& b)
+	{
+		return a.first < b.first;
+	}
+
+	struct Tile {
+		const CyberiadaSMExporter*      exporter;
+		QRectF                          region;     // in the scene coordinates
+		QSize                           size;       // in pixels
+		qreal                           scale;
+		QColor                          background;
+		QImage                          image;
+	};
+
+	void renderTile(Tile& tile)
+	{
+		SM_TRACE_SPAN("export tile");
+		QImage image(tile.size, QImage::Format_ARGB32_Premultiplied);
+		image.fill(tile.background);
+		QPainter painter(&image);
+		painter.setRenderHint(QPainter::Antialiasing);
+		painter.setRenderHint(QPainter::TextAntialiasing);
+		painter.scale(tile.scale, tile.scale);
+		painter.translate(-tile.region.topLeft());
+		tile.exporter->paintRegion(&painter, tile.region);
+		painter.end();
+		tile.image = image.convertToFormat(QImage::Format_RGB888);
+	}
+
+	bool isCanceled(CyberiadaSMExporter::Progress* progress)
+	{
+		return progress && progress->canceled.loadAcquire() != 0;
+	}
+
+	void reportProgress(CyberiadaSMExporter::Progress* progress, qint64 done, qint64 total)
+	{
+		if (progress && total > 0) {
+			progress->done.storeRelease(int(done * 1000 / total));
+		}
+	}
+}
+
+CyberiadaSMExporter::CyberiadaSMExporter(const CyberiadaSMModel* _model, const Cyberiada::StateMachine* _sm):
+	model(_model), sm(_sm)
+{
+	MY_ASSERT(model);
+	MY_ASSERT(sm);
+	CyberiadaSMTypography* typography = CyberiadaSMTypography::instance();
+	for (int role = 0; role < CyberiadaSMTypography::roleCount; role++) {
+		fonts[role] = typography->layoutFont(CyberiadaSMTypography::Role(role));
+	}
+}
+
+bool CyberiadaSMExporter::formatFromPath(const QString& path, Format& format)
+{
+	QString suffix = QFileInfo(path).suffix().toLower();
+	if (suffix == "png") {
+		format = formatPNG;
+	} else if (suffix == "pdf") {
+		format = formatPDF;
+	} else if (suffix == "svg") {
+		format = formatSVG;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+QRectF CyberiadaSMExporter::exportRect(const Options& options) const
+{
+	const CyberiadaSMSpatialIndex* index = model->spatialIndex(sm);
+	QRectF rect;
+	foreach(const Cyberiada::Element* element, model->elementsIn(sm, QRectF(-INT_MAX / 2, -INT_MAX / 2, INT_MAX, INT_MAX))) {
+		rect |= index->elementRect(element);
+	}
+	if (rect.isNull()) {
+		return rect;
+	}
+	return rect.adjusted(-options.margin, -options.margin, options.margin, options.margin);
+}
+
+bool CyberiadaSMExporter::exportTo(const QString& path, Format format, const Options& options, QString& error,
+								   Progress* progress) const
+{
+	SM_TRACE_SPAN("export");
+	MY_ASSERT(options.scale > 0);
+	MY_ASSERT(options.tileSize > 0);
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		error = file.errorString();
+		return false;
+	}
+	// the spatial index is built here, the workers only read it
+	model->spatialIndex(sm);
+	bool done = false;
+	switch (format) {
+	case formatPNG: done = exportPNG(&file, options, error, progress); break;
+	case formatPDF: done = exportPDF(&file, options, error, progress); break;
+	case formatSVG: done = exportSVG(&file, options, error); break;
+	}
+	if (isCanceled(progress)) {
+		// the canceled export leaves no partial file
+		file.close();
+		file.remove();
+		error = QString("The export is canceled");
+		return false;
+	}
+	reportProgress(progress, 1, 1);
+	return done;
+}
+
+bool CyberiadaSMExporter::exportPNG(QIODevice* device, const Options& options, QString& error,
+									Progress* progress) const
+{
+	QRectF rect = exportRect(options);
+	if (rect.isEmpty()) {
+		error = QString("The state machine is empty");
+		return false;
+	}
+	int width = qCeil(rect.width() * options.scale);
+	int height = qCeil(rect.height() * options.scale);
+	int tile_size = options.tileSize;
+	int columns = (width + tile_size - 1) / tile_size;
+
+	CyberiadaSMPngStream png(device, PNG_COMPRESSION);
+	if (!png.begin(width, height)) {
+		error = QString("Cannot write the PNG header");
+		return false;
+	}
+	QByteArray row(width * 3, 0);
+	for (int top = 0; top < height; top += tile_size) {
+		if (isCanceled(progress)) {
+			return false;
+		}
+		reportProgress(progress, top, height);
+		int band_height = qMin(tile_size, height - top);
+		QVector<Tile> tiles(columns);
+		for (int c = 0; c < columns; c++) {
+			Tile& tile = tiles[c];
+			int left = c * tile_size;
+			tile.exporter = this;
+			tile.size = QSize(qMin(tile_size, width - left), band_height);
+			tile.region = QRectF(rect.left() + left / options.scale, rect.top() + top / options.scale,
+								 tile.size.width() / options.scale, tile.size.height() / options.scale);
+			tile.scale = options.scale;
+			tile.background = options.background;
+		}
+		QtConcurrent::blockingMap(tiles, renderTile);
+		for (int y = 0; y < band_height; y++) {
+			char* dest = row.data();
+			foreach(const Tile& tile, tiles) {
+				int bytes = tile.size.width() * 3;
+				memcpy(dest, tile.image.constScanLine(y), bytes);
+				dest += bytes;
+			}
+			if (!png.writeRow(reinterpret_cast<const uchar*>(row.constData()), row.size())) {
+				error = QString("Cannot write the PNG data");
+				return false;
+			}
+		}
+	}
+	if (!png.end()) {
+		error = QString("Cannot finish the PNG file");
+		return false;
+	}
+	return true;
+}
+
+bool CyberiadaSMExporter::exportPDF(QIODevice* device, const Options& options, QString& error,
+									Progress* progress) const
+{
+	QRectF rect = exportRect(options);
+	if (rect.isEmpty()) {
+		error = QString("The state machine is empty");
+		return false;
+	}
+	// a page per tile, the pages are vector and are painted one by one
+	qreal page = options.tileSize / options.scale;
+	int columns = qCeil(rect.width() / page), rows = qCeil(rect.height() / page);
+
+	QPdfWriter writer(device);
+	writer.setResolution(72);
+	writer.setTitle(QString(sm->get_name().c_str()));
+	writer.setPageMargins(QMarginsF(0, 0, 0, 0));
+	QPainter painter;
+	for (int r = 0; r < rows; r++) {
+		for (int c = 0; c < columns; c++) {
+			if (isCanceled(progress)) {
+				painter.end();
+				return false;
+			}
+			reportProgress(progress, r * columns + c, rows * columns);
+			QRectF region(rect.left() + c * page, rect.top() + r * page,
+						  qMin(page, rect.right() - rect.left() - c * page),
+						  qMin(page, rect.bottom() - rect.top() - r * page));
+			writer.setPageSize(QPageSize(region.size() * options.scale, QPageSize::Point));
+			if (r == 0 && c == 0) {
+				if (!painter.begin(&writer)) {
+					error = QString("Cannot start the PDF document");
+					return false;
+				}
+			} else if (!writer.newPage()) {
+				error = QString("Cannot add a PDF page");
+				return false;
+			}
+			painter.resetTransform();
+			painter.setClipping(false);
+			painter.fillRect(QRectF(QPointF(), region.size() * options.scale), options.background);
+			painter.scale(options.scale, options.scale);
+			painter.translate(-region.topLeft());
+			painter.setClipRect(region);
+			paintRegion(&painter, region);
+		}
+	}
+	return painter.end();
+}
+
+bool CyberiadaSMExporter::exportSVG(QIODevice* device, const Options& options, QString& error) const
+{
+	QRectF rect = exportRect(options);
+	if (rect.isEmpty()) {
+		error = QString("The state machine is empty");
+		return false;
+	}
+	QSize size(qCeil(rect.width() * options.scale), qCeil(rect.height() * options.scale));
+	QSvgGenerator generator;
+	generator.setOutputDevice(device);
+	generator.setSize(size);
+	generator.setViewBox(QRect(QPoint(), size));
+	generator.setTitle(QString(sm->get_name().c_str()));
+	QPainter painter;
+	if (!painter.begin(&generator)) {
+		error = QString("Cannot start the SVG document");
+		return false;
+	}
+	painter.fillRect(QRect(QPoint(), size), options.background);
+	painter.scale(options.scale, options.scale);
+	painter.translate(-rect.topLeft());
+	paintRegion(&painter, rect);
+	return painter.end();
+}
+
+void CyberiadaSMExporter::paintRegion(QPainter* painter, const QRectF& region) const
+{
+	const CyberiadaSMSpatialIndex* index = model->spatialIndex(sm);
+	QRectF area = region.adjusted(-TEXT_OVERFLOW, -TEXT_OVERFLOW, TEXT_OVERFLOW, TEXT_OVERFLOW);
+
+	// the parents are painted before their children, the transitions above all states
+	QVector<OrderedElement> ordered;
+	foreach(const Cyberiada::Element* element, model->elementsIn(sm, area)) {
+		int depth = 0;
+		if (element->get_type() == Cyberiada::elementTransition) {
+			depth = INT_MAX;
+		} else {
+			for (const Cyberiada::Element* p = element->get_parent(); p && p != sm; p = p->get_parent()) {
+				depth++;
+			}
+		}
+		ordered.append(qMakePair(depth, element));
+	}
+	std::stable_sort(ordered.begin(), ordered.end(), lessOrdered);
+
+	const QFont& title_font = fonts[CyberiadaSMTypography::roleTitle];
+	const QFont& action_font = fonts[CyberiadaSMTypography::roleAction];
+	const QFont& trigger_font = fonts[CyberiadaSMTypography::roleTrigger];
+	qreal title_height = QFontMetricsF(title_font).height() + 2 * TEXT_MARGIN;
+
+	foreach(const OrderedElement& o, ordered) {
+		const Cyberiada::Element* element = o.second;
+		Cyberiada::ElementType type = element->get_type();
+		if (type == Cyberiada::elementTransition) {
+			QVector<QPointF> path = index->transitionPath(static_cast<const Cyberiada::Transition*>(element));
+			if (path.size() < 2) continue;
+			QPainterPath line(path.first());
+			for (int i = 1; i < path.size(); i++) {
+				line.lineTo(path[i]);
+			}
+			CyberiadaSMPainter::paintTransition(painter, line, path[path.size() - 2], path.last(), false);
+			QString trigger = model->elementText(element, CyberiadaSMModel::textTrigger);
+			if (!trigger.isEmpty()) {
+				int middle = (path.size() - 1) / 2;
+				QPointF center = (path[middle] + path[middle + 1]) / 2;
+				painter->setPen(CyberiadaSMPainter::textPen());
+				painter->setFont(trigger_font);
+				QRectF text_rect = painter->boundingRect(QRectF(center, QSizeF()), Qt::AlignCenter, trigger);
+				text_rect.moveBottom(center.y() - TEXT_MARGIN);
+				painter->drawText(text_rect, Qt::AlignCenter, trigger);
+			}
+			continue;
+		}
+
+		QRectF r = CyberiadaSMGeometry::sceneRect(element);
+		switch (type) {
+		case Cyberiada::elementSimpleState:
+		case Cyberiada::elementCompositeState: {
+			CyberiadaSMPainter::paintState(painter, r, title_height, false);
+			painter->setPen(CyberiadaSMPainter::textPen());
+			painter->setFont(title_font);
+			painter->drawText(QRectF(r.left(), r.top(), r.width(), title_height), Qt::AlignCenter,
+							  QString(element->get_name().c_str()));
+			QStringList actions;
+			const std::list<Cyberiada::Action>& list = static_cast<const Cyberiada::State*>(element)->get_actions();
+			for (std::list<Cyberiada::Action>::const_iterator i = list.begin(); i != list.end(); i++) {
+				if (i->get_type() == Cyberiada::actionEntry) {
+					actions.append(QString("entry() / ") + QString(i->get_behavior().c_str()));
+				} else if (i->get_type() == Cyberiada::actionExit) {
+					actions.append(QString("exit() / ") + QString(i->get_behavior().c_str()));
+				}
+			}
+			if (!actions.isEmpty()) {
+				painter->setFont(action_font);
+				painter->drawText(QRectF(r.left() + TEXT_MARGIN, r.top() + title_height + TEXT_MARGIN,
+										 r.width() - 2 * TEXT_MARGIN, r.height() - title_height - 2 * TEXT_MARGIN),
+								  Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, actions.join("\n"));
+			}
+			break;
+		}
+		case Cyberiada::elementInitial:
+		case Cyberiada::elementFinal:
+		case Cyberiada::elementTerminate:
+			CyberiadaSMPainter::paintVertex(painter, type, r, false);
+			break;
+		case Cyberiada::elementChoice:
+			CyberiadaSMPainter::paintChoice(painter, r, false);
+			break;
+		case Cyberiada::elementComment:
+		case Cyberiada::elementFormalComment:
+			CyberiadaSMPainter::paintComment(painter, r, type == Cyberiada::elementFormalComment, false);
+			painter->setPen(CyberiadaSMPainter::textPen());
+			painter->setFont(action_font);
+			painter->drawText(r.adjusted(TEXT_MARGIN, TEXT_MARGIN, -COMMENT_ANGLE_CORNER, -TEXT_MARGIN),
+							  Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap,
+							  model->elementText(element, CyberiadaSMModel::textBody));
+			break;
+		default:
+			break;
+		}
+	}
+}
@@ -0,0 +1,105 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Diagram Export
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_EXPORT_HEADER
+#define CYBERIADA_SM_EXPORT_HEADER
+
+#include <QString>
+#include <QRectF>
+#include <QColor>
+#include <QFont>
+#include <QAtomicInt>
+#include <cyberiada/cyberiadamlpp.h>
+#include "cyberiadasm_typography.h"
+
+class QPainter;
+class QIODevice;
+class CyberiadaSMModel;
+
+/* -----------------------------------------------------------------------------
+ * Export of a state machine diagram to PNG, PDF and SVG. The diagram is painted
+ * from the document, not from the editor scene, so the worker threads can paint
+ * it and the virtualized scenes are exported completely; every painted region
+ * gets its elements from the spatial index of the model.
+ *
+ * PNG is rendered in the bands of fixed-size tiles: the tiles of a band are
+ * rendered on the worker threads and the band is compressed to the file before
+ * the next one, so the memory is bounded by one band. PDF gets one vector page
+ * per tile, SVG is written as a single vector page. The model must not change
+ * while the export runs.
+ *
+ * The elements are drawn by CyberiadaSMPainter like the scene items. The fonts
+ * are taken from the typography when the exporter is created; the typography
+ * itself must have been created on the GUI thread.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMExporter {
+public:
+	enum Format {
+		formatPNG,
+		formatPDF,
+		formatSVG
+	};
+
+	struct Options {
+		qreal                           scale;      // the pixels (points for PDF) per scene unit
+		int                             tileSize;   // in pixels
+		qreal                           margin;     // in the scene units
+		QColor                          background;
+		Options(): scale(1), tileSize(512), margin(20), background(Qt::white) {}
+	};
+
+	// the export updates the done share and checks the cancel request between
+	// the bands of PNG and the pages of PDF
+	struct Progress {
+		QAtomicInt                      done;       // per mille
+		QAtomicInt                      canceled;
+		Progress(): done(0), canceled(0) {}
+	};
+
+	CyberiadaSMExporter(const CyberiadaSMModel* model, const Cyberiada::StateMachine* sm);
+
+	static bool                         formatFromPath(const QString& path, Format& format);
+
+	// the exported scene rect with the margins
+	QRectF                              exportRect(const Options& options) const;
+	bool                                exportTo(const QString& path, Format format,
+												 const Options& options, QString& error,
+												 Progress* progress = NULL) const;
+	// paint the elements intersecting the region (in the scene coordinates); thread-safe
+	void                                paintRegion(QPainter* painter, const QRectF& region) const;
+
+private:
+	bool                                exportPNG(QIODevice* device, const Options& options, QString& error,
+												  Progress* progress) const;
+	bool                                exportPDF(QIODevice* device, const Options& options, QString& error,
+												  Progress* progress) const;
+	bool                                exportSVG(QIODevice* device, const Options& options, QString& error) const;
+
+	const CyberiadaSMModel*             model;
+	const Cyberiada::StateMachine*      sm;
+	QFont                               fonts[CyberiadaSMTypography::roleCount];
+};
+
+#endif
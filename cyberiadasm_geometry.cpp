@@ -0,0 +1,103 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Element Geometry
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include "cyberiadasm_geometry.h"
+#include "cyberiadasm_editor_items.h"
+#include "myassert.h"
+
+QRectF CyberiadaSMGeometry::localRect(const Cyberiada::Element* element, bool* valid)
+{
+	MY_ASSERT(element);
+	Cyberiada::Rect r;
+	switch (element->get_type()) {
+	case Cyberiada::elementSimpleState:
+	case Cyberiada::elementCompositeState:
+		r = static_cast<const Cyberiada::ElementCollection*>(element)->get_geometry_rect();
+		break;
+	case Cyberiada::elementComment:
+	case Cyberiada::elementFormalComment:
+		r = static_cast<const Cyberiada::Comment*>(element)->get_geometry_rect();
+		break;
+	case Cyberiada::elementChoice:
+		r = static_cast<const Cyberiada::ChoicePseudostate*>(element)->get_geometry_rect();
+		break;
+	case Cyberiada::elementInitial:
+	case Cyberiada::elementFinal:
+	case Cyberiada::elementTerminate: {
+		Cyberiada::Point p = static_cast<const Cyberiada::Vertex*>(element)->get_geometry_point();
+		r = Cyberiada::Rect(p.x, p.y, VERTEX_POINT_RADIUS * 2, VERTEX_POINT_RADIUS * 2);
+		r.valid = p.valid;
+		break;
+	}
+	default:
+		break;
+	}
+	if (valid) {
+		*valid = r.valid;
+	}
+	if (!r.valid) {
+		return QRectF();
+	}
+	return QRectF(r.x - r.width / 2, r.y - r.height / 2, r.width, r.height);
+}
+
+QRectF CyberiadaSMGeometry::sceneRect(const Cyberiada::Element* element)
+{
+	if (!element || element->get_type() == Cyberiada::elementSM) {
+		return QRectF();
+	}
+	bool valid = false;
+	QRectF rect = localRect(element, &valid);
+	if (!valid) {
+		return QRectF();
+	}
+	for (const Cyberiada::Element* e = element->get_parent(); e && e->get_type() != Cyberiada::elementSM;
+		 e = e->get_parent()) {
+		QRectF parent = localRect(e, &valid);
+		if (!valid) {
+			return QRectF();
+		}
+		rect.translate(parent.center());
+	}
+	return rect;
+}
+
+QVector<QPointF> CyberiadaSMGeometry::transitionPath(const Cyberiada::Transition* t,
+													 const QPointF& sc, const QPointF& tc)
+{
+	MY_ASSERT(t);
+	QVector<QPointF> path;
+	path.append(t->has_geometry_source_point() ?
+				sc + QPointF(t->get_source_point().x, t->get_source_point().y) : sc);
+	if (t->has_polyline()) {
+		// the polyline is relative to the source center
+		const Cyberiada::Polyline& polyline = t->get_geometry_polyline();
+		for (Cyberiada::Polyline::const_iterator p = polyline.begin(); p != polyline.end(); p++) {
+			path.append(sc + QPointF(p->x, p->y));
+		}
+	}
+	path.append(t->has_geometry_target_point() ?
+				tc + QPointF(t->get_target_point().x, t->get_target_point().y) : tc);
+	return path;
+}
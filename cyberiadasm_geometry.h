@@ -0,0 +1,54 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Element Geometry
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_GEOMETRY_HEADER
+#define CYBERIADA_SM_GEOMETRY_HEADER
+
+#include <QVector>
+#include <QRectF>
+#include <cyberiada/cyberiadamlpp.h>
+
+/* -----------------------------------------------------------------------------
+ * The geometry of the document elements as the editor shows it. The document
+ * keeps every element relative to the center of its parent and the transition
+ * ends relative to the centers of their elements; these functions are the only
+ * place that turns it into the scene coordinates (the state machine is at the
+ * origin), so the geometry store, the spatial index and the exporter agree
+ * with the scene items.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMGeometry {
+public:
+	// the rectangle centered on the element position, in the coordinates of the parent center;
+	// the pseudostates get the size of their items
+	static QRectF                       localRect(const Cyberiada::Element* element, bool* valid = NULL);
+	// the rectangle in the scene coordinates, null if the element or a parent has no geometry
+	static QRectF                       sceneRect(const Cyberiada::Element* element);
+	// the source point, the polyline and the target point for the given end centers
+	static QVector<QPointF>             transitionPath(const Cyberiada::Transition* transition,
+													   const QPointF& sourceCenter,
+													   const QPointF& targetCenter);
+};
+
+#endif
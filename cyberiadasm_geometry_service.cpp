@@ -0,0 +1,86 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Background Geometry Service implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+#include <QtConcurrent>
+
+#include "cyberiadasm_geometry_service.h"
+#include "myassert.h"
+
+CyberiadaSMGeometryService::CyberiadaSMGeometryService(QObject* parent):
+	QObject(parent), generation(0), runningGeneration(0)
+{
+	watcher = new QFutureWatcher<CyberiadaSMLayoutResult>(this);
+	connect(watcher, SIGNAL(finished()), this, SLOT(slotFinished()));
+}
+
+CyberiadaSMGeometryService::~CyberiadaSMGeometryService()
+{
+	watcher->waitForFinished();
+}
+
+int CyberiadaSMGeometryService::request(const Cyberiada::StateMachine* sm)
+{
+	MY_ASSERT(sm);
+	generation++;
+	QSharedPointer<CyberiadaSMLayout> layout(new CyberiadaSMLayout(sm));
+	if (watcher->isRunning()) {
+		// the running computation cannot be interrupted, the new one waits for it
+		pending = layout;
+	} else {
+		start(layout);
+	}
+	return generation;
+}
+
+void CyberiadaSMGeometryService::cancel()
+{
+	generation++;
+	pending.clear();
+}
+
+void CyberiadaSMGeometryService::start(QSharedPointer<CyberiadaSMLayout> layout)
+{
+	runningGeneration = generation;
+	watcher->setFuture(QtConcurrent::run(&CyberiadaSMGeometryService::compute, layout));
+}
+
+CyberiadaSMLayoutResult CyberiadaSMGeometryService::compute(QSharedPointer<CyberiadaSMLayout> layout)
+{
+	layout->run();
+	return layout;
+}
+
+void CyberiadaSMGeometryService::slotFinished()
+{
+	CyberiadaSMLayoutResult result = watcher->result();
+	int finished_generation = runningGeneration;
+
+	if (!pending.isNull()) {
+		QSharedPointer<CyberiadaSMLayout> next = pending;
+		pending.clear();
+		start(next);
+	}
+	if (finished_generation == generation) {
+		emit finished(finished_generation, result);
+	}
+}
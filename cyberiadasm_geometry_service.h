@@ -0,0 +1,72 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Background Geometry Service
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+#ifndef CYBERIADA_SM_GEOMETRY_SERVICE_HEADER
+#define CYBERIADA_SM_GEOMETRY_SERVICE_HEADER
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QFutureWatcher>
+#include <cyberiada/cyberiadamlpp.h>
+
+#include "cyberiadasm_layout.h"
+
+typedef QSharedPointer<const CyberiadaSMLayout> CyberiadaSMLayoutResult;
+
+/* -----------------------------------------------------------------------------
+ * The service computes the geometry of a state machine on a worker thread.
+ * The snapshot of the machine is taken by request() on the GUI thread; the
+ * worker only sees the snapshot and returns it as an immutable result that
+ * the receiver applies to the model at once. Every request and cancel() start
+ * a new generation, the results of the older generations are dropped.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMGeometryService: public QObject {
+Q_OBJECT
+
+public:
+	CyberiadaSMGeometryService(QObject* parent = NULL);
+	~CyberiadaSMGeometryService();
+
+	int                                 request(const Cyberiada::StateMachine* sm);
+	void                                cancel();
+	bool                                isBusy() const { return watcher->isRunning() || !pending.isNull(); }
+	int                                 currentGeneration() const { return generation; }
+
+signals:
+	void                                finished(int generation, CyberiadaSMLayoutResult result);
+
+private slots:
+	void                                slotFinished();
+
+private:
+	static CyberiadaSMLayoutResult      compute(QSharedPointer<CyberiadaSMLayout> layout);
+	void                                start(QSharedPointer<CyberiadaSMLayout> layout);
+
+	QFutureWatcher<CyberiadaSMLayoutResult>* watcher;
+	QSharedPointer<CyberiadaSMLayout>   pending;
+	int                                 generation;
+	int                                 runningGeneration;
+};
+
+#endif
@@ -0,0 +1,363 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Scene Geometry Store implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <algorithm>
+#include <limits>
+
+#include "cyberiadasm_geometry_store.h"
+#include "cyberiadasm_geometry.h"
+#include "myassert.h"
+
+// the room for the arrow and the label around the transition path
+static const qreal TRANSITION_MARGIN = 10;
+
+CyberiadaSMGeometryStore::CyberiadaSMGeometryStore()
+{
+}
+
+void CyberiadaSMGeometryStore::clear()
+{
+	elements.clear();
+	parents.clear();
+	ends.clear();
+	sources.clear();
+	targets.clear();
+	index.clear();
+	xs.clear();
+	ys.clear();
+	ws.clear();
+	hs.clear();
+	valid.clear();
+	pathOffsets.clear();
+	pathXs.clear();
+	pathYs.clear();
+	incidenceOffsets.clear();
+	incidence.clear();
+}
+
+void CyberiadaSMGeometryStore::build(Cyberiada::StateMachine* sm)
+{
+	MY_ASSERT(sm);
+	clear();
+
+	// the state machine item is placed at the origin of the scene and has no rectangle
+	elements.append(sm);
+	parents.append(-1);
+	ends.append(0);
+	index.insert(sm->get_id(), 0);
+	addEntries(sm, 0);
+	int n = elements.size();
+	ends[0] = n;
+
+	sources.fill(-1, n);
+	targets.fill(-1, n);
+	xs.fill(0, n);
+	ys.fill(0, n);
+	ws.fill(0, n);
+	hs.fill(0, n);
+	valid.fill(0, n);
+
+	QVector<int> counts(n + 1, 0);
+	for (int i = 1; i < n; i++) {
+		if (elements[i]->get_type() != Cyberiada::elementTransition) {
+			updateRect(i);
+			continue;
+		}
+		const Cyberiada::Transition* t = static_cast<const Cyberiada::Transition*>(elements[i]);
+		sources[i] = indexOf(t->source_element_id());
+		targets[i] = indexOf(t->target_element_id());
+		if (sources[i] >= 0) counts[sources[i]]++;
+		if (targets[i] >= 0 && targets[i] != sources[i]) counts[targets[i]]++;
+	}
+
+	// the transitions attached to every vertex in the compressed rows
+	incidenceOffsets.fill(0, n + 1);
+	for (int i = 0; i < n; i++) {
+		incidenceOffsets[i + 1] = incidenceOffsets[i] + counts[i];
+	}
+	incidence.resize(incidenceOffsets[n]);
+	counts.fill(0);
+	for (int i = 1; i < n; i++) {
+		if (sources[i] >= 0) {
+			incidence[incidenceOffsets[sources[i]] + counts[sources[i]]++] = i;
+		}
+		if (targets[i] >= 0 && targets[i] != sources[i]) {
+			incidence[incidenceOffsets[targets[i]] + counts[targets[i]]++] = i;
+		}
+	}
+
+	// the transitions need the rectangles of both ends
+	buildPaths();
+}
+
+void CyberiadaSMGeometryStore::addEntries(Cyberiada::ElementCollection* collection, int parent)
+{
+	if (!collection->has_children()) {
+		return;
+	}
+	const Cyberiada::ElementList& children = collection->get_children();
+	for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+		Cyberiada::Element* e = *i;
+		switch (e->get_type()) {
+		case Cyberiada::elementSimpleState:
+		case Cyberiada::elementCompositeState:
+		case Cyberiada::elementComment:
+		case Cyberiada::elementFormalComment:
+		case Cyberiada::elementInitial:
+		case Cyberiada::elementFinal:
+		case Cyberiada::elementTerminate:
+		case Cyberiada::elementChoice:
+		case Cyberiada::elementTransition:
+			break;
+		default:
+			// the scene has no items for the other pseudostates
+			continue;
+		}
+		int i_entry = elements.size();
+		elements.append(e);
+		parents.append(parent);
+		ends.append(i_entry + 1);
+		index.insert(e->get_id(), i_entry);
+		if (e->get_type() == Cyberiada::elementCompositeState) {
+			addEntries(static_cast<Cyberiada::ElementCollection*>(e), i_entry);
+			ends[i_entry] = elements.size();
+		}
+	}
+}
+
+void CyberiadaSMGeometryStore::updateRect(int i)
+{
+	// the element geometry is relative to the center of the parent
+	int p = parents[i];
+	qreal cx = p > 0 ? xs[p] + ws[p] / 2 : 0;
+	qreal cy = p > 0 ? ys[p] + hs[p] / 2 : 0;
+	bool v = false;
+	QRectF r = CyberiadaSMGeometry::localRect(elements[i], &v);
+	xs[i] = cx + r.x();
+	ys[i] = cy + r.y();
+	ws[i] = r.width();
+	hs[i] = r.height();
+	valid[i] = v;
+}
+
+void CyberiadaSMGeometryStore::updatePath(int i, QVector<qreal>& pxs, QVector<qreal>& pys) const
+{
+	int s = sources[i], t = targets[i];
+	if (s < 0 || t < 0 || !valid[s] || !valid[t]) {
+		return;
+	}
+	QVector<QPointF> path = CyberiadaSMGeometry::transitionPath(static_cast<const Cyberiada::Transition*>(elements[i]),
+																rect(s).center(), rect(t).center());
+	foreach(const QPointF& p, path) {
+		pxs.append(p.x());
+		pys.append(p.y());
+	}
+}
+
+void CyberiadaSMGeometryStore::buildPaths()
+{
+	int n = elements.size();
+	pathOffsets.resize(n + 1);
+	pathXs.clear();
+	pathYs.clear();
+	for (int i = 0; i < n; i++) {
+		pathOffsets[i] = pathXs.size();
+		if (sources[i] >= 0 || targets[i] >= 0) {
+			updatePath(i, pathXs, pathYs);
+		}
+	}
+	pathOffsets[n] = pathXs.size();
+	for (int i = 0; i < n; i++) {
+		if (elements[i]->get_type() == Cyberiada::elementTransition) {
+			updateTransitionRect(i);
+		}
+	}
+}
+
+void CyberiadaSMGeometryStore::updateTransitionRect(int i)
+{
+	int begin = pathOffsets[i], end = pathOffsets[i + 1];
+	if (end - begin < 2) {
+		valid[i] = 0;
+		return;
+	}
+	const qreal* px = pathXs.constData();
+	const qreal* py = pathYs.constData();
+	qreal left = px[begin], right = px[begin], top = py[begin], bottom = py[begin];
+	for (int k = begin + 1; k < end; k++) {
+		left = std::min(left, px[k]);
+		right = std::max(right, px[k]);
+		top = std::min(top, py[k]);
+		bottom = std::max(bottom, py[k]);
+	}
+	xs[i] = left - TRANSITION_MARGIN;
+	ys[i] = top - TRANSITION_MARGIN;
+	ws[i] = right - left + 2 * TRANSITION_MARGIN;
+	hs[i] = bottom - top + 2 * TRANSITION_MARGIN;
+	valid[i] = 1;
+}
+
+bool CyberiadaSMGeometryStore::update(const QList<Cyberiada::Element*>& changed)
+{
+	QVector<int> transitions;
+	foreach(Cyberiada::Element* e, changed) {
+		int i = indexOf(e->get_id());
+		if (i < 0 || elements[i] != e) {
+			return false;
+		}
+		if (e->get_type() == Cyberiada::elementTransition) {
+			transitions.append(i);
+			continue;
+		}
+		// the nested elements move together with their parent
+		for (int k = i; k < ends[i]; k++) {
+			if (elements[k]->get_type() == Cyberiada::elementTransition) {
+				transitions.append(k);
+				continue;
+			}
+			updateRect(k);
+			for (int j = incidenceOffsets[k]; j < incidenceOffsets[k + 1]; j++) {
+				transitions.append(incidence[j]);
+			}
+		}
+	}
+	std::sort(transitions.begin(), transitions.end());
+	transitions.erase(std::unique(transitions.begin(), transitions.end()), transitions.end());
+
+	QVector<qreal> pxs, pys;
+	foreach(int t, transitions) {
+		pxs.clear();
+		pys.clear();
+		updatePath(t, pxs, pys);
+		if (pxs.size() != pathSize(t)) {
+			// the number of the points has changed, the buffers are laid out again
+			buildPaths();
+			return true;
+		}
+		std::copy(pxs.constBegin(), pxs.constEnd(), pathXs.begin() + pathOffsets[t]);
+		std::copy(pys.constBegin(), pys.constEnd(), pathYs.begin() + pathOffsets[t]);
+		updateTransitionRect(t);
+	}
+	return true;
+}
+
+QRectF CyberiadaSMGeometryStore::boundingRect() const
+{
+	const int n = elements.size();
+	const qreal* x = xs.constData();
+	const qreal* y = ys.constData();
+	const qreal* w = ws.constData();
+	const qreal* h = hs.constData();
+	const uchar* v = valid.constData();
+	qreal left = std::numeric_limits<qreal>::max(), top = left;
+	qreal right = -left, bottom = -left;
+	for (int i = 0; i < n; i++) {
+		left = std::min(left, v[i] ? x[i] : left);
+		top = std::min(top, v[i] ? y[i] : top);
+		right = std::max(right, v[i] ? x[i] + w[i] : right);
+		bottom = std::max(bottom, v[i] ? y[i] + h[i] : bottom);
+	}
+	if (left > right) {
+		return QRectF();
+	}
+	return QRectF(QPointF(left, top), QPointF(right, bottom));
+}
+
+QRectF CyberiadaSMGeometryStore::boundingRect(const QVector<int>& indexes) const
+{
+	QRectF result;
+	foreach(int i, indexes) {
+		if (valid[i]) {
+			result |= rect(i);
+		}
+	}
+	return result;
+}
+
+QVector<int> CyberiadaSMGeometryStore::query(const QRectF& region) const
+{
+	const int n = elements.size();
+	const qreal* x = xs.constData();
+	const qreal* y = ys.constData();
+	const qreal* w = ws.constData();
+	const qreal* h = hs.constData();
+	const uchar* v = valid.constData();
+	const qreal l = region.left(), r = region.right(), t = region.top(), b = region.bottom();
+
+	QVector<uchar> mask(n);
+	uchar* m = mask.data();
+	for (int i = 0; i < n; i++) {
+		m[i] = v[i] & (x[i] < r) & (x[i] + w[i] > l) & (y[i] < b) & (y[i] + h[i] > t);
+	}
+
+	QVector<int> result;
+	for (int i = 0; i < n; i++) {
+		if (!m[i]) continue;
+		// the bounding box of a long transition covers much more than its path
+		if (pathSize(i) > 2 && !pathIntersects(i, region)) continue;
+		result.append(i);
+	}
+	return result;
+}
+
+QVector<int> CyberiadaSMGeometryStore::contained(const QRectF& region) const
+{
+	const int n = elements.size();
+	const qreal* x = xs.constData();
+	const qreal* y = ys.constData();
+	const qreal* w = ws.constData();
+	const qreal* h = hs.constData();
+	const uchar* v = valid.constData();
+	const qreal l = region.left(), r = region.right(), t = region.top(), b = region.bottom();
+
+	QVector<uchar> mask(n);
+	uchar* m = mask.data();
+	for (int i = 0; i < n; i++) {
+		m[i] = v[i] & (x[i] >= l) & (x[i] + w[i] <= r) & (y[i] >= t) & (y[i] + h[i] <= b);
+	}
+
+	QVector<int> result;
+	for (int i = 0; i < n; i++) {
+		if (m[i]) {
+			result.append(i);
+		}
+	}
+	return result;
+}
+
+bool CyberiadaSMGeometryStore::pathIntersects(int i, const QRectF& region) const
+{
+	// the conservative test of the segment boxes
+	int begin = pathOffsets[i], end = pathOffsets[i + 1];
+	for (int k = begin + 1; k < end; k++) {
+		qreal x1 = pathXs[k - 1], x2 = pathXs[k], y1 = pathYs[k - 1], y2 = pathYs[k];
+		if (std::min(x1, x2) - TRANSITION_MARGIN < region.right() &&
+			std::max(x1, x2) + TRANSITION_MARGIN > region.left() &&
+			std::min(y1, y2) - TRANSITION_MARGIN < region.bottom() &&
+			std::max(y1, y2) + TRANSITION_MARGIN > region.top()) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,111 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Scene Geometry Store
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_GEOMETRY_STORE_HEADER
+#define CYBERIADA_SM_GEOMETRY_STORE_HEADER
+
+#include <QVector>
+#include <QMap>
+#include <QList>
+#include <QRectF>
+#include <cyberiada/cyberiadamlpp.h>
+
+/* -----------------------------------------------------------------------------
+ * The compact copy of the scene geometry of a state machine. Every element
+ * that has an editor item gets a dense index in the depth-first order of the
+ * document, so the parents precede their children and every subtree is a
+ * contiguous range. The geometry is kept as a structure of arrays: the scene
+ * rectangles in x/y/w/h and the transition paths (in the scene coordinates)
+ * in the flat point buffers, so the culling, the rubber band selection and
+ * the bounding box are plain loops over the arrays the compiler vectorizes.
+ * The transitions get the bounding boxes of their paths.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMGeometryStore {
+public:
+	CyberiadaSMGeometryStore();
+
+	void                                build(Cyberiada::StateMachine* sm);
+	void                                clear();
+	// re-read the geometry of the elements, their subtrees and the attached transitions;
+	// returns false if an element is unknown and the store needs to be rebuilt
+	bool                                update(const QList<Cyberiada::Element*>& elements);
+
+	int                                 size() const { return elements.size(); }
+	int                                 indexOf(const Cyberiada::ID& id) const { return index.value(id, -1); }
+	Cyberiada::Element*                 element(int i) const { return elements[i]; }
+	int                                 parent(int i) const { return parents[i]; }
+	int                                 source(int i) const { return sources[i]; }
+	int                                 target(int i) const { return targets[i]; }
+	int                                 subtreeEnd(int i) const { return ends[i]; }
+	bool                                isValid(int i) const { return valid[i]; }
+	QRectF                              rect(int i) const { return QRectF(xs[i], ys[i], ws[i], hs[i]); }
+	QRectF                              boundingRect() const;
+	QRectF                              boundingRect(const QVector<int>& indexes) const;
+
+	// the transition path: the source point, the polyline and the target point
+	int                                 pathSize(int i) const { return pathOffsets[i + 1] - pathOffsets[i]; }
+	QPointF                             pathPoint(int i, int k) const {
+		return QPointF(pathXs[pathOffsets[i] + k], pathYs[pathOffsets[i] + k]);
+	}
+
+	// the entries intersecting the region (the transitions by their path segments)
+	QVector<int>                        query(const QRectF& region) const;
+	// the entries lying inside the region
+	QVector<int>                        contained(const QRectF& region) const;
+
+private:
+	void                                addEntries(Cyberiada::ElementCollection* collection, int parent);
+	void                                updateRect(int i);
+	void                                updatePath(int i, QVector<qreal>& pxs, QVector<qreal>& pys) const;
+	void                                buildPaths();
+	void                                updateTransitionRect(int i);
+	bool                                pathIntersects(int i, const QRectF& region) const;
+
+	// the elements
+	QVector<Cyberiada::Element*>        elements;
+	QVector<int>                        parents;    // -1 for the state machine
+	QVector<int>                        ends;       // the end of the subtree
+	QVector<int>                        sources;    // the transition ends, -1 for other elements
+	QVector<int>                        targets;
+	QMap<Cyberiada::ID, int>            index;
+
+	// the scene rectangles
+	QVector<qreal>                      xs;
+	QVector<qreal>                      ys;
+	QVector<qreal>                      ws;
+	QVector<qreal>                      hs;
+	QVector<uchar>                      valid;
+
+	// the transition paths; the entry i owns the points [pathOffsets[i], pathOffsets[i + 1])
+	QVector<int>                        pathOffsets;
+	QVector<qreal>                      pathXs;
+	QVector<qreal>                      pathYs;
+
+	// the transitions attached to the vertices: incidence[incidenceOffsets[i] ...]
+	QVector<int>                        incidenceOffsets;
+	QVector<int>                        incidence;
+};
+
+#endif
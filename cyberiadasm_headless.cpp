@@ -0,0 +1,167 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Headless Export implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <QDir>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QtConcurrent>
+
+#include "cyberiadasm_headless.h"
+#include "cyberiadasm_model.h"
+#include "cyberiadasm_layout.h"
+#include "cyberiadasm_typography.h"
+#include "cyberiadasm_trace.h"
+#include "myassert.h"
+
+namespace {
+	struct Report {
+		QString                         file;
+		QString                         error;
+		int                             machines;
+		QStringList                     outputs;
+		qint64                          loadMsecs;
+		qint64                          buildMsecs;
+		qint64                          renderMsecs;
+	};
+
+	const char* formatSuffix(CyberiadaSMExporter::Format format)
+	{
+		switch (format) {
+		case CyberiadaSMExporter::formatPNG: return "png";
+		case CyberiadaSMExporter::formatPDF: return "pdf";
+		case CyberiadaSMExporter::formatSVG: return "svg";
+		}
+		return "";
+	}
+
+	// the model lives only while its document is processed, so the reports
+	// kept by the future are the only memory the finished documents hold
+	struct ProcessDocument {
+		typedef Report                  result_type;
+		const CyberiadaSMHeadless::Options* options;
+
+		ProcessDocument(const CyberiadaSMHeadless::Options* o): options(o) {}
+
+		Report operator()(const QString& file) const
+		{
+			SM_TRACE_SPAN("headless document");
+			Report report;
+			report.file = file;
+			report.machines = 0;
+			report.loadMsecs = report.buildMsecs = report.renderMsecs = 0;
+			CyberiadaSMModel model(NULL);
+			process(model, report);
+			return report;
+		}
+
+		void process(CyberiadaSMModel& model, Report& report) const
+		{
+			QElapsedTimer timer;
+			timer.start();
+			if (!model.loadDocument(report.file, &report.error)) {
+				return;
+			}
+			report.loadMsecs = timer.restart();
+
+			// the same geometry the editor scene would show
+			QList<Cyberiada::StateMachine*> sms = model.stateMachines();
+			foreach(Cyberiada::StateMachine* sm, sms) {
+				if (CyberiadaSMLayout::needsLayout(sm)) {
+					CyberiadaSMLayout layout(sm);
+					layout.run();
+					layout.apply(&model);
+				}
+				model.spatialIndex(sm);
+			}
+			report.buildMsecs = timer.restart();
+
+			QString base = QDir(options->outputDir).filePath(QFileInfo(report.file).completeBaseName());
+			for (int i = 0; i < sms.size(); i++) {
+				CyberiadaSMExporter exporter(&model, sms[i]);
+				QString name = sms.size() == 1 ? base : QString("%1-%2").arg(base).arg(i + 1);
+				foreach(CyberiadaSMExporter::Format format, options->formats) {
+					QString path = name + "." + formatSuffix(format);
+					QString error;
+					if (!exporter.exportTo(path, format, options->exportOptions, error)) {
+						report.error = QString("%1: %2").arg(path, error);
+						return;
+					}
+					report.outputs.append(path);
+				}
+			}
+			report.machines = sms.size();
+			report.renderMsecs = timer.elapsed();
+		}
+	};
+}
+
+bool CyberiadaSMHeadless::parseFormats(const QString& list, QList<CyberiadaSMExporter::Format>& formats)
+{
+	formats.clear();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	foreach(const QString& name, list.split(",", Qt::SkipEmptyParts)) {
+#else
+	foreach(const QString& name, list.split(",", QString::SkipEmptyParts)) {
+#endif
+		CyberiadaSMExporter::Format format;
+		if (!CyberiadaSMExporter::formatFromPath(QString("file.") + name.trimmed(), format)) {
+			return false;
+		}
+		formats.append(format);
+	}
+	return !formats.isEmpty();
+}
+
+int CyberiadaSMHeadless::run(const QStringList& files, const Options& options)
+{
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+	if (!QDir().mkpath(options.outputDir)) {
+		err << "Cannot create the output directory " << options.outputDir << endl;
+		return 1;
+	}
+
+	QElapsedTimer total;
+	total.start();
+	int failed = 0;
+	// the typography is a QObject of the main thread; the exporters only read its fonts
+	CyberiadaSMTypography::instance();
+	// the pool takes the next document as soon as a thread is free, the reports
+	// are printed in the order of the files as they become ready
+	QFuture<Report> reports = QtConcurrent::mapped(files, ProcessDocument(&options));
+	for (int i = 0; i < files.size(); i++) {
+		Report report = reports.resultAt(i);
+		if (!report.error.isEmpty()) {
+			failed++;
+			err << report.file << ": " << QString(report.error).replace('\n', ' ') << endl;
+		} else {
+			out << report.file << ": " << report.machines << " machines, load " << report.loadMsecs
+				<< " ms, build " << report.buildMsecs << " ms, render " << report.renderMsecs << " ms" << endl;
+		}
+	}
+	out << files.size() - failed << " of " << files.size() << " documents rendered in "
+		<< total.elapsed() << " ms" << endl;
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Headless Export
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_HEADLESS_HEADER
+#define CYBERIADA_SM_HEADLESS_HEADER
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+#include "cyberiadasm_export.h"
+
+/* -----------------------------------------------------------------------------
+ * The command line mode that renders every state machine of the documents to
+ * the image files without showing the editor. The documents are processed
+ * concurrently: each one is loaded, the machines without the geometry are laid
+ * out the same way the editor does it, and the machines are exported with the
+ * painting of the editor items. Every document gets its own model on the worker
+ * thread. The load, build and render timings are reported per document in the
+ * order of the files.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMHeadless {
+public:
+	struct Options {
+		QString                         outputDir;
+		QList<CyberiadaSMExporter::Format> formats;
+		CyberiadaSMExporter::Options    exportOptions;
+	};
+
+	// returns the process exit code
+	static int                          run(const QStringList& files, const Options& options);
+	static bool                         parseFormats(const QString& list, QList<CyberiadaSMExporter::Format>& formats);
+};
+
+#endif
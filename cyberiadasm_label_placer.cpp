@@ -0,0 +1,170 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Transition Label Placement implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <cmath>
+
+#include "cyberiadasm_label_placer.h"
+#include "myassert.h"
+
+// the overlap with another label is worse than the overlap with a state
+static const qreal LABEL_OVERLAP_WEIGHT = 3;
+static const qreal STATE_OVERLAP_WEIGHT = 1;
+// the cost of a transition line crossing the label
+static const qreal LINE_CROSSING_COST = 150;
+// the cost of taking the next candidate instead of the preferred one
+static const qreal CANDIDATE_RANK_COST = 20;
+
+CyberiadaSMLabelPlacer::CyberiadaSMLabelPlacer(qreal _cellSize):
+	cellSize(_cellSize)
+{
+	MY_ASSERT(cellSize > 0);
+}
+
+void CyberiadaSMLabelPlacer::cellRange(const QRectF& rect, int& x1, int& y1, int& x2, int& y2) const
+{
+	x1 = int(std::floor(rect.left() / cellSize));
+	y1 = int(std::floor(rect.top() / cellSize));
+	x2 = int(std::floor(rect.right() / cellSize));
+	y2 = int(std::floor(rect.bottom() / cellSize));
+}
+
+int CyberiadaSMLabelPlacer::place(const QGraphicsItem* label,
+								  const QVector<QPointF>& candidates, const QSizeF& size,
+								  const QVector<QRectF>& obstacles, const QVector<QLineF>& lines)
+{
+	MY_ASSERT(label);
+	remove(label);
+	if (candidates.isEmpty()) {
+		return -1;
+	}
+
+	int best = 0;
+	qreal best_cost = -1;
+	for (int i = 0; i < candidates.size(); i++) {
+		qreal rank_cost = i * CANDIDATE_RANK_COST;
+		if (best_cost >= 0 && rank_cost >= best_cost) {
+			// the rest of the candidates cannot win even without any overlaps
+			break;
+		}
+		qreal c = rank_cost + cost(label, QRectF(candidates[i], size), obstacles, lines);
+		if (best_cost < 0 || c < best_cost) {
+			best = i;
+			best_cost = c;
+		}
+	}
+
+	QRectF rect(candidates[best], size);
+	labels.insert(label, rect);
+	int x1, y1, x2, y2;
+	cellRange(rect, x1, y1, x2, y2);
+	for (int x = x1; x <= x2; x++) {
+		for (int y = y1; y <= y2; y++) {
+			cells[key(x, y)].append(label);
+		}
+	}
+	return best;
+}
+
+void CyberiadaSMLabelPlacer::remove(const QGraphicsItem* label)
+{
+	QHash<const QGraphicsItem*, QRectF>::iterator i = labels.find(label);
+	if (i == labels.end()) {
+		return;
+	}
+	int x1, y1, x2, y2;
+	cellRange(i.value(), x1, y1, x2, y2);
+	for (int x = x1; x <= x2; x++) {
+		for (int y = y1; y <= y2; y++) {
+			QHash<qint64, QVector<const QGraphicsItem*> >::iterator cell = cells.find(key(x, y));
+			if (cell == cells.end()) continue;
+			cell.value().removeAll(label);
+			if (cell.value().isEmpty()) {
+				cells.erase(cell);
+			}
+		}
+	}
+	labels.erase(i);
+}
+
+void CyberiadaSMLabelPlacer::clear()
+{
+	labels.clear();
+	cells.clear();
+}
+
+qreal CyberiadaSMLabelPlacer::cost(const QGraphicsItem* label, const QRectF& rect,
+								   const QVector<QRectF>& obstacles, const QVector<QLineF>& lines) const
+{
+	qreal result = 0;
+	foreach(const QRectF& obstacle, obstacles) {
+		QRectF common = rect.intersected(obstacle);
+		result += common.width() * common.height() * STATE_OVERLAP_WEIGHT;
+	}
+	foreach(const QLineF& line, lines) {
+		if (crosses(line, rect)) {
+			result += LINE_CROSSING_COST;
+		}
+	}
+
+	// the label spanning several cells meets the same neighbour more than once
+	QVector<const QGraphicsItem*> seen;
+	int x1, y1, x2, y2;
+	cellRange(rect, x1, y1, x2, y2);
+	for (int x = x1; x <= x2; x++) {
+		for (int y = y1; y <= y2; y++) {
+			QHash<qint64, QVector<const QGraphicsItem*> >::const_iterator cell = cells.find(key(x, y));
+			if (cell == cells.end()) continue;
+			foreach(const QGraphicsItem* other, cell.value()) {
+				if (other == label || seen.contains(other)) continue;
+				seen.append(other);
+				QRectF common = rect.intersected(labels.value(other));
+				result += common.width() * common.height() * LABEL_OVERLAP_WEIGHT;
+			}
+		}
+	}
+	return result;
+}
+
+bool CyberiadaSMLabelPlacer::crosses(const QLineF& line, const QRectF& rect)
+{
+	if (rect.contains(line.p1()) || rect.contains(line.p2())) {
+		return true;
+	}
+	QLineF edges[4] = {
+		QLineF(rect.topLeft(), rect.topRight()),
+		QLineF(rect.topRight(), rect.bottomRight()),
+		QLineF(rect.bottomRight(), rect.bottomLeft()),
+		QLineF(rect.bottomLeft(), rect.topLeft())
+	};
+	for (int i = 0; i < 4; i++) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+		if (line.intersects(edges[i], NULL) == QLineF::BoundedIntersection) {
+#else
+		if (line.intersect(edges[i], NULL) == QLineF::BoundedIntersection) {
+#endif
+			return true;
+		}
+	}
+	return false;
+}
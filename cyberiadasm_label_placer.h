@@ -0,0 +1,68 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Transition Label Placement
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_LABEL_PLACER_HEADER
+#define CYBERIADA_SM_LABEL_PLACER_HEADER
+
+#include <QVector>
+#include <QHash>
+#include <QRectF>
+#include <QLineF>
+
+class QGraphicsItem;
+
+/* -----------------------------------------------------------------------------
+ * Greedy placement of the transition labels. Every label comes with a short
+ * list of the candidate positions ordered by preference and with the state
+ * rectangles and the transition segments around them; the placer picks the
+ * cheapest candidate, where the overlaps with the already placed labels, the
+ * states and the lines cost more than a less preferred position. The placed
+ * labels are kept in a uniform grid, so the labels are placed one by one as
+ * their transitions change and the rest of the diagram is left untouched.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMLabelPlacer {
+public:
+	CyberiadaSMLabelPlacer(qreal cellSize = 64);
+
+	int                                 place(const QGraphicsItem* label,
+											  const QVector<QPointF>& candidates, const QSizeF& size,
+											  const QVector<QRectF>& obstacles, const QVector<QLineF>& lines);
+	void                                remove(const QGraphicsItem* label);
+	void                                clear();
+	bool                                contains(const QGraphicsItem* label) const { return labels.contains(label); }
+
+private:
+	qreal                               cost(const QGraphicsItem* label, const QRectF& rect,
+											 const QVector<QRectF>& obstacles, const QVector<QLineF>& lines) const;
+	void                                cellRange(const QRectF& rect, int& x1, int& y1, int& x2, int& y2) const;
+	static bool                         crosses(const QLineF& line, const QRectF& rect);
+	static qint64                       key(int x, int y) { return (qint64(x) << 32) ^ quint32(y); }
+
+	qreal                               cellSize;
+	QHash<const QGraphicsItem*, QRectF> labels;
+	QHash<qint64, QVector<const QGraphicsItem*> > cells;
+};
+
+#endif
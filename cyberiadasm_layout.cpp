@@ -0,0 +1,512 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Layered Layout implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <QHash>
+#include <QPair>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include "cyberiadasm_layout.h"
+#include "cyberiadasm_model.h"
+#include "cyberiadasm_trace.h"
+#include "myassert.h"
+
+static const qreal STATE_MIN_WIDTH = 120;
+static const qreal STATE_MIN_HEIGHT = 70;
+static const qreal STATE_TITLE_HEIGHT = 30;
+static const qreal STATE_PADDING = 20;
+static const qreal CHAR_WIDTH = 9;       // the title font is monospace
+static const qreal VERTEX_SIZE = 20;
+static const qreal CHOICE_SIZE = 30;
+static const qreal COMMENT_WIDTH = 120;
+static const qreal COMMENT_HEIGHT = 60;
+static const qreal NODE_SPACING = 50;
+static const qreal LAYER_SPACING = 70;
+static const int   ORDER_SWEEPS = 4;
+
+namespace {
+	struct GroupLayout {
+		typedef void result_type;
+		CyberiadaSMLayout* layout;
+		GroupLayout(CyberiadaSMLayout* l): layout(l) {}
+		void operator()(int group) const { layout->layoutGroup(group); }
+	};
+
+	bool lessKey(const QPair<qreal, int>& a, const QPair<qreal, int>& b)
+	{
+		return a.first < b.first;
+	}
+}
+
+CyberiadaSMLayout::CyberiadaSMLayout(const Cyberiada::StateMachine* sm):
+	maxDepth(0), freeNodes(0), elapsedTime(0)
+{
+	MY_ASSERT(sm);
+	Node root;
+	root.id = sm->get_id();
+	root.type = Cyberiada::elementSM;
+	root.parent = -1;
+	root.depth = 0;
+	root.placed = true;
+	nodes.append(root);
+
+	QMap<Cyberiada::ID, int> index;
+	index.insert(root.id, 0);
+	QList<const Cyberiada::Transition*> transitions;
+	addNodes(sm, 0, index, transitions);
+
+	groupEdges.resize(nodes.size());
+	foreach(const Cyberiada::Transition* t, transitions) {
+		QMap<Cyberiada::ID, int>::const_iterator source = index.find(t->source_element_id());
+		QMap<Cyberiada::ID, int>::const_iterator target = index.find(t->target_element_id());
+		if (source == index.end() || target == index.end()) continue;
+		addEdge(source.value(), target.value());
+		Link link;
+		link.id = t->get_id();
+		link.source = source.value();
+		link.target = target.value();
+		link.moved = false;
+		link.valid = false;
+		links.append(link);
+	}
+}
+
+bool CyberiadaSMLayout::needsLayout(const Cyberiada::StateMachine* sm)
+{
+	MY_ASSERT(sm);
+	QList<const Cyberiada::ElementCollection*> collections;
+	collections.append(sm);
+	while (!collections.isEmpty()) {
+		const Cyberiada::ElementCollection* collection = collections.takeLast();
+		if (!collection->has_children()) continue;
+		const Cyberiada::ElementList& children = collection->get_children();
+		for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+			const Cyberiada::Element* child = *i;
+			switch (child->get_type()) {
+			case Cyberiada::elementCompositeState:
+				collections.append(static_cast<const Cyberiada::ElementCollection*>(child));
+				// fall through
+			case Cyberiada::elementSimpleState:
+				if (!static_cast<const Cyberiada::ElementCollection*>(child)->get_geometry_rect().valid) {
+					return true;
+				}
+				break;
+			case Cyberiada::elementInitial:
+			case Cyberiada::elementFinal:
+			case Cyberiada::elementTerminate:
+				if (!static_cast<const Cyberiada::Vertex*>(child)->get_geometry_point().valid) {
+					return true;
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	return false;
+}
+
+void CyberiadaSMLayout::addNodes(const Cyberiada::ElementCollection* collection, int parent,
+								 QMap<Cyberiada::ID, int>& index,
+								 QList<const Cyberiada::Transition*>& transitions)
+{
+	if (!collection->has_children()) {
+		return;
+	}
+	const Cyberiada::ElementList& children = collection->get_children();
+	for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+		const Cyberiada::Element* child = *i;
+		Cyberiada::ElementType type = child->get_type();
+		if (type == Cyberiada::elementTransition) {
+			transitions.append(static_cast<const Cyberiada::Transition*>(child));
+			continue;
+		}
+		Node node;
+		node.id = child->get_id();
+		node.type = type;
+		node.parent = parent;
+		node.depth = nodes[parent].depth + 1;
+		node.size = leafSize(child);
+		node.placed = placedGeometry(child, node);
+		if (!node.placed) {
+			freeNodes++;
+		}
+		int n = nodes.size();
+		nodes.append(node);
+		nodes[parent].children.append(n);
+		index.insert(node.id, n);
+		maxDepth = qMax(maxDepth, node.depth);
+		if (type == Cyberiada::elementCompositeState) {
+			addNodes(static_cast<const Cyberiada::ElementCollection*>(child), n, index, transitions);
+		}
+	}
+}
+
+void CyberiadaSMLayout::addEdge(int source, int target)
+{
+	// the edge is lifted to the children of the closest common ancestor
+	while (nodes[source].depth > nodes[target].depth) source = nodes[source].parent;
+	while (nodes[target].depth > nodes[source].depth) target = nodes[target].parent;
+	if (source == target) {
+		// a loop or a transition between a composite state and its child
+		return;
+	}
+	while (nodes[source].parent != nodes[target].parent) {
+		source = nodes[source].parent;
+		target = nodes[target].parent;
+	}
+	Edge e;
+	e.source = source;
+	e.target = target;
+	groupEdges[nodes[source].parent].append(e);
+}
+
+QSizeF CyberiadaSMLayout::leafSize(const Cyberiada::Element* element)
+{
+	switch (element->get_type()) {
+	case Cyberiada::elementSimpleState:
+	case Cyberiada::elementCompositeState: {
+		qreal title = QString(element->get_name().c_str()).length() * CHAR_WIDTH + 2 * STATE_PADDING;
+		return QSizeF(qMax(STATE_MIN_WIDTH, title), STATE_MIN_HEIGHT);
+	}
+	case Cyberiada::elementInitial:
+	case Cyberiada::elementFinal:
+	case Cyberiada::elementTerminate:
+		return QSizeF(VERTEX_SIZE, VERTEX_SIZE);
+	case Cyberiada::elementChoice:
+		return QSizeF(CHOICE_SIZE, CHOICE_SIZE);
+	case Cyberiada::elementComment:
+	case Cyberiada::elementFormalComment: {
+		Cyberiada::Rect r = static_cast<const Cyberiada::Comment*>(element)->get_geometry_rect();
+		if (r.valid) {
+			return QSizeF(r.width, r.height);
+		}
+		return QSizeF(COMMENT_WIDTH, COMMENT_HEIGHT);
+	}
+	default:
+		return QSizeF();
+	}
+}
+
+bool CyberiadaSMLayout::placedGeometry(const Cyberiada::Element* element, Node& node)
+{
+	Cyberiada::Rect r;
+	switch (element->get_type()) {
+	case Cyberiada::elementSimpleState:
+	case Cyberiada::elementCompositeState:
+		r = static_cast<const Cyberiada::ElementCollection*>(element)->get_geometry_rect();
+		break;
+	case Cyberiada::elementChoice:
+		r = static_cast<const Cyberiada::ChoicePseudostate*>(element)->get_geometry_rect();
+		break;
+	case Cyberiada::elementComment:
+	case Cyberiada::elementFormalComment:
+		r = static_cast<const Cyberiada::Comment*>(element)->get_geometry_rect();
+		break;
+	case Cyberiada::elementInitial:
+	case Cyberiada::elementFinal:
+	case Cyberiada::elementTerminate: {
+		Cyberiada::Point p = static_cast<const Cyberiada::Vertex*>(element)->get_geometry_point();
+		if (!p.valid) {
+			return false;
+		}
+		node.center = QPointF(p.x, p.y);
+		return true;
+	}
+	default:
+		return false;
+	}
+	if (!r.valid) {
+		return false;
+	}
+	node.center = QPointF(r.x, r.y);
+	node.size = QSizeF(r.width, r.height);
+	return true;
+}
+
+void CyberiadaSMLayout::fitGroup(int group, const QRectF& content)
+{
+	// the composite state is centered on its position, so it grows to the farthest child side
+	Node& g = nodes[group];
+	if (group == 0 || g.placed || content.isNull()) {
+		return;
+	}
+	qreal title = STATE_TITLE_HEIGHT;
+	QSizeF size(2 * qMax(-content.left(), content.right()) + 2 * STATE_PADDING,
+				2 * qMax(-content.top() + title / 2, content.bottom() - title / 2) + 2 * STATE_PADDING + title);
+	g.size = g.size.expandedTo(size);
+}
+
+void CyberiadaSMLayout::run()
+{
+	SM_TRACE_SPAN("layout");
+	QElapsedTimer timer;
+	timer.start();
+
+	QVector<QVector<int> > levels(maxDepth + 1);
+	for (int i = 0; i < nodes.size(); i++) {
+		if (!nodes[i].children.isEmpty()) {
+			levels[nodes[i].depth].append(i);
+		}
+	}
+	// each level depends on the sizes of the composite states one level deeper
+	for (int depth = maxDepth; depth >= 0; depth--) {
+		QVector<int>& groups = levels[depth];
+		if (groups.isEmpty()) {
+			continue;
+		} else if (groups.size() == 1) {
+			layoutGroup(groups.first());
+		} else {
+			QtConcurrent::blockingMap(groups, GroupLayout(this));
+		}
+	}
+
+	layoutLinks();
+
+	elapsedTime = timer.elapsed();
+}
+
+void CyberiadaSMLayout::layoutLinks()
+{
+	// the nodes are stored in preorder, so the parent position is known before the children
+	QVector<QPointF> position(nodes.size());
+	QVector<bool> moved(nodes.size(), false);
+	for (int i = 1; i < nodes.size(); i++) {
+		position[i] = position[nodes[i].parent] + nodes[i].center;
+		moved[i] = !nodes[i].placed || moved[nodes[i].parent];
+	}
+	for (int i = 0; i < links.size(); i++) {
+		Link& link = links[i];
+		// the transitions between the placed elements keep their routes
+		link.moved = moved[link.source] || moved[link.target];
+		if (!link.moved) {
+			continue;
+		}
+		QRectF source(QPointF(), nodes[link.source].size), target(QPointF(), nodes[link.target].size);
+		source.moveCenter(position[link.source]);
+		target.moveCenter(position[link.target]);
+		// loops and the transitions between the composite states and their children keep the defaults
+		if (link.source == link.target || source.contains(target) || target.contains(source)) {
+			continue;
+		}
+		QPointF d = target.center() - source.center();
+		if (d.isNull()) {
+			continue;
+		}
+		// the points where the line between the centers crosses the borders
+		qreal sk = qMin(d.x() != 0 ? source.width() / 2 / qAbs(d.x()) : 1e9,
+						d.y() != 0 ? source.height() / 2 / qAbs(d.y()) : 1e9);
+		qreal tk = qMin(d.x() != 0 ? target.width() / 2 / qAbs(d.x()) : 1e9,
+						d.y() != 0 ? target.height() / 2 / qAbs(d.y()) : 1e9);
+		link.sourcePoint = d * sk;
+		link.targetPoint = -d * tk;
+		link.valid = true;
+	}
+}
+
+void CyberiadaSMLayout::layoutGroup(int group)
+{
+	SM_TRACE_SPAN("layoutGroup");
+	// the groups of the same level touch disjoint nodes only, the vector is never reallocated here
+	Node* n = nodes.data();
+	// the placed children stay where they are, only the rest is laid out
+	QVector<int> children;
+	QRectF placed;
+	foreach(int c, n[group].children) {
+		if (n[c].placed) {
+			QRectF r(QPointF(), n[c].size);
+			r.moveCenter(n[c].center);
+			placed |= r;
+		} else {
+			children.append(c);
+		}
+	}
+	int count = children.size();
+	if (count == 0) {
+		fitGroup(group, placed);
+		return;
+	}
+
+	QHash<int, int> local;
+	for (int i = 0; i < count; i++) {
+		local.insert(children[i], i);
+	}
+	QVector<QVector<int> > out(count);
+	foreach(const Edge& e, groupEdges[group]) {
+		if (!local.contains(e.source) || !local.contains(e.target)) continue;
+		int s = local.value(e.source), t = local.value(e.target);
+		if (s != t && !out[s].contains(t)) {
+			out[s].append(t);
+		}
+	}
+
+	// 1. cycle removal: the edges closing a cycle in the depth-first order are reversed;
+	//    the search starts from the initial pseudostates so that the flow goes from them
+	QVector<int> roots;
+	for (int i = 0; i < count; i++) {
+		if (n[children[i]].type == Cyberiada::elementInitial) roots.append(i);
+	}
+	for (int i = 0; i < count; i++) {
+		if (n[children[i]].type != Cyberiada::elementInitial) roots.append(i);
+	}
+	QVector<QVector<int> > dag(count);
+	QVector<int> visited(count, 0); // 0 - new, 1 - on the stack, 2 - done
+	foreach(int r, roots) {
+		if (visited[r]) continue;
+		QVector<QPair<int, int> > stack;
+		stack.append(qMakePair(r, 0));
+		visited[r] = 1;
+		while (!stack.isEmpty()) {
+			int v = stack.last().first;
+			int next = stack.last().second;
+			if (next < out[v].size()) {
+				stack.last().second++;
+				int w = out[v][next];
+				if (visited[w] == 1) {
+					if (!dag[w].contains(v)) dag[w].append(v);
+				} else {
+					if (!dag[v].contains(w)) dag[v].append(w);
+					if (visited[w] == 0) {
+						visited[w] = 1;
+						stack.append(qMakePair(w, 0));
+					}
+				}
+			} else {
+				visited[v] = 2;
+				stack.removeLast();
+			}
+		}
+	}
+
+	// 2. longest path layering
+	QVector<int> indegree(count, 0);
+	QVector<QVector<int> > pred(count);
+	for (int v = 0; v < count; v++) {
+		foreach(int w, dag[v]) {
+			indegree[w]++;
+			pred[w].append(v);
+		}
+	}
+	QVector<int> layer(count, 0);
+	QVector<int> queue;
+	for (int v = 0; v < count; v++) {
+		if (indegree[v] == 0) queue.append(v);
+	}
+	int layers_count = 1;
+	for (int q = 0; q < queue.size(); q++) {
+		int v = queue[q];
+		layers_count = qMax(layers_count, layer[v] + 1);
+		foreach(int w, dag[v]) {
+			layer[w] = qMax(layer[w], layer[v] + 1);
+			if (--indegree[w] == 0) queue.append(w);
+		}
+	}
+	QVector<QVector<int> > layers(layers_count);
+	QVector<qreal> position(count);
+	for (int v = 0; v < count; v++) {
+		position[v] = layers[layer[v]].size();
+		layers[layer[v]].append(v);
+	}
+
+	// 3. crossing reduction with the barycenter heuristic, alternating down and up sweeps
+	for (int sweep = 0; sweep < ORDER_SWEEPS && layers_count > 1; sweep++) {
+		bool down = sweep % 2 == 0;
+		for (int k = 0; k < layers_count; k++) {
+			QVector<int>& l = layers[down ? k : layers_count - 1 - k];
+			QVector<QPair<qreal, int> > keys;
+			foreach(int v, l) {
+				const QVector<int>& neighbours = down ? pred[v] : dag[v];
+				qreal key = position[v];
+				if (!neighbours.isEmpty()) {
+					qreal sum = 0;
+					foreach(int w, neighbours) sum += position[w];
+					key = sum / neighbours.size();
+				}
+				keys.append(qMakePair(key, v));
+			}
+			std::stable_sort(keys.begin(), keys.end(), lessKey);
+			for (int i = 0; i < keys.size(); i++) {
+				l[i] = keys[i].second;
+				position[keys[i].second] = i;
+			}
+		}
+	}
+
+	// 4. coordinates: the layers go from top to bottom and are centered horizontally
+	QVector<qreal> layer_width(layers_count, 0), layer_height(layers_count, 0);
+	qreal width = 0, height = LAYER_SPACING * (layers_count - 1);
+	for (int l = 0; l < layers_count; l++) {
+		foreach(int v, layers[l]) {
+			const QSizeF& s = n[children[v]].size;
+			layer_width[l] += s.width();
+			layer_height[l] = qMax(layer_height[l], s.height());
+		}
+		layer_width[l] += NODE_SPACING * (layers[l].size() - 1);
+		width = qMax(width, layer_width[l]);
+		height += layer_height[l];
+	}
+	//    the block of the new children goes to the right of the placed ones
+	qreal title = group == 0 ? 0 : STATE_TITLE_HEIGHT;
+	QPointF origin(0, title / 2);
+	if (!placed.isNull()) {
+		origin = QPointF(placed.right() + NODE_SPACING + width / 2, placed.top() + height / 2);
+	}
+	qreal top = origin.y() - height / 2;
+	for (int l = 0; l < layers_count; l++) {
+		qreal x = origin.x() - layer_width[l] / 2;
+		foreach(int v, layers[l]) {
+			Node& child = n[children[v]];
+			child.center = QPointF(x + child.size.width() / 2, top + layer_height[l] / 2);
+			x += child.size.width() + NODE_SPACING;
+		}
+		top += layer_height[l] + LAYER_SPACING;
+	}
+
+	// the composite state grows to fit its children below the title
+	QRectF block(origin.x() - width / 2, origin.y() - height / 2, width, height);
+	fitGroup(group, placed | block);
+}
+
+void CyberiadaSMLayout::apply(CyberiadaSMModel* model) const
+{
+	MY_ASSERT(model);
+	QMap<Cyberiada::ID, Cyberiada::Rect> geometry;
+	for (int i = 1; i < nodes.size(); i++) {
+		const Node& node = nodes[i];
+		if (node.placed) continue;
+		geometry.insert(node.id, Cyberiada::Rect(node.center.x(), node.center.y(),
+												 node.size.width(), node.size.height()));
+	}
+	QMap<Cyberiada::ID, CyberiadaSMModel::TransitionGeometry> transitions;
+	foreach(const Link& link, links) {
+		if (!link.moved) continue;
+		CyberiadaSMModel::TransitionGeometry g;
+		if (link.valid) {
+			g.sourcePoint = Cyberiada::Point(link.sourcePoint.x(), link.sourcePoint.y());
+			g.targetPoint = Cyberiada::Point(link.targetPoint.x(), link.targetPoint.y());
+		}
+		transitions.insert(link.id, g);
+	}
+	model->layoutElements(geometry, transitions);
+}
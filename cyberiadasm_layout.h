@@ -0,0 +1,110 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Layered Layout
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+#ifndef CYBERIADA_SM_LAYOUT_HEADER
+#define CYBERIADA_SM_LAYOUT_HEADER
+
+#include <QVector>
+#include <QMap>
+#include <QPointF>
+#include <QSizeF>
+#include <QRectF>
+#include <cyberiada/cyberiadamlpp.h>
+
+class CyberiadaSMModel;
+
+/* -----------------------------------------------------------------------------
+ * Layered (Sugiyama-style) layout of the state machine.
+ *
+ * The constructor takes a snapshot of the machine structure, run() works on
+ * the snapshot only and apply() pushes the result to the model as a single
+ * undoable command. Only the elements without geometry are placed: the placed
+ * ones keep their position and size, and the new ones of the same composite
+ * are laid out as a block to the right of them. The children of every
+ * composite state are laid out independently: the states of the same nesting
+ * depth are processed in parallel, starting from the deepest ones, so that
+ * the size of each composite is known before its parent is laid out. The
+ * transitions with an end placed by the layout get the end points on the
+ * borders of their states and lose the polylines; the others are kept.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMLayout {
+public:
+	CyberiadaSMLayout(const Cyberiada::StateMachine* sm);
+
+	static bool                         needsLayout(const Cyberiada::StateMachine* sm);
+
+	void                                run();
+	void                                apply(CyberiadaSMModel* model) const;
+
+	const Cyberiada::ID&                stateMachineId() const { return nodes.first().id; }
+	// the number of the elements placed by the layout
+	int                                 elementsCount() const { return freeNodes; }
+	qint64                              elapsed() const { return elapsedTime; }
+
+	// the layout of one composite (or of the machine itself); public for the worker threads
+	void                                layoutGroup(int group);
+
+private:
+	struct Node {
+		Cyberiada::ID                   id;
+		Cyberiada::ElementType          type;
+		int                             parent;
+		int                             depth;
+		QVector<int>                    children;
+		QSizeF                          size;
+		QPointF                         center;     // relative to the center of the parent
+		bool                            placed;     // the geometry is taken from the model and kept
+	};
+	struct Edge {
+		int                             source;
+		int                             target;
+	};
+	struct Link {
+		Cyberiada::ID                   id;
+		int                             source;
+		int                             target;
+		bool                            moved;       // an end is placed by the layout
+		bool                            valid;
+		QPointF                         sourcePoint; // relative to the source center
+		QPointF                         targetPoint; // relative to the target center
+	};
+
+	void                                addNodes(const Cyberiada::ElementCollection* collection, int parent,
+												 QMap<Cyberiada::ID, int>& index,
+												 QList<const Cyberiada::Transition*>& transitions);
+	void                                addEdge(int source, int target);
+	static QSizeF                       leafSize(const Cyberiada::Element* element);
+	static bool                         placedGeometry(const Cyberiada::Element* element, Node& node);
+	void                                fitGroup(int group, const QRectF& content);
+	void                                layoutLinks();
+
+	QVector<Node>                       nodes;      // the state machine is the node 0
+	QVector<QVector<Edge> >             groupEdges; // the edges between the children of the node
+	QVector<Link>                       links;      // the transitions
+	int                                 maxDepth;
+	int                                 freeNodes;
+	qint64                              elapsedTime;
+};
+
+#endif
@@ -0,0 +1,253 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Overview Minimap implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <QPainter>
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QShowEvent>
+
+#include "cyberiadasm_minimap.h"
+#include "cyberiadasm_editor_scene.h"
+#include "cyberiadasm_editor_view.h"
+#include "myassert.h"
+
+static const int   MINIMAP_RENDER_DELAY = 100;  // msecs to collect the dirty regions
+static const int   MINIMAP_MARGIN = 4;
+static const int   MINIMAP_MAX_DIRTY_RECTS = 32;
+static const qreal VERTEX_MIN_SIZE = 2;
+
+CyberiadaSMMinimap::CyberiadaSMMinimap(CyberiadaSMEditorScene* _scene, CyberiadaSMGraphicsView* _view,
+									   QWidget* parent):
+	QWidget(parent), scene(_scene), view(_view), imageScale(1), fullDirty(true)
+{
+	MY_ASSERT(scene);
+	MY_ASSERT(view);
+	setMinimumSize(80, 60);
+	setCursor(Qt::PointingHandCursor);
+	renderTimer = new QTimer(this);
+	renderTimer->setSingleShot(true);
+	renderTimer->setInterval(MINIMAP_RENDER_DELAY);
+	connect(renderTimer, SIGNAL(timeout()), this, SLOT(slotRender()));
+	connect(scene, &CyberiadaSMEditorScene::overviewChanged, this, &CyberiadaSMMinimap::slotOverviewChanged);
+	// the viewport frame follows the view
+	connect(view, SIGNAL(viewportChanged()), this, SLOT(update()));
+	renderTimer->start();
+}
+
+QSize CyberiadaSMMinimap::sizeHint() const
+{
+	return QSize(240, 180);
+}
+
+void CyberiadaSMMinimap::slotOverviewChanged(const QRectF& rect)
+{
+	if (rect.isNull() || !imageRect.contains(rect)) {
+		fullDirty = true;
+	} else if (!fullDirty) {
+		dirtyRects.append(rect);
+		if (dirtyRects.size() > MINIMAP_MAX_DIRTY_RECTS) {
+			fullDirty = true;
+		}
+	}
+	if (!renderTimer->isActive()) {
+		renderTimer->start();
+	}
+}
+
+void CyberiadaSMMinimap::slotRender()
+{
+	if (!isVisible()) {
+		// rendered when shown
+		return;
+	}
+	if (fullDirty) {
+		renderFull();
+	} else {
+		foreach(const QRectF& rect, dirtyRects) {
+			render(rect);
+		}
+	}
+	dirtyRects.clear();
+	update();
+}
+
+void CyberiadaSMMinimap::renderFull()
+{
+	fullDirty = false;
+	QSize size = this->size();
+	if (image.size() != size) {
+		image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+	}
+	image.fill(palette().color(QPalette::Window));
+	imageRect = QRectF();
+	if (!scene->stateMachine()) {
+		return;
+	}
+	const CyberiadaSMGeometryStore& store = scene->geometryStore();
+	QRectF rect = store.boundingRect();
+	if (rect.isEmpty()) {
+		return;
+	}
+	qreal width = size.width() - 2 * MINIMAP_MARGIN, height = size.height() - 2 * MINIMAP_MARGIN;
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+	imageScale = qMin(width / rect.width(), height / rect.height());
+	// the image shows the rect with the margins and centered
+	imageRect = QRectF(QPointF(), QSizeF(size.width() / imageScale, size.height() / imageScale));
+	imageRect.moveCenter(rect.center());
+	imageOffset = imageRect.topLeft();
+	render(imageRect);
+}
+
+void CyberiadaSMMinimap::render(const QRectF& sceneRect)
+{
+	if (imageRect.isNull() || !scene->stateMachine()) {
+		return;
+	}
+	const CyberiadaSMGeometryStore& store = scene->geometryStore();
+	QRectF area = sceneRect.adjusted(-1 / imageScale, -1 / imageScale, 1 / imageScale, 1 / imageScale);
+
+	QPainter painter(&image);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.scale(imageScale, imageScale);
+	painter.translate(-imageOffset);
+	painter.setClipRect(area);
+	painter.fillRect(area, palette().color(QPalette::Window));
+
+	QPen state_pen(Qt::darkGray);
+	state_pen.setCosmetic(true);
+	QPen transition_pen(QColor(120, 120, 160));
+	transition_pen.setCosmetic(true);
+	qreal vertex = VERTEX_MIN_SIZE / imageScale;
+
+	// the store keeps the parents before the children, so the nested states are painted above
+	QVector<int> transitions;
+	foreach(int i, store.query(area)) {
+		if (!store.isValid(i)) continue;
+		Cyberiada::ElementType type = store.element(i)->get_type();
+		QRectF r = store.rect(i);
+		switch (type) {
+		case Cyberiada::elementSM:
+			break;
+		case Cyberiada::elementTransition:
+			transitions.append(i);
+			break;
+		case Cyberiada::elementSimpleState:
+		case Cyberiada::elementCompositeState:
+			painter.setPen(state_pen);
+			painter.setBrush(QColor(240, 240, 250));
+			painter.drawRect(r);
+			break;
+		case Cyberiada::elementComment:
+		case Cyberiada::elementFormalComment:
+			painter.setPen(Qt::NoPen);
+			painter.setBrush(QColor(255, 255, 200));
+			painter.drawRect(r);
+			break;
+		default:
+			// the pseudostates are dots of at least a couple of pixels
+			painter.setPen(Qt::NoPen);
+			painter.setBrush(Qt::black);
+			painter.drawEllipse(r.center(), qMax(r.width() / 2, vertex), qMax(r.height() / 2, vertex));
+			break;
+		}
+	}
+	painter.setPen(transition_pen);
+	foreach(int i, transitions) {
+		QPolygonF path;
+		for (int k = 0; k < store.pathSize(i); k++) {
+			path.append(store.pathPoint(i, k));
+		}
+		painter.drawPolyline(path);
+	}
+}
+
+QPointF CyberiadaSMMinimap::toScene(const QPointF& imagePoint) const
+{
+	return imagePoint / imageScale + imageOffset;
+}
+
+QPointF CyberiadaSMMinimap::toImage(const QPointF& scenePoint) const
+{
+	return (scenePoint - imageOffset) * imageScale;
+}
+
+void CyberiadaSMMinimap::paintEvent(QPaintEvent*)
+{
+	QPainter painter(this);
+	if (image.isNull() || imageRect.isNull()) {
+		painter.fillRect(rect(), palette().color(QPalette::Window));
+		return;
+	}
+	painter.drawImage(0, 0, image);
+	// the part of the machine visible in the view
+	QPolygonF visible = view->mapToScene(view->viewport()->rect());
+	QPolygonF frame;
+	foreach(const QPointF& p, visible) {
+		frame.append(toImage(p));
+	}
+	painter.setPen(Qt::red);
+	painter.setBrush(QColor(255, 0, 0, 30));
+	painter.drawPolygon(frame);
+}
+
+void CyberiadaSMMinimap::showEvent(QShowEvent* event)
+{
+	QWidget::showEvent(event);
+	// the changes made while hidden were not rendered
+	fullDirty = true;
+	renderTimer->start();
+}
+
+void CyberiadaSMMinimap::resizeEvent(QResizeEvent* event)
+{
+	QWidget::resizeEvent(event);
+	fullDirty = true;
+	renderTimer->start();
+}
+
+void CyberiadaSMMinimap::moveView(const QPoint& pos)
+{
+	if (imageRect.isNull()) {
+		return;
+	}
+	view->centerOn(toScene(pos));
+	update();
+}
+
+void CyberiadaSMMinimap::mousePressEvent(QMouseEvent* event)
+{
+	if (event->button() == Qt::LeftButton) {
+		moveView(event->pos());
+	}
+}
+
+void CyberiadaSMMinimap::mouseMoveEvent(QMouseEvent* event)
+{
+	if (event->buttons() & Qt::LeftButton) {
+		moveView(event->pos());
+	}
+}
@@ -0,0 +1,84 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Overview Minimap
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_MINIMAP_HEADER
+#define CYBERIADA_SM_MINIMAP_HEADER
+
+#include <QWidget>
+#include <QImage>
+#include <QRegion>
+#include <QTimer>
+
+class CyberiadaSMEditorScene;
+class CyberiadaSMGraphicsView;
+
+/* -----------------------------------------------------------------------------
+ * The overview of the whole state machine. The image is rendered at a low
+ * resolution from the geometry store of the scene, so the elements that have
+ * no items in a virtualized scene are shown too. The scene reports the dirty
+ * regions and only these parts of the image are rendered again; the whole
+ * image is rendered when the machine outgrows it or the widget is resized.
+ * Clicking or dragging moves the view to the point.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMMinimap: public QWidget {
+Q_OBJECT
+
+public:
+	CyberiadaSMMinimap(CyberiadaSMEditorScene* scene, CyberiadaSMGraphicsView* view, QWidget* parent = NULL);
+
+	QSize                               sizeHint() const override;
+
+public slots:
+	void                                slotOverviewChanged(const QRectF& rect);
+
+protected:
+	void                                paintEvent(QPaintEvent* event) override;
+	void                                resizeEvent(QResizeEvent* event) override;
+	void                                showEvent(QShowEvent* event) override;
+	void                                mousePressEvent(QMouseEvent* event) override;
+	void                                mouseMoveEvent(QMouseEvent* event) override;
+
+private slots:
+	void                                slotRender();
+
+private:
+	void                                renderFull();
+	void                                render(const QRectF& sceneRect);
+	QPointF                             toScene(const QPointF& imagePoint) const;
+	QPointF                             toImage(const QPointF& scenePoint) const;
+	void                                moveView(const QPoint& pos);
+
+	CyberiadaSMEditorScene*             scene;
+	CyberiadaSMGraphicsView*            view;
+	QImage                              image;
+	QRectF                              imageRect;  // the scene rect shown in the image
+	qreal                               imageScale;
+	QPointF                             imageOffset;
+	bool                                fullDirty;
+	QList<QRectF>                       dirtyRects; // in the scene coordinates
+	QTimer*                             renderTimer;
+};
+
+#endif
@@ -21,37 +21,39 @@
  *
  * ----------------------------------------------------------------------------- */
 
+#include <algorithm>
+#include <climits>
 #include <QIcon>
 #include <QList>
+#include <QSet>
 #include <QMimeData>
 #include <QDebug>
 #include <QMessageBox>
+#include <QUndoStack>
 
 #include "cyberiadasm_model.h"
+#include "cyberiadasm_commands.h"
+#include "cyberiadasm_spatial_index.h"
+#include "cyberiadasm_trace.h"
 #include "myassert.h"
 #include "cyberiada_constants.h"
 
+// the commands keep compact deltas only, so the limit bounds the history memory
+static const int UNDO_STACK_LIMIT = 500;
+
 CyberiadaSMModel::CyberiadaSMModel(QObject *parent):
 	QAbstractItemModel(parent)
 {
 	root = NULL;
-	icons[Cyberiada::elementRoot] = QIcon(":/Icons/images/sm-root.png");
-	icons[Cyberiada::elementSM] = QIcon(":/Icons/images/sm.png");
-	icons[Cyberiada::elementSimpleState] = QIcon(":/Icons/images/state.png");
-	icons[Cyberiada::elementCompositeState] = QIcon(":/Icons/images/state-comp.png"); 
-	icons[Cyberiada::elementComment] = QIcon(":/Icons/images/comment.png");
-	icons[Cyberiada::elementFormalComment] = QIcon(":/Icons/images/comment-machine.png");
-	icons[Cyberiada::elementInitial] = QIcon(":/Icons/images/init-state.png");
-	icons[Cyberiada::elementFinal] = QIcon(":/Icons/images/final-state.png");
-	icons[Cyberiada::elementChoice] = QIcon(":/Icons/images/choice.png");
-	icons[Cyberiada::elementTerminate] = QIcon(":/Icons/images/terminate.png");
-	icons[Cyberiada::elementTransition] = QIcon(":/Icons/images/trans.png");;
-
+	updateDepth = 0;
+	commands = new QUndoStack(this);
+	commands->setUndoLimit(UNDO_STACK_LIMIT);
 	cyberiadaStateMimeType = CYBERIADA_MIME_TYPE_STATE;
 }
 
 CyberiadaSMModel::~CyberiadaSMModel()
 {
+	clearSpatialIndexes();
 	if (root) {
 		delete root;
 	}
@@ -59,48 +61,62 @@ CyberiadaSMModel::~CyberiadaSMModel()
 
 void CyberiadaSMModel::reset()
 {
+	commands->clear();
 	beginResetModel();
+	clearSpatialIndexes();
 	if (root) {
 		root->reset();
 	}	
 	endResetModel();	
 }
 
-void CyberiadaSMModel::loadDocument(const QString& path)
+bool CyberiadaSMModel::loadDocument(const QString& path, QString* error_message)
 {	
+	SM_TRACE_SPAN("loadDocument");
 	Cyberiada::LocalDocument* new_doc = NULL;
 
 	bool error = false;
+	QString message;
 	try {
 		new_doc = new Cyberiada::LocalDocument();
 		new_doc->open(path.toStdString());
 	} catch (const Cyberiada::XMLException& e) {
-		QMessageBox::critical(NULL, tr("Load State Machine"),
-							  tr("XML grapml error:\n") + QString(e.str().c_str()));
+		message = tr("XML grapml error:\n") + QString(e.str().c_str());
 		error = true;
 	} catch (const Cyberiada::CybMLException& e) {
-		QMessageBox::critical(NULL, tr("Load State Machine"),
-							  tr("Wrong format of the Cyberiada grapml file:\n") + QString(e.str().c_str()));
+		message = tr("Wrong format of the Cyberiada grapml file:\n") + QString(e.str().c_str());
 		error = true;
 	} catch (const Cyberiada::Exception& e) {
-		QMessageBox::critical(NULL, tr("Load State Machine"),
-							  tr("Cannot load state machine graph:\n") + QString(e.str().c_str()));
+		message = tr("Cannot load state machine graph:\n") + QString(e.str().c_str());
 		error = true;
 	}
 
+	if (error) {
+		// the headless callers have no one to show the message box to
+		if (error_message) {
+			*error_message = message;
+		} else {
+			QMessageBox::critical(NULL, tr("Load State Machine"), message);
+		}
+	}
+
 	if (error && new_doc) {
 		delete new_doc;
 		new_doc = NULL;
 	}
 
 	if (new_doc) {
+		commands->clear();
 		beginResetModel();
+		clearSpatialIndexes();
 		if (root) {
 			delete root;
 		}
 		root = new_doc;
+		changedElements.clear();
 		endResetModel();
 	}
+	return !error;
 }
 
 QVariant CyberiadaSMModel::data(const QModelIndex &index, int role) const
@@ -160,8 +176,28 @@ QVariant CyberiadaSMModel::data(const QModelIndex &index, int role) const
 	}
 }
 
+void CyberiadaSMModel::loadIcons() const
+{
+	icons[Cyberiada::elementRoot] = QIcon(":/Icons/images/sm-root.png");
+	icons[Cyberiada::elementSM] = QIcon(":/Icons/images/sm.png");
+	icons[Cyberiada::elementSimpleState] = QIcon(":/Icons/images/state.png");
+	icons[Cyberiada::elementCompositeState] = QIcon(":/Icons/images/state-comp.png");
+	icons[Cyberiada::elementComment] = QIcon(":/Icons/images/comment.png");
+	icons[Cyberiada::elementFormalComment] = QIcon(":/Icons/images/comment-machine.png");
+	icons[Cyberiada::elementInitial] = QIcon(":/Icons/images/init-state.png");
+	icons[Cyberiada::elementFinal] = QIcon(":/Icons/images/final-state.png");
+	icons[Cyberiada::elementChoice] = QIcon(":/Icons/images/choice.png");
+	icons[Cyberiada::elementTerminate] = QIcon(":/Icons/images/terminate.png");
+	icons[Cyberiada::elementTransition] = QIcon(":/Icons/images/trans.png");
+}
+
 QIcon CyberiadaSMModel::getElementIcon(Cyberiada::ElementType type) const
 {
+	// the icons are loaded by the views on the GUI thread, so the models
+	// created on the worker threads never touch them
+	if (icons.isEmpty()) {
+		loadIcons();
+	}
 	if (icons.find(type) != icons.end()) {
 		return icons[type];
 	} else {
@@ -182,6 +218,666 @@ bool CyberiadaSMModel::setData(const QModelIndex&, const QVariant&, int)
 	return false;
 }
 
+void CyberiadaSMModel::beginUpdate()
+{
+	updateDepth++;
+}
+
+void CyberiadaSMModel::endUpdate()
+{
+	MY_ASSERT(updateDepth > 0);
+	updateDepth--;
+	if (updateDepth > 0 || changedElements.isEmpty()) {
+		return;
+	}
+
+	QList<Cyberiada::Element*> elements = changedElements;
+	changedElements.clear();
+	updateSpatialIndexes(elements);
+
+	// notify the views once per parent using the range of the changed rows
+	QMap<const Cyberiada::Element*, QPair<int, int> > ranges;
+	foreach(Cyberiada::Element* element, elements) {
+		if (element->is_root()) {
+			QAbstractItemModel::dataChanged(documentIndex(), documentIndex());
+			continue;
+		}
+		const Cyberiada::Element* parent = element->get_parent();
+		MY_ASSERT(parent);
+		int row = element->index();
+		if (ranges.contains(parent)) {
+			QPair<int, int>& range = ranges[parent];
+			range.first = qMin(range.first, row);
+			range.second = qMax(range.second, row);
+		} else {
+			ranges.insert(parent, qMakePair(row, row));
+		}
+	}
+	for (QMap<const Cyberiada::Element*, QPair<int, int> >::const_iterator i = ranges.begin(); i != ranges.end(); i++) {
+		QModelIndex parent_index = elementToIndex(i.key());
+		QAbstractItemModel::dataChanged(index(i.value().first, 0, parent_index),
+										index(i.value().second, 0, parent_index));
+	}
+	emit elementsChanged(elements);
+}
+
+QString CyberiadaSMModel::elementText(const Cyberiada::Element* element, TextField field) const
+{
+	MY_ASSERT(element);
+	Cyberiada::ElementType type = element->get_type();
+	switch(field) {
+	case textName:
+		return QString(element->get_name().c_str());
+	case textTrigger:
+	case textGuard:
+	case textBehavior:
+		if (type == Cyberiada::elementTransition) {
+			const Cyberiada::Action& a = static_cast<const Cyberiada::Transition*>(element)->get_action();
+			if (field == textTrigger) {
+				return QString(a.get_trigger().c_str());
+			} else if (field == textGuard) {
+				return QString(a.get_guard().c_str());
+			} else {
+				return QString(a.get_behavior().c_str());
+			}
+		}
+		break;
+	case textBody:
+		if (type == Cyberiada::elementComment || type == Cyberiada::elementFormalComment) {
+			return QString(static_cast<const Cyberiada::Comment*>(element)->get_body().c_str());
+		}
+		break;
+	}
+	return QString();
+}
+
+bool CyberiadaSMModel::updateElementText(Cyberiada::Element* element, TextField field, const QString& text)
+{
+	MY_ASSERT(element);
+	switch(field) {
+	case textName:
+		return updateElementName(element, text);
+	case textTrigger:
+	case textGuard:
+	case textBehavior:
+		return updateTransitionAction(element,
+									  field == textTrigger ? text : elementText(element, textTrigger),
+									  field == textGuard ? text : elementText(element, textGuard),
+									  field == textBehavior ? text : elementText(element, textBehavior));
+	case textBody:
+		return updateCommentBody(element, text);
+	}
+	return false;
+}
+
+bool CyberiadaSMModel::translateElement(Cyberiada::Element* element, const QPointF& delta)
+{
+	MY_ASSERT(element);
+	if (delta.isNull()) {
+		return false;
+	}
+
+	switch(element->get_type()) {
+	case Cyberiada::elementSimpleState:
+	case Cyberiada::elementCompositeState: {
+		Cyberiada::ElementCollection* c = static_cast<Cyberiada::ElementCollection*>(element);
+		Cyberiada::Rect r = c->get_geometry_rect();
+		if (!r.valid) return false;
+		r.x += delta.x();
+		r.y += delta.y();
+		beginUpdate();
+		c->set_geometry_rect(r);
+		break;
+	}
+	case Cyberiada::elementComment:
+	case Cyberiada::elementFormalComment: {
+		Cyberiada::Comment* c = static_cast<Cyberiada::Comment*>(element);
+		Cyberiada::Rect r = c->get_geometry_rect();
+		if (!r.valid) return false;
+		r.x += delta.x();
+		r.y += delta.y();
+		beginUpdate();
+		c->set_geometry_rect(r);
+		break;
+	}
+	case Cyberiada::elementChoice: {
+		Cyberiada::ChoicePseudostate* c = static_cast<Cyberiada::ChoicePseudostate*>(element);
+		Cyberiada::Rect r = c->get_geometry_rect();
+		if (!r.valid) return false;
+		r.x += delta.x();
+		r.y += delta.y();
+		beginUpdate();
+		c->set_geometry_rect(r);
+		break;
+	}
+	case Cyberiada::elementInitial:
+	case Cyberiada::elementFinal:
+	case Cyberiada::elementTerminate: {
+		Cyberiada::Vertex* v = static_cast<Cyberiada::Vertex*>(element);
+		Cyberiada::Point p = v->get_geometry_point();
+		if (!p.valid) return false;
+		p.x += delta.x();
+		p.y += delta.y();
+		beginUpdate();
+		v->set_geometry_point(p);
+		break;
+	}
+	case Cyberiada::elementTransition: {
+		// the polyline points are relative to the source element
+		Cyberiada::Transition* t = static_cast<Cyberiada::Transition*>(element);
+		if (!t->has_polyline()) return false;
+		Cyberiada::Polyline pl = t->get_geometry_polyline();
+		for (Cyberiada::Polyline::iterator i = pl.begin(); i != pl.end(); i++) {
+			i->x += delta.x();
+			i->y += delta.y();
+		}
+		beginUpdate();
+		t->set_geometry_polyline(pl);
+		break;
+	}
+	default:
+		return false;
+	}
+	elementChanged(element);
+	endUpdate();
+	return true;
+}
+
+Cyberiada::Rect CyberiadaSMModel::elementGeometry(const Cyberiada::Element* element) const
+{
+	MY_ASSERT(element);
+	switch(element->get_type()) {
+	case Cyberiada::elementSimpleState:
+	case Cyberiada::elementCompositeState:
+		return static_cast<const Cyberiada::ElementCollection*>(element)->get_geometry_rect();
+	case Cyberiada::elementComment:
+	case Cyberiada::elementFormalComment:
+		return static_cast<const Cyberiada::Comment*>(element)->get_geometry_rect();
+	case Cyberiada::elementChoice:
+		return static_cast<const Cyberiada::ChoicePseudostate*>(element)->get_geometry_rect();
+	case Cyberiada::elementInitial:
+	case Cyberiada::elementFinal:
+	case Cyberiada::elementTerminate: {
+		Cyberiada::Point p = static_cast<const Cyberiada::Vertex*>(element)->get_geometry_point();
+		if (p.valid) {
+			return Cyberiada::Rect(p.x, p.y, 0, 0);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	return Cyberiada::Rect();
+}
+
+bool CyberiadaSMModel::updateElementGeometry(Cyberiada::Element* element, const Cyberiada::Rect& rect)
+{
+	MY_ASSERT(element);
+	// the rect center is the position of the element, the pseudostates keep the point only
+	switch(element->get_type()) {
+	case Cyberiada::elementSimpleState:
+	case Cyberiada::elementCompositeState:
+		beginUpdate();
+		static_cast<Cyberiada::ElementCollection*>(element)->set_geometry_rect(rect);
+		break;
+	case Cyberiada::elementComment:
+	case Cyberiada::elementFormalComment:
+		beginUpdate();
+		static_cast<Cyberiada::Comment*>(element)->set_geometry_rect(rect);
+		break;
+	case Cyberiada::elementChoice:
+		beginUpdate();
+		static_cast<Cyberiada::ChoicePseudostate*>(element)->set_geometry_rect(rect);
+		break;
+	case Cyberiada::elementInitial:
+	case Cyberiada::elementFinal:
+	case Cyberiada::elementTerminate:
+		beginUpdate();
+		static_cast<Cyberiada::Vertex*>(element)->set_geometry_point(rect.valid ? Cyberiada::Point(rect.x, rect.y) :
+																	 Cyberiada::Point());
+		break;
+	default:
+		return false;
+	}
+	elementChanged(element);
+	endUpdate();
+	return true;
+}
+
+CyberiadaSMModel::TransitionGeometry CyberiadaSMModel::transitionGeometry(const Cyberiada::Element* element) const
+{
+	MY_ASSERT(element);
+	MY_ASSERT(element->get_type() == Cyberiada::elementTransition);
+	const Cyberiada::Transition* t = static_cast<const Cyberiada::Transition*>(element);
+	TransitionGeometry g;
+	if (t->has_geometry_source_point()) {
+		g.sourcePoint = t->get_source_point();
+	}
+	if (t->has_geometry_target_point()) {
+		g.targetPoint = t->get_target_point();
+	}
+	if (t->has_polyline()) {
+		g.polyline = t->get_geometry_polyline();
+	}
+	return g;
+}
+
+bool CyberiadaSMModel::updateTransitionGeometry(Cyberiada::Element* element, const TransitionGeometry& geometry)
+{
+	MY_ASSERT(element);
+	if (element->get_type() != Cyberiada::elementTransition) {
+		return false;
+	}
+	Cyberiada::Transition* t = static_cast<Cyberiada::Transition*>(element);
+	beginUpdate();
+	t->set_source_point(geometry.sourcePoint);
+	t->set_target_point(geometry.targetPoint);
+	t->set_geometry_polyline(geometry.polyline);
+	elementChanged(element);
+	endUpdate();
+	return true;
+}
+
+QList<Cyberiada::Element*> CyberiadaSMModel::anchoredTransitions(const QList<Cyberiada::Element*>& elements)
+{
+	QList<Cyberiada::Element*> result;
+	if (!root || elements.isEmpty()) {
+		return result;
+	}
+
+	QSet<const Cyberiada::Element*> moved;
+	foreach(Cyberiada::Element* element, elements) {
+		moved.insert(element);
+	}
+
+	Cyberiada::StateMachine* sm = root->get_parent_sm(elements.first());
+	if (!sm) {
+		return result;
+	}
+	QList<Cyberiada::Element*> transitions;
+	collectTransitions(sm, transitions);
+
+	// the transitions leaving the moved elements (or their descendants) for the unmoved ones
+	// keep their polyline points in place
+	foreach(Cyberiada::Element* element, transitions) {
+		const Cyberiada::Transition* t = static_cast<const Cyberiada::Transition*>(element);
+		if (!t->has_polyline()) continue;
+		bool source_moved = false, target_moved = false;
+		for (const Cyberiada::Element* e = idToElement(t->source_element_id().c_str()); e; e = e->get_parent()) {
+			if (moved.contains(e)) {
+				source_moved = true;
+				break;
+			}
+		}
+		for (const Cyberiada::Element* e = idToElement(t->target_element_id().c_str()); e; e = e->get_parent()) {
+			if (moved.contains(e)) {
+				target_moved = true;
+				break;
+			}
+		}
+		if (source_moved && !target_moved) {
+			result.append(element);
+		}
+	}
+	return result;
+}
+
+void CyberiadaSMModel::collectTransitions(Cyberiada::ElementCollection* collection,
+										  QList<Cyberiada::Element*>& transitions)
+{
+	MY_ASSERT(collection);
+	if (!collection->has_children()) {
+		return;
+	}
+	const Cyberiada::ElementList& children = collection->get_children();
+	for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+		Cyberiada::Element* child = *i;
+		Cyberiada::ElementType type = child->get_type();
+		if (type == Cyberiada::elementTransition) {
+			transitions.append(child);
+		} else if (type == Cyberiada::elementCompositeState) {
+			collectTransitions(static_cast<Cyberiada::ElementCollection*>(child), transitions);
+		}
+	}
+}
+
+int CyberiadaSMModel::beginInsertElement(Cyberiada::ElementCollection* parent)
+{
+	MY_ASSERT(root);
+	MY_ASSERT(parent);
+	// the new elements are appended to the children of the collection
+	dropSpatialIndex(parent);
+	int row = int(parent->children_count());
+	beginInsertRows(elementToIndex(parent), row, row);
+	return row;
+}
+
+void CyberiadaSMModel::endInsertElement(Cyberiada::Element* element, const Cyberiada::ID& id, int row)
+{
+	MY_ASSERT(element);
+	// the element re-created by redo gets its former ID back, so that the
+	// commands above it on the stack still find it
+	if (!id.empty() && element->get_id() != id) {
+		element->set_id(id);
+	}
+	MY_ASSERT(int(element->index()) == row);
+	endInsertRows();
+}
+
+Cyberiada::Element* CyberiadaSMModel::insertState(Cyberiada::ElementCollection* parent,
+												  const Cyberiada::ID& id,
+												  const QString& name,
+												  const Cyberiada::Rect& rect)
+{
+	int row = beginInsertElement(parent);
+	Cyberiada::Element* element = root->new_state(parent, name.toStdString(), Cyberiada::Action(), rect);
+	endInsertElement(element, id, row);
+	return element;
+}
+
+Cyberiada::Element* CyberiadaSMModel::insertComment(Cyberiada::ElementCollection* parent,
+													const Cyberiada::ID& id,
+													const QString& body,
+													const Cyberiada::Rect& rect)
+{
+	int row = beginInsertElement(parent);
+	Cyberiada::Element* element = root->new_comment(parent, body.toStdString(), rect);
+	endInsertElement(element, id, row);
+	return element;
+}
+
+Cyberiada::Element* CyberiadaSMModel::insertTransition(Cyberiada::StateMachine* sm,
+													   const Cyberiada::ID& id,
+													   Cyberiada::Element* source,
+													   Cyberiada::Element* target)
+{
+	MY_ASSERT(source);
+	MY_ASSERT(target);
+	int row = beginInsertElement(sm);
+	Cyberiada::Element* element = root->new_transition(sm, source, target);
+	endInsertElement(element, id, row);
+	return element;
+}
+
+bool CyberiadaSMModel::removeElement(Cyberiada::Element* element)
+{
+	MY_ASSERT(element);
+	if (element->is_root() || element->get_type() == Cyberiada::elementSM) {
+		return false;
+	}
+	Cyberiada::ElementCollection* parent = static_cast<Cyberiada::ElementCollection*>(element->get_parent());
+	MY_ASSERT(parent);
+	int row = element->index();
+	changedElements.removeAll(element);
+	dropSpatialIndex(element);
+	beginRemoveRows(elementToIndex(parent), row, row);
+	parent->remove_element(element->get_id());
+	endRemoveRows();
+	return true;
+}
+
+void CyberiadaSMModel::editElementsText(const QList<Cyberiada::Element*>& elements,
+										TextField field, const QString& text, int session)
+{
+	CyberiadaSMTextCommand* command = new CyberiadaSMTextCommand(this, elements, field, text, session);
+	if (command->isEmpty()) {
+		delete command;
+		return;
+	}
+	commands->push(command);
+}
+
+void CyberiadaSMModel::moveElements(const QList<Cyberiada::Element*>& elements, const QPointF& delta,
+									int gesture)
+{
+	if (elements.isEmpty() || delta.isNull()) {
+		return;
+	}
+	commands->push(new CyberiadaSMMoveCommand(this, elements, delta, gesture));
+}
+
+Cyberiada::Element* CyberiadaSMModel::createState(Cyberiada::ElementCollection* parent, const Cyberiada::Rect& rect)
+{
+	MY_ASSERT(parent);
+	return pushInsertCommand(new CyberiadaSMInsertCommand(this, Cyberiada::elementSimpleState, parent,
+														  tr("State"), rect));
+}
+
+Cyberiada::Element* CyberiadaSMModel::createComment(Cyberiada::ElementCollection* parent, const Cyberiada::Rect& rect)
+{
+	MY_ASSERT(parent);
+	return pushInsertCommand(new CyberiadaSMInsertCommand(this, Cyberiada::elementComment, parent,
+														  QString(), rect));
+}
+
+Cyberiada::Element* CyberiadaSMModel::createTransition(Cyberiada::Element* source, Cyberiada::Element* target)
+{
+	MY_ASSERT(source);
+	MY_ASSERT(target);
+	if (!root || root->get_parent_sm(source) != root->get_parent_sm(target)) {
+		return NULL;
+	}
+	return pushInsertCommand(new CyberiadaSMInsertCommand(this, source, target));
+}
+
+void CyberiadaSMModel::routeTransitions(const QMap<Cyberiada::ID, TransitionGeometry>& geometry)
+{
+	CyberiadaSMRouteCommand* command = new CyberiadaSMRouteCommand(this, geometry);
+	if (command->isEmpty()) {
+		delete command;
+		return;
+	}
+	commands->push(command);
+}
+
+void CyberiadaSMModel::layoutElements(const QMap<Cyberiada::ID, Cyberiada::Rect>& geometry,
+									  const QMap<Cyberiada::ID, TransitionGeometry>& transitions)
+{
+	// the elements and their transitions are placed and undone together
+	QUndoCommand* command = new QUndoCommand(tr("Layout"));
+	CyberiadaSMGeometryCommand* elements = new CyberiadaSMGeometryCommand(this, geometry, command);
+	CyberiadaSMRouteCommand* routes = new CyberiadaSMRouteCommand(this, transitions, command);
+	if (elements->isEmpty() && routes->isEmpty()) {
+		delete command;
+		return;
+	}
+	commands->push(command);
+}
+
+Cyberiada::Element* CyberiadaSMModel::pushInsertCommand(CyberiadaSMInsertCommand* command)
+{
+	commands->push(command);
+	return idToElement(QString(command->elementId().c_str()));
+}
+
+const CyberiadaSMSpatialIndex* CyberiadaSMModel::spatialIndex(const Cyberiada::StateMachine* sm) const
+{
+	MY_ASSERT(sm);
+	QMutexLocker lock(&spatialIndexesMutex);
+	CyberiadaSMSpatialIndex* index = spatialIndexes.value(sm);
+	if (!index) {
+		index = new CyberiadaSMSpatialIndex(sm);
+		spatialIndexes.insert(sm, index);
+	}
+	return index;
+}
+
+QList<const Cyberiada::Element*> CyberiadaSMModel::elementsAt(const Cyberiada::StateMachine* sm,
+															   const QPointF& point) const
+{
+	// the topmost (the most nested) elements first
+	QList<QPair<int, const Cyberiada::Element*> > found;
+	QSet<const Cyberiada::Element*> seen;
+	foreach(const CyberiadaSMSpatialIndex::Entry& e, spatialIndex(sm)->search(point)) {
+		if (seen.contains(e.element)) continue;
+		seen.insert(e.element);
+		int depth = 0;
+		for (const Cyberiada::Element* p = e.element->get_parent(); p && p != sm; p = p->get_parent()) {
+			depth++;
+		}
+		// the transitions are drawn above the states
+		if (e.element->get_type() == Cyberiada::elementTransition) {
+			depth = INT_MAX;
+		}
+		found.append(qMakePair(-depth, e.element));
+	}
+	std::stable_sort(found.begin(), found.end(),
+					 [](const QPair<int, const Cyberiada::Element*>& a, const QPair<int, const Cyberiada::Element*>& b) {
+						 return a.first < b.first;
+					 });
+	QList<const Cyberiada::Element*> result;
+	for (int i = 0; i < found.size(); i++) {
+		result.append(found[i].second);
+	}
+	return result;
+}
+
+QList<const Cyberiada::Element*> CyberiadaSMModel::elementsIn(const Cyberiada::StateMachine* sm,
+															   const QRectF& rect) const
+{
+	QList<const Cyberiada::Element*> result;
+	QSet<const Cyberiada::Element*> seen;
+	foreach(const CyberiadaSMSpatialIndex::Entry& e, spatialIndex(sm)->search(rect)) {
+		if (!seen.contains(e.element)) {
+			seen.insert(e.element);
+			result.append(e.element);
+		}
+	}
+	return result;
+}
+
+QList<const Cyberiada::Element*> CyberiadaSMModel::overlappingElements(const Cyberiada::Element* element) const
+{
+	MY_ASSERT(root);
+	MY_ASSERT(element);
+	QList<const Cyberiada::Element*> result;
+	const Cyberiada::StateMachine* sm = root->get_parent_sm(element);
+	if (!sm || element->get_type() == Cyberiada::elementTransition) {
+		return result;
+	}
+	const CyberiadaSMSpatialIndex* index = spatialIndex(sm);
+	QRectF rect = index->elementRect(element);
+	if (rect.isNull()) {
+		return result;
+	}
+	// the nested elements and the ancestors do not overlap with the element, they contain each other
+	foreach(const Cyberiada::Element* other, elementsIn(sm, rect)) {
+		if (other == element || other->get_type() == Cyberiada::elementTransition) continue;
+		bool related = false;
+		for (const Cyberiada::Element* p = other->get_parent(); p && !related; p = p->get_parent()) {
+			related = p == element;
+		}
+		for (const Cyberiada::Element* p = element->get_parent(); p && !related; p = p->get_parent()) {
+			related = p == other;
+		}
+		if (!related && index->elementRect(other).intersects(rect)) {
+			result.append(other);
+		}
+	}
+	return result;
+}
+
+void CyberiadaSMModel::updateSpatialIndexes(const QList<Cyberiada::Element*>& elements)
+{
+	QMutexLocker lock(&spatialIndexesMutex);
+	if (spatialIndexes.isEmpty()) {
+		return;
+	}
+	foreach(Cyberiada::Element* element, elements) {
+		if (element->is_root() || element->get_type() == Cyberiada::elementSM) continue;
+		CyberiadaSMSpatialIndex* index = spatialIndexes.value(root->get_parent_sm(element));
+		if (index) {
+			index->update(element);
+		}
+	}
+}
+
+void CyberiadaSMModel::dropSpatialIndex(const Cyberiada::Element* element)
+{
+	QMutexLocker lock(&spatialIndexesMutex);
+	if (spatialIndexes.isEmpty() || element->is_root()) {
+		return;
+	}
+	const Cyberiada::StateMachine* sm = element->get_type() == Cyberiada::elementSM ?
+		static_cast<const Cyberiada::StateMachine*>(element) : root->get_parent_sm(element);
+	delete spatialIndexes.take(sm);
+}
+
+void CyberiadaSMModel::clearSpatialIndexes()
+{
+	QMutexLocker lock(&spatialIndexesMutex);
+	qDeleteAll(spatialIndexes);
+	spatialIndexes.clear();
+}
+
+void CyberiadaSMModel::elementChanged(Cyberiada::Element* element)
+{
+	MY_ASSERT(element);
+	MY_ASSERT(updateDepth > 0);
+	if (!changedElements.contains(element)) {
+		changedElements.append(element);
+	}
+}
+
+bool CyberiadaSMModel::updateElementName(Cyberiada::Element* element, const QString& name)
+{
+	MY_ASSERT(element);
+	if (element->is_root() || element->get_type() == Cyberiada::elementTransition) {
+		return false;
+	}
+	if (QString(element->get_name().c_str()) == name) {
+		return false;
+	}
+	beginUpdate();
+	element->set_name(name.toStdString());
+	elementChanged(element);
+	endUpdate();
+	return true;
+}
+
+bool CyberiadaSMModel::updateTransitionAction(Cyberiada::Element* element,
+											  const QString& trigger,
+											  const QString& guard,
+											  const QString& behavior)
+{
+	MY_ASSERT(element);
+	if (element->get_type() != Cyberiada::elementTransition) {
+		return false;
+	}
+	Cyberiada::Transition* trans = static_cast<Cyberiada::Transition*>(element);
+	const Cyberiada::Action& action = trans->get_action();
+	if (QString(action.get_trigger().c_str()) == trigger &&
+		QString(action.get_guard().c_str()) == guard &&
+		QString(action.get_behavior().c_str()) == behavior) {
+		return false;
+	}
+	beginUpdate();
+	trans->set_action(Cyberiada::Action(trigger.toStdString(),
+										guard.toStdString(),
+										behavior.toStdString()));
+	elementChanged(element);
+	endUpdate();
+	return true;
+}
+
+bool CyberiadaSMModel::updateCommentBody(Cyberiada::Element* element, const QString& body)
+{
+	MY_ASSERT(element);
+	if (element->get_type() != Cyberiada::elementComment &&
+		element->get_type() != Cyberiada::elementFormalComment) {
+		return false;
+	}
+	Cyberiada::Comment* comment = static_cast<Cyberiada::Comment*>(element);
+	if (QString(comment->get_body().c_str()) == body) {
+		return false;
+	}
+	beginUpdate();
+	comment->set_body(body.toStdString());
+	elementChanged(element);
+	endUpdate();
+	return true;
+}
+
 Qt::ItemFlags CyberiadaSMModel::flags(const QModelIndex &index) const
 {
 	Qt::ItemFlags default_flags = Qt::ItemIsEnabled | Qt::ItemIsSelectable;
@@ -304,6 +1000,18 @@ QModelIndex CyberiadaSMModel::documentIndex() const
 	}
 }
 
+QList<Cyberiada::StateMachine*> CyberiadaSMModel::stateMachines() const
+{
+	QList<Cyberiada::StateMachine*> result;
+	if (root) {
+		std::list<Cyberiada::StateMachine*> sms = root->get_state_machines();
+		for (std::list<Cyberiada::StateMachine*>::const_iterator i = sms.begin(); i != sms.end(); i++) {
+			result.append(*i);
+		}
+	}
+	return result;
+}
+
 QModelIndex CyberiadaSMModel::firstSMIndex() const
 {
 	if (root) {
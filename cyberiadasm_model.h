@@ -27,8 +27,14 @@
 #include <QAbstractItemModel>
 #include <QIcon>
 #include <QDateTime>
+#include <QPointF>
+#include <QMutex>
 #include <cyberiada/cyberiadamlpp.h>
 
+class QUndoStack;
+class CyberiadaSMInsertCommand;
+class CyberiadaSMSpatialIndex;
+
 class CyberiadaSMModel: public QAbstractItemModel {
 Q_OBJECT
 
@@ -36,9 +42,25 @@ public:
 	CyberiadaSMModel(QObject *parent);
 	~CyberiadaSMModel();
 
+	enum TextField {
+		textName,
+		textTrigger,
+		textGuard,
+		textBehavior,
+		textBody
+	};
+
+	// transition geometry relative to the source and target centers
+	struct TransitionGeometry {
+		Cyberiada::Point                sourcePoint;
+		Cyberiada::Point                targetPoint;
+		Cyberiada::Polyline             polyline;
+	};
+
 	// CORE FUNCTIONALITY
 	void                                reset();
-	void                                loadDocument(const QString& path);
+	// shows the errors in a message box unless error_message is given
+	bool                                loadDocument(const QString& path, QString* error_message = NULL);
 
 	// DATA REPRESENTATION
 	QVariant                            data(const QModelIndex &index, int role) const;	
@@ -54,6 +76,58 @@ public:
 	
 	// EDITING
 	bool                                setData(const QModelIndex & index, const QVariant & value, int role = Qt::EditRole);
+	void                                beginUpdate();
+	void                                endUpdate();
+	bool                                updateElementName(Cyberiada::Element* element, const QString& name);
+	bool                                updateTransitionAction(Cyberiada::Element* element,
+															   const QString& trigger,
+															   const QString& guard,
+															   const QString& behavior);
+	bool                                updateCommentBody(Cyberiada::Element* element, const QString& body);
+	QString                             elementText(const Cyberiada::Element* element, TextField field) const;
+	bool                                updateElementText(Cyberiada::Element* element, TextField field, const QString& text);
+	bool                                translateElement(Cyberiada::Element* element, const QPointF& delta);
+	Cyberiada::Rect                     elementGeometry(const Cyberiada::Element* element) const;
+	bool                                updateElementGeometry(Cyberiada::Element* element, const Cyberiada::Rect& rect);
+	TransitionGeometry                  transitionGeometry(const Cyberiada::Element* element) const;
+	bool                                updateTransitionGeometry(Cyberiada::Element* element,
+																 const TransitionGeometry& geometry);
+	QList<Cyberiada::Element*>          anchoredTransitions(const QList<Cyberiada::Element*>& elements);
+	Cyberiada::Element*                 insertState(Cyberiada::ElementCollection* parent,
+													const Cyberiada::ID& id,
+													const QString& name,
+													const Cyberiada::Rect& rect);
+	Cyberiada::Element*                 insertComment(Cyberiada::ElementCollection* parent,
+													  const Cyberiada::ID& id,
+													  const QString& body,
+													  const Cyberiada::Rect& rect);
+	Cyberiada::Element*                 insertTransition(Cyberiada::StateMachine* sm,
+														 const Cyberiada::ID& id,
+														 Cyberiada::Element* source,
+														 Cyberiada::Element* target);
+	bool                                removeElement(Cyberiada::Element* element);
+
+	// UNDOABLE EDITING
+	QUndoStack*                         undoStack() const { return commands; }
+	// the edits of the same session (see CyberiadaSMTextCommand::newSession) are a single undo step
+	void                                editElementsText(const QList<Cyberiada::Element*>& elements,
+														 TextField field, const QString& text, int session = 0);
+	void                                moveElements(const QList<Cyberiada::Element*>& elements, const QPointF& delta,
+													 int gesture = 0);
+	Cyberiada::Element*                 createState(Cyberiada::ElementCollection* parent, const Cyberiada::Rect& rect);
+	Cyberiada::Element*                 createComment(Cyberiada::ElementCollection* parent, const Cyberiada::Rect& rect);
+	Cyberiada::Element*                 createTransition(Cyberiada::Element* source, Cyberiada::Element* target);
+	void                                routeTransitions(const QMap<Cyberiada::ID, TransitionGeometry>& geometry);
+	void                                layoutElements(const QMap<Cyberiada::ID, Cyberiada::Rect>& geometry,
+													   const QMap<Cyberiada::ID, TransitionGeometry>& transitions);
+
+	// SPATIAL QUERIES (in the scene coordinates of the state machine, no scene needed)
+	// the index is built on the first call from any thread; it can be read by several
+	// threads at once as long as the model is not edited meanwhile
+	const CyberiadaSMSpatialIndex*      spatialIndex(const Cyberiada::StateMachine* sm) const;
+	QList<const Cyberiada::Element*>    elementsAt(const Cyberiada::StateMachine* sm, const QPointF& point) const;
+	QList<const Cyberiada::Element*>    elementsIn(const Cyberiada::StateMachine* sm, const QRectF& rect) const;
+	QList<const Cyberiada::Element*>    overlappingElements(const Cyberiada::Element* element) const;
 
 	// DRAG & DROP
 	Qt::DropActions                     supportedDropActions() const;
@@ -76,6 +150,7 @@ public:
 
 	const Cyberiada::LocalDocument*     rootDocument() const;
 	Cyberiada::LocalDocument*           rootDocument();
+	QList<Cyberiada::StateMachine*>     stateMachines() const;
 	const Cyberiada::Element*           indexToElement(const QModelIndex& index) const;
 	Cyberiada::Element*                 indexToElement(const QModelIndex& index);
 	const Cyberiada::Element*           idToElement(const QString& id) const;
@@ -85,14 +160,31 @@ signals:
 	void                                dataChanged(const QModelIndex & topLeft, const QModelIndex & bottomRight);
 	void                                modelAboutToBeReset();
 	void                                modelReset();
+	void                                elementsChanged(const QList<Cyberiada::Element*>& elements);
 
 private:
 	void                                move(Cyberiada::Element* element, Cyberiada::ElementCollection* target_parent);
+	void                                elementChanged(Cyberiada::Element* element);
+	void                                collectTransitions(Cyberiada::ElementCollection* collection,
+														   QList<Cyberiada::Element*>& transitions);
+	int                                 beginInsertElement(Cyberiada::ElementCollection* parent);
+	void                                endInsertElement(Cyberiada::Element* element, const Cyberiada::ID& id, int row);
+	Cyberiada::Element*                 pushInsertCommand(CyberiadaSMInsertCommand* command);
+	void                                updateSpatialIndexes(const QList<Cyberiada::Element*>& elements);
+	void                                dropSpatialIndex(const Cyberiada::Element* element);
+	void                                clearSpatialIndexes();
+	void                                loadIcons() const;
 	
 	Cyberiada::LocalDocument*           root;
 	QString							   	cyberiadaStateMimeType;
 	QIcon                              	emptyIcon;
-	QMap<Cyberiada::ElementType, QIcon> icons;
+	mutable QMap<Cyberiada::ElementType, QIcon> icons;
+	QUndoStack*                         commands;
+	int                                 updateDepth;
+	QList<Cyberiada::Element*>          changedElements;
+	// built on the first query, updated on geometry edits and dropped on structure changes
+	mutable QMap<const Cyberiada::StateMachine*, CyberiadaSMSpatialIndex*> spatialIndexes;
+	mutable QMutex                      spatialIndexesMutex;
 };
 
 #endif
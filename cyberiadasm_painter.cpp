@@ -0,0 +1,140 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Element Painting implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <QPainter>
+#include <QtMath>
+
+#include "cyberiadasm_painter.h"
+#include "cyberiadasm_editor_items.h"
+
+static const qreal ARROW_SIZE = 10;
+
+QColor CyberiadaSMPainter::lineColor(bool selected)
+{
+	return selected ? QColor(255, 0, 0) : QColor(Qt::black);
+}
+
+QPen CyberiadaSMPainter::textPen()
+{
+	return QPen(Qt::black);
+}
+
+QBrush CyberiadaSMPainter::commentBrush()
+{
+	return QBrush(QColor(0xff, 0xcc, 0));
+}
+
+void CyberiadaSMPainter::paintState(QPainter* painter, const QRectF& rect, qreal titleHeight, bool selected)
+{
+	painter->setPen(QPen(lineColor(selected), 1, Qt::SolidLine));
+	painter->setBrush(Qt::NoBrush);
+	painter->drawLine(QPointF(rect.left(), rect.top() + titleHeight), QPointF(rect.right(), rect.top() + titleHeight));
+	painter->drawRoundedRect(rect, ROUNDED_RECT_RADIUS, ROUNDED_RECT_RADIUS);
+}
+
+void CyberiadaSMPainter::paintVertex(QPainter* painter, Cyberiada::ElementType type, const QRectF& rect, bool selected)
+{
+	QColor color = lineColor(selected);
+	painter->setPen(QPen(color, 1, Qt::SolidLine));
+	if (type == Cyberiada::elementInitial) {
+		painter->setBrush(QBrush(color));
+		painter->drawEllipse(rect);
+	} else if (type == Cyberiada::elementFinal) {
+		// the inner circle has two thirds of the radius
+		qreal inset = rect.width() / 6;
+		painter->setBrush(painter->background());
+		painter->drawEllipse(rect);
+		painter->setBrush(QBrush(color));
+		painter->drawEllipse(rect.adjusted(inset, inset, -inset, -inset));
+	} else if (type == Cyberiada::elementTerminate) {
+		painter->setPen(QPen(color, 2, Qt::SolidLine));
+		painter->drawLine(rect.topLeft(), rect.bottomRight());
+	}
+}
+
+void CyberiadaSMPainter::paintChoice(QPainter* painter, const QRectF& rect, bool selected)
+{
+	painter->setPen(QPen(lineColor(selected), 1, Qt::SolidLine));
+	painter->setBrush(Qt::NoBrush);
+	const QPointF points[] = {
+		QPointF(rect.center().x(), rect.top()),
+		QPointF(rect.right(), rect.center().y()),
+		QPointF(rect.center().x(), rect.bottom()),
+		QPointF(rect.left(), rect.center().y())
+	};
+	painter->drawConvexPolygon(points, 4);
+}
+
+void CyberiadaSMPainter::paintComment(QPainter* painter, const QRectF& rect, bool formal, bool selected)
+{
+	painter->setPen(QPen(lineColor(selected), 1, Qt::SolidLine));
+	painter->setBrush(commentBrush());
+	const QPointF points[] = {
+		QPointF(rect.left(), rect.top()),
+		QPointF(rect.right() - COMMENT_ANGLE_CORNER, rect.top()),
+		QPointF(rect.right(), rect.top() + COMMENT_ANGLE_CORNER),
+		QPointF(rect.right(), rect.bottom()),
+		QPointF(rect.left(), rect.bottom())
+	};
+	painter->drawConvexPolygon(points, 5);
+
+	// the folded corner of the formal comment is filled
+	if (formal) {
+		painter->setBrush(QBrush(Qt::black));
+	}
+	const QPointF corner[] = {
+		QPointF(rect.right() - COMMENT_ANGLE_CORNER, rect.top()),
+		QPointF(rect.right(), rect.top() + COMMENT_ANGLE_CORNER),
+		QPointF(rect.right() - COMMENT_ANGLE_CORNER, rect.top() + COMMENT_ANGLE_CORNER)
+	};
+	painter->drawConvexPolygon(corner, 3);
+}
+
+void CyberiadaSMPainter::paintTransition(QPainter* painter, const QPainterPath& path,
+										 const QPointF& beforeEnd, const QPointF& end, bool selected)
+{
+	// the line keeps its width at any zoom
+	QPen pen(lineColor(selected), 1);
+	pen.setCosmetic(true);
+	painter->setPen(pen);
+	painter->setBrush(Qt::NoBrush);
+	painter->drawPath(path);
+	paintArrow(painter, beforeEnd, end, selected);
+}
+
+void CyberiadaSMPainter::paintArrow(QPainter* painter, const QPointF& from, const QPointF& to, bool selected)
+{
+	QColor color = lineColor(selected);
+	QLineF line(from, to);
+	qreal angle = std::atan2(-line.dy(), line.dx());
+	const QPointF head[] = {
+		to,
+		to + QPointF(-ARROW_SIZE * std::cos(angle - M_PI / 6), ARROW_SIZE * std::sin(angle - M_PI / 6)),
+		to + QPointF(-ARROW_SIZE * std::cos(angle + M_PI / 6), ARROW_SIZE * std::sin(angle + M_PI / 6))
+	};
+	painter->setPen(QPen(color, 1));
+	painter->setBrush(QBrush(color));
+	painter->drawPolygon(head, 3);
+}
@@ -0,0 +1,68 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Element Painting
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#ifndef CYBERIADA_SM_PAINTER_HEADER
+#define CYBERIADA_SM_PAINTER_HEADER
+
+#include <QColor>
+#include <QBrush>
+#include <QPen>
+#include <QRectF>
+#include <QPainterPath>
+#include <cyberiada/cyberiadamlpp.h>
+
+class QPainter;
+
+/* -----------------------------------------------------------------------------
+ * The shapes of the state machine elements as the editor items draw them. The
+ * exporter paints the document with the same functions, so the exported image
+ * looks like the scene. The functions only use the painter, so any thread can
+ * call them.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMPainter {
+public:
+	static QColor                       lineColor(bool selected);
+	static QPen                         textPen();
+	static QBrush                       commentBrush();
+
+	// the rounded frame with the line under the title
+	static void                         paintState(QPainter* painter, const QRectF& rect, qreal titleHeight,
+												   bool selected);
+	// the initial, final and terminate pseudostates in the circle rect
+	static void                         paintVertex(QPainter* painter, Cyberiada::ElementType type,
+													const QRectF& rect, bool selected);
+	static void                         paintChoice(QPainter* painter, const QRectF& rect, bool selected);
+	static void                         paintComment(QPainter* painter, const QRectF& rect, bool formal,
+													 bool selected);
+	// the path with the arrow pointing from the point before the end to the end
+	static void                         paintTransition(QPainter* painter, const QPainterPath& path,
+														const QPointF& beforeEnd, const QPointF& end,
+														bool selected);
+	static void                         paintArrow(QPainter* painter, const QPointF& from, const QPointF& to,
+												   bool selected);
+};
+
+#endif
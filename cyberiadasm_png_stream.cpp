@@ -0,0 +1,113 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The Streaming PNG Encoder
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <cstring>
+#include <QtEndian>
+#include <QIODevice>
+
+#include "cyberiadasm_png_stream.h"
+
+// the size of the deflate output buffer and of the IDAT chunks
+static const int PNG_BUFFER_SIZE = 1 << 16;
+
+CyberiadaSMPngStream::CyberiadaSMPngStream(QIODevice* _device, int _compression):
+	device(_device), compression(_compression), started(false)
+{
+	memset(&zs, 0, sizeof(zs));
+}
+
+CyberiadaSMPngStream::~CyberiadaSMPngStream()
+{
+	if (started) {
+		deflateEnd(&zs);
+	}
+}
+
+bool CyberiadaSMPngStream::begin(int width, int height)
+{
+	static const char signature[] = "\x89PNG\r\n\x1a\n";
+	if (device->write(signature, 8) != 8) return false;
+	uchar header[13];
+	qToBigEndian<quint32>(width, header);
+	qToBigEndian<quint32>(height, header + 4);
+	header[8] = 8;  // the bit depth
+	header[9] = 2;  // RGB
+	header[10] = 0; // deflate
+	header[11] = 0; // the adaptive filtering
+	header[12] = 0; // no interlace
+	if (!writeChunk("IHDR", header, sizeof(header))) return false;
+	started = deflateInit(&zs, compression) == Z_OK;
+	return started;
+}
+
+bool CyberiadaSMPngStream::writeRow(const uchar* row, int bytes)
+{
+	static const uchar filter = 0;
+	return compress(&filter, 1, Z_NO_FLUSH) && compress(row, bytes, Z_NO_FLUSH);
+}
+
+bool CyberiadaSMPngStream::end()
+{
+	if (!compress(NULL, 0, Z_FINISH)) return false;
+	if (!idat.isEmpty() && !writeChunk("IDAT", reinterpret_cast<const uchar*>(idat.constData()), idat.size())) {
+		return false;
+	}
+	return writeChunk("IEND", NULL, 0);
+}
+
+bool CyberiadaSMPngStream::compress(const uchar* data, int size, int flush)
+{
+	uchar out[PNG_BUFFER_SIZE];
+	zs.next_in = const_cast<Bytef*>(data);
+	zs.avail_in = size;
+	do {
+		zs.next_out = out;
+		zs.avail_out = PNG_BUFFER_SIZE;
+		if (deflate(&zs, flush) == Z_STREAM_ERROR) return false;
+		idat.append(reinterpret_cast<const char*>(out), PNG_BUFFER_SIZE - zs.avail_out);
+		if (idat.size() >= PNG_BUFFER_SIZE) {
+			if (!writeChunk("IDAT", reinterpret_cast<const uchar*>(idat.constData()), idat.size())) {
+				return false;
+			}
+			idat.clear();
+		}
+	} while (zs.avail_out == 0);
+	return true;
+}
+
+bool CyberiadaSMPngStream::writeChunk(const char* type, const uchar* data, int size)
+{
+	uchar length[4];
+	qToBigEndian<quint32>(size, length);
+	uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+	if (size > 0) {
+		crc = crc32(crc, data, size);
+	}
+	uchar checksum[4];
+	qToBigEndian<quint32>(quint32(crc), checksum);
+	return device->write(reinterpret_cast<const char*>(length), 4) == 4 &&
+		device->write(type, 4) == 4 &&
+		(size == 0 || device->write(reinterpret_cast<const char*>(data), size) == size) &&
+		device->write(reinterpret_cast<const char*>(checksum), 4) == 4;
+}
@@ -0,0 +1,60 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The Streaming PNG Encoder
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_PNG_STREAM_HEADER
+#define CYBERIADA_SM_PNG_STREAM_HEADER
+
+#include <QByteArray>
+#include <zlib.h>
+
+class QIODevice;
+
+/* -----------------------------------------------------------------------------
+ * The streaming PNG encoder for the images too large to keep in memory: the
+ * 8-bit RGB rows are written one by one without filtering, and the compressed
+ * data goes to the device in the IDAT chunks as soon as a chunk is full.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMPngStream {
+public:
+	CyberiadaSMPngStream(QIODevice* device, int compression = Z_DEFAULT_COMPRESSION);
+	~CyberiadaSMPngStream();
+
+	bool                                begin(int width, int height);
+	// the row is width * 3 bytes
+	bool                                writeRow(const uchar* row, int bytes);
+	bool                                end();
+
+private:
+	bool                                compress(const uchar* data, int size, int flush);
+	bool                                writeChunk(const char* type, const uchar* data, int size);
+
+	QIODevice*                          device;
+	int                                 compression;
+	z_stream                            zs;
+	bool                                started;
+	QByteArray                          idat;
+};
+
+#endif
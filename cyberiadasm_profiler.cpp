@@ -0,0 +1,44 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Editor Profiling Counters implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include "cyberiadasm_profiler.h"
+
+quint32 CyberiadaSMProfiler::counters[CyberiadaSMProfiler::countersNumber] = { 0 };
+
+bool CyberiadaSMProfiler::isEnabled()
+{
+#ifdef CYBERIADA_EDITOR_PROFILING
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CyberiadaSMProfiler::takeFrame(quint32 frame[countersNumber])
+{
+	for (int i = 0; i < countersNumber; i++) {
+		frame[i] = counters[i];
+		counters[i] = 0;
+	}
+}
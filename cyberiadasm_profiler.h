@@ -0,0 +1,65 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Editor Profiling Counters
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_PROFILER_HEADER
+#define CYBERIADA_SM_PROFILER_HEADER
+
+#include <QtGlobal>
+
+/* -----------------------------------------------------------------------------
+ * The counters of the editor hot paths for the profiling overlay of the view.
+ * The items count their paints and geometry calls with SM_PROFILE_COUNT; the
+ * macro is empty unless the build defines CYBERIADA_EDITOR_PROFILING. All the
+ * counted calls are made on the GUI thread, so the counters are plain ints.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMProfiler {
+public:
+	enum Counter {
+		paintState = 0,
+		paintTransition,
+		paintVertex,
+		paintSM,
+		paintText,
+		boundingRectCall,
+		shapeCall,
+		countersNumber
+	};
+
+	static void                         count(Counter c) { counters[c]++; }
+	static bool                         isEnabled();
+	// the counters since the previous call
+	static void                         takeFrame(quint32 frame[countersNumber]);
+
+private:
+	static quint32                      counters[countersNumber];
+};
+
+#ifdef CYBERIADA_EDITOR_PROFILING
+#define SM_PROFILE_COUNT(counter) CyberiadaSMProfiler::count(CyberiadaSMProfiler::counter)
+#else
+#define SM_PROFILE_COUNT(counter) do {} while (0)
+#endif
+
+#endif
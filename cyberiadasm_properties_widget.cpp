@@ -25,9 +25,10 @@
 
 #include "myassert.h"
 #include "cyberiadasm_properties_widget.h"
+#include "cyberiadasm_trace.h"
 
 CyberiadaSMPropertiesWidget::CyberiadaSMPropertiesWidget(QWidget *parent):
-	QtTreePropertyBrowser(parent), model(NULL), element(NULL)
+	QtTreePropertyBrowser(parent), model(NULL), element(NULL), updatingProperties(false)
 {
 	properties = {
 		{propActionType,           propEditorActionType,        tr("Action Type", "Property name")},
@@ -80,9 +81,10 @@ CyberiadaSMPropertiesWidget::CyberiadaSMPropertiesWidget(QWidget *parent):
 	
 	groupManager = new QtGroupPropertyManager(this);
 	stringManager = new QtStringPropertyManager(this);
-//	connect(stringManager, SIGNAL(propertyChanged(QtProperty*)), this, SLOT(slotPropertyChanged(QtProperty*)));
-//	lineEditFactory = new QtLineEditFactory(this);
-//	setFactoryForManager(stringManager, lineEditFactory);
+	editableStringManager = new QtStringPropertyManager(this);
+	connect(editableStringManager, SIGNAL(propertyChanged(QtProperty*)), this, SLOT(slotPropertyChanged(QtProperty*)));
+	lineEditFactory = new QtLineEditFactory(this);
+	setFactoryForManager(editableStringManager, lineEditFactory);
 	enumManager = new QtEnumPropertyManager(this);
 	pointManager = new QtPointFPropertyManager(this);
 	rectManager = new QtRectFPropertyManager(this);
@@ -136,6 +138,7 @@ void CyberiadaSMPropertiesWidget::setModel(CyberiadaSMModel* model)
 	MY_ASSERT(model);
 	this->model = model;
 	element = NULL;
+	elements.clear();
 
 	QMap<Cyberiada::ElementType, QString> types = {
 		{Cyberiada::elementRoot,           tr("Document", "Element type")},
@@ -160,8 +163,10 @@ void CyberiadaSMPropertiesWidget::setModel(CyberiadaSMModel* model)
 
 void CyberiadaSMPropertiesWidget::clearProperties()
 {
+	editableProperties.clear();
 	groupManager->clear();
 	stringManager->clear();
+	editableStringManager->clear();
 	enumManager->clear();
 	pointManager->clear();
 	rectManager->clear();
@@ -171,24 +176,139 @@ void CyberiadaSMPropertiesWidget::clearProperties()
 
 void CyberiadaSMPropertiesWidget::slotElementSelected(const QModelIndex& index)
 {
+	slotElementsSelected(QModelIndexList() << index);
+}
+
+void CyberiadaSMPropertiesWidget::slotElementsSelected(const QModelIndexList& indexes)
+{
+	SM_TRACE_SPAN("properties selection sync");
 	clearProperties();
-	if (model && index.isValid() && index != model->rootIndex()) {
+	element = NULL;
+	elements.clear();
+	if (!model) return;
+
+	QList<Cyberiada::Element*> new_elements;
+	foreach(QModelIndex index, indexes) {
+		if (!index.isValid() || index == model->rootIndex()) continue;
 		Cyberiada::Element* new_element = model->indexToElement(index);
 		MY_ASSERT(new_element);
-		newElement(new_element);
-	} else {
-		element = NULL;
+		new_elements.append(new_element);
+	}
+
+	updatingProperties = true;
+	if (new_elements.size() == 1) {
+		newElement(new_elements.first());
+	} else if (new_elements.size() > 1) {
+		newElements(new_elements);
+	}
+	updatingProperties = false;
+}
+
+void CyberiadaSMPropertiesWidget::slotPropertyChanged(QtProperty* property)
+{
+	if (updatingProperties || !model || elements.isEmpty() || !editableProperties.contains(property)) {
+		return;
+	}
+
+	CyberiadaSMModel::TextField field;
+	if (!propertyTextField(editableProperties.value(property), field)) {
+		return;
+	}
+	// a single undoable command updates all selected elements at once
+	model->editElementsText(elements, field, editableStringManager->value(property));
+}
+
+bool CyberiadaSMPropertiesWidget::propertyTextField(CyberiadaPropertyName prop, CyberiadaSMModel::TextField& field) const
+{
+	switch(prop) {
+	case propName:     field = CyberiadaSMModel::textName; return true;
+	case propTrigger:  field = CyberiadaSMModel::textTrigger; return true;
+	case propGuard:    field = CyberiadaSMModel::textGuard; return true;
+	case propBehavior: field = CyberiadaSMModel::textBehavior; return true;
+	case propBody:     field = CyberiadaSMModel::textBody; return true;
+	default:           return false;
+	}
+}
+
+void CyberiadaSMPropertiesWidget::newElements(const QList<Cyberiada::Element*>& new_elements)
+{
+	MY_ASSERT(new_elements.size() > 0);
+	elements = new_elements;
+	element = elements.first();
+
+	bool same_type = true, all_transitions = true, all_comments = true, has_named = true;
+	Cyberiada::ElementType type = element->get_type();
+	foreach(Cyberiada::Element* e, elements) {
+		Cyberiada::ElementType t = e->get_type();
+		if (t != type) same_type = false;
+		if (t != Cyberiada::elementTransition) all_transitions = false;
+		if (t != Cyberiada::elementComment && t != Cyberiada::elementFormalComment) all_comments = false;
+		if (t == Cyberiada::elementTransition || e->is_root()) has_named = false;
 	}
+
+	QtProperty* element_group_prop = constructProperty(propGroupElement);
+	addProperty(element_group_prop);
+
+	if (same_type) {
+		QtProperty* element_type_prop = constructProperty(propType);
+		enumManager->setValue(element_type_prop, type);
+		element_group_prop->addSubProperty(element_type_prop);
+	}
+
+	if (has_named) {
+		element_group_prop->addSubProperty(constructCommonProperty(propName));
+	}
+
+	if (all_transitions) {
+		QtProperty* trans_group_prop = constructProperty(propGroupTransition);
+		addProperty(trans_group_prop);
+
+		QtProperty* action_group_prop = constructProperty(propGroupAction);
+		trans_group_prop->addSubProperty(action_group_prop);
+
+		action_group_prop->addSubProperty(constructCommonProperty(propTrigger));
+		action_group_prop->addSubProperty(constructCommonProperty(propGuard));
+		action_group_prop->addSubProperty(constructCommonProperty(propBehavior));
+	}
+
+	if (all_comments) {
+		QtProperty* comment_group_prop = constructProperty(propGroupComment);
+		addProperty(comment_group_prop);
+
+		comment_group_prop->addSubProperty(constructCommonProperty(propBody));
+	}
+}
+
+QtProperty* CyberiadaSMPropertiesWidget::constructCommonProperty(CyberiadaPropertyName prop)
+{
+	MY_ASSERT(elements.size() > 0);
+	QtProperty* new_property = constructProperty(prop, true);
+	QString value = elementValue(elements.first(), prop);
+	for (int i = 1; i < elements.size(); i++) {
+		if (elementValue(elements[i], prop) != value) {
+			new_property->setToolTip(tr("Multiple values"));
+			return new_property;
+		}
+	}
+	editableStringManager->setValue(new_property, value);
+	return new_property;
 }
 
-void CyberiadaSMPropertiesWidget::slotPropertyChanged(QtProperty*)
+QString CyberiadaSMPropertiesWidget::elementValue(const Cyberiada::Element* e, CyberiadaPropertyName prop) const
 {
+	CyberiadaSMModel::TextField field;
+	if (!propertyTextField(prop, field)) {
+		return QString();
+	}
+	return model->elementText(e, field);
 }
 
 void CyberiadaSMPropertiesWidget::newElement(Cyberiada::Element* new_element)
 {
+	SM_TRACE_SPAN("newElement");
 	MY_ASSERT(new_element);
 	element = new_element;
+	elements = QList<Cyberiada::Element*>() << element;
 	
 	Cyberiada::ElementType type = element->get_type();
 
@@ -299,16 +419,16 @@ void CyberiadaSMPropertiesWidget::newElement(Cyberiada::Element* new_element)
 			QtProperty* action_group_prop = constructProperty(propGroupAction);
 			trans_group_prop->addSubProperty(action_group_prop);
 			
-			QtProperty* trigger_prop = constructProperty(propTrigger);
-			stringManager->setValue(trigger_prop, QString(trans->get_action().get_trigger().c_str()));
+			QtProperty* trigger_prop = constructProperty(propTrigger, true);
+			editableStringManager->setValue(trigger_prop, QString(trans->get_action().get_trigger().c_str()));
 			action_group_prop->addSubProperty(trigger_prop);
 			
-			QtProperty* guard_prop = constructProperty(propGuard);
-			stringManager->setValue(guard_prop, QString(trans->get_action().get_guard().c_str()));
+			QtProperty* guard_prop = constructProperty(propGuard, true);
+			editableStringManager->setValue(guard_prop, QString(trans->get_action().get_guard().c_str()));
 			action_group_prop->addSubProperty(guard_prop);
 			
-			QtProperty* behavior_prop = constructProperty(propBehavior);
-			stringManager->setValue(behavior_prop, QString(trans->get_action().get_behavior().c_str()));
+			QtProperty* behavior_prop = constructProperty(propBehavior, true);
+			editableStringManager->setValue(behavior_prop, QString(trans->get_action().get_behavior().c_str()));
 			action_group_prop->addSubProperty(behavior_prop);
 
 			if (trans->has_geometry()) {
@@ -350,8 +470,8 @@ void CyberiadaSMPropertiesWidget::newElement(Cyberiada::Element* new_element)
 			}
 			
 		} else {
-			QtProperty* element_name_prop = constructProperty(propName);
-			stringManager->setValue(element_name_prop, QString(element->get_name().c_str()));    
+			QtProperty* element_name_prop = constructProperty(propName, true);
+			editableStringManager->setValue(element_name_prop, QString(element->get_name().c_str()));
 			element_group_prop->addSubProperty(element_name_prop);
 			
 			if (type == Cyberiada::elementSimpleState || type == Cyberiada::elementCompositeState) {
@@ -391,8 +511,8 @@ void CyberiadaSMPropertiesWidget::newElement(Cyberiada::Element* new_element)
 				QtProperty* comment_group_prop = constructProperty(propGroupComment);
 				addProperty(comment_group_prop);
 
-				QtProperty* body_prop = constructProperty(propBody);
-				stringManager->setValue(body_prop, QString(comment->get_body().c_str()));    
+				QtProperty* body_prop = constructProperty(propBody, true);
+				editableStringManager->setValue(body_prop, QString(comment->get_body().c_str()));
 				comment_group_prop->addSubProperty(body_prop);
 
 				QtProperty* markup_prop = constructProperty(propMarkup);
@@ -498,7 +618,7 @@ void CyberiadaSMPropertiesWidget::newElement(Cyberiada::Element* new_element)
 	}
 }
 	
-QtProperty* CyberiadaSMPropertiesWidget::constructProperty(CyberiadaPropertyName prop)
+QtProperty* CyberiadaSMPropertiesWidget::constructProperty(CyberiadaPropertyName prop, bool editable)
 {
 	MY_ASSERT(element);
 	Cyberiada::ElementType type = element->get_type();
@@ -548,7 +668,12 @@ QtProperty* CyberiadaSMPropertiesWidget::constructProperty(CyberiadaPropertyName
 		break;
 		break;
 	case propEditorString:
-		new_property = stringManager->addProperty(p.propName);
+		if (editable) {
+			new_property = editableStringManager->addProperty(p.propName);
+			editableProperties.insert(new_property, prop);
+		} else {
+			new_property = stringManager->addProperty(p.propName);
+		}
 		break;
 	case propEditorSubjectType:
 		new_property = enumManager->addProperty(p.propName);
@@ -42,12 +42,15 @@ public:
 
 public slots:
 	void                     slotElementSelected(const QModelIndex& index);
+	void                     slotElementsSelected(const QModelIndexList& indexes);
 	void                     slotPropertyChanged(QtProperty* property);
 	
 private:
 	
-	CyberiadaSMModel*        model;
-	Cyberiada::Element*      element;
+	CyberiadaSMModel*          model;
+	Cyberiada::Element*        element;
+	QList<Cyberiada::Element*> elements;
+	bool                       updatingProperties;
 
 	enum CyberiadaPropertyName {
 		propActionType,
@@ -125,6 +128,7 @@ private:
 
 	QtGroupPropertyManager*     groupManager;
 	QtStringPropertyManager*    stringManager;
+	QtStringPropertyManager*    editableStringManager;
 	QtEnumPropertyManager*      enumManager;
 	QtPointFPropertyManager*    pointManager;
 	QtRectFPropertyManager*     rectManager;
@@ -142,9 +146,15 @@ private:
 	
 	QtLineEditFactory*          lineEditFactory;
 
+	QMap<QtProperty*, CyberiadaPropertyName> editableProperties;
+
 	void                        clearProperties();
 	void                        newElement(Cyberiada::Element* new_element);
-	QtProperty*                 constructProperty(CyberiadaPropertyName prop);
+	void                        newElements(const QList<Cyberiada::Element*>& new_elements);
+	QtProperty*                 constructProperty(CyberiadaPropertyName prop, bool editable = false);
+	QtProperty*                 constructCommonProperty(CyberiadaPropertyName prop);
+	QString                     elementValue(const Cyberiada::Element* e, CyberiadaPropertyName prop) const;
+	bool                        propertyTextField(CyberiadaPropertyName prop, CyberiadaSMModel::TextField& field) const;
 	CyberiadaProperty&          findPropertyStruct(CyberiadaPropertyName prop);
 	CyberiadaProperty&          findPropertyStruct(const QString& propName);
 	Cyberiada::ConstElementList getAllElements(bool source) const;
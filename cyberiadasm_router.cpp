@@ -0,0 +1,376 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Orthogonal Transition Router implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cmath>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include "cyberiadasm_router.h"
+#include "myassert.h"
+
+static const qreal OBSTACLE_CELL_SIZE = 128;
+static const qreal ROUTE_STUB = 15;          // the first and the last segments leave the ports orthogonally
+static const qreal ROUTE_MARGIN = 20;        // the distance of the detour channels from the obstacles
+static const qreal ROUTE_BEND_COST = 40;
+static const qreal ROUTE_HIT_COST = 10000;
+
+/* -----------------------------------------------------------------------------
+ * Obstacle Index
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMObstacleIndex::CyberiadaSMObstacleIndex(qreal _cellSize):
+	cellSize(_cellSize)
+{
+	MY_ASSERT(cellSize > 0);
+}
+
+void CyberiadaSMObstacleIndex::insert(int obstacle, const QRectF& rect)
+{
+	int x1 = int(std::floor(rect.left() / cellSize)), x2 = int(std::floor(rect.right() / cellSize));
+	int y1 = int(std::floor(rect.top() / cellSize)), y2 = int(std::floor(rect.bottom() / cellSize));
+	for (int x = x1; x <= x2; x++) {
+		for (int y = y1; y <= y2; y++) {
+			cells[key(x, y)].append(obstacle);
+		}
+	}
+}
+
+void CyberiadaSMObstacleIndex::query(const QRectF& area, QVector<int>& result) const
+{
+	result.clear();
+	int x1 = int(std::floor(area.left() / cellSize)), x2 = int(std::floor(area.right() / cellSize));
+	int y1 = int(std::floor(area.top() / cellSize)), y2 = int(std::floor(area.bottom() / cellSize));
+	for (int x = x1; x <= x2; x++) {
+		for (int y = y1; y <= y2; y++) {
+			QHash<qint64, QVector<int> >::const_iterator cell = cells.find(key(x, y));
+			if (cell != cells.end()) {
+				result += cell.value();
+			}
+		}
+	}
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+/* -----------------------------------------------------------------------------
+ * Routing
+ * ----------------------------------------------------------------------------- */
+
+namespace {
+
+	// the route segments are horizontal or vertical, the rectangle interior only counts
+	bool segmentHits(const QPointF& a, const QPointF& b, const QRectF& r)
+	{
+		if (qFuzzyCompare(a.y(), b.y())) {
+			return a.y() > r.top() && a.y() < r.bottom() &&
+				qMax(qMin(a.x(), b.x()), r.left()) < qMin(qMax(a.x(), b.x()), r.right());
+		}
+		if (qFuzzyCompare(a.x(), b.x())) {
+			return a.x() > r.left() && a.x() < r.right() &&
+				qMax(qMin(a.y(), b.y()), r.top()) < qMin(qMax(a.y(), b.y()), r.bottom());
+		}
+		return QRectF(a, b).normalized().intersects(r);
+	}
+
+	QPolygonF simplify(const QPolygonF& points)
+	{
+		QPolygonF result;
+		foreach(const QPointF& p, points) {
+			if (!result.isEmpty() && result.last() == p) continue;
+			if (result.size() >= 2) {
+				const QPointF& a = result[result.size() - 2];
+				const QPointF& b = result.last();
+				if ((qFuzzyCompare(a.x(), b.x()) && qFuzzyCompare(b.x(), p.x())) ||
+					(qFuzzyCompare(a.y(), b.y()) && qFuzzyCompare(b.y(), p.y()))) {
+					result.last() = p;
+					continue;
+				}
+			}
+			result.append(p);
+		}
+		return result;
+	}
+
+	class RouteBuilder {
+	public:
+		RouteBuilder(const CyberiadaSMRoutingSnapshot& s, const CyberiadaSMObstacleIndex& i):
+			snapshot(s), index(i) {}
+
+		QPolygonF route(const CyberiadaSMRouteRequest& request);
+
+	private:
+		qreal cost(const QPolygonF& points, const CyberiadaSMRouteRequest& request, QVector<int>* hits);
+		void candidates(const QPointF& a, const QPointF& b,
+						const QVector<qreal>& xs, const QVector<qreal>& ys,
+						QVector<QPolygonF>& result) const;
+		QPolygonF best(const CyberiadaSMRouteRequest& request,
+					   const QVector<qreal>& xs, const QVector<qreal>& ys,
+					   qreal& best_cost, QVector<int>& hits);
+
+		const CyberiadaSMRoutingSnapshot& snapshot;
+		const CyberiadaSMObstacleIndex&   index;
+		QVector<int>                      found;
+	};
+
+	QPointF port(const QRectF& r, int side, QPointF& normal)
+	{
+		switch (side) {
+		case 0: normal = QPointF(-1, 0); return QPointF(r.left(), r.center().y());
+		case 1: normal = QPointF(1, 0);  return QPointF(r.right(), r.center().y());
+		case 2: normal = QPointF(0, -1); return QPointF(r.center().x(), r.top());
+		default: normal = QPointF(0, 1); return QPointF(r.center().x(), r.bottom());
+		}
+	}
+
+	void RouteBuilder::candidates(const QPointF& a, const QPointF& b,
+								  const QVector<qreal>& xs, const QVector<qreal>& ys,
+								  QVector<QPolygonF>& result) const
+	{
+		// L-shapes
+		result.append(QPolygonF() << QPointF(a.x(), b.y()));
+		result.append(QPolygonF() << QPointF(b.x(), a.y()));
+		// Z-shapes through the middle and through the detour channels
+		result.append(QPolygonF() << QPointF(a.x(), (a.y() + b.y()) / 2) << QPointF(b.x(), (a.y() + b.y()) / 2));
+		result.append(QPolygonF() << QPointF((a.x() + b.x()) / 2, a.y()) << QPointF((a.x() + b.x()) / 2, b.y()));
+		foreach(qreal y, ys) {
+			result.append(QPolygonF() << QPointF(a.x(), y) << QPointF(b.x(), y));
+		}
+		foreach(qreal x, xs) {
+			result.append(QPolygonF() << QPointF(x, a.y()) << QPointF(x, b.y()));
+		}
+	}
+
+	qreal RouteBuilder::cost(const QPolygonF& points, const CyberiadaSMRouteRequest& request, QVector<int>* hits)
+	{
+		qreal length = 0;
+		int collisions = 0;
+		for (int i = 1; i < points.size(); i++) {
+			const QPointF& a = points[i - 1];
+			const QPointF& b = points[i];
+			length += std::fabs(b.x() - a.x()) + std::fabs(b.y() - a.y());
+			// the ends themselves are crossed by the inner segments only
+			if (i > 1 && i < points.size() - 1) {
+				if (segmentHits(a, b, request.source)) collisions++;
+				if (segmentHits(a, b, request.target)) collisions++;
+			}
+			index.query(QRectF(a, b).normalized().adjusted(-1, -1, 1, 1), found);
+			foreach(int o, found) {
+				const QRectF& r = snapshot.obstacles[o].rect;
+				// the ends and the states containing them are not obstacles
+				if (r == request.source || r == request.target ||
+					r.contains(request.source) || r.contains(request.target)) {
+					continue;
+				}
+				if (segmentHits(a, b, r)) {
+					collisions++;
+					if (hits && !hits->contains(o)) hits->append(o);
+				}
+			}
+		}
+		return length + ROUTE_BEND_COST * qMax(0, points.size() - 2) + ROUTE_HIT_COST * collisions;
+	}
+
+	QPolygonF RouteBuilder::best(const CyberiadaSMRouteRequest& request,
+								 const QVector<qreal>& xs, const QVector<qreal>& ys,
+								 qreal& best_cost, QVector<int>& hits)
+	{
+		QPolygonF result;
+		QVector<QPolygonF> connectors;
+		for (int source_side = 0; source_side < 4; source_side++) {
+			for (int target_side = 0; target_side < 4; target_side++) {
+				QPointF source_normal, target_normal;
+				QPointF ps = port(request.source, source_side, source_normal);
+				QPointF pt = port(request.target, target_side, target_normal);
+				QPointF ps1 = ps + source_normal * ROUTE_STUB;
+				QPointF pt1 = pt + target_normal * ROUTE_STUB;
+				connectors.clear();
+				candidates(ps1, pt1, xs, ys, connectors);
+				foreach(const QPolygonF& connector, connectors) {
+					QPolygonF points = simplify(QPolygonF() << ps << ps1 << connector << pt1 << pt);
+					qreal c = cost(points, request, NULL);
+					if (result.isEmpty() || c < best_cost) {
+						best_cost = c;
+						result = points;
+					}
+				}
+			}
+		}
+		hits.clear();
+		cost(result, request, &hits);
+		return result;
+	}
+
+	QPolygonF RouteBuilder::route(const CyberiadaSMRouteRequest& request)
+	{
+		qreal c = 0;
+		QVector<int> hits;
+		QPolygonF result = best(request, QVector<qreal>(), QVector<qreal>(), c, hits);
+		if (hits.isEmpty()) {
+			return result;
+		}
+		// detour: try the channels along the obstacles crossed by the best straightforward route
+		QVector<qreal> xs, ys;
+		foreach(int o, hits) {
+			const QRectF& r = snapshot.obstacles[o].rect;
+			xs << r.left() - ROUTE_MARGIN << r.right() + ROUTE_MARGIN;
+			ys << r.top() - ROUTE_MARGIN << r.bottom() + ROUTE_MARGIN;
+		}
+		qreal detour_cost = 0;
+		QPolygonF detour = best(request, xs, ys, detour_cost, hits);
+		return detour_cost < c ? detour : result;
+	}
+
+	bool routeAffected(const QPolygonF& points, const QVector<QRectF>& changed)
+	{
+		for (int i = 1; i < points.size(); i++) {
+			foreach(const QRectF& r, changed) {
+				if (segmentHits(points[i - 1], points[i], r)) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+ * Router
+ * ----------------------------------------------------------------------------- */
+
+CyberiadaSMRouter::CyberiadaSMRouter(QObject* parent):
+	QObject(parent), hasPending(false)
+{
+	watcher = new QFutureWatcher<CyberiadaSMRoutingResult>(this);
+	connect(watcher, SIGNAL(finished()), this, SLOT(slotFinished()));
+}
+
+CyberiadaSMRouter::~CyberiadaSMRouter()
+{
+	watcher->waitForFinished();
+}
+
+void CyberiadaSMRouter::route(const CyberiadaSMRoutingSnapshot& snapshot)
+{
+	if (watcher->isRunning()) {
+		pending = snapshot;
+		hasPending = true;
+		return;
+	}
+	watcher->setFuture(QtConcurrent::run(&CyberiadaSMRouter::compute, snapshot, cache, cachedObstacles));
+}
+
+CyberiadaSMRoutingResult CyberiadaSMRouter::routeNow(const CyberiadaSMRoutingSnapshot& snapshot)
+{
+	hasPending = false;
+	// the running computation works on its own copies of the cache
+	CyberiadaSMRoutingResult result = compute(snapshot, cache, cachedObstacles);
+	updateCache(result);
+	return result;
+}
+
+void CyberiadaSMRouter::updateCache(const CyberiadaSMRoutingResult& result)
+{
+	cache.clear();
+	foreach(const CyberiadaSMRoute& r, result.routes) {
+		cache.insert(r.id, r);
+	}
+	cachedObstacles = result.obstacles;
+}
+
+void CyberiadaSMRouter::clearCache()
+{
+	cache.clear();
+	cachedObstacles.clear();
+	hasPending = false;
+}
+
+void CyberiadaSMRouter::slotFinished()
+{
+	CyberiadaSMRoutingResult result = watcher->result();
+	updateCache(result);
+
+	if (hasPending) {
+		hasPending = false;
+		watcher->setFuture(QtConcurrent::run(&CyberiadaSMRouter::compute, pending, cache, cachedObstacles));
+	}
+	emit routed(result);
+}
+
+CyberiadaSMRoutingResult CyberiadaSMRouter::compute(const CyberiadaSMRoutingSnapshot& snapshot,
+													const QMap<Cyberiada::ID, CyberiadaSMRoute>& cache,
+													const QMap<Cyberiada::ID, QRectF>& cachedObstacles)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	CyberiadaSMRoutingResult result;
+	result.serial = snapshot.serial;
+	result.reused = 0;
+
+	CyberiadaSMObstacleIndex index(OBSTACLE_CELL_SIZE);
+	for (int i = 0; i < snapshot.obstacles.size(); i++) {
+		const CyberiadaSMRouteObstacle& o = snapshot.obstacles[i];
+		index.insert(i, o.rect);
+		result.obstacles.insert(o.id, o.rect);
+	}
+
+	// the old and the new places of the moved obstacles
+	QVector<QRectF> changed;
+	for (QMap<Cyberiada::ID, QRectF>::const_iterator i = result.obstacles.begin(); i != result.obstacles.end(); i++) {
+		QMap<Cyberiada::ID, QRectF>::const_iterator old = cachedObstacles.find(i.key());
+		if (old == cachedObstacles.end()) {
+			changed.append(i.value());
+		} else if (old.value() != i.value()) {
+			changed.append(old.value());
+			changed.append(i.value());
+		}
+	}
+	for (QMap<Cyberiada::ID, QRectF>::const_iterator i = cachedObstacles.begin(); i != cachedObstacles.end(); i++) {
+		if (!result.obstacles.contains(i.key())) {
+			changed.append(i.value());
+		}
+	}
+
+	RouteBuilder builder(snapshot, index);
+	foreach(const CyberiadaSMRouteRequest& request, snapshot.transitions) {
+		QMap<Cyberiada::ID, CyberiadaSMRoute>::const_iterator c = cache.find(request.id);
+		if (c != cache.end() &&
+			c.value().source == request.source &&
+			c.value().target == request.target &&
+			!routeAffected(c.value().points, changed)) {
+			result.routes.append(c.value());
+			result.reused++;
+			continue;
+		}
+		CyberiadaSMRoute r;
+		r.id = request.id;
+		r.source = request.source;
+		r.target = request.target;
+		r.points = builder.route(request);
+		result.routes.append(r);
+	}
+
+	result.elapsed = timer.elapsed();
+	return result;
+}
@@ -0,0 +1,132 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Orthogonal Transition Router
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+#ifndef CYBERIADA_SM_ROUTER_HEADER
+#define CYBERIADA_SM_ROUTER_HEADER
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+#include <QRectF>
+#include <QPolygonF>
+#include <QFutureWatcher>
+#include <cyberiada/cyberiadamlpp.h>
+
+/* -----------------------------------------------------------------------------
+ * Routing data. Everything is in the scene coordinates and is copied from the
+ * scene before routing, so the worker thread never touches the model or the
+ * items.
+ * ----------------------------------------------------------------------------- */
+
+struct CyberiadaSMRouteObstacle {
+	Cyberiada::ID                       id;
+	QRectF                              rect;
+};
+
+struct CyberiadaSMRouteRequest {
+	Cyberiada::ID                       id;
+	QRectF                              source;
+	QRectF                              target;
+};
+
+struct CyberiadaSMRoute {
+	Cyberiada::ID                       id;
+	QRectF                              source;
+	QRectF                              target;
+	QPolygonF                           points;     // from the source port to the target port
+};
+
+struct CyberiadaSMRoutingSnapshot {
+	int                                 serial;
+	QVector<CyberiadaSMRouteObstacle>   obstacles;
+	QVector<CyberiadaSMRouteRequest>    transitions;
+};
+
+struct CyberiadaSMRoutingResult {
+	int                                 serial;
+	QVector<CyberiadaSMRoute>           routes;
+	QMap<Cyberiada::ID, QRectF>         obstacles;
+	int                                 reused;
+	qint64                              elapsed;
+};
+
+/* -----------------------------------------------------------------------------
+ * Uniform grid of the obstacle rectangles
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMObstacleIndex {
+public:
+	CyberiadaSMObstacleIndex(qreal cellSize);
+
+	void                                insert(int obstacle, const QRectF& rect);
+	void                                query(const QRectF& area, QVector<int>& result) const;
+
+private:
+	static qint64                       key(int x, int y) { return (qint64(x) << 32) ^ quint32(y); }
+
+	qreal                               cellSize;
+	QHash<qint64, QVector<int> >        cells;
+};
+
+/* -----------------------------------------------------------------------------
+ * The router runs on a worker thread; a new request made while the previous
+ * one is running is postponed and only the latest postponed one is executed.
+ * The routes are cached between the runs and a route is reused if its ends
+ * did not move and no moved obstacle crosses it.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMRouter: public QObject {
+Q_OBJECT
+
+public:
+	CyberiadaSMRouter(QObject* parent = NULL);
+	~CyberiadaSMRouter();
+
+	void                                route(const CyberiadaSMRoutingSnapshot& snapshot);
+	// routes on the calling thread, the postponed request is dropped as outdated
+	CyberiadaSMRoutingResult            routeNow(const CyberiadaSMRoutingSnapshot& snapshot);
+	void                                clearCache();
+	bool                                isRunning() const { return watcher->isRunning(); }
+
+	static CyberiadaSMRoutingResult     compute(const CyberiadaSMRoutingSnapshot& snapshot,
+												const QMap<Cyberiada::ID, CyberiadaSMRoute>& cache,
+												const QMap<Cyberiada::ID, QRectF>& cachedObstacles);
+
+signals:
+	void                                routed(const CyberiadaSMRoutingResult& result);
+
+private slots:
+	void                                slotFinished();
+
+private:
+	void                                updateCache(const CyberiadaSMRoutingResult& result);
+
+	QFutureWatcher<CyberiadaSMRoutingResult>* watcher;
+	bool                                hasPending;
+	CyberiadaSMRoutingSnapshot          pending;
+	QMap<Cyberiada::ID, CyberiadaSMRoute> cache;
+	QMap<Cyberiada::ID, QRectF>         cachedObstacles;
+};
+
+#endif
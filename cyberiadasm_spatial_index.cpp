@@ -0,0 +1,524 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Spatial Index implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <algorithm>
+
+#include "cyberiadasm_spatial_index.h"
+#include "cyberiadasm_geometry.h"
+#include "myassert.h"
+
+// the node capacity of the tree
+static const int   MAX_ENTRIES = 16;
+static const int   MIN_ENTRIES = 6;
+// the half width of the transition segment boxes
+static const qreal SEGMENT_MARGIN = 4;
+
+static QRectF unite(const QRectF& a, const QRectF& b)
+{
+	return QRectF(QPointF(std::min(a.left(), b.left()), std::min(a.top(), b.top())),
+				  QPointF(std::max(a.right(), b.right()), std::max(a.bottom(), b.bottom())));
+}
+
+static bool overlaps(const QRectF& a, const QRectF& b)
+{
+	return a.left() <= b.right() && b.left() <= a.right() && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+static bool encloses(const QRectF& a, const QRectF& b)
+{
+	return a.left() <= b.left() && a.right() >= b.right() && a.top() <= b.top() && a.bottom() >= b.bottom();
+}
+
+static qreal area(const QRectF& r)
+{
+	return r.width() * r.height();
+}
+
+CyberiadaSMSpatialIndex::CyberiadaSMSpatialIndex(const Cyberiada::StateMachine* _sm):
+	sm(_sm), count(0)
+{
+	MY_ASSERT(sm);
+	root = new Node;
+	root->leaf = true;
+	root->parent = NULL;
+	// the transitions may precede their ends in the document
+	addIds(sm);
+	addElements(sm);
+}
+
+CyberiadaSMSpatialIndex::~CyberiadaSMSpatialIndex()
+{
+	deleteNode(root);
+}
+
+void CyberiadaSMSpatialIndex::deleteNode(Node* node)
+{
+	foreach(Node* child, node->children) {
+		deleteNode(child);
+	}
+	delete node;
+}
+
+QVector<QPointF> CyberiadaSMSpatialIndex::transitionPath(const Cyberiada::Transition* t) const
+{
+	QRectF source = CyberiadaSMGeometry::sceneRect(findElement(t->source_element_id()));
+	QRectF target = CyberiadaSMGeometry::sceneRect(findElement(t->target_element_id()));
+	if (source.isNull() || target.isNull()) {
+		return QVector<QPointF>();
+	}
+	return CyberiadaSMGeometry::transitionPath(t, source.center(), target.center());
+}
+
+const Cyberiada::Element* CyberiadaSMSpatialIndex::findElement(const Cyberiada::ID& id) const
+{
+	std::unordered_map<Cyberiada::ID, const Cyberiada::Element*>::const_iterator i = ids.find(id);
+	return i != ids.end() ? i->second : NULL;
+}
+
+void CyberiadaSMSpatialIndex::addIds(const Cyberiada::ElementCollection* collection)
+{
+	if (!collection->has_children()) {
+		return;
+	}
+	const Cyberiada::ElementList& children = collection->get_children();
+	for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+		const Cyberiada::Element* child = *i;
+		ids[child->get_id()] = child;
+		if (child->get_type() == Cyberiada::elementCompositeState) {
+			addIds(static_cast<const Cyberiada::ElementCollection*>(child));
+		}
+	}
+}
+
+void CyberiadaSMSpatialIndex::addElements(const Cyberiada::ElementCollection* collection)
+{
+	if (!collection->has_children()) {
+		return;
+	}
+	const Cyberiada::ElementList& children = collection->get_children();
+	for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+		const Cyberiada::Element* child = *i;
+		if (child->get_type() == Cyberiada::elementTransition) {
+			linkTransition(child);
+		}
+		addElement(child);
+		if (child->get_type() == Cyberiada::elementCompositeState) {
+			addElements(static_cast<const Cyberiada::ElementCollection*>(child));
+		}
+	}
+}
+
+void CyberiadaSMSpatialIndex::linkTransition(const Cyberiada::Element* element)
+{
+	const Cyberiada::Transition* t = static_cast<const Cyberiada::Transition*>(element);
+	QPair<const Cyberiada::Element*, const Cyberiada::Element*> ends(findElement(t->source_element_id()),
+																	 findElement(t->target_element_id()));
+	QHash<const Cyberiada::Element*, QPair<const Cyberiada::Element*, const Cyberiada::Element*> >::iterator old =
+		transitionEnds.find(element);
+	if (old != transitionEnds.end()) {
+		if (old.value() == ends) {
+			return;
+		}
+		// the transition is reconnected, the old ends must not move it any more
+		if (old.value().first) {
+			incidence[old.value().first].removeOne(element);
+		}
+		if (old.value().second && old.value().second != old.value().first) {
+			incidence[old.value().second].removeOne(element);
+		}
+	}
+	transitionEnds.insert(element, ends);
+	if (ends.first) {
+		incidence[ends.first].append(element);
+	}
+	if (ends.second && ends.second != ends.first) {
+		incidence[ends.second].append(element);
+	}
+}
+
+void CyberiadaSMSpatialIndex::addElement(const Cyberiada::Element* element)
+{
+	if (element->get_type() == Cyberiada::elementTransition) {
+		QVector<QPointF> path = transitionPath(static_cast<const Cyberiada::Transition*>(element));
+		for (int k = 1; k < path.size(); k++) {
+			QRectF box = unite(QRectF(path[k - 1], QSizeF()), QRectF(path[k], QSizeF()));
+			insert(element, k - 1, box.adjusted(-SEGMENT_MARGIN, -SEGMENT_MARGIN, SEGMENT_MARGIN, SEGMENT_MARGIN));
+		}
+	} else {
+		QRectF box = CyberiadaSMGeometry::sceneRect(element);
+		if (!box.isNull()) {
+			insert(element, 0, box);
+		}
+	}
+}
+
+void CyberiadaSMSpatialIndex::update(const Cyberiada::Element* element)
+{
+	MY_ASSERT(element);
+	QList<const Cyberiada::Element*> elements;
+	QList<const Cyberiada::Element*> transitions;
+	elements.append(element);
+	while (!elements.isEmpty()) {
+		const Cyberiada::Element* e = elements.takeLast();
+		if (e->get_type() == Cyberiada::elementTransition) {
+			transitions.append(e);
+			continue;
+		}
+		removeElement(e);
+		addElement(e);
+		foreach(const Cyberiada::Element* t, incidence.value(e)) {
+			transitions.append(t);
+		}
+		if (e->get_type() == Cyberiada::elementCompositeState) {
+			const Cyberiada::ElementCollection* c = static_cast<const Cyberiada::ElementCollection*>(e);
+			if (c->has_children()) {
+				const Cyberiada::ElementList& children = c->get_children();
+				for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+					elements.append(*i);
+				}
+			}
+		}
+	}
+	std::sort(transitions.begin(), transitions.end());
+	transitions.erase(std::unique(transitions.begin(), transitions.end()), transitions.end());
+	foreach(const Cyberiada::Element* t, transitions) {
+		linkTransition(t);
+		removeElement(t);
+		addElement(t);
+	}
+}
+
+void CyberiadaSMSpatialIndex::insert(const Cyberiada::Element* element, int part, const QRectF& box)
+{
+	Entry entry;
+	entry.element = element;
+	entry.part = part;
+	entry.box = box;
+	boxes[element].append(box);
+	insertEntry(entry);
+	count++;
+}
+
+void CyberiadaSMSpatialIndex::removeElement(const Cyberiada::Element* element)
+{
+	QVector<QRectF> element_boxes = boxes.take(element);
+	foreach(const QRectF& box, element_boxes) {
+		Node* leaf = findLeaf(root, element, box);
+		MY_ASSERT(leaf);
+		if (!leaf) continue;
+		for (int i = 0; i < leaf->entries.size(); i++) {
+			if (leaf->entries[i].element == element && leaf->entries[i].box == box) {
+				leaf->entries.remove(i);
+				break;
+			}
+		}
+		count--;
+		condenseTree(leaf);
+	}
+}
+
+QRectF CyberiadaSMSpatialIndex::elementRect(const Cyberiada::Element* element) const
+{
+	QRectF result;
+	bool first = true;
+	foreach(const QRectF& box, boxes.value(element)) {
+		result = first ? box : unite(result, box);
+		first = false;
+	}
+	return result;
+}
+
+QRectF CyberiadaSMSpatialIndex::nodeBox(const Node* node)
+{
+	QRectF result;
+	bool first = true;
+	if (node->leaf) {
+		foreach(const Entry& e, node->entries) {
+			result = first ? e.box : unite(result, e.box);
+			first = false;
+		}
+	} else {
+		foreach(const Node* child, node->children) {
+			result = first ? child->box : unite(result, child->box);
+			first = false;
+		}
+	}
+	return result;
+}
+
+CyberiadaSMSpatialIndex::Node* CyberiadaSMSpatialIndex::chooseLeaf(const QRectF& box) const
+{
+	// descend to the child that needs the least enlargement
+	Node* node = root;
+	while (!node->leaf) {
+		Node* best = NULL;
+		qreal best_enlargement = 0, best_area = 0;
+		foreach(Node* child, node->children) {
+			qreal a = area(child->box);
+			qreal enlargement = area(unite(child->box, box)) - a;
+			if (!best || enlargement < best_enlargement || (enlargement == best_enlargement && a < best_area)) {
+				best = child;
+				best_enlargement = enlargement;
+				best_area = a;
+			}
+		}
+		node = best;
+	}
+	return node;
+}
+
+void CyberiadaSMSpatialIndex::insertEntry(const Entry& entry)
+{
+	Node* leaf = chooseLeaf(entry.box);
+	leaf->entries.append(entry);
+	Node* split = NULL;
+	if (leaf->entries.size() > MAX_ENTRIES) {
+		split = splitNode(leaf);
+	}
+	adjustTree(leaf, split);
+}
+
+CyberiadaSMSpatialIndex::Node* CyberiadaSMSpatialIndex::splitNode(Node* node)
+{
+	// the quadratic split
+	QVector<QRectF> items;
+	if (node->leaf) {
+		foreach(const Entry& e, node->entries) items.append(e.box);
+	} else {
+		foreach(const Node* child, node->children) items.append(child->box);
+	}
+	int n = items.size();
+
+	int seed1 = 0, seed2 = 1;
+	qreal worst = -1;
+	for (int i = 0; i < n; i++) {
+		for (int j = i + 1; j < n; j++) {
+			qreal d = area(unite(items[i], items[j])) - area(items[i]) - area(items[j]);
+			if (d > worst) {
+				worst = d;
+				seed1 = i;
+				seed2 = j;
+			}
+		}
+	}
+
+	QVector<int> group(n, -1);
+	group[seed1] = 0;
+	group[seed2] = 1;
+	QRectF boxes_of[2] = { items[seed1], items[seed2] };
+	int sizes[2] = { 1, 1 };
+	int remaining = n - 2;
+	while (remaining > 0) {
+		// the group that is too small takes all the rest
+		int forced = -1;
+		if (sizes[0] + remaining == MIN_ENTRIES) forced = 0;
+		if (sizes[1] + remaining == MIN_ENTRIES) forced = 1;
+		if (forced >= 0) {
+			for (int i = 0; i < n; i++) {
+				if (group[i] < 0) {
+					group[i] = forced;
+					boxes_of[forced] = unite(boxes_of[forced], items[i]);
+					sizes[forced]++;
+				}
+			}
+			break;
+		}
+		// the item with the strongest preference goes first
+		int next = -1;
+		qreal best_diff = -1, d0 = 0, d1 = 0;
+		for (int i = 0; i < n; i++) {
+			if (group[i] >= 0) continue;
+			qreal e0 = area(unite(boxes_of[0], items[i])) - area(boxes_of[0]);
+			qreal e1 = area(unite(boxes_of[1], items[i])) - area(boxes_of[1]);
+			qreal diff = qAbs(e0 - e1);
+			if (diff > best_diff) {
+				best_diff = diff;
+				next = i;
+				d0 = e0;
+				d1 = e1;
+			}
+		}
+		int g;
+		if (d0 != d1) {
+			g = d0 < d1 ? 0 : 1;
+		} else if (area(boxes_of[0]) != area(boxes_of[1])) {
+			g = area(boxes_of[0]) < area(boxes_of[1]) ? 0 : 1;
+		} else {
+			g = sizes[0] <= sizes[1] ? 0 : 1;
+		}
+		group[next] = g;
+		boxes_of[g] = unite(boxes_of[g], items[next]);
+		sizes[g]++;
+		remaining--;
+	}
+
+	Node* sibling = new Node;
+	sibling->leaf = node->leaf;
+	sibling->parent = node->parent;
+	if (node->leaf) {
+		QVector<Entry> entries;
+		entries.swap(node->entries);
+		for (int i = 0; i < n; i++) {
+			(group[i] == 0 ? node->entries : sibling->entries).append(entries[i]);
+		}
+	} else {
+		QVector<Node*> children;
+		children.swap(node->children);
+		for (int i = 0; i < n; i++) {
+			Node* owner = group[i] == 0 ? node : sibling;
+			owner->children.append(children[i]);
+			children[i]->parent = owner;
+		}
+	}
+	node->box = boxes_of[0];
+	sibling->box = boxes_of[1];
+	return sibling;
+}
+
+void CyberiadaSMSpatialIndex::adjustTree(Node* node, Node* split)
+{
+	while (true) {
+		node->box = nodeBox(node);
+		if (node == root) {
+			if (split) {
+				// the root is split, the tree grows
+				Node* new_root = new Node;
+				new_root->leaf = false;
+				new_root->parent = NULL;
+				new_root->children.append(node);
+				new_root->children.append(split);
+				node->parent = split->parent = new_root;
+				new_root->box = nodeBox(new_root);
+				root = new_root;
+			}
+			return;
+		}
+		Node* parent = node->parent;
+		Node* parent_split = NULL;
+		if (split) {
+			split->parent = parent;
+			parent->children.append(split);
+			if (parent->children.size() > MAX_ENTRIES) {
+				parent_split = splitNode(parent);
+			}
+		}
+		node = parent;
+		split = parent_split;
+	}
+}
+
+CyberiadaSMSpatialIndex::Node* CyberiadaSMSpatialIndex::findLeaf(Node* node, const Cyberiada::Element* element,
+																 const QRectF& box) const
+{
+	if (node->leaf) {
+		foreach(const Entry& e, node->entries) {
+			if (e.element == element && e.box == box) {
+				return node;
+			}
+		}
+		return NULL;
+	}
+	foreach(Node* child, node->children) {
+		if (encloses(child->box, box)) {
+			Node* leaf = findLeaf(child, element, box);
+			if (leaf) {
+				return leaf;
+			}
+		}
+	}
+	return NULL;
+}
+
+void CyberiadaSMSpatialIndex::collectEntries(Node* node, QVector<Entry>& entries) const
+{
+	if (node->leaf) {
+		entries += node->entries;
+		return;
+	}
+	foreach(Node* child, node->children) {
+		collectEntries(child, entries);
+	}
+}
+
+void CyberiadaSMSpatialIndex::condenseTree(Node* leaf)
+{
+	// the underfull nodes are dropped and their entries inserted again
+	QVector<Entry> orphans;
+	Node* node = leaf;
+	while (node != root) {
+		Node* parent = node->parent;
+		int size = node->leaf ? node->entries.size() : node->children.size();
+		if (size < MIN_ENTRIES) {
+			parent->children.removeOne(node);
+			collectEntries(node, orphans);
+			deleteNode(node);
+		} else {
+			node->box = nodeBox(node);
+		}
+		node = parent;
+	}
+	root->box = nodeBox(root);
+	while (!root->leaf && root->children.size() == 1) {
+		Node* child = root->children.first();
+		root->children.clear();
+		delete root;
+		root = child;
+		root->parent = NULL;
+	}
+	if (!root->leaf && root->children.isEmpty()) {
+		root->leaf = true;
+	}
+	foreach(const Entry& e, orphans) {
+		insertEntry(e);
+	}
+}
+
+QList<CyberiadaSMSpatialIndex::Entry> CyberiadaSMSpatialIndex::search(const QRectF& region) const
+{
+	QList<Entry> result;
+	QVector<const Node*> stack;
+	stack.append(root);
+	while (!stack.isEmpty()) {
+		const Node* node = stack.takeLast();
+		if (node->leaf) {
+			foreach(const Entry& e, node->entries) {
+				if (overlaps(e.box, region)) {
+					result.append(e);
+				}
+			}
+			continue;
+		}
+		foreach(const Node* child, node->children) {
+			if (overlaps(child->box, region)) {
+				stack.append(child);
+			}
+		}
+	}
+	return result;
+}
+
+QList<CyberiadaSMSpatialIndex::Entry> CyberiadaSMSpatialIndex::search(const QPointF& point) const
+{
+	return search(QRectF(point, QSizeF()));
+}
@@ -0,0 +1,108 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Spatial Index
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_SPATIAL_INDEX_HEADER
+#define CYBERIADA_SM_SPATIAL_INDEX_HEADER
+
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QPair>
+#include <QRectF>
+#include <unordered_map>
+#include <cyberiada/cyberiadamlpp.h>
+
+/* -----------------------------------------------------------------------------
+ * R-tree over the geometry of a state machine in the coordinates of its scene
+ * (the machine is at the origin). The states, the pseudostates and the comments
+ * get their rectangles, the transitions get one box per path segment (the part
+ * number is the segment index). The index works on the document only, so the
+ * hit tests and the overlap checks need no graphics scene; the geometry is
+ * read with CyberiadaSMGeometry, the same way the scene store reads it.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMSpatialIndex {
+public:
+	struct Entry {
+		const Cyberiada::Element*       element;
+		int                             part;
+		QRectF                          box;
+	};
+
+	CyberiadaSMSpatialIndex(const Cyberiada::StateMachine* sm);
+	~CyberiadaSMSpatialIndex();
+
+	const Cyberiada::StateMachine*      stateMachine() const { return sm; }
+	int                                 size() const { return count; }
+
+	// re-index the element, its nested elements and the attached transitions
+	void                                update(const Cyberiada::Element* element);
+
+	QList<Entry>                        search(const QRectF& region) const;
+	QList<Entry>                        search(const QPointF& point) const;
+	QRectF                              elementRect(const Cyberiada::Element* element) const;
+	// the element of the machine by id without the document search, NULL if unknown
+	const Cyberiada::Element*           findElement(const Cyberiada::ID& id) const;
+
+	// the path of the transition in the scene coordinates
+	QVector<QPointF>                    transitionPath(const Cyberiada::Transition* transition) const;
+
+private:
+	struct Node {
+		bool                            leaf;
+		QRectF                          box;
+		Node*                           parent;
+		QVector<Node*>                  children;
+		QVector<Entry>                  entries;
+	};
+
+	void                                addIds(const Cyberiada::ElementCollection* collection);
+	void                                addElements(const Cyberiada::ElementCollection* collection);
+	void                                addElement(const Cyberiada::Element* element);
+	void                                linkTransition(const Cyberiada::Element* transition);
+	void                                removeElement(const Cyberiada::Element* element);
+	void                                insert(const Cyberiada::Element* element, int part, const QRectF& box);
+	void                                insertEntry(const Entry& entry);
+	Node*                               chooseLeaf(const QRectF& box) const;
+	Node*                               splitNode(Node* node);
+	void                                adjustTree(Node* node, Node* split);
+	Node*                               findLeaf(Node* node, const Cyberiada::Element* element, const QRectF& box) const;
+	void                                condenseTree(Node* leaf);
+	void                                collectEntries(Node* node, QVector<Entry>& entries) const;
+	static QRectF                       nodeBox(const Node* node);
+	static void                         deleteNode(Node* node);
+
+	const Cyberiada::StateMachine*      sm;
+	Node*                               root;
+	int                                 count;
+	// the elements by id; the model drops the index on every insertion or removal
+	std::unordered_map<Cyberiada::ID, const Cyberiada::Element*> ids;
+	// the boxes of every indexed element to find its entries
+	QHash<const Cyberiada::Element*, QVector<QRectF> > boxes;
+	// the transitions attached to every vertex and the ends they were attached by
+	QHash<const Cyberiada::Element*, QVector<const Cyberiada::Element*> > incidence;
+	QHash<const Cyberiada::Element*, QPair<const Cyberiada::Element*, const Cyberiada::Element*> > transitionEnds;
+};
+
+#endif
@@ -0,0 +1,192 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Editor Trace Recorder implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <atomic>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QCoreApplication>
+#include <QThread>
+
+#include "cyberiadasm_trace.h"
+
+// the spans kept per thread
+static const int TRACE_BUFFER_SIZE = 1 << 14;
+
+namespace {
+	// the slot sequence is the span index + 1 once the span is complete and 0
+	// while the writer fills it, so the reader detects the torn copies
+	struct Span {
+		std::atomic<quint64>            seq;
+		std::atomic<const char*>        name;
+		std::atomic<qint64>             start;
+		std::atomic<qint64>             end;
+		Span(): seq(0), name(NULL), start(0), end(0) {}
+	};
+
+	// only the owner thread writes to the buffer; the buffer of a finished
+	// thread keeps its spans and goes to the next new thread
+	struct Buffer {
+		int                             thread;
+		std::atomic<bool>               main;
+		std::atomic<quint64>            head;
+		Span                            spans[TRACE_BUFFER_SIZE];
+		Buffer(int t): thread(t), main(false), head(0) {}
+	};
+
+	struct Registry {
+		QMutex                          mutex;
+		QVector<Buffer*>                buffers;   // the buffers live until the exit
+		QVector<Buffer*>                free;      // the buffers of the finished threads
+		QElapsedTimer                   clock;
+		Registry() { clock.start(); }
+	};
+
+	Registry& registry()
+	{
+		static Registry r;
+		return r;
+	}
+
+	thread_local Buffer* currentBuffer = NULL;
+
+	// returns the buffer of the thread to the registry at the thread exit
+	struct BufferOwner {
+		~BufferOwner()
+		{
+			if (!currentBuffer) return;
+			Registry& r = registry();
+			QMutexLocker locker(&r.mutex);
+			r.free.append(currentBuffer);
+			currentBuffer = NULL;
+		}
+	};
+
+	Buffer* threadBuffer()
+	{
+		static thread_local BufferOwner owner;
+		if (!currentBuffer) {
+			Registry& r = registry();
+			QMutexLocker locker(&r.mutex);
+			if (!r.free.isEmpty()) {
+				currentBuffer = r.free.takeLast();
+			} else {
+				currentBuffer = new Buffer(r.buffers.size() + 1);
+				r.buffers.append(currentBuffer);
+			}
+			QCoreApplication* app = QCoreApplication::instance();
+			currentBuffer->main.store(app && app->thread() == QThread::currentThread(),
+			                          std::memory_order_relaxed);
+		}
+		return currentBuffer;
+	}
+}
+
+QAtomicInt CyberiadaSMTrace::enabled(0);
+
+void CyberiadaSMTrace::setEnabled(bool on)
+{
+	if (on) {
+		// the clock starts before the first span
+		registry();
+	}
+	enabled.storeRelease(on ? 1 : 0);
+}
+
+qint64 CyberiadaSMTrace::now()
+{
+	return registry().clock.nsecsElapsed();
+}
+
+void CyberiadaSMTrace::record(const char* name, qint64 start, qint64 end)
+{
+	Buffer* buffer = threadBuffer();
+	quint64 head = buffer->head.load(std::memory_order_relaxed);
+	Span& span = buffer->spans[head % TRACE_BUFFER_SIZE];
+	span.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	span.name.store(name, std::memory_order_relaxed);
+	span.start.store(start, std::memory_order_relaxed);
+	span.end.store(end, std::memory_order_relaxed);
+	span.seq.store(head + 1, std::memory_order_release);
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool CyberiadaSMTrace::dump(const QString& path)
+{
+	QVector<Buffer*> buffers;
+	{
+		Registry& r = registry();
+		QMutexLocker locker(&r.mutex);
+		buffers = r.buffers;
+	}
+
+	QJsonArray events;
+	qint64 pid = QCoreApplication::applicationPid();
+	foreach(Buffer* buffer, buffers) {
+		QJsonObject meta;
+		meta.insert("name", "thread_name");
+		meta.insert("ph", "M");
+		meta.insert("pid", pid);
+		meta.insert("tid", buffer->thread);
+		QJsonObject args;
+		args.insert("name", buffer->main.load(std::memory_order_relaxed) ? QString("main") : QString("worker %1").arg(buffer->thread));
+		meta.insert("args", args);
+		events.append(meta);
+
+		quint64 head = buffer->head.load(std::memory_order_acquire);
+		quint64 first = head > quint64(TRACE_BUFFER_SIZE) ? head - TRACE_BUFFER_SIZE : 0;
+		for (quint64 i = first; i < head; i++) {
+			const Span& span = buffer->spans[i % TRACE_BUFFER_SIZE];
+			// the span overwritten or being written while copying is dropped
+			if (span.seq.load(std::memory_order_acquire) != i + 1) continue;
+			const char* name = span.name.load(std::memory_order_relaxed);
+			qint64 start = span.start.load(std::memory_order_relaxed);
+			qint64 end = span.end.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (span.seq.load(std::memory_order_relaxed) != i + 1) continue;
+			QJsonObject event;
+			event.insert("name", name);
+			event.insert("ph", "X");
+			event.insert("pid", pid);
+			event.insert("tid", buffer->thread);
+			event.insert("ts", start / 1000.0);
+			event.insert("dur", (end - start) / 1000.0);
+			events.append(event);
+		}
+	}
+
+	QJsonObject trace;
+	trace.insert("traceEvents", events);
+	trace.insert("displayTimeUnit", "ms");
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+	return file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) >= 0;
+}
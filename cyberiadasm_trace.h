@@ -0,0 +1,74 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Editor Trace Recorder
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_TRACE_HEADER
+#define CYBERIADA_SM_TRACE_HEADER
+
+#include <QString>
+#include <QAtomicInt>
+
+/* -----------------------------------------------------------------------------
+ * The recorder of the timed spans on the editor hot paths. Every thread writes
+ * its spans to its own ring buffer of a fixed size without any locks, so the
+ * oldest spans are overwritten and the memory stays bounded. The buffer of a
+ * finished thread is taken by the next new one, so the short-lived workers do
+ * not add buffers. dump() writes the buffers in the Chrome trace event format
+ * (chrome://tracing, Perfetto) and skips the spans being overwritten. When the
+ * recording is off, a span costs a single atomic load.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMTrace {
+public:
+	static void                         setEnabled(bool on);
+	static bool                         isEnabled() { return enabled.loadAcquire() != 0; }
+	static qint64                       now();
+	// the span names are string literals, they are not copied
+	static void                         record(const char* name, qint64 start, qint64 end);
+	static bool                         dump(const QString& path);
+
+private:
+	static QAtomicInt                   enabled;
+};
+
+class CyberiadaSMTraceSpan {
+public:
+	CyberiadaSMTraceSpan(const char* name):
+		spanName(CyberiadaSMTrace::isEnabled() ? name : NULL),
+		start(spanName ? CyberiadaSMTrace::now() : 0) {}
+	~CyberiadaSMTraceSpan() {
+		if (spanName) {
+			CyberiadaSMTrace::record(spanName, start, CyberiadaSMTrace::now());
+		}
+	}
+
+private:
+	const char*                         spanName;
+	qint64                              start;
+};
+
+#define SM_TRACE_CONCAT_(a, b) a##b
+#define SM_TRACE_CONCAT(a, b) SM_TRACE_CONCAT_(a, b)
+#define SM_TRACE_SPAN(name) CyberiadaSMTraceSpan SM_TRACE_CONCAT(sm_trace_span_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,167 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Editor Typography implementation
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#include <QtMath>
+#include <QStringList>
+
+#include "cyberiadasm_typography.h"
+#include "myassert.h"
+
+// the resolution is rounded to this step (dpi)
+static const qreal RESOLUTION_STEP = 12;
+static const qreal DEFAULT_RESOLUTION = 96;
+// the zoom buckets are half an octave wide
+static const qreal ZOOM_BUCKETS_PER_OCTAVE = 2;
+static const int   MAX_ZOOM_BUCKET = 16;
+// the measured texts kept for every role
+static const int   TEXT_CACHE_SIZE = 20000;
+static const qreal POINTS_PER_INCH = 72;
+
+CyberiadaSMTypography* CyberiadaSMTypography::instance()
+{
+	static CyberiadaSMTypography typography;
+	return &typography;
+}
+
+CyberiadaSMTypography::CyberiadaSMTypography():
+	resolutionBucket(qRound(DEFAULT_RESOLUTION / RESOLUTION_STEP)), zoomBucket(0)
+{
+	for (int role = 0; role < roleCount; role++) {
+		fontMetrics[role] = NULL;
+		sizes[role].setMaxCost(TEXT_CACHE_SIZE);
+	}
+}
+
+CyberiadaSMTypography::~CyberiadaSMTypography()
+{
+	for (int role = 0; role < roleCount; role++) {
+		delete fontMetrics[role];
+	}
+}
+
+QFont CyberiadaSMTypography::baseFont(Role role)
+{
+	switch (role) {
+	case roleTitle:
+	case roleAction:
+		return QFont("Monospace");
+	default:
+		return QFont();
+	}
+}
+
+void CyberiadaSMTypography::setResolution(qreal dpi)
+{
+	MY_ASSERT(dpi > 0);
+	int bucket = qRound(dpi / RESOLUTION_STEP);
+	if (bucket == resolutionBucket) {
+		return;
+	}
+	{
+		QMutexLocker locker(&resolutionMutex);
+		resolutionBucket = bucket;
+	}
+	for (int role = 0; role < roleCount; role++) {
+		delete fontMetrics[role];
+		fontMetrics[role] = NULL;
+		sizes[role].clear();
+	}
+	emit metricsChanged();
+}
+
+void CyberiadaSMTypography::setZoom(qreal zoom)
+{
+	MY_ASSERT(zoom > 0);
+	int bucket = qBound(-MAX_ZOOM_BUCKET, qRound(std::log2(zoom) * ZOOM_BUCKETS_PER_OCTAVE), MAX_ZOOM_BUCKET);
+	zoomBucket = bucket;
+}
+
+QFont CyberiadaSMTypography::resolve(Role role, int zoom)
+{
+	int k = key(resolutionBucket, zoom);
+	QHash<int, QFont>::const_iterator i = fonts[role].find(k);
+	if (i != fonts[role].end()) {
+		return i.value();
+	}
+	QFont font = makeFont(role, resolutionBucket, zoom);
+	fonts[role].insert(k, font);
+	return font;
+}
+
+QFont CyberiadaSMTypography::makeFont(Role role, int resolution, int zoom)
+{
+	QFont font = baseFont(role);
+	// the pixel size fixes the text size in the scene units at the resolution
+	qreal points = font.pointSizeF() > 0 ? font.pointSizeF() : 9;
+	font.setPixelSize(qMax(1, qRound(points * resolution * RESOLUTION_STEP / POINTS_PER_INCH)));
+	// the scaled texts are drawn without the hinting made for the normal size
+	font.setHintingPreference(zoom == 0 ? QFont::PreferDefaultHinting : QFont::PreferNoHinting);
+	return font;
+}
+
+QFont CyberiadaSMTypography::font(Role role)
+{
+	return resolve(role, zoomBucket);
+}
+
+QFont CyberiadaSMTypography::layoutFont(Role role)
+{
+	// the cache of resolve() belongs to the GUI thread, the font is made anew
+	int resolution;
+	{
+		QMutexLocker locker(&resolutionMutex);
+		resolution = resolutionBucket;
+	}
+	return makeFont(role, resolution, 0);
+}
+
+const QFontMetricsF& CyberiadaSMTypography::metrics(Role role)
+{
+	if (!fontMetrics[role]) {
+		fontMetrics[role] = new QFontMetricsF(resolve(role, 0));
+	}
+	return *fontMetrics[role];
+}
+
+qreal CyberiadaSMTypography::textWidth(Role role, const QString& text)
+{
+	return textSize(role, text).width();
+}
+
+QSizeF CyberiadaSMTypography::textSize(Role role, const QString& text)
+{
+	QSizeF* cached = sizes[role].object(text);
+	if (cached) {
+		return *cached;
+	}
+	const QFontMetricsF& m = metrics(role);
+	QStringList lines = text.split('\n');
+	qreal width = 0;
+	foreach(const QString& line, lines) {
+		width = qMax(width, m.horizontalAdvance(line));
+	}
+	QSizeF size(width, m.height() + (lines.size() - 1) * m.lineSpacing());
+	sizes[role].insert(text, new QSizeF(size));
+	return size;
+}
@@ -0,0 +1,95 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Editor Typography
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+#ifndef CYBERIADA_SM_TYPOGRAPHY_HEADER
+#define CYBERIADA_SM_TYPOGRAPHY_HEADER
+
+#include <QObject>
+#include <QFont>
+#include <QFontMetricsF>
+#include <QHash>
+#include <QCache>
+#include <QMutex>
+#include <QSizeF>
+#include <QString>
+
+/* -----------------------------------------------------------------------------
+ * The fonts of the editor items resolved once per resolution and zoom bucket
+ * and shared by all items. The texts are measured with the metrics of the
+ * current resolution at the normal zoom, so the layout does not depend on the
+ * zoom, and the measurements are cached by the text. The zoom bucket only
+ * chooses the font the texts are painted with. Only layoutFont() may be called
+ * outside the GUI thread.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMTypography: public QObject {
+Q_OBJECT
+
+public:
+	enum Role {
+		roleTitle = 0,
+		roleAction,
+		roleTrigger,
+		roleCount
+	};
+
+	static CyberiadaSMTypography*       instance();
+
+	void                                setResolution(qreal dpi);
+	void                                setZoom(qreal zoom);
+	// changes together with the fonts returned by font()
+	int                                 fontKey() const { return key(resolutionBucket, zoomBucket); }
+	// changes together with the metrics
+	int                                 metricsKey() const { return resolutionBucket; }
+
+	QFont                               font(Role role);
+	// the font of the normal zoom the texts are measured with; thread-safe
+	QFont                               layoutFont(Role role);
+	const QFontMetricsF&                metrics(Role role);
+	qreal                               textWidth(Role role, const QString& text);
+	// the size of the unwrapped (possibly multi-line) text
+	QSizeF                              textSize(Role role, const QString& text);
+
+signals:
+	// the texts need to be measured again
+	void                                metricsChanged();
+
+private:
+	CyberiadaSMTypography();
+	~CyberiadaSMTypography();
+
+	static QFont                        baseFont(Role role);
+	static int                          key(int resolution, int zoom) { return (resolution << 8) | (zoom & 0xff); }
+	static QFont                        makeFont(Role role, int resolution, int zoom);
+	QFont                               resolve(Role role, int zoom);
+
+	int                                 resolutionBucket;
+	int                                 zoomBucket;
+	QHash<int, QFont>                   fonts[roleCount];
+	QFontMetricsF*                      fontMetrics[roleCount];
+	QCache<QString, QSizeF>             sizes[roleCount];
+	QMutex                              resolutionMutex;  // guards the resolution read by the other threads
+};
+
+#endif
@@ -28,6 +28,7 @@
 
 #include "cyberiadasm_model.h"
 #include "cyberiadasm_view.h"
+#include "cyberiadasm_trace.h"
 #include "myassert.h"
 
 CyberiadaSMView::CyberiadaSMView(QWidget* parent):
@@ -39,7 +40,7 @@ CyberiadaSMView::CyberiadaSMView(QWidget* parent):
 	setDragDropMode(QAbstractItemView::DragDrop);
 	setDefaultDropAction(Qt::MoveAction);
 	setEditTriggers(QAbstractItemView::SelectedClicked);
-//	setSelectionMode(QAbstractItemView::MultiSelection);
+	setSelectionMode(QAbstractItemView::ExtendedSelection);
 }
 
 void CyberiadaSMView::select(const QModelIndex& index)
@@ -48,6 +49,25 @@ void CyberiadaSMView::select(const QModelIndex& index)
     emit currentIndexActivated(index);
 }
 
+void CyberiadaSMView::select(const QModelIndexList& indexes)
+{
+	SM_TRACE_SPAN("view selection sync");
+	if (indexes.isEmpty()) {
+		selectionModel()->clearSelection();
+		return;
+	}
+	// replace the whole selection at once to get a single selectionChanged notification
+	QItemSelection selection;
+	foreach(QModelIndex index, indexes) {
+		selection.select(index, index);
+	}
+	selectionModel()->select(selection, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+	if (!selection.contains(currentIndex())) {
+		selectionModel()->setCurrentIndex(indexes.first(), QItemSelectionModel::NoUpdate);
+	}
+	scrollTo(indexes.first());
+}
+
 void CyberiadaSMView::currentChanged(const QModelIndex &current, const QModelIndex &previous)
 {
     QTreeView::currentChanged(current, previous);
@@ -55,6 +75,12 @@ void CyberiadaSMView::currentChanged(const QModelIndex &current, const QModelInd
     emit currentIndexActivated(current);
 }
 
+void CyberiadaSMView::selectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
+{
+	QTreeView::selectionChanged(selected, deselected);
+	emit selectionActivated(selectionModel()->selectedRows());
+}
+
 void CyberiadaSMView::startDrag(Qt::DropActions)
 {
 	QDrag* drag = new QDrag(this);
@@ -37,12 +37,15 @@ public:
 
 public slots:
 	void select(const QModelIndex& index);
+	void select(const QModelIndexList& indexes);
 									
 protected slots:
 	void currentChanged(const QModelIndex &current, const QModelIndex &previous);
+	void selectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
 
 signals:
 	void currentIndexActivated(const QModelIndex& current);
+	void selectionActivated(const QModelIndexList& indexes);
 	
 protected:
     void startDrag(Qt::DropActions);
@@ -1,4 +1,5 @@
 #include "editable_text_item.h"
+#include "cyberiadasm_profiler.h"
 
 #include <QGraphicsSceneMouseEvent>
 #include <QTextCursor>
@@ -11,10 +12,11 @@
 #include <QDebug>
 
 #include "cyberiadasm_editor_state_item.h"
+#include "cyberiadasm_commands.h"
 
 
 EditableTextItem::EditableTextItem(const QString &text, QGraphicsItem *parent, bool align)
-    : QGraphicsTextItem(text, parent), align(align) {
+    : QGraphicsTextItem(text, parent), isEdit(false), align(align), editSession(0) {
     setFlags(QGraphicsItem::ItemIsSelectable);
     setTextInteractionFlags(Qt::NoTextInteraction);
     setAlign();
@@ -31,24 +33,53 @@ void EditableTextItem::mousePressEvent(QGraphicsSceneMouseEvent *event) {
 void EditableTextItem::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
     setTextInteractionFlags(Qt::TextEditorInteraction);
     setFocus();
+    if (!isEdit) {
+        editStartText = toPlainText();
+        editSession = CyberiadaSMTextCommand::newSession();
+    }
     isEdit = true;
     QGraphicsTextItem::mouseDoubleClickEvent(event);
 }
 
+void EditableTextItem::startEditing() {
+    setTextInteractionFlags(Qt::TextEditorInteraction);
+    setFocus();
+    editStartText = toPlainText();
+    if (!isEdit) {
+        editSession = CyberiadaSMTextCommand::newSession();
+    }
+    isEdit = true;
+    QTextCursor cursor = textCursor();
+    cursor.select(QTextCursor::Document);
+    setTextCursor(cursor);
+}
+
 void EditableTextItem::keyPressEvent(QKeyEvent *event){
     if (isEdit) {
         CyberiadaSMEditorStateItem *parentRectangle = dynamic_cast<CyberiadaSMEditorStateItem*>(parentItem());
         QGraphicsTextItem::keyPressEvent(event);
-        parentRectangle->setPositionText();
+        if (parentRectangle) {
+            parentRectangle->setPositionText();
+        }
         parentItem()->update();
     }
 }
 
 void EditableTextItem::focusOutEvent(QFocusEvent *event) {
     setTextInteractionFlags(Qt::NoTextInteraction);
-    isEdit = false;
     setPlainText(toPlainText().trimmed());
     QGraphicsTextItem::focusOutEvent(event);
+    if (isEdit) {
+        isEdit = false;
+        CyberiadaSMEditorAbstractItem *owner = dynamic_cast<CyberiadaSMEditorAbstractItem*>(parentItem());
+        if (owner && toPlainText() != editStartText) {
+            owner->textEdited(this, toPlainText());
+        }
+        if (owner) {
+            owner->textEditFinished(this);
+        }
+        editSession = 0;
+    }
 }
 
 void EditableTextItem::hoverEnterEvent(QGraphicsSceneHoverEvent *event) {
@@ -63,11 +94,13 @@ void EditableTextItem::hoverEnterEvent(QGraphicsSceneHoverEvent *event) {
 
 void EditableTextItem::setAlign(){
     CyberiadaSMEditorStateItem *rectParent = dynamic_cast<CyberiadaSMEditorStateItem*>(parentItem());
-    if (!align) {
-        setTextWidth(rectParent->rect().width() - 30);
-    }
-    if (boundingRect().width() > rectParent->rect().width() - 30) {
-        setTextWidth(rectParent->rect().width() - 30);
+    if (rectParent) {
+        if (!align) {
+            setTextWidth(rectParent->rect().width() - 30);
+        }
+        if (boundingRect().width() > rectParent->rect().width() - 30) {
+            setTextWidth(rectParent->rect().width() - 30);
+        }
     }
     QTextBlockFormat blockFormat;
     if (align) {
@@ -79,8 +112,8 @@ void EditableTextItem::setAlign(){
 }
 
 void EditableTextItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    SM_PROFILE_COUNT(paintText);
     setAlign();
-    painter->setFont(QFont(font()));
 
     QGraphicsTextItem::paint(painter, option, widget);
 }
@@ -8,6 +8,10 @@ class EditableTextItem : public QGraphicsTextItem {
 public:
     explicit EditableTextItem(const QString &text, QGraphicsItem *parent = nullptr, bool align = false);
 
+    void startEditing();
+    // the undo session of the current edit, 0 when the text is not edited
+    int session() const { return editSession; }
+
 protected:
     void focusOutEvent(QFocusEvent *event) override;
     void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
@@ -23,6 +27,8 @@ protected:
     void setAlign();
     bool isEdit;
     bool align;
+    QString editStartText;
+    int editSession;
 };
 
 
@@ -22,18 +22,75 @@
  * ----------------------------------------------------------------------------- */
 
 #include <QDateTime>
+#include <QCommandLineParser>
 #include "main.h"
 #include "smeditor_window.h"
 #include "cyberiada_constants.h"
+#include "cyberiadasm_trace.h"
+#include "cyberiadasm_headless.h"
+
+static bool isHeadless(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		QByteArray arg(argv[i]);
+		if (arg == "--export" || arg.startsWith("--export=")) {
+			return true;
+		}
+	}
+	return false;
+}
 
 int main(int argc, char *argv[])
 {
 	qsrand(QDateTime::currentDateTime().toTime_t());
+	// the platform is chosen when the application is created, so the arguments are checked before
+	bool headless = isHeadless(argc, argv);
+	if (headless && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
 	CyberiadaSMEditorApplication app(argc, argv);
+	app.setHeadless(headless);
+
+	QCommandLineParser parser;
+	parser.addHelpOption();
+	QCommandLineOption trace_option("trace", "Record the editor trace and write it to <file> at exit.", "file");
+	parser.addOption(trace_option);
+	QCommandLineOption export_option("export", "Render the state machines of the documents to <dir> without the editor.", "dir");
+	parser.addOption(export_option);
+	QCommandLineOption formats_option("formats", "The comma-separated export formats: png, svg, pdf (png by default).",
+									  "list", "png");
+	parser.addOption(formats_option);
+	QCommandLineOption scale_option("scale", "The export scale, pixels per scene unit (1 by default).", "factor", "1");
+	parser.addOption(scale_option);
+	parser.addPositionalArgument("files", "The documents to export.", "[files...]");
+	parser.process(app);
+	if (parser.isSet(trace_option)) {
+		CyberiadaSMTrace::setEnabled(true);
+	}
+
 	try {
+		if (headless) {
+			CyberiadaSMHeadless::Options options;
+			options.outputDir = parser.value(export_option);
+			bool scale_ok = false;
+			options.exportOptions.scale = parser.value(scale_option).toDouble(&scale_ok);
+			if (!CyberiadaSMHeadless::parseFormats(parser.value(formats_option), options.formats) ||
+				!scale_ok || options.exportOptions.scale <= 0 || parser.positionalArguments().isEmpty()) {
+				parser.showHelp(1);
+			}
+			int res = CyberiadaSMHeadless::run(parser.positionalArguments(), options);
+			if (parser.isSet(trace_option) && !CyberiadaSMTrace::dump(parser.value(trace_option))) {
+				app.printMessage(QString("Cannot write the trace to %1").arg(parser.value(trace_option)));
+			}
+			return res;
+		}
+
 		CyberiadaSMEditorWindow win;
 		win.show();
 		int res = app.exec();
+		if (parser.isSet(trace_option) && !CyberiadaSMTrace::dump(parser.value(trace_option))) {
+			app.printMessage(QString("Cannot write the trace to %1").arg(parser.value(trace_option)));
+		}
 		return res;
 	} catch(const QString& error) {
 		app.printMessage(error);
@@ -26,14 +26,18 @@
 
 #include <QApplication>
 #include <QMessageBox>
+#include <QTextStream>
 
 class CyberiadaSMEditorApplication: public QApplication {
 Q_OBJECT
 public:
 	CyberiadaSMEditorApplication(int & argc, char ** argv):
-		QApplication(argc, argv) 
+		QApplication(argc, argv), headless(false)
 		{}
 
+	// the headless mode has no one to show the message boxes to
+	void setHeadless(bool on) { headless = on; }
+
 	virtual bool notify(QObject * receiver, QEvent * e) {
 		try {
 			return QApplication::notify(receiver, e);
@@ -48,6 +52,11 @@ public:
 	}
 	
 	void printMessage(const QString& msg = "") {
+		if (headless) {
+			QTextStream(stderr) << "Error while running the program: "
+								<< (msg.isEmpty() ? QString("Crytical error") : msg) << endl;
+			return;
+		}
 		if(!msg.isEmpty()) {
 			QMessageBox::critical(0,
 								  "Cyberiada State Machine Editor",
@@ -58,6 +67,9 @@ public:
 								  "Crytical error");
 		}
 	}
+
+private:
+	bool headless;
 };
 
 #endif
@@ -25,7 +25,17 @@
 #include <QFileDialog>
 #include <QDebug>
 #include <QDir>
+#include <QUndoStack>
+#include <QToolBar>
+#include <QStatusBar>
+#include <QDockWidget>
+#include <QMessageBox>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QtConcurrent>
 #include "smeditor_window.h"
+#include "cyberiadasm_trace.h"
+#include "cyberiadasm_export.h"
 #include "myassert.h"
 
 
@@ -43,7 +53,374 @@ CyberiadaSMEditorWindow::CyberiadaSMEditorWindow(QWidget* parent):
 
 	connect(SMView, SIGNAL(currentIndexActivated(QModelIndex)),
             scene, SLOT(slotElementSelected(QModelIndex)));
+	connect(SMView, SIGNAL(selectionActivated(QModelIndexList)),
+			scene, SLOT(slotElementsSelected(QModelIndexList)));
+	connect(scene, SIGNAL(elementsSelected(QModelIndexList)),
+			SMView, SLOT(select(QModelIndexList)));
+	connect(model, &CyberiadaSMModel::elementsChanged,
+			scene, &CyberiadaSMEditorScene::slotElementsChanged);
+	connect(scene, &CyberiadaSMEditorScene::layoutFinished,
+			this, &CyberiadaSMEditorWindow::slotLayoutFinished);
+	connect(sceneView, &CyberiadaSMGraphicsView::viewportChanged,
+			scene, &CyberiadaSMEditorScene::scheduleLevelOfDetail);
+	connect(sceneView, &CyberiadaSMGraphicsView::zoomChanged,
+			scene, &CyberiadaSMEditorScene::slotZoomChanged);
+	connect(sceneView, &CyberiadaSMGraphicsView::framePainted,
+			scene, &CyberiadaSMEditorScene::slotFramePainted);
 
+	QAction* undo_action = model->undoStack()->createUndoAction(this, tr("&Undo"));
+	undo_action->setShortcut(QKeySequence::Undo);
+	menuEdit->addAction(undo_action);
+	QAction* redo_action = model->undoStack()->createRedoAction(this, tr("&Redo"));
+	redo_action->setShortcut(QKeySequence::Redo);
+	menuEdit->addAction(redo_action);
+	menuEdit->addSeparator();
+	QAction* route_action = menuEdit->addAction(tr("Route &Transitions"));
+	connect(route_action, SIGNAL(triggered()), scene, SLOT(routeTransitions()));
+	QAction* auto_route_action = menuEdit->addAction(tr("&Automatic Routing"));
+	auto_route_action->setCheckable(true);
+	auto_route_action->setChecked(scene->isAutoRouting());
+	connect(auto_route_action, SIGNAL(toggled(bool)), scene, SLOT(setAutoRouting(bool)));
+	QAction* virtual_action = menuEdit->addAction(tr("&Virtualized Scene"));
+	virtual_action->setCheckable(true);
+	virtual_action->setChecked(scene->isVirtualized());
+	connect(virtual_action, SIGNAL(toggled(bool)), scene, SLOT(setVirtualized(bool)));
+	QAction* bundles_action = menuEdit->addAction(tr("Collapse Transition &Bundles"));
+	connect(bundles_action, SIGNAL(triggered()), scene, SLOT(collapseBundles()));
+	QAction* caching_action = menuEdit->addAction(tr("Item &Caching"));
+	caching_action->setCheckable(true);
+	caching_action->setChecked(scene->isCachingEnabled());
+	connect(caching_action, SIGNAL(toggled(bool)), this, SLOT(slotCachingToggled(bool)));
+	QAction* updates_action = menuEdit->addAction(tr("Adaptive &Viewport Updates"));
+	updates_action->setCheckable(true);
+	updates_action->setChecked(sceneView->isAdaptiveUpdates());
+	connect(updates_action, SIGNAL(toggled(bool)), this, SLOT(slotAdaptiveUpdatesToggled(bool)));
+	QAction* overlay_action = menuEdit->addAction(tr("&Profiling Overlay"));
+	overlay_action->setCheckable(true);
+	overlay_action->setChecked(sceneView->isProfilingOverlay());
+	connect(overlay_action, SIGNAL(toggled(bool)), sceneView, SLOT(setProfilingOverlay(bool)));
+	menuEdit->addSeparator();
+	QAction* check_action = menuEdit->addAction(tr("Check &Diagram"));
+	connect(check_action, SIGNAL(triggered()), this, SLOT(slotCheckDiagram()));
+
+	QMenu* menu_view = menuBar()->addMenu(tr("&View"));
+	QAction* fit_action = menu_view->addAction(tr("Zoom to &Fit"));
+	connect(fit_action, SIGNAL(triggered()), this, SLOT(slotZoomToFit()));
+	QAction* zoom_selection_action = menu_view->addAction(tr("Zoom to &Selection"));
+	connect(zoom_selection_action, SIGNAL(triggered()), this, SLOT(slotZoomToSelection()));
+
+	QAction* export_action = new QAction(tr("&Export..."), this);
+	connect(export_action, SIGNAL(triggered()), this, SLOT(slotFileExport()));
+	menuFile->insertAction(actionExit, export_action);
+	menuFile->insertSeparator(actionExit);
+	exporter = NULL;
+	exportWatcher = new QFutureWatcher<bool>(this);
+	connect(exportWatcher, SIGNAL(finished()), this, SLOT(slotExportFinished()));
+	exportDialog = new QProgressDialog(this);
+	exportDialog->setWindowTitle(tr("Export State Machine"));
+	exportDialog->setWindowModality(Qt::WindowModal);
+	exportDialog->setRange(0, 1000);
+	exportDialog->setAutoReset(false);
+	exportDialog->setMinimumDuration(0);
+	exportDialog->reset();
+	connect(exportDialog, SIGNAL(canceled()), this, SLOT(slotExportCanceled()));
+	exportTimer = new QTimer(this);
+	exportTimer->setInterval(100);
+	connect(exportTimer, SIGNAL(timeout()), this, SLOT(slotExportProgress()));
+	QAction* record_action = new QAction(tr("&Record Trace"), this);
+	record_action->setCheckable(true);
+	record_action->setChecked(CyberiadaSMTrace::isEnabled());
+	connect(record_action, SIGNAL(toggled(bool)), this, SLOT(slotRecordTrace(bool)));
+	menuFile->insertAction(actionExit, record_action);
+	QAction* save_trace_action = new QAction(tr("Save &Trace..."), this);
+	connect(save_trace_action, SIGNAL(triggered()), this, SLOT(slotSaveTrace()));
+	menuFile->insertAction(actionExit, save_trace_action);
+	menuFile->insertSeparator(actionExit);
+
+	initTools();
+	initDiagnostics();
+	initMinimap(menu_view);
+}
+
+void CyberiadaSMEditorWindow::initTools()
+{
+	QToolBar* tools = addToolBar(tr("Tools"));
+	tools->setObjectName("toolsToolBar");
+	toolsGroup = new QActionGroup(this);
+	toolsGroup->setExclusive(true);
+
+	struct {
+		CyberiadaSMEditorScene::Tool tool;
+		QString                      name;
+	} items[] = {
+		{ CyberiadaSMEditorScene::toolSelect,     tr("Select") },
+		{ CyberiadaSMEditorScene::toolState,      tr("State") },
+		{ CyberiadaSMEditorScene::toolTransition, tr("Transition") },
+		{ CyberiadaSMEditorScene::toolComment,    tr("Comment") }
+	};
+	for (size_t i = 0; i < sizeof(items) / sizeof(items[0]); i++) {
+		QAction* action = new QAction(items[i].name, toolsGroup);
+		action->setCheckable(true);
+		action->setData(int(items[i].tool));
+		action->setChecked(items[i].tool == scene->getTool());
+		tools->addAction(action);
+	}
+
+	connect(toolsGroup, SIGNAL(triggered(QAction*)), this, SLOT(slotToolSelected(QAction*)));
+	connect(scene, SIGNAL(toolChanged(int)), this, SLOT(slotToolChanged(int)));
+}
+
+void CyberiadaSMEditorWindow::initDiagnostics()
+{
+	QDockWidget* dock = new QDockWidget(tr("Diagnostics"), this);
+	dock->setObjectName("diagnosticsDock");
+	diagnosticsList = new QListWidget(dock);
+	dock->setWidget(diagnosticsList);
+	addDockWidget(Qt::BottomDockWidgetArea, dock);
+	dock->hide();
+	connect(diagnosticsList, SIGNAL(itemActivated(QListWidgetItem*)),
+			this, SLOT(slotDiagnosticActivated(QListWidgetItem*)));
+}
+
+void CyberiadaSMEditorWindow::initMinimap(QMenu* menu)
+{
+	QDockWidget* dock = new QDockWidget(tr("Overview"), this);
+	dock->setObjectName("overviewDock");
+	dock->setWidget(new CyberiadaSMMinimap(scene, sceneView, dock));
+	addDockWidget(Qt::RightDockWidgetArea, dock);
+	menu->addSeparator();
+	menu->addAction(dock->toggleViewAction());
+}
+
+QString CyberiadaSMEditorWindow::elementTitle(const Cyberiada::ID& id) const
+{
+	const Cyberiada::Element* element = model->idToElement(QString(id.c_str()));
+	if (!element) {
+		return QString(id.c_str());
+	}
+	if (element->get_type() == Cyberiada::elementTransition) {
+		const Cyberiada::Transition* t = static_cast<const Cyberiada::Transition*>(element);
+		return QString("%1 -> %2").arg(elementTitle(t->source_element_id()),
+									   elementTitle(t->target_element_id()));
+	}
+	if (element->get_name().empty()) {
+		return QString(id.c_str());
+	}
+	return QString(element->get_name().c_str());
+}
+
+void CyberiadaSMEditorWindow::slotCheckDiagram()
+{
+	Cyberiada::StateMachine* sm = scene->stateMachine();
+	if (!sm) {
+		statusBar()->showMessage(tr("No state machine to check"));
+		return;
+	}
+	CyberiadaSMDiagnostics checker(model, sm);
+	diagnostics = checker.run();
+
+	diagnosticsList->clear();
+	for (int i = 0; i < diagnostics.size(); i++) {
+		const CyberiadaSMDiagnostic& d = diagnostics[i];
+		QString text;
+		switch (d.kind) {
+		case CyberiadaSMDiagnostic::statesOverlap:
+			text = tr("States \"%1\" and \"%2\" overlap");
+			break;
+		case CyberiadaSMDiagnostic::transitionCrossesState:
+			text = tr("Transition \"%1\" crosses state \"%2\"");
+			break;
+		case CyberiadaSMDiagnostic::transitionsCross:
+			text = tr("Transitions \"%1\" and \"%2\" cross");
+			break;
+		}
+		QListWidgetItem* item = new QListWidgetItem(text.arg(elementTitle(d.first), elementTitle(d.second)),
+													diagnosticsList);
+		item->setData(Qt::UserRole, i);
+	}
+	diagnosticsList->parentWidget()->show();
+	statusBar()->showMessage(tr("%1 problems found in %2 ms").arg(diagnostics.size()).arg(checker.elapsed()));
+}
+
+void CyberiadaSMEditorWindow::slotDiagnosticActivated(QListWidgetItem* item)
+{
+	int i = item->data(Qt::UserRole).toInt();
+	if (i < 0 || i >= diagnostics.size()) {
+		return;
+	}
+	const CyberiadaSMDiagnostic& d = diagnostics[i];
+	QModelIndexList indexes;
+	Cyberiada::ID ids[] = { d.first, d.second };
+	for (size_t k = 0; k < sizeof(ids) / sizeof(ids[0]); k++) {
+		const Cyberiada::Element* element = model->idToElement(QString(ids[k].c_str()));
+		if (element) {
+			indexes.append(model->elementToIndex(element));
+		}
+	}
+	scene->focusElements(indexes, d.position);
+}
+
+void CyberiadaSMEditorWindow::slotLayoutFinished(int elements, qint64 msecs)
+{
+	statusBar()->showMessage(tr("Layout of %1 elements done in %2 ms").arg(elements).arg(msecs));
+}
+
+CyberiadaSMEditorWindow::~CyberiadaSMEditorWindow()
+{
+	// the worker uses the model and the exporter
+	exportProgress.canceled.storeRelease(1);
+	exportWatcher->waitForFinished();
+	delete exporter;
+}
+
+void CyberiadaSMEditorWindow::slotFileExport()
+{
+	if (exportWatcher->isRunning()) {
+		return;
+	}
+	if (!scene->stateMachine()) {
+		statusBar()->showMessage(tr("No state machine to export"));
+		return;
+	}
+	QString filter;
+	QString fileName = QFileDialog::getSaveFileName(this, tr("Export State Machine"),
+													QDir::currentPath(),
+													tr("PNG image (*.png);;PDF document (*.pdf);;SVG drawing (*.svg)"),
+													&filter);
+	if (fileName.isEmpty()) {
+		return;
+	}
+	CyberiadaSMExporter::Format format;
+	if (!CyberiadaSMExporter::formatFromPath(fileName, format)) {
+		// the suffix comes from the chosen filter
+		fileName += filter.section("*", 1, 1).section(")", 0, 0);
+		CyberiadaSMExporter::formatFromPath(fileName, format);
+	}
+
+	// the workers read the model, so the dialog blocks the window from the start
+	// and the edits wait until the export is finished or canceled
+	delete exporter;
+	exporter = new CyberiadaSMExporter(model, scene->stateMachine());
+	exportFile = fileName;
+	exportError.clear();
+	exportProgress.done.storeRelease(0);
+	exportProgress.canceled.storeRelease(0);
+	exportDialog->reset();
+	exportDialog->setLabelText(tr("Exporting to %1...").arg(QFileInfo(fileName).fileName()));
+	exportDialog->setValue(0);
+	exportDialog->open();
+	exportClock.start();
+	const CyberiadaSMExporter* job = exporter;
+	QString* error = &exportError;
+	CyberiadaSMExporter::Progress* progress = &exportProgress;
+	exportWatcher->setFuture(QtConcurrent::run([job, fileName, format, error, progress]() {
+		return job->exportTo(fileName, format, CyberiadaSMExporter::Options(), *error, progress);
+	}));
+	exportTimer->start();
+}
+
+void CyberiadaSMEditorWindow::slotExportProgress()
+{
+	exportDialog->setValue(exportProgress.done.loadAcquire());
+}
+
+void CyberiadaSMEditorWindow::slotExportCanceled()
+{
+	// the worker stops at the next band or page; the dialog is already closed,
+	// so the window waits for it before the model can be edited again
+	exportProgress.canceled.storeRelease(1);
+	exportWatcher->waitForFinished();
+}
+
+void CyberiadaSMEditorWindow::slotExportFinished()
+{
+	exportTimer->stop();
+	exportDialog->reset();
+	bool done = exportWatcher->result();
+	delete exporter;
+	exporter = NULL;
+	if (done) {
+		statusBar()->showMessage(tr("Exported to %1 in %2 ms").arg(exportFile).arg(exportClock.elapsed()));
+	} else if (exportProgress.canceled.loadAcquire()) {
+		statusBar()->showMessage(tr("The export to %1 is canceled").arg(exportFile));
+	} else {
+		QMessageBox::critical(this, tr("Export State Machine"),
+							  tr("Cannot export to %1:\n%2").arg(exportFile, exportError));
+	}
+}
+
+void CyberiadaSMEditorWindow::slotZoomToFit()
+{
+	sceneView->zoomToRect(scene->machineRect());
+}
+
+void CyberiadaSMEditorWindow::slotZoomToSelection()
+{
+	sceneView->zoomToRect(scene->selectionRect());
+}
+
+void CyberiadaSMEditorWindow::slotRecordTrace(bool on)
+{
+	CyberiadaSMTrace::setEnabled(on);
+}
+
+void CyberiadaSMEditorWindow::slotSaveTrace()
+{
+	QString fileName = QFileDialog::getSaveFileName(this, tr("Save Editor Trace"),
+													QDir::currentPath(),
+													tr("Chrome trace (*.json)"));
+	if (fileName.isEmpty()) {
+		return;
+	}
+	if (CyberiadaSMTrace::dump(fileName)) {
+		statusBar()->showMessage(tr("The trace is saved to %1").arg(fileName));
+	} else {
+		statusBar()->showMessage(tr("Cannot write the trace to %1").arg(fileName));
+	}
+}
+
+void CyberiadaSMEditorWindow::slotCachingToggled(bool on)
+{
+	// the averages of the finished mode are shown to compare the frame times
+	CyberiadaSMEditorScene::CacheStatistics stats = scene->cacheStatistics();
+	statusBar()->showMessage(tr("Frame: %1 ms with %2 cached items, %3 ms without caching")
+							 .arg(stats.cachedFrameMs, 0, 'f', 2)
+							 .arg(stats.cachedItems)
+							 .arg(stats.uncachedFrameMs, 0, 'f', 2));
+	scene->resetCacheStatistics();
+	scene->setCachingEnabled(on);
+}
+
+void CyberiadaSMEditorWindow::slotAdaptiveUpdatesToggled(bool on)
+{
+	CyberiadaSMGraphicsView::UpdateStatistics stats = sceneView->updateStatistics();
+	QString mode;
+	switch (stats.mode) {
+	case QGraphicsView::MinimalViewportUpdate:      mode = tr("minimal"); break;
+	case QGraphicsView::BoundingRectViewportUpdate: mode = tr("bounding rect"); break;
+	case QGraphicsView::FullViewportUpdate:         mode = tr("full"); break;
+	default:                                        mode = QString::number(stats.mode);
+	}
+	statusBar()->showMessage(tr("Viewport update: %1 after %2 switches; frame %3/%4/%5 ms (minimal/bounding/full)")
+							 .arg(mode).arg(stats.switches)
+							 .arg(stats.frameMs[0], 0, 'f', 2)
+							 .arg(stats.frameMs[1], 0, 'f', 2)
+							 .arg(stats.frameMs[2], 0, 'f', 2));
+	sceneView->setAdaptiveUpdates(on);
+}
+
+void CyberiadaSMEditorWindow::slotToolSelected(QAction* action)
+{
+	scene->setTool(CyberiadaSMEditorScene::Tool(action->data().toInt()));
+}
+
+void CyberiadaSMEditorWindow::slotToolChanged(int tool)
+{
+	foreach(QAction* action, toolsGroup->actions()) {
+		if (action->data().toInt() == tool) {
+			action->setChecked(true);
+		}
+	}
 }
 
 void CyberiadaSMEditorWindow::slotFileOpen()
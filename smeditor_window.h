@@ -25,21 +25,66 @@
 #define CYBERIADA_SM_WINDOW
 
 #include <QMainWindow>
+#include <QActionGroup>
+#include <QListWidget>
+#include <QFutureWatcher>
+#include <QProgressDialog>
+#include <QElapsedTimer>
+#include <QTimer>
 #include "ui_smeditor_window.h"
 #include "cyberiadasm_model.h"
 #include "cyberiadasm_editor_scene.h"
+#include "cyberiadasm_diagnostics.h"
+#include "cyberiadasm_minimap.h"
+#include "cyberiadasm_export.h"
 
 class CyberiadaSMEditorWindow: public QMainWindow, public Ui_SMEditorWindow {
 Q_OBJECT
 public:
 	CyberiadaSMEditorWindow(QWidget* parent = 0);
+	~CyberiadaSMEditorWindow();
 
 public slots:
 	void                    slotFileOpen();
 
+private slots:
+	void                    slotToolSelected(QAction* action);
+	void                    slotToolChanged(int tool);
+	void                    slotLayoutFinished(int elements, qint64 msecs);
+	void                    slotCachingToggled(bool on);
+	void                    slotFileExport();
+	void                    slotExportProgress();
+	void                    slotExportCanceled();
+	void                    slotExportFinished();
+	void                    slotZoomToFit();
+	void                    slotZoomToSelection();
+	void                    slotRecordTrace(bool on);
+	void                    slotSaveTrace();
+	void                    slotAdaptiveUpdatesToggled(bool on);
+	void                    slotCheckDiagram();
+	void                    slotDiagnosticActivated(QListWidgetItem* item);
+
 private:
+	void                    initTools();
+	void                    initDiagnostics();
+	void                    initMinimap(QMenu* menu);
+	QString                 elementTitle(const Cyberiada::ID& id) const;
+
 	CyberiadaSMModel*       model;
 	CyberiadaSMEditorScene* scene;
+	QActionGroup*           toolsGroup;
+	QListWidget*            diagnosticsList;
+	QList<CyberiadaSMDiagnostic> diagnostics;
+
+	// the export runs on a worker thread behind the window-modal progress dialog
+	CyberiadaSMExporter*    exporter;
+	CyberiadaSMExporter::Progress exportProgress;
+	QFutureWatcher<bool>*   exportWatcher;
+	QProgressDialog*        exportDialog;
+	QTimer*                 exportTimer;      // polls the progress of the worker
+	QElapsedTimer           exportClock;
+	QString                 exportFile;
+	QString                 exportError;
 };
 
 #endif
@@ -0,0 +1,231 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Editor Test Documents
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#ifndef CYBERIADA_SM_TEST_DOCUMENT_HEADER
+#define CYBERIADA_SM_TEST_DOCUMENT_HEADER
+
+#include <QString>
+#include <QList>
+#include <QRectF>
+#include <QFile>
+#include <QXmlStreamWriter>
+#include <cyberiada/cyberiadamlpp.h>
+
+/* -----------------------------------------------------------------------------
+ * The writer of the small CyberiadaML documents for the tests: a single state
+ * machine with the states, the pseudostates, the nested states and the
+ * transitions between them.
+ * The state rects are written as the document keeps them, the tests compare
+ * the results with CyberiadaSMGeometry and do not depend on the convention;
+ * the free states are written without geometry.
+ * ----------------------------------------------------------------------------- */
+
+class CyberiadaSMTestDocument {
+public:
+	void addState(const QString& id, qreal x, qreal y, qreal width, qreal height,
+				  const QString& parent = QString())
+	{
+		State s;
+		s.id = id;
+		s.rect = QRectF(x, y, width, height);
+		s.parent = parent;
+		states.append(s);
+	}
+
+	// the pseudostate of the type ("choice", "terminate" and so on): the choice
+	// gets the rect, the others get the point (x, y)
+	void addVertex(const QString& id, const QString& vertex, qreal x, qreal y,
+				   qreal width = 0, qreal height = 0, const QString& parent = QString())
+	{
+		addState(id, x, y, width, height, parent);
+		states.last().vertex = vertex;
+	}
+
+	// the state without geometry, to be placed by the layout
+	void addFreeState(const QString& id, const QString& parent = QString())
+	{
+		addState(id, 0, 0, 0, 0, parent);
+	}
+
+	void addTransition(const QString& id, const QString& source, const QString& target)
+	{
+		Transition t;
+		t.id = id;
+		t.source = source;
+		t.target = target;
+		transitions.append(t);
+	}
+
+	bool save(const QString& path) const
+	{
+		QFile file(path);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			return false;
+		}
+		QXmlStreamWriter xml(&file);
+		xml.setAutoFormatting(true);
+		xml.writeStartDocument();
+		xml.writeStartElement("graphml");
+		xml.writeDefaultNamespace("http://graphml.graphdrawing.org/xmlns");
+		writeData(xml, "gFormat", "Cyberiada-GraphML-1.0");
+		writeKey(xml, "gFormat", "graphml", "format");
+		writeKey(xml, "dName", "graph", "name");
+		writeKey(xml, "dStateMachine", "graph", "stateMachine");
+		writeKey(xml, "dName", "node", "name");
+		writeKey(xml, "dVertex", "node", "vertex");
+		writeKey(xml, "dData", "node", "data");
+		writeKey(xml, "dData", "edge", "data");
+		writeKey(xml, "dNote", "node", "note");
+		writeKey(xml, "dGeometry", "node", "geometry");
+		writeKey(xml, "dGeometry", "edge", "geometry");
+
+		xml.writeStartElement("graph");
+		xml.writeAttribute("id", "G");
+		xml.writeAttribute("edgedefault", "directed");
+		xml.writeEmptyElement("data");
+		xml.writeAttribute("key", "dStateMachine");
+		writeData(xml, "dName", "SM");
+		xml.writeStartElement("node");
+		xml.writeAttribute("id", "nMeta");
+		writeData(xml, "dNote", "formal");
+		writeData(xml, "dName", "CGML_META");
+		writeData(xml, "dData", "standardVersion/ 1.0\n\n");
+		xml.writeEndElement();
+		writeStates(xml, QString());
+		foreach(const Transition& t, transitions) {
+			xml.writeStartElement("edge");
+			xml.writeAttribute("id", t.id);
+			xml.writeAttribute("source", t.source);
+			xml.writeAttribute("target", t.target);
+			writeData(xml, "dData", t.id + "/\n");
+			xml.writeEndElement();
+		}
+		xml.writeEndElement();
+
+		xml.writeEndElement();
+		xml.writeEndDocument();
+		return !xml.hasError();
+	}
+
+	// the document of the file or NULL if it cannot be read
+	static Cyberiada::LocalDocument* load(const QString& path)
+	{
+		Cyberiada::LocalDocument* doc = new Cyberiada::LocalDocument();
+		try {
+			doc->open(path.toStdString());
+		} catch (const Cyberiada::Exception&) {
+			delete doc;
+			return NULL;
+		}
+		return doc;
+	}
+
+	static Cyberiada::StateMachine* stateMachine(Cyberiada::LocalDocument* doc)
+	{
+		std::list<Cyberiada::StateMachine*> sms = doc->get_state_machines();
+		return sms.empty() ? NULL : sms.front();
+	}
+
+private:
+	struct State {
+		QString                         id;
+		QRectF                          rect;
+		QString                         parent;
+		QString                         vertex;     // empty for the states
+	};
+	struct Transition {
+		QString                         id;
+		QString                         source;
+		QString                         target;
+	};
+
+	static void writeKey(QXmlStreamWriter& xml, const QString& id, const QString& scope, const QString& name)
+	{
+		xml.writeEmptyElement("key");
+		xml.writeAttribute("id", id);
+		xml.writeAttribute("for", scope);
+		xml.writeAttribute("attr.name", name);
+		xml.writeAttribute("attr.type", "string");
+	}
+
+	static void writeData(QXmlStreamWriter& xml, const QString& key, const QString& value)
+	{
+		xml.writeStartElement("data");
+		xml.writeAttribute("key", key);
+		xml.writeCharacters(value);
+		xml.writeEndElement();
+	}
+
+	void writeStates(QXmlStreamWriter& xml, const QString& parent) const
+	{
+		foreach(const State& s, states) {
+			if (s.parent != parent) continue;
+			xml.writeStartElement("node");
+			xml.writeAttribute("id", s.id);
+			if (s.vertex.isEmpty()) {
+				writeData(xml, "dName", s.id);
+			} else {
+				writeData(xml, "dVertex", s.vertex);
+			}
+			if (!s.vertex.isEmpty() && s.vertex != "choice") {
+				xml.writeStartElement("data");
+				xml.writeAttribute("key", "dGeometry");
+				xml.writeEmptyElement("point");
+				xml.writeAttribute("x", QString::number(s.rect.x()));
+				xml.writeAttribute("y", QString::number(s.rect.y()));
+				xml.writeEndElement();
+			} else if (!s.rect.isNull()) {
+				xml.writeStartElement("data");
+				xml.writeAttribute("key", "dGeometry");
+				xml.writeEmptyElement("rect");
+				xml.writeAttribute("x", QString::number(s.rect.x()));
+				xml.writeAttribute("y", QString::number(s.rect.y()));
+				xml.writeAttribute("width", QString::number(s.rect.width()));
+				xml.writeAttribute("height", QString::number(s.rect.height()));
+				xml.writeEndElement();
+			}
+			if (hasChildren(s.id)) {
+				xml.writeStartElement("graph");
+				xml.writeAttribute("id", s.id + ":");
+				writeStates(xml, s.id);
+				xml.writeEndElement();
+			}
+			xml.writeEndElement();
+		}
+	}
+
+	bool hasChildren(const QString& id) const
+	{
+		foreach(const State& s, states) {
+			if (s.parent == id) return true;
+		}
+		return false;
+	}
+
+	QList<State>                        states;
+	QList<Transition>                   transitions;
+};
+
+#endif
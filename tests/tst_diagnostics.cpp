@@ -0,0 +1,156 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Diagnostics tests
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QSet>
+
+#include "cyberiadasm_diagnostics.h"
+#include "cyberiadasm_geometry.h"
+#include "cyberiadasm_model.h"
+#include "cyberiadasm_test_document.h"
+
+typedef QPair<QString, QString> IdPair;
+
+class TestDiagnostics: public QObject {
+Q_OBJECT
+
+private slots:
+	void defects();
+	void overlapsOfMixedHeights();
+
+private:
+	static IdPair pair(const CyberiadaSMDiagnostic& d);
+	bool load(CyberiadaSMModel& model, const CyberiadaSMTestDocument& document);
+
+	QTemporaryDir                       dir;
+};
+
+// the same as the diagnostics, the touching states are not reported
+static const qreal OVERLAP_TOLERANCE = 1;
+
+IdPair TestDiagnostics::pair(const CyberiadaSMDiagnostic& d)
+{
+	QString first(d.first.c_str()), second(d.second.c_str());
+	return first < second ? IdPair(first, second) : IdPair(second, first);
+}
+
+bool TestDiagnostics::load(CyberiadaSMModel& model, const CyberiadaSMTestDocument& document)
+{
+	QString path = dir.filePath(QString("%1.graphml").arg(QTest::currentTestFunction()));
+	QString error;
+	return document.save(path) && model.loadDocument(path, &error) && model.stateMachines().size() == 1;
+}
+
+void TestDiagnostics::defects()
+{
+	// the states of the same size keep their relations under any rect convention
+	CyberiadaSMTestDocument document;
+	document.addState("A", 0, 0, 100, 60);
+	document.addState("B", 40, 10, 100, 60);
+	document.addState("A1", 0, 0, 20, 10, "A");
+	document.addState("C", 0, 300, 100, 60);
+	document.addState("X", 300, 300, 100, 60);
+	document.addState("D", 600, 300, 100, 60);
+	document.addState("E", 0, 600, 100, 60);
+	document.addState("F", 600, 900, 100, 60);
+	document.addState("G", 0, 900, 100, 60);
+	document.addState("H", 600, 600, 100, 60);
+	document.addTransition("CD", "C", "D");
+	document.addTransition("EF", "E", "F");
+	document.addTransition("GH", "G", "H");
+	CyberiadaSMModel model(NULL);
+	QVERIFY(load(model, document));
+
+	CyberiadaSMDiagnostics diagnostics(&model, model.stateMachines().first());
+	QList<CyberiadaSMDiagnostic> result = diagnostics.run();
+	QMap<IdPair, CyberiadaSMDiagnostic::Kind> found;
+	foreach(const CyberiadaSMDiagnostic& d, result) {
+		QVERIFY(!found.contains(pair(d)));
+		found.insert(pair(d), d.kind);
+	}
+	QCOMPARE(found.size(), 3);
+	QVERIFY(found.contains(IdPair("A", "B")));
+	QVERIFY(found.contains(IdPair("CD", "X")));
+	QVERIFY(found.contains(IdPair("EF", "GH")));
+	QCOMPARE(found.value(IdPair("A", "B")), CyberiadaSMDiagnostic::statesOverlap);
+	QCOMPARE(found.value(IdPair("CD", "X")), CyberiadaSMDiagnostic::transitionCrossesState);
+	QCOMPARE(found.value(IdPair("EF", "GH")), CyberiadaSMDiagnostic::transitionsCross);
+	foreach(const CyberiadaSMDiagnostic& d, result) {
+		if (d.kind == CyberiadaSMDiagnostic::transitionCrossesState) {
+			QCOMPARE(QString(d.first.c_str()), QString("CD"));
+		}
+	}
+}
+
+void TestDiagnostics::overlapsOfMixedHeights()
+{
+	// the heights span several orders, so every height group of the sweep is used
+	CyberiadaSMTestDocument document;
+	quint32 seed = 4321;
+	for (int i = 0; i < 300; i++) {
+		qreal values[4];
+		for (int k = 0; k < 4; k++) {
+			seed = seed * 1103515245 + 12345;
+			values[k] = ((seed >> 8) & 0xffff) / qreal(0x10000);
+		}
+		qreal height = i % 50 == 0 ? 1000 + 1000 * values[3] : 2 + 200 * values[3] * values[3];
+		document.addState(QString("s%1").arg(i), 3000 * values[0], 3000 * values[1], 10 + 150 * values[2], height);
+	}
+	CyberiadaSMModel model(NULL);
+	QVERIFY(load(model, document));
+	Cyberiada::StateMachine* sm = model.stateMachines().first();
+
+	QList<const Cyberiada::Element*> states;
+	const Cyberiada::ElementList& children = sm->get_children();
+	for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+		if ((*i)->get_type() == Cyberiada::elementSimpleState) {
+			states.append(*i);
+		}
+	}
+	QCOMPARE(states.size(), 300);
+	QSet<IdPair> expected;
+	for (int i = 0; i < states.size(); i++) {
+		for (int j = i + 1; j < states.size(); j++) {
+			QRectF common = CyberiadaSMGeometry::sceneRect(states[i]).intersected(CyberiadaSMGeometry::sceneRect(states[j]));
+			if (common.width() > OVERLAP_TOLERANCE && common.height() > OVERLAP_TOLERANCE) {
+				QString a(states[i]->get_id().c_str()), b(states[j]->get_id().c_str());
+				expected.insert(a < b ? IdPair(a, b) : IdPair(b, a));
+			}
+		}
+	}
+	QVERIFY(!expected.isEmpty());
+
+	QSet<IdPair> found;
+	foreach(const CyberiadaSMDiagnostic& d, CyberiadaSMDiagnostics(&model, sm).run()) {
+		QCOMPARE(d.kind, CyberiadaSMDiagnostic::statesOverlap);
+		found.insert(pair(d));
+	}
+	QCOMPARE(found, expected);
+}
+
+QTEST_GUILESS_MAIN(TestDiagnostics)
+
+#include "tst_diagnostics.moc"
@@ -0,0 +1,101 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Geometry Store tests
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "cyberiadasm_geometry_store.h"
+#include "cyberiadasm_geometry.h"
+#include "cyberiadasm_test_document.h"
+
+class TestGeometryStore: public QObject {
+Q_OBJECT
+
+private slots:
+	void pseudostateEnds();
+
+private:
+	QTemporaryDir                       dir;
+};
+
+void TestGeometryStore::pseudostateEnds()
+{
+	CyberiadaSMTestDocument document;
+	document.addState("S1", 0, 0, 100, 60);
+	document.addState("S2", 400, 0, 100, 60);
+	document.addVertex("C", "choice", 200, 200, 30, 30);
+	document.addVertex("T", "terminate", 600, 200);
+	document.addTransition("S1C", "S1", "C");
+	document.addTransition("CS2", "C", "S2");
+	document.addTransition("S2T", "S2", "T");
+	QString path = dir.filePath("store.graphml");
+	QVERIFY(document.save(path));
+	QScopedPointer<Cyberiada::LocalDocument> doc(CyberiadaSMTestDocument::load(path));
+	QVERIFY(doc);
+	Cyberiada::StateMachine* sm = CyberiadaSMTestDocument::stateMachine(doc.data());
+	QVERIFY(sm);
+
+	CyberiadaSMGeometryStore store;
+	store.build(sm);
+	int c = store.indexOf("C");
+	int t = store.indexOf("T");
+	QVERIFY(c > 0);
+	QVERIFY(t > 0);
+	QVERIFY(store.isValid(c));
+	QVERIFY(store.isValid(t));
+	Cyberiada::Element* choice = sm->find_element_by_id("C");
+	QCOMPARE(store.rect(c), CyberiadaSMGeometry::sceneRect(choice));
+	QVERIFY(store.query(store.rect(c)).contains(c));
+	QVERIFY(store.boundingRect().contains(store.rect(c)));
+	QVERIFY(store.boundingRect().contains(store.rect(t)));
+
+	// the transitions to and from the pseudostates have both ends and a path
+	int s1c = store.indexOf("S1C");
+	int cs2 = store.indexOf("CS2");
+	int s2t = store.indexOf("S2T");
+	QCOMPARE(store.source(s1c), store.indexOf("S1"));
+	QCOMPARE(store.target(s1c), c);
+	QCOMPARE(store.source(cs2), c);
+	QCOMPARE(store.target(cs2), store.indexOf("S2"));
+	QCOMPARE(store.target(s2t), t);
+	foreach(int i, QVector<int>() << s1c << cs2 << s2t) {
+		QVERIFY(store.isValid(i));
+		QVERIFY(store.pathSize(i) >= 2);
+	}
+
+	// the moved choice is updated in place with its transitions
+	QPointF end = store.pathPoint(s1c, store.pathSize(s1c) - 1);
+	Cyberiada::Rect r = static_cast<Cyberiada::ChoicePseudostate*>(choice)->get_geometry_rect();
+	r.x += 300;
+	static_cast<Cyberiada::ChoicePseudostate*>(choice)->set_geometry_rect(r);
+	QVERIFY(store.update(QList<Cyberiada::Element*>() << choice));
+	QCOMPARE(store.rect(c), CyberiadaSMGeometry::sceneRect(choice));
+	QVERIFY(store.pathPoint(s1c, store.pathSize(s1c) - 1) != end);
+	QVERIFY(store.query(store.rect(c)).contains(c));
+}
+
+QTEST_GUILESS_MAIN(TestGeometryStore)
+
+#include "tst_geometry_store.moc"
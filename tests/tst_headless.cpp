@@ -0,0 +1,78 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The Headless Mode tests
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <QtTest>
+
+#include "cyberiadasm_headless.h"
+
+typedef QList<CyberiadaSMExporter::Format> FormatList;
+Q_DECLARE_METATYPE(FormatList)
+
+class TestHeadless: public QObject {
+Q_OBJECT
+
+private slots:
+	void parseFormats_data();
+	void parseFormats();
+};
+
+void TestHeadless::parseFormats_data()
+{
+	QTest::addColumn<QString>("list");
+	QTest::addColumn<bool>("valid");
+	QTest::addColumn<FormatList>("formats");
+
+	QTest::newRow("single") << "png" << true << (FormatList() << CyberiadaSMExporter::formatPNG);
+	QTest::newRow("several") << "svg,pdf,png" << true
+							 << (FormatList() << CyberiadaSMExporter::formatSVG
+								 << CyberiadaSMExporter::formatPDF << CyberiadaSMExporter::formatPNG);
+	QTest::newRow("spaces and case") << " PNG , Svg" << true
+									 << (FormatList() << CyberiadaSMExporter::formatPNG
+										 << CyberiadaSMExporter::formatSVG);
+	QTest::newRow("empty items") << "pdf,,png," << true
+								 << (FormatList() << CyberiadaSMExporter::formatPDF
+									 << CyberiadaSMExporter::formatPNG);
+	QTest::newRow("unknown") << "png,jpg" << false << FormatList();
+	QTest::newRow("empty") << "" << false << FormatList();
+	QTest::newRow("only commas") << ",," << false << FormatList();
+}
+
+void TestHeadless::parseFormats()
+{
+	QFETCH(QString, list);
+	QFETCH(bool, valid);
+	QFETCH(FormatList, formats);
+
+	FormatList result;
+	result << CyberiadaSMExporter::formatPDF;
+	QCOMPARE(CyberiadaSMHeadless::parseFormats(list, result), valid);
+	if (valid) {
+		QCOMPARE(result, formats);
+	}
+}
+
+QTEST_GUILESS_MAIN(TestHeadless)
+
+#include "tst_headless.moc"
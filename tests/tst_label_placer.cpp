@@ -0,0 +1,116 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Label Placer tests
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <QtTest>
+
+#include "cyberiadasm_label_placer.h"
+
+class TestLabelPlacer: public QObject {
+Q_OBJECT
+
+private slots:
+	void init();
+	void preferredCandidate();
+	void labelsAvoidEachOther();
+	void obstaclesAndLines();
+	void removeFreesTheSpace();
+	void labelsOverSeveralCells();
+
+private:
+	// the placer only uses the items as the keys
+	static const QGraphicsItem* label(int n) { return reinterpret_cast<const QGraphicsItem*>(quintptr(n * 16)); }
+
+	QVector<QPointF>                    candidates;
+	QSizeF                              size;
+};
+
+void TestLabelPlacer::init()
+{
+	candidates.clear();
+	candidates << QPointF(0, 0) << QPointF(0, 100) << QPointF(200, 0);
+	size = QSizeF(40, 20);
+}
+
+void TestLabelPlacer::preferredCandidate()
+{
+	CyberiadaSMLabelPlacer placer;
+	QCOMPARE(placer.place(label(1), candidates, size, QVector<QRectF>(), QVector<QLineF>()), 0);
+	QVERIFY(placer.contains(label(1)));
+	// placing the label again does not collide with its old place
+	QCOMPARE(placer.place(label(1), candidates, size, QVector<QRectF>(), QVector<QLineF>()), 0);
+	QCOMPARE(placer.place(label(2), QVector<QPointF>(), size, QVector<QRectF>(), QVector<QLineF>()), -1);
+	QVERIFY(!placer.contains(label(2)));
+}
+
+void TestLabelPlacer::labelsAvoidEachOther()
+{
+	CyberiadaSMLabelPlacer placer;
+	QCOMPARE(placer.place(label(1), candidates, size, QVector<QRectF>(), QVector<QLineF>()), 0);
+	QCOMPARE(placer.place(label(2), candidates, size, QVector<QRectF>(), QVector<QLineF>()), 1);
+	QCOMPARE(placer.place(label(3), candidates, size, QVector<QRectF>(), QVector<QLineF>()), 2);
+}
+
+void TestLabelPlacer::obstaclesAndLines()
+{
+	CyberiadaSMLabelPlacer placer;
+	QVector<QRectF> obstacles;
+	obstacles << QRectF(-10, -10, 60, 40);
+	QCOMPARE(placer.place(label(1), candidates, size, obstacles, QVector<QLineF>()), 1);
+
+	QVector<QLineF> lines;
+	lines << QLineF(-50, 110, 300, 110);
+	QCOMPARE(placer.place(label(2), candidates, size, obstacles, lines), 2);
+}
+
+void TestLabelPlacer::removeFreesTheSpace()
+{
+	CyberiadaSMLabelPlacer placer;
+	placer.place(label(1), candidates, size, QVector<QRectF>(), QVector<QLineF>());
+	QCOMPARE(placer.place(label(2), candidates, size, QVector<QRectF>(), QVector<QLineF>()), 1);
+	placer.remove(label(1));
+	QVERIFY(!placer.contains(label(1)));
+	QCOMPARE(placer.place(label(2), candidates, size, QVector<QRectF>(), QVector<QLineF>()), 0);
+	placer.clear();
+	QVERIFY(!placer.contains(label(2)));
+	QCOMPARE(placer.place(label(3), candidates, size, QVector<QRectF>(), QVector<QLineF>()), 0);
+}
+
+void TestLabelPlacer::labelsOverSeveralCells()
+{
+	// the large label is registered in every cell it covers
+	CyberiadaSMLabelPlacer placer(64);
+	QVector<QPointF> large;
+	large << QPointF(60, 60);
+	placer.place(label(1), large, QSizeF(150, 150), QVector<QRectF>(), QVector<QLineF>());
+	QVector<QPointF> corner;
+	corner << QPointF(190, 190) << QPointF(300, 300);
+	QCOMPARE(placer.place(label(2), corner, size, QVector<QRectF>(), QVector<QLineF>()), 1);
+	placer.remove(label(1));
+	QCOMPARE(placer.place(label(2), corner, size, QVector<QRectF>(), QVector<QLineF>()), 0);
+}
+
+QTEST_GUILESS_MAIN(TestLabelPlacer)
+
+#include "tst_label_placer.moc"
@@ -0,0 +1,110 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Layout tests
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QUndoStack>
+
+#include "cyberiadasm_layout.h"
+#include "cyberiadasm_geometry.h"
+#include "cyberiadasm_model.h"
+#include "cyberiadasm_test_document.h"
+
+class TestLayout: public QObject {
+Q_OBJECT
+
+private slots:
+	void freeStates();
+
+private:
+	QRectF rect(const QString& id) const;
+
+	QTemporaryDir                       dir;
+	const Cyberiada::StateMachine*      sm;
+};
+
+QRectF TestLayout::rect(const QString& id) const
+{
+	const Cyberiada::Element* element = sm->find_element_by_id(id.toStdString());
+	return element ? CyberiadaSMGeometry::sceneRect(element) : QRectF();
+}
+
+void TestLayout::freeStates()
+{
+	CyberiadaSMTestDocument document;
+	document.addState("P", 0, 0, 100, 60);
+	document.addFreeState("A");
+	document.addFreeState("B");
+	document.addFreeState("C");
+	document.addFreeState("K");
+	document.addFreeState("K1", "K");
+	document.addFreeState("K2", "K");
+	document.addTransition("AB", "A", "B");
+	document.addTransition("BC", "B", "C");
+	document.addTransition("K1K2", "K1", "K2");
+	QString path = dir.filePath("layout.graphml");
+	QVERIFY(document.save(path));
+	CyberiadaSMModel model(NULL);
+	QString error;
+	QVERIFY(model.loadDocument(path, &error));
+	QCOMPARE(model.stateMachines().size(), 1);
+	sm = model.stateMachines().first();
+	QRectF placed = rect("P");
+
+	QVERIFY(CyberiadaSMLayout::needsLayout(sm));
+	CyberiadaSMLayout layout(sm);
+	layout.run();
+	QCOMPARE(layout.elementsCount(), 6);
+	layout.apply(&model);
+	QVERIFY(!CyberiadaSMLayout::needsLayout(sm));
+
+	// the placed state is kept and the new ones do not overlap it or each other
+	QCOMPARE(rect("P"), placed);
+	QStringList siblings;
+	siblings << "P" << "A" << "B" << "C" << "K";
+	for (int i = 0; i < siblings.size(); i++) {
+		QVERIFY(!rect(siblings[i]).isEmpty());
+		for (int j = i + 1; j < siblings.size(); j++) {
+			QVERIFY2(!rect(siblings[i]).intersects(rect(siblings[j])),
+					 qPrintable(siblings[i] + " " + siblings[j]));
+		}
+	}
+	// the layers go from top to bottom
+	QVERIFY(rect("A").bottom() < rect("B").top());
+	QVERIFY(rect("B").bottom() < rect("C").top());
+	// the composite is laid out around its children
+	QVERIFY(rect("K").contains(rect("K1")));
+	QVERIFY(rect("K").contains(rect("K2")));
+	QVERIFY(rect("K1").bottom() < rect("K2").top());
+
+	// the layout is a single command
+	model.undoStack()->undo();
+	QVERIFY(CyberiadaSMLayout::needsLayout(sm));
+	QCOMPARE(rect("P"), placed);
+}
+
+QTEST_GUILESS_MAIN(TestLayout)
+
+#include "tst_layout.moc"
@@ -0,0 +1,110 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The Streaming PNG Encoder tests
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <QtTest>
+#include <QBuffer>
+#include <QImage>
+
+#include "cyberiadasm_png_stream.h"
+
+class TestPngStream: public QObject {
+Q_OBJECT
+
+private slots:
+	void smallImage();
+	void noiseImage();
+	void closedDevice();
+
+private:
+	static QByteArray encode(const QImage& image);
+	static void compareDecoded(const QByteArray& png, const QImage& image);
+};
+
+QByteArray TestPngStream::encode(const QImage& image)
+{
+	QImage rgb = image.convertToFormat(QImage::Format_RGB888);
+	QBuffer buffer;
+	buffer.open(QIODevice::WriteOnly);
+	CyberiadaSMPngStream png(&buffer, 3);
+	if (!png.begin(rgb.width(), rgb.height())) return QByteArray();
+	for (int y = 0; y < rgb.height(); y++) {
+		if (!png.writeRow(rgb.constScanLine(y), rgb.width() * 3)) return QByteArray();
+	}
+	if (!png.end()) return QByteArray();
+	return buffer.data();
+}
+
+void TestPngStream::compareDecoded(const QByteArray& png, const QImage& image)
+{
+	QImage decoded = QImage::fromData(png, "PNG");
+	QVERIFY(!decoded.isNull());
+	QCOMPARE(decoded.size(), image.size());
+	for (int y = 0; y < image.height(); y++) {
+		for (int x = 0; x < image.width(); x++) {
+			QCOMPARE(decoded.pixel(x, y), image.pixel(x, y));
+		}
+	}
+}
+
+void TestPngStream::smallImage()
+{
+	QImage image(7, 5, QImage::Format_RGB32);
+	for (int y = 0; y < image.height(); y++) {
+		for (int x = 0; x < image.width(); x++) {
+			image.setPixel(x, y, qRgb(x * 30, y * 50, (x + y) * 20));
+		}
+	}
+	QByteArray png = encode(image);
+	QVERIFY(png.startsWith("\x89PNG\r\n\x1a\n"));
+	QVERIFY(png.endsWith(QByteArray("IEND\xae\x42\x60\x82", 8)));
+	compareDecoded(png, image);
+}
+
+void TestPngStream::noiseImage()
+{
+	// the noise does not compress, so the data takes several IDAT chunks
+	QImage image(300, 300, QImage::Format_RGB32);
+	quint32 seed = 12345;
+	for (int y = 0; y < image.height(); y++) {
+		for (int x = 0; x < image.width(); x++) {
+			seed = seed * 1103515245u + 12345u;
+			image.setPixel(x, y, 0xff000000u | (seed >> 8));
+		}
+	}
+	QByteArray png = encode(image);
+	QVERIFY(png.count("IDAT") > 1);
+	compareDecoded(png, image);
+}
+
+void TestPngStream::closedDevice()
+{
+	QBuffer buffer;
+	CyberiadaSMPngStream png(&buffer);
+	QVERIFY(!png.begin(10, 10));
+}
+
+QTEST_GUILESS_MAIN(TestPngStream)
+
+#include "tst_png_stream.moc"
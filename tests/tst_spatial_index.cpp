@@ -0,0 +1,290 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Spatial Index tests
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QSet>
+
+#include "cyberiadasm_spatial_index.h"
+#include "cyberiadasm_geometry.h"
+#include "cyberiadasm_test_document.h"
+
+typedef QPair<const Cyberiada::Element*, int> EntryKey;
+
+class TestSpatialIndex: public QObject {
+Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void searchRegion();
+	void searchPoint();
+	void moveElements();
+	void removeGeometry();
+	void largeMachine();
+
+private:
+	QSet<EntryKey> found(const QList<CyberiadaSMSpatialIndex::Entry>& entries) const;
+	QSet<EntryKey> expectedStates(const QRectF& region) const;
+	void checkRegions(const CyberiadaSMSpatialIndex& index, int count);
+	QRectF randomRect(qreal range, qreal size);
+	qreal random(qreal range);
+
+	QTemporaryDir                       dir;
+	Cyberiada::LocalDocument*           doc;
+	Cyberiada::StateMachine*            sm;
+	QList<Cyberiada::Element*>          states;
+	QList<Cyberiada::Element*>          transitions;
+	quint32                             seed;
+};
+
+// the grid of the states is large enough to split the tree nodes many times
+static const int   GRID_SIZE = 24;
+static const qreal GRID_STEP = 200;
+
+// the index reports the boxes touching the region too
+static bool overlaps(const QRectF& a, const QRectF& b)
+{
+	return a.left() <= b.right() && b.left() <= a.right() && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+void TestSpatialIndex::initTestCase()
+{
+	seed = 12345;
+	CyberiadaSMTestDocument document;
+	for (int row = 0; row < GRID_SIZE; row++) {
+		for (int column = 0; column < GRID_SIZE; column++) {
+			document.addState(QString("s%1_%2").arg(row).arg(column), column * GRID_STEP, row * GRID_STEP,
+							  40 + random(120), 30 + random(120));
+			if (column > 0) {
+				document.addTransition(QString("t%1_%2").arg(row).arg(column),
+									   QString("s%1_%2").arg(row).arg(column - 1),
+									   QString("s%1_%2").arg(row).arg(column));
+			}
+		}
+	}
+	// the nested states are indexed together with their parents
+	document.addState("n0", 0, 0, 20, 10, "s0_0");
+	QString path = dir.filePath("grid.graphml");
+	QVERIFY(document.save(path));
+	doc = CyberiadaSMTestDocument::load(path);
+	QVERIFY(doc);
+	sm = CyberiadaSMTestDocument::stateMachine(doc);
+	QVERIFY(sm);
+
+	QList<Cyberiada::ElementCollection*> collections;
+	collections.append(sm);
+	while (!collections.isEmpty()) {
+		Cyberiada::ElementCollection* c = collections.takeLast();
+		if (!c->has_children()) continue;
+		const Cyberiada::ElementList& children = c->get_children();
+		for (Cyberiada::ElementList::const_iterator i = children.begin(); i != children.end(); i++) {
+			Cyberiada::Element* e = *i;
+			if (e->get_type() == Cyberiada::elementTransition) {
+				transitions.append(e);
+			} else if (e->get_type() == Cyberiada::elementSimpleState ||
+					   e->get_type() == Cyberiada::elementCompositeState) {
+				states.append(e);
+				collections.append(static_cast<Cyberiada::ElementCollection*>(e));
+			}
+		}
+	}
+	QCOMPARE(states.size(), GRID_SIZE * GRID_SIZE + 1);
+	QCOMPARE(transitions.size(), GRID_SIZE * (GRID_SIZE - 1));
+}
+
+void TestSpatialIndex::cleanupTestCase()
+{
+	delete doc;
+}
+
+qreal TestSpatialIndex::random(qreal range)
+{
+	seed = seed * 1103515245 + 12345;
+	return range * ((seed >> 8) & 0xffff) / 0x10000;
+}
+
+QRectF TestSpatialIndex::randomRect(qreal range, qreal size)
+{
+	return QRectF(random(range) - size, random(range) - size, random(2 * size), random(2 * size));
+}
+
+QSet<EntryKey> TestSpatialIndex::found(const QList<CyberiadaSMSpatialIndex::Entry>& entries) const
+{
+	QSet<EntryKey> result;
+	foreach(const CyberiadaSMSpatialIndex::Entry& entry, entries) {
+		result.insert(EntryKey(entry.element, entry.part));
+	}
+	return result;
+}
+
+QSet<EntryKey> TestSpatialIndex::expectedStates(const QRectF& region) const
+{
+	QSet<EntryKey> result;
+	foreach(const Cyberiada::Element* state, states) {
+		QRectF r = CyberiadaSMGeometry::sceneRect(state);
+		if (r.isNull()) continue;
+		if (overlaps(r, region)) {
+			result.insert(EntryKey(state, 0));
+		}
+	}
+	return result;
+}
+
+void TestSpatialIndex::checkRegions(const CyberiadaSMSpatialIndex& index, int count)
+{
+	for (int i = 0; i < count; i++) {
+		QRectF region = randomRect(GRID_SIZE * GRID_STEP, 300);
+		QList<CyberiadaSMSpatialIndex::Entry> entries = index.search(region);
+		QSet<EntryKey> states_found;
+		foreach(const CyberiadaSMSpatialIndex::Entry& entry, entries) {
+			QVERIFY(overlaps(entry.box, region));
+			if (entry.element->get_type() != Cyberiada::elementTransition) {
+				states_found.insert(EntryKey(entry.element, entry.part));
+			}
+		}
+		QCOMPARE(states_found, expectedStates(region));
+
+		// every transition segment with an end in the region is found
+		QSet<EntryKey> all = found(entries);
+		foreach(const Cyberiada::Element* t, transitions) {
+			QVector<QPointF> path = index.transitionPath(static_cast<const Cyberiada::Transition*>(t));
+			for (int k = 1; k < path.size(); k++) {
+				if (region.contains(path[k - 1]) || region.contains(path[k])) {
+					QVERIFY(all.contains(EntryKey(t, k - 1)));
+				}
+			}
+		}
+	}
+}
+
+void TestSpatialIndex::searchRegion()
+{
+	CyberiadaSMSpatialIndex index(sm);
+	QVERIFY(index.size() >= states.size() + transitions.size());
+	checkRegions(index, 200);
+	// the whole diagram
+	QRectF everything(-GRID_STEP, -GRID_STEP, (GRID_SIZE + 2) * GRID_STEP, (GRID_SIZE + 2) * GRID_STEP);
+	QCOMPARE(index.search(everything).size(), index.size());
+}
+
+void TestSpatialIndex::searchPoint()
+{
+	CyberiadaSMSpatialIndex index(sm);
+	for (int i = 0; i < 200; i++) {
+		QPointF point(random(GRID_SIZE * GRID_STEP), random(GRID_SIZE * GRID_STEP));
+		QSet<EntryKey> states_found;
+		foreach(const CyberiadaSMSpatialIndex::Entry& entry, index.search(point)) {
+			if (entry.element->get_type() != Cyberiada::elementTransition) {
+				states_found.insert(EntryKey(entry.element, entry.part));
+			}
+		}
+		QCOMPARE(states_found, expectedStates(QRectF(point, QSizeF())));
+	}
+}
+
+void TestSpatialIndex::moveElements()
+{
+	CyberiadaSMSpatialIndex index(sm);
+	int size = index.size();
+	// the moved states take their nested states and the transitions along
+	for (int i = 0; i < 100; i++) {
+		Cyberiada::ElementCollection* state =
+			static_cast<Cyberiada::ElementCollection*>(states[int(random(states.size() - 1))]);
+		Cyberiada::Rect r = state->get_geometry_rect();
+		state->set_geometry_rect(Cyberiada::Rect(r.x + random(800) - 400, r.y + random(800) - 400,
+												 r.width, r.height));
+		index.update(state);
+		QCOMPARE(index.size(), size);
+		QCOMPARE(index.elementRect(state), CyberiadaSMGeometry::sceneRect(state));
+	}
+	checkRegions(index, 200);
+}
+
+void TestSpatialIndex::removeGeometry()
+{
+	CyberiadaSMSpatialIndex index(sm);
+	int size = index.size();
+	Cyberiada::ElementCollection* state = static_cast<Cyberiada::ElementCollection*>(states.last());
+	QVERIFY(state->get_parent() != sm);
+	Cyberiada::Rect old = state->get_geometry_rect();
+	// the element without the geometry leaves the index
+	state->set_geometry_rect(Cyberiada::Rect());
+	index.update(state);
+	QCOMPARE(index.size(), size - 1);
+	QVERIFY(index.elementRect(state).isNull());
+	checkRegions(index, 50);
+	state->set_geometry_rect(old);
+	index.update(state);
+	QCOMPARE(index.size(), size);
+	checkRegions(index, 50);
+}
+
+void TestSpatialIndex::largeMachine()
+{
+	// a few thousand elements; the transition ends are looked up by id while building
+	const int size = 60;
+	CyberiadaSMTestDocument document;
+	for (int row = 0; row < size; row++) {
+		for (int column = 0; column < size; column++) {
+			document.addState(QString("L%1_%2").arg(row).arg(column), column * GRID_STEP, row * GRID_STEP, 80, 60);
+			if (column > 0) {
+				document.addTransition(QString("M%1_%2").arg(row).arg(column),
+									   QString("L%1_%2").arg(row).arg(column - 1),
+									   QString("L%1_%2").arg(row).arg(column));
+			}
+		}
+	}
+	QString path = dir.filePath("large.graphml");
+	QVERIFY(document.save(path));
+	QScopedPointer<Cyberiada::LocalDocument> large(CyberiadaSMTestDocument::load(path));
+	QVERIFY(large);
+	const Cyberiada::StateMachine* machine = CyberiadaSMTestDocument::stateMachine(large.data());
+	QVERIFY(machine);
+
+	CyberiadaSMSpatialIndex index(machine);
+	QVERIFY(index.size() >= size * size + size * (size - 1));
+	QVERIFY(!index.findElement("missing"));
+	QRectF everything(-GRID_STEP, -GRID_STEP, (size + 2) * GRID_STEP, (size + 2) * GRID_STEP);
+	QCOMPARE(index.search(everything).size(), index.size());
+	for (int row = 0; row < size; row++) {
+		for (int column = 1; column < size; column++) {
+			const Cyberiada::Element* t = index.findElement(QString("M%1_%2").arg(row).arg(column).toStdString());
+			QVERIFY(t);
+			QCOMPARE(t->get_type(), Cyberiada::elementTransition);
+			const Cyberiada::Transition* transition = static_cast<const Cyberiada::Transition*>(t);
+			const Cyberiada::Element* source = index.findElement(transition->source_element_id());
+			const Cyberiada::Element* target = index.findElement(transition->target_element_id());
+			QVERIFY(source && target);
+			QCOMPARE(QString(source->get_id().c_str()), QString("L%1_%2").arg(row).arg(column - 1));
+			QCOMPARE(QString(target->get_id().c_str()), QString("L%1_%2").arg(row).arg(column));
+			QVERIFY(index.transitionPath(transition).size() >= 2);
+		}
+	}
+}
+
+QTEST_GUILESS_MAIN(TestSpatialIndex)
+
+#include "tst_spatial_index.moc"
@@ -0,0 +1,129 @@
+/* -----------------------------------------------------------------------------
+ * The Cyberiada State Machine Editor
+ * -----------------------------------------------------------------------------
+ *
+ * The State Machine Trace tests
+ *
+ * Copyright (C) 2024 Alexey Fedoseev <aleksey@fedoseev.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see https://www.gnu.org/licenses/
+ *
+ * ----------------------------------------------------------------------------- */
+
+
+
+#include <thread>
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include "cyberiadasm_trace.h"
+
+class TestTrace: public QObject {
+Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void ringWraparound();
+	void finishedThreadBuffers();
+
+private:
+	QJsonArray dump();
+	static void recordSpans(const char* name, int count);
+
+	QTemporaryDir                       dir;
+};
+
+void TestTrace::initTestCase()
+{
+	QVERIFY(dir.isValid());
+	CyberiadaSMTrace::setEnabled(true);
+}
+
+QJsonArray TestTrace::dump()
+{
+	QString path = dir.filePath("trace.json");
+	if (!CyberiadaSMTrace::dump(path)) return QJsonArray();
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) return QJsonArray();
+	return QJsonDocument::fromJson(file.readAll()).object().value("traceEvents").toArray();
+}
+
+void TestTrace::recordSpans(const char* name, int count)
+{
+	// the span i starts at i microseconds
+	for (int i = 0; i < count; i++) {
+		CyberiadaSMTrace::record(name, qint64(i) * 1000, qint64(i) * 1000 + 500);
+	}
+}
+
+void TestTrace::ringWraparound()
+{
+	const int count = 100000;
+	recordSpans("ring", count);
+
+	QList<int> starts;
+	foreach(const QJsonValue& value, dump()) {
+		QJsonObject event = value.toObject();
+		if (event.value("ph").toString() == "X" && event.value("name").toString() == "ring") {
+			starts.append(int(event.value("ts").toDouble()));
+			QCOMPARE(event.value("dur").toDouble(), 0.5);
+		}
+	}
+	// only the newest spans are kept, in order and without gaps
+	QVERIFY(!starts.isEmpty());
+	QVERIFY(starts.size() < count);
+	for (int i = 0; i < starts.size(); i++) {
+		QCOMPARE(starts[i], count - starts.size() + i);
+	}
+}
+
+void TestTrace::finishedThreadBuffers()
+{
+	// join() returns after the thread locals are destroyed, so the second
+	// thread always finds the buffer of the first one
+	std::thread first(recordSpans, "first", 10);
+	first.join();
+	std::thread second(recordSpans, "second", 20);
+	second.join();
+
+	int workers = 0, firstSpans = 0, secondSpans = 0;
+	QSet<int> tids;
+	foreach(const QJsonValue& value, dump()) {
+		QJsonObject event = value.toObject();
+		QString name = event.value("name").toString();
+		if (event.value("ph").toString() == "M") {
+			if (event.value("args").toObject().value("name").toString().startsWith("worker")) {
+				workers++;
+			}
+		} else if (name == "first") {
+			firstSpans++;
+			tids.insert(event.value("tid").toInt());
+		} else if (name == "second") {
+			secondSpans++;
+			tids.insert(event.value("tid").toInt());
+		}
+	}
+	QCOMPARE(workers, 1);
+	QCOMPARE(tids.size(), 1);
+	// the buffer keeps the spans of the finished thread
+	QCOMPARE(firstSpans, 10);
+	QCOMPARE(secondSpans, 20);
+}
+
+QTEST_GUILESS_MAIN(TestTrace)
+
+#include "tst_trace.moc"